@@ -1,5 +1,5 @@
-#ifndef COROUTINE_CONTEXT_H
-#define COROUTINE_CONTEXT_H
+#ifndef STACK_CO_CONTEXT_H
+#define STACK_CO_CONTEXT_H
 
 #include <cstddef>
 #include <cstring>
@@ -80,4 +80,4 @@ namespace stack_co {
 
 } // namespace stack_co
 
-#endif //COROUTINE_CONTEXT_H
+#endif //STACK_CO_CONTEXT_H
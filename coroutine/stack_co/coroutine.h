@@ -1,5 +1,5 @@
-#ifndef COROUTINE_COROUTINE_H
-#define COROUTINE_COROUTINE_H
+#ifndef STACK_CO_COROUTINE_H
+#define STACK_CO_COROUTINE_H
 //协程类
 
 #include "status.h"
@@ -81,4 +81,4 @@ namespace stack_co {
 
 } // namespace stack_co
 
-#endif //COROUTINE_COROUTINE_H
+#endif //STACK_CO_COROUTINE_H
@@ -1,9 +1,10 @@
-#ifndef COROUTINE_ENVIRONMENT_H
-#define COROUTINE_ENVIRONMENT_H
+#ifndef STACK_CO_ENVIRONMENT_H
+#define STACK_CO_ENVIRONMENT_H
 
 //本例中实现的协程不支持跨线程，而是每个线程分配一个环境，来维护该线程下运行中的协程之间的层次关系；
 #include "coroutine.h"
 
+#include <array>
 #include <cstddef>
 #include <cstring>
 #include <functional>
@@ -62,4 +63,4 @@ namespace stack_co {
 
 } // namespace stack_co
 
-#endif //COROUTINE_ENVIRONMENT_H
+#endif //STACK_CO_ENVIRONMENT_H
@@ -1,7 +1,7 @@
 //协程状态
 
-#ifndef COROUTINE_STATUS_H
-#define COROUTINE_STATUS_H
+#ifndef STACK_CO_STATUS_H
+#define STACK_CO_STATUS_H
 
 namespace stack_co {
 
@@ -32,4 +32,4 @@ namespace stack_co {
 
 } // namespace stack_co
 
-#endif //COROUTINE_STATUS_H
+#endif //STACK_CO_STATUS_H
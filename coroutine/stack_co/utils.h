@@ -2,8 +2,8 @@
 // Created by JasonkayZK on 2022.06.06.
 //
 
-#ifndef COROUTINE_UTILS_H
-#define COROUTINE_UTILS_H
+#ifndef STACK_CO_UTILS_H
+#define STACK_CO_UTILS_H
 
 #include "coroutine.h"
 #include "environment.h"
@@ -18,8 +18,9 @@ namespace stack_co {
 
     } // namespace this_coroutine
 
+    //test()是成员函数，要用当前线程的栈顶协程来判断
     inline bool test() {
-        return Coroutine::test();
+        return Coroutine::get_thread_top_coroutine().test();
     }
 
     inline Environment& open() {
@@ -28,4 +29,4 @@ namespace stack_co {
 
 } // namespace stack_co
 
-#endif //COROUTINE_UTILS_H
+#endif //STACK_CO_UTILS_H
@@ -2,8 +2,8 @@
 // Created by Jasonkay on 2022/6/6.
 //
 
-#ifndef COROUTINE_COROUTINE_H
-#define COROUTINE_COROUTINE_H
+#ifndef STACKLESS_CO_COROUTINE_H
+#define STACKLESS_CO_COROUTINE_H
 
 #include "utils.h"
 #include "schedule.h"
@@ -101,4 +101,4 @@ namespace stackless_co {
 
 } // namespace stackless_co
 
-#endif //COROUTINE_COROUTINE_H
+#endif //STACKLESS_CO_COROUTINE_H
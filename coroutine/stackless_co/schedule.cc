@@ -94,7 +94,7 @@ namespace stackless_co {
             return id;
         } 
         else {
-            std::cout<<"tag2"<<std::endl;
+            //std::cout<<"tag2"<<std::endl;
             int i;
             for (i = 0; i < this->cap_of_vec; i++) {
                 //从当前数组末尾开始遍历一轮
@@ -1,7 +1,7 @@
 
 //调度器
-#ifndef COROUTINE_SCHEDULE_H
-#define COROUTINE_SCHEDULE_H
+#ifndef STACKLESS_CO_SCHEDULE_H
+#define STACKLESS_CO_SCHEDULE_H
 
 #include "utils.h"
 #include "coroutine.h"
@@ -94,4 +94,4 @@ namespace stackless_co {
 
 } // namespace stackless_co
 
-#endif //COROUTINE_SCHEDULE_H
+#endif //STACKLESS_CO_SCHEDULE_H
@@ -2,8 +2,8 @@
 // Created by Jasonkay on 2022/6/12.
 //
 
-#ifndef COROUTINE_UTILS_H
-#define COROUTINE_UTILS_H
+#ifndef STACKLESS_CO_UTILS_H
+#define STACKLESS_CO_UTILS_H
 
 namespace stackless_co {
 
@@ -13,4 +13,4 @@ namespace stackless_co {
 
 } // namespace stackless_co
 
-#endif //COROUTINE_UTILS_H
+#endif //STACKLESS_CO_UTILS_H
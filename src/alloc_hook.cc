@@ -0,0 +1,176 @@
+/**
+ * @file alloc_hook.cc
+ * @brief 替换malloc系列函数，把分配记到当前协程上，见alloc_profiler.h
+ * @details 做法同simple_hook/hook_malloc.c：在程序里定义同名函数覆盖libc中的符号，用dlsym(RTLD_NEXT)找到真正的实现。
+ *          只有需要统计内存分配的程序才链接这个文件，其他程序不受影响。
+ *          dlsym本身可能调用calloc，找到真正的实现之前的分配从一块静态缓冲区中分出，不会被释放
+ * @version 0.1
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "alloc_profiler.h"
+#include "macro.h"
+
+namespace {
+
+#define ALLOC_FUN(XX) \
+    XX(malloc) \
+    XX(calloc) \
+    XX(realloc) \
+    XX(free) \
+    XX(posix_memalign) \
+    XX(aligned_alloc) \
+    XX(memalign)
+
+typedef void *(*malloc_fun)(size_t size);
+typedef void *(*calloc_fun)(size_t nmemb, size_t size);
+typedef void *(*realloc_fun)(void *ptr, size_t size);
+typedef void (*free_fun)(void *ptr);
+typedef int (*posix_memalign_fun)(void **memptr, size_t alignment, size_t size);
+typedef void *(*aligned_alloc_fun)(size_t alignment, size_t size);
+typedef void *(*memalign_fun)(size_t alignment, size_t size);
+
+#define XX(name) name##_fun name##_f = nullptr;
+ALLOC_FUN(XX);
+#undef XX
+
+/// 找到真正的实现之前用的静态缓冲区
+char s_boot_buf[64 * 1024] __attribute__((aligned(16)));
+size_t s_boot_used = 0;
+
+/// 正在dlsym，这期间的分配走静态缓冲区
+bool s_initing = false;
+
+void *BootAlloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (s_boot_used + size > sizeof(s_boot_buf)) {
+        return nullptr;
+    }
+    void *p = s_boot_buf + s_boot_used;
+    s_boot_used += size;
+    return p;
+}
+
+bool IsBoot(void *ptr) { return ptr >= (void *)s_boot_buf && ptr < (void *)(s_boot_buf + sizeof(s_boot_buf)); }
+
+void AllocHookInit() {
+    if (malloc_f || s_initing) {
+        return;
+    }
+    s_initing = true;
+#define XX(name) name##_f = (name##_fun)dlsym(RTLD_NEXT, #name);
+    ALLOC_FUN(XX);
+#undef XX
+    s_initing = false;
+    sylar::detail::g_alloc_hook_installed = true;
+}
+
+struct _AllocHookIniter {
+    _AllocHookIniter() { AllocHookInit(); }
+};
+
+_AllocHookIniter s_alloc_hook_initer;
+
+inline void OnAlloc(void *ptr, size_t size) {
+    if (SYLAR_UNLIKELY(sylar::AllocProfiler::IsEnabled()) && ptr) {
+        sylar::AllocProfiler::OnAlloc(size);
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+void *malloc(size_t size) noexcept {
+    if (SYLAR_UNLIKELY(!malloc_f)) {
+        AllocHookInit();
+        if (s_initing) {
+            return BootAlloc(size);
+        }
+    }
+    void *ptr = malloc_f(size);
+    OnAlloc(ptr, size);
+    return ptr;
+}
+
+void *calloc(size_t nmemb, size_t size) noexcept {
+    if (SYLAR_UNLIKELY(!calloc_f)) {
+        AllocHookInit();
+        if (s_initing) {
+            //静态缓冲区本来就是0
+            return BootAlloc(nmemb * size);
+        }
+    }
+    void *ptr = calloc_f(nmemb, size);
+    OnAlloc(ptr, nmemb * size);
+    return ptr;
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+    if (SYLAR_UNLIKELY(!realloc_f)) {
+        AllocHookInit();
+    }
+    if (SYLAR_UNLIKELY(IsBoot(ptr))) {
+        //静态缓冲区中的块不知道原来的大小，按剩余空间拷贝
+        void *p = malloc(size);
+        if (p) {
+            size_t n = (size_t)(s_boot_buf + sizeof(s_boot_buf) - (char *)ptr);
+            memcpy(p, ptr, n < size ? n : size);
+        }
+        return p;
+    }
+    void *p = realloc_f(ptr, size);
+    //原来的块被释放：成功移动或扩缩，或者realloc(ptr, 0)；失败时原来的块不变
+    if (SYLAR_UNLIKELY(sylar::AllocProfiler::IsEnabled()) && ptr && (p || size == 0)) {
+        sylar::AllocProfiler::OnFree();
+    }
+    OnAlloc(p, size);
+    return p;
+}
+
+void free(void *ptr) noexcept {
+    if (!ptr || SYLAR_UNLIKELY(IsBoot(ptr))) {
+        return;
+    }
+    if (SYLAR_UNLIKELY(!free_f)) {
+        AllocHookInit();
+    }
+    if (SYLAR_UNLIKELY(sylar::AllocProfiler::IsEnabled())) {
+        sylar::AllocProfiler::OnFree();
+    }
+    free_f(ptr);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size) noexcept {
+    if (SYLAR_UNLIKELY(!posix_memalign_f)) {
+        AllocHookInit();
+    }
+    int rt = posix_memalign_f(memptr, alignment, size);
+    OnAlloc(rt == 0 ? *memptr : nullptr, size);
+    return rt;
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+    if (SYLAR_UNLIKELY(!aligned_alloc_f)) {
+        AllocHookInit();
+    }
+    void *ptr = aligned_alloc_f(alignment, size);
+    OnAlloc(ptr, size);
+    return ptr;
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+    if (SYLAR_UNLIKELY(!memalign_f)) {
+        AllocHookInit();
+    }
+    void *ptr = memalign_f(alignment, size);
+    OnAlloc(ptr, size);
+    return ptr;
+}
+
+}
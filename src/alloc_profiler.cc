@@ -0,0 +1,160 @@
+/**
+ * @file alloc_profiler.cc
+ * @brief 按协程归类的内存分配统计实现
+ * @version 0.1
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include "alloc_profiler.h"
+#include "fiber.h"
+#include "macro.h"
+#include "thread_stats.h"
+
+namespace sylar {
+
+namespace detail {
+std::atomic<bool> g_alloc_profiler_enabled{false};
+std::atomic<bool> g_alloc_hook_installed{false};
+} // namespace detail
+
+namespace {
+
+/**
+ * @brief 一个类别在一个线程内的累加值
+ */
+struct Acc {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> frees{0};
+};
+
+typedef detail::TagStatsMap<Acc> ThreadStats;
+
+detail::ThreadStatsRegistry<ThreadStats> &Stats() {
+    static detail::ThreadStatsRegistry<ThreadStats> s_stats;
+    return s_stats;
+}
+
+/// 正在记录，记录过程中自己的分配(建表、插入类别)不再记录
+thread_local bool t_busy = false;
+
+/// 距离下一次采样还要分配的字节数
+thread_local int64_t t_until_sample = 0;
+
+std::atomic<uint64_t> s_sample_bytes{0};
+
+} // namespace
+
+void AllocProfiler::SetEnabled(bool v) {
+    detail::g_alloc_profiler_enabled.store(v, std::memory_order_relaxed);
+}
+
+void AllocProfiler::SetSampleRate(uint64_t bytes) {
+    s_sample_bytes.store(bytes, std::memory_order_relaxed);
+}
+
+uint64_t AllocProfiler::GetSampleRate() {
+    return s_sample_bytes.load(std::memory_order_relaxed);
+}
+
+void AllocProfiler::OnAlloc(size_t size) {
+    if (t_busy) {
+        return;
+    }
+    uint64_t bytes = size, calls = 1;
+    uint64_t rate  = s_sample_bytes.load(std::memory_order_relaxed);
+    if (rate) {
+        t_until_sample -= (int64_t)size;
+        if (SYLAR_LIKELY(t_until_sample > 0)) {
+            return;
+        }
+        //大小为size的分配跨过采样点的概率是min(1,size/rate)，按其倒数加权
+        t_until_sample += (int64_t)(((uint64_t)(-t_until_sample) / rate + 1) * rate);
+        if (size < rate) {
+            bytes = rate;
+            calls = size ? (rate + size / 2) / size : rate;
+        }
+    }
+    t_busy   = true;
+    Fiber *f = Fiber::GetCurrent();
+    if (f) {
+        f->recordAlloc(bytes, calls);
+    }
+    Acc *acc = detail::GetTagAcc(Stats(), f ? f->getTag() : nullptr);
+    if (acc) {
+        detail::AddRelaxed(acc->calls, calls);
+        detail::AddRelaxed(acc->bytes, bytes);
+    }
+    t_busy = false;
+}
+
+void AllocProfiler::OnFree() {
+    if (t_busy || s_sample_bytes.load(std::memory_order_relaxed)) {
+        return;
+    }
+    t_busy   = true;
+    Fiber *f = Fiber::GetCurrent();
+    Acc *acc = detail::GetTagAcc(Stats(), f ? f->getTag() : nullptr);
+    if (acc) {
+        detail::AddRelaxed(acc->frees);
+    }
+    t_busy = false;
+}
+
+void AllocProfiler::Collect(std::vector<TagStats> &out) {
+    bool busy = t_busy;
+    t_busy    = true;
+    std::map<std::string, TagStats> merged;
+    Stats().forEach([&merged](ThreadStats &stats) {
+        Spinlock::Lock lock(stats.mutex);
+        for (auto &i : stats.tags) {
+            TagStats &m = merged[detail::TagName(i.first)];
+            m.calls += i.second.calls.load(std::memory_order_relaxed);
+            m.bytes += i.second.bytes.load(std::memory_order_relaxed);
+            m.frees += i.second.frees.load(std::memory_order_relaxed);
+        }
+    });
+    t_busy = busy;
+    out.clear();
+    for (auto &i : merged) {
+        out.push_back(i.second);
+        out.back().tag = i.first;
+    }
+    std::stable_sort(out.begin(), out.end(), [](const TagStats &a, const TagStats &b) { return a.bytes > b.bytes; });
+}
+
+void AllocProfiler::Dump(std::ostream &os, size_t top_n) {
+    std::vector<TagStats> stats;
+    Collect(stats);
+    uint64_t total = 0;
+    for (auto &i : stats) {
+        total += i.bytes;
+    }
+    os << std::left << std::setw(24) << "tag" << std::right << std::setw(14) << "calls" << std::setw(14)
+       << "bytes" << std::setw(8) << "bytes%" << std::setw(12) << "avg size" << std::setw(14) << "frees" << std::endl;
+    std::streamsize precision = os.precision(1);
+    os << std::fixed;
+    for (size_t i = 0; i < stats.size() && i < top_n; ++i) {
+        const TagStats &s = stats[i];
+        os << std::left << std::setw(24) << s.tag << std::right << std::setw(14) << s.calls << std::setw(14)
+           << s.bytes << std::setw(8) << (total ? s.bytes * 100.0 / total : 0) << std::setw(12)
+           << (s.calls ? (double)s.bytes / s.calls : 0) << std::setw(14) << s.frees << std::endl;
+    }
+    os << std::defaultfloat;
+    os.precision(precision);
+}
+
+void AllocProfiler::Reset() {
+    Stats().forEach([](ThreadStats &stats) {
+        Spinlock::Lock lock(stats.mutex);
+        for (auto &i : stats.tags) {
+            i.second.calls = 0;
+            i.second.bytes = 0;
+            i.second.frees = 0;
+        }
+    });
+}
+
+} // namespace sylar
@@ -0,0 +1,108 @@
+/**
+ * @file alloc_profiler.h
+ * @brief 按协程归类的内存分配统计
+ * @details 把alloc_hook.cc一起链接进程序后，malloc/calloc/realloc/free等函数被替换(做法同simple_hook/hook_malloc.c，
+ *          用dlsym(RTLD_NEXT)找到真正的实现)，打开统计时每次分配记到当前协程和它的类别(tag)上：
+ *          sylar::AllocProfiler::SetEnabled(true);
+ *          ...
+ *          sylar::AllocProfiler::Dump(std::cout);   // 分配字节数最多的几类协程
+ *          每个线程在自己的表中按tag累加，汇总时合并，记录时不加锁。
+ *          默认记录每一次分配和释放；SetSampleRate(n)之后改为每分配约n字节采样一次，
+ *          被采样的大小为s的分配按max(s,n)字节、max(1,n/s)次计入，得到总量的无偏估计，不再统计释放。
+ *          关闭时每次分配只多一次对全局开关的relaxed读；没有链接alloc_hook.cc时什么也不记录
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_ALLOC_PROFILER_H__
+#define __SYLAR_ALLOC_PROFILER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sylar {
+
+namespace detail {
+/// 统计开关，放在头文件中让替换的malloc内联判断
+extern std::atomic<bool> g_alloc_profiler_enabled;
+/// 替换的malloc是否已经生效
+extern std::atomic<bool> g_alloc_hook_installed;
+} // namespace detail
+
+/**
+ * @brief 内存分配统计
+ */
+class AllocProfiler {
+public:
+    /**
+     * @brief 一个类别的汇总
+     */
+    struct TagStats {
+        std::string tag;
+        /// 分配次数
+        uint64_t calls = 0;
+        /// 分配的字节数
+        uint64_t bytes = 0;
+        /// 释放次数，采样模式下不统计
+        uint64_t frees = 0;
+    };
+
+    /**
+     * @brief 打开或关闭统计，默认关闭
+     */
+    static void SetEnabled(bool v);
+
+    /**
+     * @brief 是否打开了统计
+     */
+    static bool IsEnabled() { return detail::g_alloc_profiler_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 替换的malloc是否生效，也就是是否链接了alloc_hook.cc
+     */
+    static bool IsHooked() { return detail::g_alloc_hook_installed.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 设置采样间隔
+     * @param[in] bytes 平均每分配多少字节采样一次，0表示记录每一次分配(默认)
+     */
+    static void SetSampleRate(uint64_t bytes);
+
+    /**
+     * @brief 获取采样间隔
+     */
+    static uint64_t GetSampleRate();
+
+    /**
+     * @brief 记录一次分配，由替换的malloc系列函数调用
+     */
+    static void OnAlloc(size_t size);
+
+    /**
+     * @brief 记录一次释放，由替换的free调用
+     */
+    static void OnFree();
+
+    /**
+     * @brief 汇总所有线程的统计，按分配字节数从大到小排序
+     */
+    static void Collect(std::vector<TagStats> &stats);
+
+    /**
+     * @brief 输出分配字节数最多的top_n个类别
+     */
+    static void Dump(std::ostream &os, size_t top_n = 10);
+
+    /**
+     * @brief 清空所有统计
+     * @details 与正在进行的记录并发时，个别累加值可能没有被清零
+     */
+    static void Reset();
+};
+
+} // namespace sylar
+
+#endif
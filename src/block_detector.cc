@@ -0,0 +1,238 @@
+/**
+ * @file block_detector.cc
+ * @brief 阻塞调用检测实现
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "block_detector.h"
+#include "fiber.h"
+#include "macro.h"
+#include "metrics.h"
+#include "mutex.h"
+#include "thread_stats.h"
+#include "util.h"
+
+namespace sylar {
+
+namespace detail {
+std::atomic<bool> g_block_detector_enabled{false};
+} // namespace detail
+
+namespace {
+
+const char *s_names[BlockDetector::FUNCTION_NUM] = {
+    "pthread_mutex_lock", "pthread_rwlock_rdlock", "pthread_rwlock_wrlock", "pthread_cond_wait",
+    "pthread_cond_timedwait", "pthread_join", "sem_wait", "fsync", "fdatasync", "poll", "select", "flock", "waitpid",
+    "system", "getaddrinfo", "gethostbyname", "gethostbyname_r"};
+
+/**
+ * @brief 一个函数在一个线程内的计数
+ */
+struct Counters {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> slow{0};
+    std::atomic<uint64_t> total_ns{0};
+    std::atomic<uint64_t> max_ns{0};
+};
+
+struct ThreadStats {
+    Counters funcs[BlockDetector::FUNCTION_NUM];
+};
+
+detail::ThreadStatsRegistry<ThreadStats> &Stats() {
+    static detail::ThreadStatsRegistry<ThreadStats> s_stats;
+    return s_stats;
+}
+
+Mutex &ReporterMutex() {
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+BlockDetector::Reporter &GetReporter() {
+    static BlockDetector::Reporter s_reporter;
+    return s_reporter;
+}
+
+/**
+ * @brief 正在计时或者正在记录
+ * @details 这期间被替换的函数不再计时：嵌套调用只计最外层，记录和报告过程中自己加的锁也不会再进来
+ */
+thread_local bool t_busy = false;
+
+std::atomic<uint64_t> s_threshold_ns{10 * 1000 * 1000};
+
+std::atomic<bool> s_atexit_registered{false};
+
+struct BusyGuard {
+    BusyGuard() : saved(t_busy) { t_busy = true; }
+    ~BusyGuard() { t_busy = saved; }
+    bool saved;
+};
+
+
+void DefaultReport(const BlockDetector::Report &r) {
+    std::stringstream ss;
+    ss << "[block_detector] " << r.function << " blocked " << std::fixed << std::setprecision(2) << r.ns / 1e6
+       << "ms in fiber " << r.fiber_id;
+    if (r.tag) {
+        ss << " (" << r.tag << ")";
+    }
+    ss << std::endl;
+    for (auto &i : r.backtrace) {
+        ss << "    " << i << std::endl;
+    }
+    std::cerr << ss.str() << std::flush;
+}
+
+void DumpAtExit() {
+    std::vector<BlockDetector::FunctionStats> stats;
+    BlockDetector::Collect(stats);
+    for (auto &s : stats) {
+        if (s.calls) {
+            std::cerr << "[block_detector] summary:" << std::endl;
+            BlockDetector::Dump(std::cerr);
+            return;
+        }
+    }
+}
+
+} // namespace
+
+void BlockDetector::SetEnabled(bool v) {
+    if (v && !s_atexit_registered.exchange(true)) {
+        //先构造用到的静态对象，它们在atexit函数之后才析构
+        BusyGuard guard;
+        Stats();
+        ReporterMutex();
+        GetReporter();
+        atexit(DumpAtExit);
+    }
+    detail::g_block_detector_enabled.store(v, std::memory_order_relaxed);
+}
+
+void BlockDetector::SetThreshold(uint64_t us) {
+    s_threshold_ns.store(us * 1000, std::memory_order_relaxed);
+}
+
+uint64_t BlockDetector::GetThreshold() {
+    return s_threshold_ns.load(std::memory_order_relaxed) / 1000;
+}
+
+void BlockDetector::SetReporter(Reporter cb) {
+    BusyGuard guard;
+    Mutex::Lock lock(ReporterMutex());
+    GetReporter().swap(cb);
+}
+
+const char *BlockDetector::GetName(Function f) {
+    return f < FUNCTION_NUM ? s_names[f] : "unknown";
+}
+
+uint64_t BlockDetector::Begin() {
+    if (!IsEnabled() || t_busy || !Fiber::InScheduler()) {
+        return 0;
+    }
+    t_busy = true;
+    return Metrics::Now();
+}
+
+void BlockDetector::End(Function f, uint64_t begin) {
+    if (!begin) {
+        return;
+    }
+    uint64_t now       = Metrics::Now();
+    uint64_t ns        = now > begin ? now - begin : 0;
+    ThreadStats *stats = Stats().local();
+    if (SYLAR_UNLIKELY(!stats)) {
+        t_busy = false;
+        return;
+    }
+    Counters &c = stats->funcs[f];
+    detail::AddRelaxed(c.calls);
+    detail::AddRelaxed(c.total_ns, ns);
+    if (ns > c.max_ns.load(std::memory_order_relaxed)) {
+        c.max_ns.store(ns, std::memory_order_relaxed);
+    }
+    if (ns >= s_threshold_ns.load(std::memory_order_relaxed)) {
+        detail::AddRelaxed(c.slow);
+        Report r;
+        r.function   = s_names[f];
+        r.ns         = ns;
+        Fiber *fiber = Fiber::GetCurrent();
+        r.fiber_id   = fiber->getId();
+        r.tag        = fiber->getTag();
+        //跳过Backtrace、End和被替换的函数
+        Backtrace(r.backtrace, 64, 3);
+        Reporter cb;
+        {
+            Mutex::Lock lock(ReporterMutex());
+            cb = GetReporter();
+        }
+        if (cb) {
+            cb(r);
+        } else {
+            DefaultReport(r);
+        }
+    }
+    t_busy = false;
+}
+
+void BlockDetector::Collect(std::vector<FunctionStats> &out) {
+    BusyGuard guard;
+    out.clear();
+    out.resize(FUNCTION_NUM);
+    for (size_t i = 0; i < FUNCTION_NUM; ++i) {
+        out[i].name = s_names[i];
+    }
+    Stats().forEach([&out](ThreadStats &stats) {
+        for (size_t i = 0; i < FUNCTION_NUM; ++i) {
+            const Counters &c = stats.funcs[i];
+            FunctionStats &s  = out[i];
+            s.calls += c.calls.load(std::memory_order_relaxed);
+            s.slow += c.slow.load(std::memory_order_relaxed);
+            s.total_ns += c.total_ns.load(std::memory_order_relaxed);
+            uint64_t max = c.max_ns.load(std::memory_order_relaxed);
+            if (max > s.max_ns) {
+                s.max_ns = max;
+            }
+        }
+    });
+}
+
+void BlockDetector::Dump(std::ostream &os) {
+    std::vector<FunctionStats> stats;
+    Collect(stats);
+    os << std::left << std::setw(24) << "function" << std::right << std::setw(12) << "calls" << std::setw(10) << "slow"
+       << std::setw(14) << "total(ms)" << std::setw(12) << "avg(us)" << std::setw(12) << "max(ms)" << std::endl;
+    std::streamsize precision = os.precision(2);
+    os << std::fixed;
+    for (auto &s : stats) {
+        if (!s.calls) {
+            continue;
+        }
+        os << std::left << std::setw(24) << s.name << std::right << std::setw(12) << s.calls << std::setw(10) << s.slow
+           << std::setw(14) << s.total_ns / 1e6 << std::setw(12) << s.total_ns / 1e3 / s.calls << std::setw(12)
+           << s.max_ns / 1e6 << std::endl;
+    }
+    os << std::defaultfloat;
+    os.precision(precision);
+}
+
+void BlockDetector::Reset() {
+    BusyGuard guard;
+    Stats().forEach([](ThreadStats &stats) {
+        for (auto &c : stats.funcs) {
+            c.calls    = 0;
+            c.slow     = 0;
+            c.total_ns = 0;
+            c.max_ns   = 0;
+        }
+    });
+}
+
+} // namespace sylar
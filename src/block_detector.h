@@ -0,0 +1,160 @@
+/**
+ * @file block_detector.h
+ * @brief 调试用的阻塞调用检测
+ * @details hook.cc只接管了HOOK_FUN中的IO和sleep函数，协程中调用pthread_mutex_lock、fsync、poll、getaddrinfo
+ *          这类没有被hook的函数时，会一直占住所在的调度线程，而且没有任何提示。
+ *          把block_detector_hook.cc一起链接进程序后，这些函数被替换(做法同alloc_hook.cc，用dlsym(RTLD_NEXT)找到真正的实现)，
+ *          打开检测时在调度器的协程中(Fiber::InScheduler())调用它们会被计时：
+ *          sylar::BlockDetector::SetThreshold(10 * 1000);   // 10ms
+ *          sylar::BlockDetector::SetEnabled(true);
+ *          超过阈值的调用交给报告函数，默认输出到标准错误，包含函数名、耗时、协程id和类别、调用栈；
+ *          每个函数的调用次数、超过阈值的次数、总耗时和最长耗时按线程累加，Dump()以表格输出，
+ *          打开过检测的程序在退出时(atexit)把表格输出到标准错误。
+ *          只用于调试：打开后协程中每次调用这些函数多两次取时间；关闭时只多一次对全局开关的relaxed读，
+ *          没有链接block_detector_hook.cc时什么也不记录
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_BLOCK_DETECTOR_H__
+#define __SYLAR_BLOCK_DETECTOR_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sylar {
+
+namespace detail {
+/// 检测开关，放在头文件中让替换的函数内联判断
+extern std::atomic<bool> g_block_detector_enabled;
+} // namespace detail
+
+/**
+ * @brief 阻塞调用检测
+ */
+class BlockDetector {
+public:
+    /**
+     * @brief 被替换的函数，与block_detector_hook.cc中的BLOCK_FUN一一对应
+     */
+    enum Function {
+        PTHREAD_MUTEX_LOCK,
+        PTHREAD_RWLOCK_RDLOCK,
+        PTHREAD_RWLOCK_WRLOCK,
+        PTHREAD_COND_WAIT,
+        PTHREAD_COND_TIMEDWAIT,
+        PTHREAD_JOIN,
+        SEM_WAIT,
+        FSYNC,
+        FDATASYNC,
+        POLL,
+        SELECT,
+        FLOCK,
+        WAITPID,
+        SYSTEM,
+        GETADDRINFO,
+        GETHOSTBYNAME,
+        GETHOSTBYNAME_R,
+        FUNCTION_NUM
+    };
+
+    /**
+     * @brief 一次超过阈值的调用
+     */
+    struct Report {
+        /// 函数名
+        const char *function = nullptr;
+        /// 耗时，纳秒
+        uint64_t ns = 0;
+        /// 协程id
+        uint64_t fiber_id = 0;
+        /// 协程类别，没有设置时为空
+        const char *tag = nullptr;
+        /// 调用栈，从调用被替换函数的地方开始
+        std::vector<std::string> backtrace;
+    };
+
+    /**
+     * @brief 一个函数的汇总
+     */
+    struct FunctionStats {
+        /// 函数名
+        std::string name;
+        /// 在协程中的调用次数
+        uint64_t calls = 0;
+        /// 超过阈值的次数
+        uint64_t slow = 0;
+        /// 总耗时，纳秒
+        uint64_t total_ns = 0;
+        /// 最长耗时，纳秒
+        uint64_t max_ns = 0;
+    };
+
+    typedef std::function<void(const Report &)> Reporter;
+
+    /**
+     * @brief 打开或关闭检测，默认关闭
+     * @details 第一次打开时注册退出时输出汇总表格的atexit函数
+     */
+    static void SetEnabled(bool v);
+
+    /**
+     * @brief 是否打开了检测
+     */
+    static bool IsEnabled() { return detail::g_block_detector_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 设置报告的阈值，单位微秒，默认10ms
+     */
+    static void SetThreshold(uint64_t us);
+
+    /**
+     * @brief 报告的阈值，单位微秒
+     */
+    static uint64_t GetThreshold();
+
+    /**
+     * @brief 设置报告函数，为空时恢复默认(输出到标准错误)
+     * @details 在发生阻塞的线程中调用，调用期间该线程的被替换函数不再计时
+     */
+    static void SetReporter(Reporter cb);
+
+    /**
+     * @brief 函数名
+     */
+    static const char *GetName(Function f);
+
+    /**
+     * @brief 打开了检测、且当前在调度器的协程中时返回当前时间(纳秒)，否则返回0，与End()配对
+     * @details 嵌套调用(比如getaddrinfo内部的poll)只计最外层
+     */
+    static uint64_t Begin();
+
+    /**
+     * @brief 记录一次调用，begin为Begin()的返回值，为0时不记录；超过阈值时报告
+     */
+    static void End(Function f, uint64_t begin);
+
+    /**
+     * @brief 汇总所有线程的统计，按Function的顺序每个函数一项
+     */
+    static void Collect(std::vector<FunctionStats> &stats);
+
+    /**
+     * @brief 以表格输出调用过的函数
+     */
+    static void Dump(std::ostream &os);
+
+    /**
+     * @brief 清空所有统计
+     * @details 与正在进行的记录并发时，个别值可能没有被清零
+     */
+    static void Reset();
+};
+
+} // namespace sylar
+
+#endif
@@ -0,0 +1,207 @@
+/**
+ * @file block_detector_hook.cc
+ * @brief 替换可能阻塞线程、又没有被hook.cc接管的libc函数，在协程中调用时计时，见block_detector.h
+ * @details 做法同alloc_hook.cc：在程序里定义同名函数覆盖libc中的符号，用dlsym(RTLD_NEXT)找到真正的实现。
+ *          只有需要检测的程序才链接这个文件，其他程序不受影响。
+ *          libc内部直接调用的(比如getaddrinfo里的poll)不经过这里，只能看到程序自己的调用。
+ *          函数的异常说明要与系统头文件中的声明一致：带__THROW的声明为noexcept，其余(取消点)不带
+ * @version 0.1
+ */
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <sys/file.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "block_detector.h"
+#include "macro.h"
+
+namespace {
+
+#define BLOCK_FUN(XX) \
+    XX(pthread_mutex_lock) \
+    XX(pthread_rwlock_rdlock) \
+    XX(pthread_rwlock_wrlock) \
+    XX(pthread_cond_wait) \
+    XX(pthread_cond_timedwait) \
+    XX(pthread_join) \
+    XX(sem_wait) \
+    XX(fsync) \
+    XX(fdatasync) \
+    XX(poll) \
+    XX(select) \
+    XX(flock) \
+    XX(waitpid) \
+    XX(system) \
+    XX(getaddrinfo) \
+    XX(gethostbyname) \
+    XX(gethostbyname_r)
+
+typedef int (*pthread_mutex_lock_fun)(pthread_mutex_t *mutex);
+typedef int (*pthread_rwlock_rdlock_fun)(pthread_rwlock_t *rwlock);
+typedef int (*pthread_rwlock_wrlock_fun)(pthread_rwlock_t *rwlock);
+typedef int (*pthread_cond_wait_fun)(pthread_cond_t *cond, pthread_mutex_t *mutex);
+typedef int (*pthread_cond_timedwait_fun)(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                                          const struct timespec *abstime);
+typedef int (*pthread_join_fun)(pthread_t thread, void **retval);
+typedef int (*sem_wait_fun)(sem_t *sem);
+typedef int (*fsync_fun)(int fd);
+typedef int (*fdatasync_fun)(int fd);
+typedef int (*poll_fun)(struct pollfd *fds, nfds_t nfds, int timeout);
+typedef int (*select_fun)(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout);
+typedef int (*flock_fun)(int fd, int operation);
+typedef pid_t (*waitpid_fun)(pid_t pid, int *wstatus, int options);
+typedef int (*system_fun)(const char *command);
+typedef int (*getaddrinfo_fun)(const char *node, const char *service, const struct addrinfo *hints,
+                               struct addrinfo **res);
+typedef struct hostent *(*gethostbyname_fun)(const char *name);
+typedef int (*gethostbyname_r_fun)(const char *name, struct hostent *ret, char *buf, size_t buflen,
+                                   struct hostent **result, int *h_errnop);
+
+#define XX(name) name##_fun name##_f = nullptr;
+BLOCK_FUN(XX);
+#undef XX
+
+void BlockHookInit() {
+    if (pthread_mutex_lock_f) {
+        return;
+    }
+#define XX(name) name##_f = (name##_fun)dlsym(RTLD_NEXT, #name);
+    BLOCK_FUN(XX);
+#undef XX
+    //条件变量有新旧两个版本，dlsym返回的是兼容旧程序的版本，要用dlvsym指定新版本
+    void *f = dlvsym(RTLD_NEXT, "pthread_cond_wait", "GLIBC_2.3.2");
+    if (f) {
+        pthread_cond_wait_f = (pthread_cond_wait_fun)f;
+    }
+    f = dlvsym(RTLD_NEXT, "pthread_cond_timedwait", "GLIBC_2.3.2");
+    if (f) {
+        pthread_cond_timedwait_f = (pthread_cond_timedwait_fun)f;
+    }
+}
+
+struct _BlockHookIniter {
+    _BlockHookIniter() { BlockHookInit(); }
+};
+
+_BlockHookIniter s_block_hook_initer;
+
+/**
+ * @brief 调用真正的实现并计时
+ * @details 强制内联，保证报告的调用栈跳过固定的层数；errno保留真正实现的结果
+ */
+template <typename Fun, typename... Args>
+inline __attribute__((always_inline)) auto Call(sylar::BlockDetector::Function f, Fun fun, Args... args)
+    -> decltype(fun(args...)) {
+    uint64_t begin = sylar::BlockDetector::Begin();
+    auto rt        = fun(args...);
+    if (begin) {
+        int err = errno;
+        sylar::BlockDetector::End(f, begin);
+        errno = err;
+    }
+    return rt;
+}
+
+} // namespace
+
+#define INIT(name) \
+    if (SYLAR_UNLIKELY(!name##_f)) { \
+        BlockHookInit(); \
+    }
+
+extern "C" {
+
+int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept {
+    INIT(pthread_mutex_lock);
+    return Call(sylar::BlockDetector::PTHREAD_MUTEX_LOCK, pthread_mutex_lock_f, mutex);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) noexcept {
+    INIT(pthread_rwlock_rdlock);
+    return Call(sylar::BlockDetector::PTHREAD_RWLOCK_RDLOCK, pthread_rwlock_rdlock_f, rwlock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) noexcept {
+    INIT(pthread_rwlock_wrlock);
+    return Call(sylar::BlockDetector::PTHREAD_RWLOCK_WRLOCK, pthread_rwlock_wrlock_f, rwlock);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+    INIT(pthread_cond_wait);
+    return Call(sylar::BlockDetector::PTHREAD_COND_WAIT, pthread_cond_wait_f, cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *abstime) {
+    INIT(pthread_cond_timedwait);
+    return Call(sylar::BlockDetector::PTHREAD_COND_TIMEDWAIT, pthread_cond_timedwait_f, cond, mutex, abstime);
+}
+
+int pthread_join(pthread_t thread, void **retval) {
+    INIT(pthread_join);
+    return Call(sylar::BlockDetector::PTHREAD_JOIN, pthread_join_f, thread, retval);
+}
+
+int sem_wait(sem_t *sem) {
+    INIT(sem_wait);
+    return Call(sylar::BlockDetector::SEM_WAIT, sem_wait_f, sem);
+}
+
+int fsync(int fd) {
+    INIT(fsync);
+    return Call(sylar::BlockDetector::FSYNC, fsync_f, fd);
+}
+
+int fdatasync(int fd) {
+    INIT(fdatasync);
+    return Call(sylar::BlockDetector::FDATASYNC, fdatasync_f, fd);
+}
+
+int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    INIT(poll);
+    return Call(sylar::BlockDetector::POLL, poll_f, fds, nfds, timeout);
+}
+
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout) {
+    INIT(select);
+    return Call(sylar::BlockDetector::SELECT, select_f, nfds, readfds, writefds, exceptfds, timeout);
+}
+
+int flock(int fd, int operation) noexcept {
+    INIT(flock);
+    return Call(sylar::BlockDetector::FLOCK, flock_f, fd, operation);
+}
+
+pid_t waitpid(pid_t pid, int *wstatus, int options) {
+    INIT(waitpid);
+    return Call(sylar::BlockDetector::WAITPID, waitpid_f, pid, wstatus, options);
+}
+
+int system(const char *command) {
+    INIT(system);
+    return Call(sylar::BlockDetector::SYSTEM, system_f, command);
+}
+
+int getaddrinfo(const char *node, const char *service, const struct addrinfo *hints, struct addrinfo **res) {
+    INIT(getaddrinfo);
+    return Call(sylar::BlockDetector::GETADDRINFO, getaddrinfo_f, node, service, hints, res);
+}
+
+struct hostent *gethostbyname(const char *name) {
+    INIT(gethostbyname);
+    return Call(sylar::BlockDetector::GETHOSTBYNAME, gethostbyname_f, name);
+}
+
+int gethostbyname_r(const char *name, struct hostent *ret, char *buf, size_t buflen, struct hostent **result,
+                    int *h_errnop) {
+    INIT(gethostbyname_r);
+    return Call(sylar::BlockDetector::GETHOSTBYNAME_R, gethostbyname_r_f, name, ret, buf, buflen, result, h_errnop);
+}
+
+}
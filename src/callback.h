@@ -0,0 +1,177 @@
+/**
+ * @file callback.h
+ * @brief 只能移动的回调函数对象
+ * @details 用来替代协程入口函数、调度任务、IO事件以及定时器回调中的std::function<void()>。
+ *          std::function要求可拷贝，并且捕获稍大一点的lambda就要在堆上分配；
+ *          Callback只能移动，不超过kInlineSize字节且移动不抛异常的可调用对象直接放在对象内部，不分配内存，
+ *          更大的可调用对象才退化为堆上分配
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_CALLBACK_H__
+#define __SYLAR_CALLBACK_H__
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace sylar {
+
+class Callback {
+public:
+    /// 内部存储大小，加上一个操作表指针，整个对象正好64字节
+    static const size_t kInlineSize = 56;
+
+    Callback() {}
+    Callback(std::nullptr_t) {}
+
+    /**
+     * @brief 从任意无参可调用对象构造
+     * @details 空的函数指针和空的std::function构造出空的Callback
+     */
+    template <class F, class D = typename std::decay<F>::type,
+              class = typename std::enable_if<!std::is_same<D, Callback>::value &&
+                                              !std::is_same<D, std::nullptr_t>::value>::type,
+              class = decltype(std::declval<D &>()())>
+    Callback(F &&f) {
+        if (IsNull(f)) {
+            return;
+        }
+        init<D>(std::forward<F>(f), std::integral_constant<bool, IsInline<D>::value>());
+    }
+
+    Callback(Callback &&other) noexcept { moveFrom(other); }
+
+    Callback &operator=(Callback &&other) noexcept {
+        if (this != &other) {
+            clear();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    Callback &operator=(std::nullptr_t) {
+        clear();
+        return *this;
+    }
+
+    Callback(const Callback &) = delete;
+    Callback &operator=(const Callback &) = delete;
+
+    ~Callback() { clear(); }
+
+    /**
+     * @brief 调用回调函数，必须非空
+     */
+    void operator()() const { m_ops->invoke(const_cast<Storage *>(&m_storage)); }
+
+    explicit operator bool() const { return m_ops != nullptr; }
+
+    void swap(Callback &other) {
+        Callback tmp(std::move(other));
+        other = std::move(*this);
+        *this = std::move(tmp);
+    }
+
+private:
+    typedef std::aligned_storage<kInlineSize, alignof(void *)>::type Storage;
+
+    /**
+     * @brief 类型擦除后的操作表，每种可调用对象类型一个静态实例
+     */
+    struct Ops {
+        void (*invoke)(Storage *s);
+        /// 把src中的对象移动到dst，并销毁src中的对象
+        void (*move)(Storage *dst, Storage *src);
+        void (*destroy)(Storage *s);
+    };
+
+    template <class D>
+    struct IsInline {
+        static const bool value = sizeof(D) <= kInlineSize &&
+                                  alignof(void *) % alignof(D) == 0 &&
+                                  std::is_nothrow_move_constructible<D>::value;
+    };
+
+    /**
+     * @brief 直接放在内部存储中的可调用对象
+     */
+    template <class D>
+    struct InlineOps {
+        static D *get(Storage *s) { return reinterpret_cast<D *>(s); }
+        static void invoke(Storage *s) { (*get(s))(); }
+        static void move(Storage *dst, Storage *src) {
+            ::new (dst) D(std::move(*get(src)));
+            get(src)->~D();
+        }
+        static void destroy(Storage *s) { get(s)->~D(); }
+        static const Ops ops;
+    };
+
+    /**
+     * @brief 放在堆上的可调用对象，内部存储中只放指针
+     */
+    template <class D>
+    struct HeapOps {
+        static D *&get(Storage *s) { return *reinterpret_cast<D **>(s); }
+        static void invoke(Storage *s) { (*get(s))(); }
+        static void move(Storage *dst, Storage *src) { *reinterpret_cast<D **>(dst) = get(src); }
+        static void destroy(Storage *s) { delete get(s); }
+        static const Ops ops;
+    };
+
+    template <class D, class F>
+    void init(F &&f, std::true_type) {
+        ::new (&m_storage) D(std::forward<F>(f));
+        m_ops = &InlineOps<D>::ops;
+    }
+
+    template <class D, class F>
+    void init(F &&f, std::false_type) {
+        *reinterpret_cast<D **>(&m_storage) = new D(std::forward<F>(f));
+        m_ops = &HeapOps<D>::ops;
+    }
+
+    template <class F>
+    static bool IsNull(const F &) { return false; }
+    template <class R>
+    static bool IsNull(R (*const &f)()) { return f == nullptr; }
+    template <class R>
+    static bool IsNull(const std::function<R()> &f) { return !f; }
+
+    void moveFrom(Callback &other) {
+        if (other.m_ops) {
+            other.m_ops->move(&m_storage, &other.m_storage);
+            m_ops       = other.m_ops;
+            other.m_ops = nullptr;
+        }
+    }
+
+    void clear() {
+        if (m_ops) {
+            m_ops->destroy(&m_storage);
+            m_ops = nullptr;
+        }
+    }
+
+private:
+    /// 内部存储
+    Storage m_storage;
+
+    /// 操作表，nullptr表示空
+    const Ops *m_ops = nullptr;
+};
+
+template <class D>
+const Callback::Ops Callback::InlineOps<D>::ops = {&InlineOps<D>::invoke, &InlineOps<D>::move,
+                                                   &InlineOps<D>::destroy};
+
+template <class D>
+const Callback::Ops Callback::HeapOps<D>::ops = {&HeapOps<D>::invoke, &HeapOps<D>::move,
+                                                 &HeapOps<D>::destroy};
+
+} // namespace sylar
+
+#endif
@@ -8,10 +8,18 @@
 #include <atomic>
 #include <cassert>
 #include "fiber.h"
+#include "fiber_context.h"
+#include "fiber_registry.h"
+#include "fiber_stats.h"
 // #include "config.h"
 // #include "log.h"
 // #include "macro.h"
 #include "scheduler.h"      
+#include "sdt.h"
+#include "stack_allocator.h"
+#include "stack_stats.h"
+#include "trace.h"
+#include "util.h"
 //按理来说在fiber中不应该考虑scheduler相关，
 //但是我们需要考虑协程是否参与调度器调度，如果参与调度器调度，其返回时cpu给调度协程，如果不参与，其返回时cpu给线程主协程
 //所以这里引入scheduler.h
@@ -25,6 +33,9 @@ static std::atomic<uint64_t> s_fiber_id{0};
 /// 全局静态变量，用于统计当前的协程数
 static std::atomic<uint64_t> s_fiber_count{0};
 
+/// 全局静态变量，用于分配协程局部变量的key
+static std::atomic<size_t> s_local_key{0};
+
 /// 线程局部变量，当前线程正在运行的协程
 static thread_local Fiber *thread_fiber = nullptr;
 
@@ -37,16 +48,9 @@ static thread_local Fiber::ptr t_thread_fiber = nullptr;
 
 const int g_fiber_stack_size = 128 * 1024;
 
-/**
- * @brief malloc栈内存分配器
- */
-class MallocStackAllocator {
-public:
-    static void *Alloc(size_t size) { return malloc(size); }
-    static void Dealloc(void *vp, size_t size) { return free(vp); }
-};
-
-using StackAllocator = MallocStackAllocator;
+Fiber *Fiber::GetCurrent() {
+    return thread_fiber;
+}
 
 uint64_t Fiber::GetFiberId() {
     if (thread_fiber) {
@@ -55,6 +59,153 @@ uint64_t Fiber::GetFiberId() {
     return 0;
 }
 
+uint64_t Fiber::TotalFibers() {
+    return s_fiber_count;
+}
+
+uint64_t Fiber::GetDeadline() {
+    if (thread_fiber) {
+        return thread_fiber->getDeadline();
+    }
+    return ~0ull;
+}
+
+std::shared_ptr<FiberContext> Fiber::GetContext() {
+    if (thread_fiber) {
+        return thread_fiber->m_context;
+    }
+    return nullptr;
+}
+
+void Fiber::setContext(std::shared_ptr<FiberContext> ctx) {
+    m_context = ctx;
+    if (m_context && m_context->getDeadline() < m_deadline) {
+        m_deadline = m_context->getDeadline();
+    }
+}
+
+void Fiber::cancel() {
+    m_cancelled = true;
+    //协程正挂起在hook调用中，在锁内唤醒，保证等待者还没有被挂起它的协程销毁
+    Mutex::Lock lock(m_waitMutex);
+    if (m_waiter) {
+        m_waiter->wake();
+    }
+}
+
+bool Fiber::setWaiter(FiberWaiter *waiter) {
+    Mutex::Lock lock(m_waitMutex);
+    if (waiter && m_cancelled) {
+        return false;
+    }
+    m_waiter = waiter;
+    return true;
+}
+
+bool Fiber::InScheduler() {
+    return thread_fiber && thread_fiber->m_runInScheduler && Scheduler::GetThis() &&
+           thread_fiber != Scheduler::GetMainFiber();
+}
+
+void Fiber::join() {
+    assert(this != thread_fiber);
+    Semaphore sem;
+    Joiner joiner;
+    {
+        Mutex::Lock lock(m_waitMutex);
+        //MainFunc先把状态改为TERM再加锁唤醒等待者，所以在锁内看到的不是TERM，就一定能被唤醒
+        if (m_state == TERM) {
+            return;
+        }
+        if (InScheduler()) {
+            joiner.scheduler = Scheduler::GetThis();
+            joiner.fiber     = thread_fiber->shared_from_this();
+        } else {
+            joiner.sem = &sem;
+        }
+        m_joiners.push_back(joiner);
+    }
+
+    if (joiner.fiber) {
+        joiner.fiber->setWaitReason("join");
+        joiner.fiber->yield();
+        joiner.fiber->setWaitReason(nullptr);
+    } else {
+        sem.wait();
+    }
+}
+
+void Fiber::wakeJoiners() {
+    std::vector<Joiner> joiners;
+    {
+        Mutex::Lock lock(m_waitMutex);
+        joiners.swap(m_joiners);
+    }
+    for (auto &i : joiners) {
+        if (i.fiber) {
+            i.scheduler->schedule(i.fiber);
+        } else {
+            i.sem->notify();
+        }
+    }
+}
+
+size_t Fiber::AllocLocalKey() {
+    return s_local_key++;
+}
+
+void *Fiber::GetLocal(size_t key) {
+    Fiber *cur = thread_fiber;
+    if (cur && key < cur->m_locals.size()) {
+        return cur->m_locals[key].value;
+    }
+    return nullptr;
+}
+
+void Fiber::SetLocal(size_t key, void *value, void (*destroy)(void *)) {
+    if (!thread_fiber) {
+        GetThis();
+    }
+    Fiber *cur = thread_fiber;
+    if (key >= cur->m_locals.size()) {
+        if (!value) {
+            return;
+        }
+        cur->m_locals.resize(key + 1);
+    }
+    LocalSlot old = cur->m_locals[key];
+    cur->m_locals[key].value   = value;
+    cur->m_locals[key].destroy = value ? destroy : nullptr;
+    //最后再销毁旧值，旧值的析构函数可能会访问其他协程局部变量
+    if (old.value && old.value != value && old.destroy) {
+        old.destroy(old.value);
+    }
+}
+
+void Fiber::recordStack(bool repaint) {
+    if (!m_painted || !m_started) {
+        return;
+    }
+    size_t used = StackStats::HighWater(m_stack, m_stacksize);
+    StackStats::Record(m_tag, used, m_stacksize);
+    if (repaint) {
+        StackStats::Paint(m_stack, m_stacksize, used);
+    }
+}
+
+void Fiber::clearLocals() {
+    //销毁函数中可能又设置了协程局部变量，循环直到清空
+    while (!m_locals.empty()) {
+        std::vector<LocalSlot> locals;
+        locals.swap(m_locals);
+        for (auto &i : locals) {
+            if (i.value && i.destroy) {
+                i.destroy(i.value);
+            }
+        }
+    }
+}
+
 Fiber::Fiber() {
 
     //设置为当前线程正在运行的协程 也就是设置t_fiber
@@ -106,13 +257,26 @@ Fiber::ptr Fiber::GetThis() {
  * 带参数的构造函数用于创建工作子协程，需要分配栈 这里体现出独立栈的特点
  * run_in_scheduler表示是否参与调度器调度
  */
-Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
+Fiber::Fiber(Callback cb, size_t stacksize, bool run_in_scheduler, const char *tag)
     : m_id(s_fiber_id++)
-    , m_cb(cb)
+    , m_tag(tag)
+    , m_cb(std::move(cb))
     , m_runInScheduler(run_in_scheduler) {
     ++s_fiber_count;
+    // 子协程继承创建者的上下文，从而继承请求的截止时间和取消状态
+    if (thread_fiber) {
+        setContext(thread_fiber->m_context);
+    }
+    // 没有指定栈大小时，按该类别协程的栈使用统计决定，没有统计时用默认大小
+    if (!stacksize && tag) {
+        stacksize = StackStats::SuggestSize(tag);
+    }
     m_stacksize = stacksize ? stacksize : g_fiber_stack_size;
-    m_stack     = StackAllocator::Alloc(m_stacksize);
+    m_stack     = StackAllocator::Alloc(m_stacksize, m_stackMode);
+    if (StackStats::IsPainting()) {
+        StackStats::Paint(m_stack, m_stacksize);
+        m_painted = true;
+    }
 
     if (getcontext(&m_ctx)) {
         //SYLAR_ASSERT2(false, "getcontext");
@@ -125,6 +289,14 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
 
     //设置协程的函数
     makecontext(&m_ctx, &Fiber::MainFunc, 0);
+    Trace::Record(Trace::FIBER_CREATE, m_tag, m_id);
+    SYLAR_PROBE2(fiber__create, m_id, m_tag);
+    if (SYLAR_UNLIKELY(FiberStats::IsEnabled())) {
+        FiberStats::RecordCreate(m_tag);
+    }
+    if (SYLAR_UNLIKELY(FiberRegistry::IsEnabled())) {
+        FiberRegistry::Add(this);
+    }
 
     //SYLAR_LOG_DEBUG(g_logger) << "Fiber::Fiber() id = " << m_id;
 }
@@ -135,11 +307,18 @@ Fiber::Fiber(std::function<void()> cb, size_t stacksize, bool run_in_scheduler)
 Fiber::~Fiber() {
     //SYLAR_LOG_DEBUG(g_logger) << "Fiber::~Fiber() id = " << m_id;
     --s_fiber_count;
+    //先删除登记，之后Dump不会再访问本协程和它的栈
+    if (m_registered) {
+        FiberRegistry::Remove(this);
+    }
+    //协程结束时已经销毁过，这里处理没有执行过的协程和线程主协程
+    clearLocals();
     if (m_stack) {
-        // 有栈，说明是子协程，需要确保子协程一定是结束状态
-        assert(m_state == TERM);
+        // 有栈，说明是子协程，需要确保子协程一定是结束状态，或者从来没有执行过
+        assert(m_state == TERM || !m_started);
         //SYLAR_ASSERT(m_state == TERM);
-        StackAllocator::Dealloc(m_stack, m_stacksize);
+        recordStack(false);
+        StackAllocator::Dealloc(m_stack, m_stacksize, m_stackMode);
         //SYLAR_LOG_DEBUG(g_logger) << "dealloc stack, id = " << m_id;
     } 
     else {
@@ -157,14 +336,37 @@ Fiber::~Fiber() {
 }
 
 /**
- * 这里为了简化状态管理，强制只有TERM状态的协程才可以重置，但其实刚创建好但没执行过的协程也应该允许重置的(但是这里不做)
+ * 只有TERM状态的协程，或者刚创建好(或刚重置)但还没执行过的协程才可以重置，
+ * 后者的栈上还没有任何东西，直接重新makecontext即可
  */
-void Fiber::reset(std::function<void()> cb) {
+void Fiber::reset(Callback cb) {
     //SYLAR_ASSERT(m_stack);
     assert(m_stack);
-    assert(m_state == TERM);
+    assert(m_state == TERM || !m_started);
     // SYLAR_ASSERT(m_state == TERM);
-    m_cb = cb;
+    m_cb = std::move(cb);
+    clearLocals();
+    //复用的栈很少释放，上一个任务的溢出在这里发现
+    StackAllocator::CheckOverflow(m_stack, m_stacksize, m_stackMode);
+    recordStack(true);
+    m_started = false;
+    m_deadline = ~0ull;
+    m_context.reset();
+    m_cancelled = false;
+    //复用的协程执行的是新任务，运行统计从零开始，按类别的协程数也按任务计
+    m_resumeCount    = 0;
+    m_cpuTicks       = 0;
+    m_ioWaitTicks    = 0;
+    m_timerWaitTicks = 0;
+    m_allocBytes     = 0;
+    m_allocCount     = 0;
+    if (SYLAR_UNLIKELY(FiberStats::IsEnabled())) {
+        FiberStats::RecordCreate(m_tag);
+    }
+    if (m_registered) {
+        m_startMS   = GetElapsedMS();
+        m_scheduler = nullptr;
+    }
     if (getcontext(&m_ctx)) {
         assert(false);
         //SYLAR_ASSERT2(false, "getcontext");
@@ -184,7 +386,14 @@ void Fiber::resume() {
     //SYLAR_ASSERT(m_state != TERM && m_state != RUNNING);
     assert(m_state != TERM && m_state != RUNNING);
     SetThis(this);
-    m_state = RUNNING;
+    m_state      = RUNNING;
+    m_started    = true;
+    m_traceBegin = Trace::Begin();
+    m_statsBegin = FiberStats::Begin();
+    if (SYLAR_UNLIKELY(m_registered)) {
+        m_scheduler = Scheduler::GetThis();
+    }
+    SYLAR_PROBE2(fiber__resume, m_id, m_tag);
     //std::cout<<"tag1"<<std::endl;
     // 如果协程参与调度器调度，那么应该和线程的调度协程进行swap，而不是线程主协程
     //注意：在工作线程(也就是非caller线程)中，调度协程与线程主协程是一样的
@@ -208,6 +417,23 @@ void Fiber::yield() {
     /// 协程运行完之后会自动yield一次，用于回到主协程，此时状态已为结束状态
     assert(m_state == RUNNING || m_state == TERM);
     //SYLAR_ASSERT(m_state == RUNNING || m_state == TERM);
+    recordRunEnd();
+    SYLAR_PROBE2(fiber__yield, m_id, m_state == TERM ? TERM : READY);
+
+    // 通过call()调用的协程回到调用者
+    if (m_caller) {
+        Fiber *caller = m_caller;
+        m_caller      = nullptr;
+        SetThis(caller);
+        if (m_state != TERM) {
+            m_state = READY;
+        }
+        if (swapcontext(&m_ctx, &caller->m_ctx)) {
+            assert(false);
+        }
+        return;
+    }
+
     SetThis(t_thread_fiber.get());
     if (m_state != TERM) {
         m_state = READY;
@@ -227,6 +453,92 @@ void Fiber::yield() {
     }
 }
 
+//对称切换，swapcontext直接从本协程切到目标协程，两者yield时回到的都是同一个调度协程(或主协程)
+void Fiber::switchTo(Fiber &target) {
+    assert(thread_fiber == this && m_state == RUNNING);
+    assert(&target != this && target.m_state == READY);
+    assert(m_stack && m_runInScheduler == target.m_runInScheduler);
+    //本协程的结束时间直接作为目标协程的开始时间，少读一次时间戳
+    uint64_t stats_now = recordRunEnd();
+    SetThis(&target);
+    m_state             = READY;
+    target.m_state      = RUNNING;
+    target.m_started    = true;
+    target.m_traceBegin = Trace::Begin();
+    target.m_statsBegin = stats_now ? stats_now : FiberStats::Begin();
+    if (SYLAR_UNLIKELY(target.m_registered)) {
+        target.m_scheduler = Scheduler::GetThis();
+    }
+    SYLAR_PROBE2(fiber__yield, m_id, READY);
+    SYLAR_PROBE2(fiber__resume, target.m_id, target.m_tag);
+    if (swapcontext(&m_ctx, &target.m_ctx)) {
+        assert(false);
+    }
+}
+
+void Fiber::call() {
+    assert(m_state == READY);
+    if (!thread_fiber) {
+        GetThis();
+    }
+    Fiber *caller = thread_fiber;
+    assert(caller != this);
+    m_caller     = caller;
+    SetThis(this);
+    m_state      = RUNNING;
+    m_started    = true;
+    m_traceBegin = Trace::Begin();
+    m_statsBegin = FiberStats::Begin();
+    if (SYLAR_UNLIKELY(m_registered)) {
+        m_scheduler = Scheduler::GetThis();
+    }
+    SYLAR_PROBE2(fiber__resume, m_id, m_tag);
+    if (swapcontext(&caller->m_ctx, &m_ctx)) {
+        assert(false);
+    }
+}
+
+uint64_t Fiber::recordRunEnd() {
+    if (SYLAR_UNLIKELY(m_traceBegin)) {
+        Trace::Record(Trace::FIBER_RUN, m_tag, m_id, 0, m_traceBegin);
+        m_traceBegin = 0;
+    }
+    if (SYLAR_LIKELY(!m_statsBegin)) {
+        return 0;
+    }
+    uint64_t now   = FiberStats::Ticks();
+    uint64_t ticks = now - m_statsBegin;
+    m_statsBegin   = 0;
+    ++m_resumeCount;
+    m_cpuTicks += ticks;
+    FiberStats::RecordRun(m_tag, ticks);
+    return now;
+}
+
+void Fiber::recordWait(FiberStats::WaitType type, uint64_t begin) {
+    if (!begin) {
+        return;
+    }
+    uint64_t ticks = FiberStats::Ticks() - begin;
+    if (type == FiberStats::WAIT_IO) {
+        m_ioWaitTicks += ticks;
+    } else {
+        m_timerWaitTicks += ticks;
+    }
+    FiberStats::RecordWait(m_tag, type, ticks);
+}
+
+void Fiber::recordBlocked(FiberStats::WaitType type, uint64_t begin) {
+    if (!begin) {
+        return;
+    }
+    //本次运行的开始时间后移，yield时算出的运行时间就不包含阻塞的这一段
+    if (m_statsBegin) {
+        m_statsBegin += FiberStats::Ticks() - begin;
+    }
+    recordWait(type, begin);
+}
+
 /**
  * 这里没有处理协程函数出现异常的情况，同样是为了简化状态管理，并且个人认为协程的异常不应该由框架处理，应该由开发者自行处理
  */
@@ -243,7 +555,11 @@ void Fiber::MainFunc() {
     cur->m_cb();        //真正执行用户指定的client函数
     //执行完成
     cur->m_cb    = nullptr;
+    cur->clearLocals(); //在协程栈上销毁协程局部变量，此时协程仍是当前协程，销毁函数中还能访问协程局部变量
     cur->m_state = TERM;    //该协程将用户指定函数执行完成，将自身状态改为TERM
+    Trace::Record(Trace::FIBER_TERM, cur->m_tag, cur->m_id);
+    SYLAR_PROBE1(fiber__exit, cur->m_id);
+    cur->wakeJoiners();     //唤醒join本协程的等待者
 
     auto raw_ptr = cur.get(); 
     cur.reset();        // 手动让t_fiber的引用计数减1
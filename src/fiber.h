@@ -8,17 +8,28 @@
 #ifndef __SYLAR_FIBER_H__
 #define __SYLAR_FIBER_H__
 
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <vector>
 #include <ucontext.h>
+#include "callback.h"
+#include "fiber_stats.h"
+#include "stack_allocator.h"
 #include "thread.h"
 
 namespace sylar {
 
+class FiberContext;
+class FiberRegistry;
+struct FiberWaiter;
+class Scheduler;
+
 /**
  * @brief 协程类
  */
 class Fiber : public std::enable_shared_from_this<Fiber> {
+friend class FiberRegistry;
 public:
     typedef std::shared_ptr<Fiber> ptr;
 
@@ -51,8 +62,10 @@ public:
      * @param[in] cb 协程入口函数
      * @param[in] stacksize 栈大小
      * @param[in] run_in_scheduler 本协程是否参与调度器调度，默认为true 即接收调度
+     * @param[in] tag 协程类别，一般是调用点的字符串常量(必须一直有效)，用于按类别统计栈使用量，
+     *            打开自适应栈大小(见stack_stats.h)且stacksize为0时，按该类别的统计决定栈大小
      */
-    Fiber(std::function<void()> cb, size_t stacksize = 0, bool run_in_scheduler = true);
+    Fiber(Callback cb, size_t stacksize = 0, bool run_in_scheduler = true, const char *tag = nullptr);
 
     /**
      * @brief 析构函数
@@ -61,9 +74,11 @@ public:
 
     /**
      * @brief 重置协程状态和入口函数，复用栈空间，不重新创建栈
+     * @details resume次数、CPU时间、等待时间和内存分配从零开始统计
      * @param[in] cb 
+     * @attention 只能重置TERM状态的协程，或者还没有执行过的READY状态的协程
      */
-    void reset(std::function<void()> cb);
+    void reset(Callback cb);
 
     /**
      * @brief 将当前协程切到到执行状态
@@ -77,16 +92,160 @@ public:
      */
     void yield();
 
+    /**
+     * @brief 从当前协程直接切换到目标协程(对称切换)，不经过调度协程
+     * @details 本协程必须是当前正在运行的协程，切换后本协程变为READY，目标协程变为RUNNING。
+     *          与yield()+schedule()相比少一次上下文切换，也不需要加调度器的锁，
+     *          适合channel、锁的移交这类在同一线程上把执行权直接交给被唤醒协程的场景。
+     *          本协程不会被自动重新调度，由调用者保证之后有人resume/switchTo/schedule它；
+     *          目标协程之后yield或者结束时，回到本线程的调度协程(或主协程)，而不是回到本协程
+     * @param[in] target 目标协程，必须是READY状态，且不能同时在调度器的任务队列中；
+     *          两个协程必须同为参与调度器调度的协程，或同为不参与调度的协程
+     */
+    void switchTo(Fiber &target);
+
+    /**
+     * @brief 从当前协程调用本协程，本协程下一次yield或者结束时回到调用者，而不是调度协程或主协程
+     * @details 类似函数调用，调用者在此期间保持RUNNING状态，不会被调度器调度。
+     *          调用者可以是任意协程(包括线程主协程、调度协程)，用于生成器这类由调用方驱动的协程
+     * @attention 本协程必须是READY状态，且应该是不参与调度器调度的协程
+     */
+    void call();
+
     /**
      * @brief 获取协程ID
      */
     uint64_t getId() const { return m_id; }
 
+    /**
+     * @brief 获取协程类别
+     */
+    const char *getTag() const { return m_tag; }
+
+    /**
+     * @brief 获取协程被resume的次数，只统计打开FiberStats期间的运行，见fiber_stats.h
+     */
+    uint64_t getResumeCount() const { return m_resumeCount; }
+
+    /**
+     * @brief 获取协程在CPU上运行的总时间，单位纳秒
+     */
+    uint64_t getCpuTime() const { return FiberStats::TicksToNs(m_cpuTicks); }
+
+    /**
+     * @brief 获取协程挂起等待的总时间，单位纳秒
+     */
+    uint64_t getWaitTime(FiberStats::WaitType type) const {
+        return FiberStats::TicksToNs(type == FiberStats::WAIT_IO ? m_ioWaitTicks : m_timerWaitTicks);
+    }
+
+    /**
+     * @brief 获取协程中malloc系列函数分配的字节数，只统计打开AllocProfiler期间的分配，见alloc_profiler.h
+     * @details 采样模式下是估计值
+     */
+    uint64_t getAllocBytes() const { return m_allocBytes; }
+
+    /**
+     * @brief 获取协程中malloc系列函数的调用次数
+     */
+    uint64_t getAllocCount() const { return m_allocCount; }
+
+    /**
+     * @brief 记录协程中的内存分配，由AllocProfiler调用
+     */
+    void recordAlloc(uint64_t bytes, uint64_t count) {
+        m_allocBytes += bytes;
+        m_allocCount += count;
+    }
+
+    /**
+     * @brief 记录一次挂起等待，由hook在挂起前后调用
+     * @param[in] begin 挂起前FiberStats::Begin()的返回值，为0时不记录
+     */
+    void recordWait(FiberStats::WaitType type, uint64_t begin);
+
+    /**
+     * @brief 记录一次不让出协程的阻塞等待(idle协程中的epoll_wait)，这段时间从本次运行时间中扣除
+     * @param[in] begin 阻塞前FiberStats::Begin()的返回值，为0时不记录
+     */
+    void recordBlocked(FiberStats::WaitType type, uint64_t begin);
+
+    /**
+     * @brief 获取协程栈大小
+     */
+    uint32_t getStackSize() const { return m_stacksize; }
+
+    /**
+     * @brief 获取协程栈的最低地址，线程主协程返回nullptr
+     */
+    void *getStack() const { return m_stack; }
+
+    /**
+     * @brief 协程栈是否带保护页，见stack_allocator.h
+     */
+    bool isStackGuarded() const { return m_stackMode == StackAllocator::MMAP_GUARD; }
+
     /**
      * @brief 获取协程状态
      */
     State getState() const { return m_state; }
 
+    /**
+     * @brief 设置协程的截止时间
+     * @param[in] deadline 绝对截止时间(毫秒)，与GetElapsedMS()同一时间基准，~0ull表示没有截止时间
+     * @details 调度器在EDF模式下按截止时间从早到晚挑选就绪协程，hook的IO函数也会参考该截止时间
+     */
+    void setDeadline(uint64_t deadline) { m_deadline = deadline; }
+
+    /**
+     * @brief 获取协程的截止时间，~0ull表示没有截止时间
+     */
+    uint64_t getDeadline() const { return m_deadline; }
+
+    /**
+     * @brief 设置协程上下文(请求上下文)
+     * @details 上下文的截止时间早于协程自身的截止时间时，同时更新协程的截止时间
+     */
+    void setContext(std::shared_ptr<FiberContext> ctx);
+
+    /**
+     * @brief 获取协程上下文
+     */
+    const std::shared_ptr<FiberContext> &getContext() const { return m_context; }
+
+    /**
+     * @brief 取消协程
+     * @details 协程正挂起在hook的阻塞调用(sleep/connect/accept/read/write/recv/send等)中时立即唤醒它，
+     *          该调用删除注册的事件和定时器，返回-1，errno为ECANCELED。之后该协程再进行hook的阻塞调用时也会直接返回ECANCELED。
+     *          与IOManager::cancelEvent不同，只影响这一个协程，不影响同一个fd上的其他等待者。可以在任意线程调用
+     */
+    void cancel();
+
+    /**
+     * @brief 协程是否已经被取消
+     */
+    bool isCancelled() const { return m_cancelled; }
+
+    /**
+     * @brief 登记协程当前的挂起等待者，由hook函数在挂起协程之前调用，传nullptr表示协程已被唤醒，删除登记
+     * @return 协程已经被取消时返回false，此时不登记
+     */
+    bool setWaiter(FiberWaiter *waiter);
+
+    /**
+     * @brief 设置协程挂起的原因，只用于FiberRegistry输出，见fiber_registry.h
+     * @param[in] reason 字符串常量，nullptr表示没有在等待；hook的IO和sleep调用通过setWaiter登记，不需要设置
+     */
+    void setWaitReason(const char *reason) { m_waitReason.store(reason, std::memory_order_relaxed); }
+
+    /**
+     * @brief 等待本协程执行结束
+     * @details 在调度器的协程中调用时挂起调用者协程，本协程结束时再把调用者协程重新加入调度，不阻塞线程；
+     *          在其他地方(比如线程主协程)调用时阻塞当前线程。本协程已经结束时直接返回
+     * @attention 不能等待自己
+     */
+    void join();
+
 public:
     /**
      * @brief 设置当前正在运行的协程，即设置线程局部变量t_fiber的值
@@ -101,6 +260,12 @@ public:
      */
     static Fiber::ptr GetThis();
 
+    /**
+     * @brief 返回当前线程正在执行的协程的裸指针
+     * @details 与GetThis()不同，不增加引用计数，当前线程还没有协程时返回nullptr而不创建主协程，可以在信号处理函数中使用
+     */
+    static Fiber *GetCurrent();
+
     /**
      * @brief 获取总协程数
      */
@@ -116,6 +281,85 @@ public:
      */
     static uint64_t GetFiberId();
 
+    /**
+     * @brief 获取当前协程的截止时间
+     * @details 当前线程没有正在运行的协程时返回~0ull，hook的IO函数通过该接口读取请求的截止时间
+     */
+    static uint64_t GetDeadline();
+
+    /**
+     * @brief 获取当前协程的上下文
+     * @details 当前线程没有正在运行的协程时返回nullptr，不会像GetThis()那样创建线程主协程
+     */
+    static std::shared_ptr<FiberContext> GetContext();
+
+    /**
+     * @brief 当前是否运行在调度器调度的协程中
+     * @details 是的话当前协程可以yield挂起，之后通过Scheduler::schedule()重新唤醒，
+     *          否则(线程主协程、调度协程)只能阻塞线程等待
+     */
+    static bool InScheduler();
+
+    /**
+     * @brief 分配一个协程局部变量的key
+     * @details key全局递增、不回收，所以协程局部变量一般定义成全局或静态对象，见fiber_local.h
+     */
+    static size_t AllocLocalKey();
+
+    /**
+     * @brief 获取当前协程中key对应的协程局部变量
+     * @return 没有设置过，或者当前线程还没有协程时返回nullptr
+     */
+    static void *GetLocal(size_t key);
+
+    /**
+     * @brief 设置当前协程中key对应的协程局部变量，原来的值用原来的销毁函数销毁
+     * @param[in] value 值，nullptr表示删除
+     * @param[in] destroy 值的销毁函数，协程结束、重置或析构时调用
+     * @details 当前线程还没有协程时先创建线程主协程，线程主协程上的值相当于线程局部变量
+     */
+    static void SetLocal(size_t key, void *value, void (*destroy)(void *));
+
+private:
+    /**
+     * @brief join的等待者，调度器协程通过重新调度唤醒，其他情况通过信号量唤醒
+     */
+    struct Joiner {
+        Scheduler *scheduler = nullptr;
+        Fiber::ptr fiber;
+        Semaphore *sem = nullptr;
+    };
+
+    /**
+     * @brief 协程结束时唤醒所有join的等待者
+     */
+    void wakeJoiners();
+
+    /**
+     * @brief 协程局部变量的存储槽
+     */
+    struct LocalSlot {
+        void *value = nullptr;
+        void (*destroy)(void *) = nullptr;
+    };
+
+    /**
+     * @brief 销毁本协程的所有协程局部变量
+     */
+    void clearLocals();
+
+    /**
+     * @brief 协程栈涂过色时，测量本次运行的栈最高水位并记录到所属类别
+     * @param[in] repaint 是否重新涂色用过的部分，复用协程时需要
+     */
+    void recordStack(bool repaint);
+
+    /**
+     * @brief 本次运行结束，开始运行时打开了追踪或统计的话，记录本次运行
+     * @return 记录了统计时返回结束的时间戳，否则返回0
+     */
+    uint64_t recordRunEnd();
+
 private:
     /// 协程id
     uint64_t m_id        = 0;
@@ -125,18 +369,94 @@ private:
     
     /// 协程状态
     State m_state        = READY;
+
+    /// 创建或重置之后是否已经resume过，没有执行过的协程可以直接重置或析构
+    bool m_started       = false;
     
     /// 协程上下文
     ucontext_t m_ctx;
     
     /// 协程栈地址 所以这里还是个独立栈
     void *m_stack = nullptr;
+
+    /// 协程类别
+    const char *m_tag = nullptr;
+
+    /// 协程栈是否涂过色
+    bool m_painted = false;
+
+    /// 协程栈的分配方式，释放时原样传回
+    StackAllocator::Mode m_stackMode = StackAllocator::MALLOC;
+
+    /// 本次运行的开始时间，没有打开追踪时为0，见trace.h
+    uint64_t m_traceBegin = 0;
+
+    /// 本次运行开始的时间戳，没有打开统计时为0，见fiber_stats.h
+    uint64_t m_statsBegin = 0;
+
+    /// resume次数
+    uint64_t m_resumeCount = 0;
+
+    /// 运行总时间，tsc周期
+    uint64_t m_cpuTicks = 0;
+
+    /// 在IO调用中挂起的总时间，tsc周期
+    uint64_t m_ioWaitTicks = 0;
+
+    /// 在sleep中挂起的总时间，tsc周期
+    uint64_t m_timerWaitTicks = 0;
+
+    /// 分配的字节数，见alloc_profiler.h
+    uint64_t m_allocBytes = 0;
+
+    /// 分配次数
+    uint64_t m_allocCount = 0;
     
     /// 协程入口函数
-    std::function<void()> m_cb;
+    Callback m_cb;
     
     /// 本协程是否参与调度器调度 只有工作子协程接收调度器调度 调度协程与线程主协程不接受调度
-    bool m_runInScheduler;
+    bool m_runInScheduler = false;
+
+    /// 通过call()调用本协程的协程，不为空时yield回到它
+    Fiber *m_caller = nullptr;
+
+    /// 协程截止时间(毫秒) ~0ull表示没有截止时间
+    uint64_t m_deadline = ~0ull;
+
+    /// 协程上下文 创建子协程时由子协程继承
+    std::shared_ptr<FiberContext> m_context;
+
+    /// 是否已经被取消
+    std::atomic<bool> m_cancelled{false};
+
+    /// 挂起在hook调用中时的等待者，取消协程时通过它唤醒协程
+    FiberWaiter *m_waiter = nullptr;
+
+    /// 保护m_waiter和m_joiners，取消和join可能来自其他线程
+    Mutex m_waitMutex;
+
+    /// 等待本协程结束的等待者
+    std::vector<Joiner> m_joiners;
+
+    /// 协程局部变量，下标为key
+    std::vector<LocalSlot> m_locals;
+
+    /// 挂起原因，见setWaitReason
+    std::atomic<const char *> m_waitReason{nullptr};
+
+    /// 是否登记在FiberRegistry中，以下几个成员只在登记时维护
+    bool m_registered = false;
+
+    /// FiberRegistry分片链表中的前后节点
+    Fiber *m_registryPrev = nullptr;
+    Fiber *m_registryNext = nullptr;
+
+    /// 创建或重置的时间(毫秒)
+    uint64_t m_startMS = 0;
+
+    /// 最近一次运行本协程的调度器
+    Scheduler *m_scheduler = nullptr;
 };
 
 } // namespace sylar
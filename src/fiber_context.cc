@@ -0,0 +1,172 @@
+/**
+ * @file fiber_context.cc
+ * @brief 协程上下文实现
+ * @version 0.1
+ */
+
+#include <errno.h>
+#include "fiber_context.h"
+#include "iomanager.h"
+#include "util.h"
+
+namespace sylar {
+
+FiberContext::ptr FiberContext::WithCancel(ptr parent) {
+    ptr ctx(new FiberContext(parent, ~0ull));
+    ctx->attach();
+    return ctx;
+}
+
+FiberContext::ptr FiberContext::WithDeadline(uint64_t deadline, ptr parent) {
+    ptr ctx(new FiberContext(parent, deadline));
+    ctx->attach();
+    return ctx;
+}
+
+FiberContext::ptr FiberContext::WithTimeout(uint64_t timeout_ms, ptr parent) {
+    return WithDeadline(sylar::GetElapsedMS() + timeout_ms, parent);
+}
+
+FiberContext::FiberContext(ptr parent, uint64_t deadline)
+    : m_parent(parent)
+    , m_deadline(deadline) {
+    //子上下文的截止时间不能晚于父上下文
+    if (m_parent && m_parent->getDeadline() < m_deadline) {
+        m_deadline = m_parent->getDeadline();
+    }
+}
+
+FiberContext::~FiberContext() {
+    //请求正常结束时上下文被释放，截止定时器不再需要，否则IOManager要等它到期才能停止
+    if (m_timer) {
+        m_timer->cancel();
+    }
+}
+
+void FiberContext::attach() {
+    if (!m_parent) {
+        return;
+    }
+    int err = 0;
+    {
+        MutexType::Lock lock(m_parent->m_mutex);
+        err = m_parent->m_error;
+        if (!err) {
+            std::vector<std::weak_ptr<FiberContext> > &children = m_parent->m_children;
+            //顺便清理已经释放的子上下文，避免长寿命的父上下文无限增长
+            if (children.size() == children.capacity()) {
+                size_t n = 0;
+                for (size_t i = 0; i < children.size(); ++i) {
+                    if (!children[i].expired()) {
+                        children[n++] = children[i];
+                    }
+                }
+                children.resize(n);
+            }
+            children.push_back(shared_from_this());
+        }
+    }
+    //父上下文已经结束，子上下文创建出来就是结束状态
+    if (err) {
+        cancel(err);
+    }
+}
+
+int FiberContext::getError() {
+    int err = 0;
+    {
+        MutexType::Lock lock(m_mutex);
+        err = m_error;
+    }
+    //截止时间已到，但是截止定时器还没来得及触发(或者还没有创建)
+    if (!err && m_deadline != ~0ull && sylar::GetElapsedMS() >= m_deadline) {
+        cancel(ETIMEDOUT);
+        MutexType::Lock lock(m_mutex);
+        err = m_error;
+    }
+    return err;
+}
+
+void FiberContext::cancel(int err) {
+    std::vector<ptr> children;
+    Timer::ptr timer;
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_error) {
+            return;
+        }
+        m_error = err;
+
+        //唤醒所有挂起的协程，等待者由被唤醒的协程自己调用delWaiter删除
+        for (auto waiter : m_waiters) {
+            waiter->wake();
+        }
+
+        for (auto &i : m_children) {
+            ptr child = i.lock();
+            if (child) {
+                children.push_back(child);
+            }
+        }
+        m_children.clear();
+        timer.swap(m_timer);
+    }
+
+    if (timer) {
+        timer->cancel();
+    }
+    //取消向下传播给所有子上下文
+    for (auto &child : children) {
+        child->cancel(err);
+    }
+}
+
+void FiberWaiter::wake() {
+    if (fd != -1) {
+        //触发一次该协程在fd上注册的事件，协程被重新加入调度；如果事件已经触发过了，协程已经在调度队列里，什么也不用做；
+        //事件已经被别的协程重新注册时也不能动它
+        iom->cancelEvent(fd, (IOManager::Event)event, fiber.get());
+    }
+    else if (timer) {
+        //定时器还没触发，删除定时器，由这里负责把协程加入调度；定时器已经触发则协程已经在调度队列里
+        if (timer->cancel()) {
+            iom->schedule(fiber);
+        }
+    }
+}
+
+bool FiberContext::addWaiter(Waiter *waiter) {
+    MutexType::Lock lock(m_mutex);
+    if (m_error) {
+        return false;
+    }
+
+    if (m_deadline != ~0ull) {
+        uint64_t now = sylar::GetElapsedMS();
+        if (now >= m_deadline) {
+            lock.unlock();
+            cancel(ETIMEDOUT);
+            return false;
+        }
+        //第一次有协程挂起时才创建截止定时器，整个上下文共用这一个定时器
+        if (!m_timer && waiter->iom) {
+            std::weak_ptr<FiberContext> weak_ctx(shared_from_this());
+            m_timer = waiter->iom->addTimer(m_deadline - now, [weak_ctx]() {
+                ptr ctx = weak_ctx.lock();
+                if (ctx) {
+                    ctx->cancel(ETIMEDOUT);
+                }
+            });
+        }
+    }
+
+    m_waiters.push_back(waiter);
+    return true;
+}
+
+void FiberContext::delWaiter(Waiter *waiter) {
+    MutexType::Lock lock(m_mutex);
+    m_waiters.remove(waiter);
+}
+
+} // namespace sylar
@@ -0,0 +1,164 @@
+/**
+ * @file fiber_context.h
+ * @brief 协程上下文(请求上下文)模块
+ * @details 携带一次请求的截止时间与取消状态，类似golang的context。
+ *          协程创建子协程或者添加回调任务时，子任务自动继承当前协程的上下文
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_FIBER_CONTEXT_H__
+#define __SYLAR_FIBER_CONTEXT_H__
+
+#include <list>
+#include <memory>
+#include <vector>
+#include "fiber.h"
+#include "mutex.h"
+#include "timer.h"
+
+namespace sylar {
+
+class IOManager;
+
+/**
+ * @brief 挂起的等待者，由hook函数在自己的栈上构造
+ * @details 挂起期间同时登记在协程(Fiber::cancel())和协程上下文(FiberContext::cancel())上，任何一方都可以通过它提前唤醒协程
+ */
+struct FiberWaiter {
+    /// 挂起的协程
+    Fiber::ptr fiber;
+
+    /// 协程挂起时所在的IO调度器
+    IOManager *iom = nullptr;
+
+    /// 等待的fd，-1表示等待的是定时器(sleep类调用)
+    int fd = -1;
+
+    /// 等待的IO事件
+    int event = 0;
+
+    /// sleep类调用的定时器
+    Timer::ptr timer;
+
+    /**
+     * @brief 提前唤醒挂起的协程
+     * @details fd等待者触发一次注册的事件并删除它，定时器等待者删除定时器并把协程加入调度，
+     *          事件或定时器已经触发时什么也不做，保证协程只被调度一次
+     */
+    void wake();
+};
+
+/**
+ * @brief 协程上下文类
+ * @details 所有hook的阻塞调用(sleep/connect/accept/read/write/recv/send等)在挂起协程之前都会向当前上下文登记，
+ *          上下文超时或者被取消时，由上下文负责唤醒这些协程，被唤醒的调用返回-1，errno为ETIMEDOUT或ECANCELED。
+ *          整个请求只需要一个截止定时器，而不是每个系统调用一个定时器
+ */
+class FiberContext : public std::enable_shared_from_this<FiberContext> {
+public:
+    typedef std::shared_ptr<FiberContext> ptr;
+    typedef Mutex MutexType;
+
+    /// 挂起的等待者
+    typedef FiberWaiter Waiter;
+
+    /**
+     * @brief 创建一个可取消的上下文
+     * @param[in] parent 父上下文，父上下文结束时子上下文也随之结束
+     */
+    static ptr WithCancel(ptr parent = nullptr);
+
+    /**
+     * @brief 创建一个带截止时间的上下文
+     * @param[in] deadline 绝对截止时间(毫秒)，与GetElapsedMS()同一时间基准
+     * @param[in] parent 父上下文，实际截止时间取两者中较早的一个
+     */
+    static ptr WithDeadline(uint64_t deadline, ptr parent = nullptr);
+
+    /**
+     * @brief 创建一个从现在开始计时的超时上下文
+     * @param[in] timeout_ms 超时时间(毫秒)
+     * @param[in] parent 父上下文
+     */
+    static ptr WithTimeout(uint64_t timeout_ms, ptr parent = nullptr);
+
+    /**
+     * @brief 析构函数，会删除截止定时器
+     * @attention 上下文不能比创建截止定时器的IOManager活得更久
+     */
+    ~FiberContext();
+
+    /**
+     * @brief 获取截止时间，~0ull表示没有截止时间
+     */
+    uint64_t getDeadline() const { return m_deadline; }
+
+    /**
+     * @brief 获取结束原因
+     * @return 0表示还未结束，否则为ETIMEDOUT或ECANCELED(或者cancel时指定的错误码)
+     */
+    int getError();
+
+    /**
+     * @brief 是否已经结束(超时或被取消)
+     */
+    bool isDone() { return getError() != 0; }
+
+    /**
+     * @brief 取消上下文
+     * @details 唤醒所有登记在本上下文及其子上下文上的挂起协程，重复取消无效
+     * @param[in] err 结束原因，也就是被唤醒的hook调用返回的errno
+     */
+    void cancel(int err = ECANCELED);
+
+    /**
+     * @brief 登记一个挂起的等待者
+     * @details 第一次有协程在IO调度器中挂起时才会创建截止定时器
+     * @return 上下文已经结束时返回false，此时不登记
+     */
+    bool addWaiter(Waiter *waiter);
+
+    /**
+     * @brief 删除一个等待者，协程被唤醒之后调用
+     */
+    void delWaiter(Waiter *waiter);
+
+private:
+    /**
+     * @brief 构造函数
+     * @param[in] parent 父上下文
+     * @param[in] deadline 本上下文的截止时间
+     */
+    FiberContext(ptr parent, uint64_t deadline);
+
+    /**
+     * @brief 把自己挂到父上下文的子上下文列表中
+     */
+    void attach();
+
+private:
+    /// 父上下文
+    ptr m_parent;
+
+    /// 截止时间(毫秒)，~0ull表示没有截止时间
+    uint64_t m_deadline = ~0ull;
+
+    /// 结束原因，0表示还未结束
+    int m_error = 0;
+
+    /// 截止定时器，整个上下文只有一个
+    Timer::ptr m_timer;
+
+    /// 当前挂起的等待者
+    std::list<Waiter *> m_waiters;
+
+    /// 子上下文
+    std::vector<std::weak_ptr<FiberContext> > m_children;
+
+    /// Mutex
+    MutexType m_mutex;
+};
+
+} // namespace sylar
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * @file fiber_group.cc
+ * @brief 结构化并发实现
+ * @version 0.1
+ */
+
+#include <cassert>
+#include "fiber_group.h"
+
+namespace sylar {
+
+void WaitGroup::done() {
+    //不是最后一个计数时只做一次原子减
+    int64_t count = m_count.load(std::memory_order_relaxed);
+    while (count > 1) {
+        if (m_count.compare_exchange_weak(count, count - 1, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+
+    //可能是最后一个计数，在锁内减，保证等待者在done()释放锁之前不会返回(进而析构WaitGroup)
+    detail::FutureNode *nodes = nullptr;
+    {
+        MutexType::Lock lock(m_mutex);
+        count = m_count.fetch_sub(1, std::memory_order_acq_rel) - 1;
+        assert(count >= 0);
+        if (count != 0) {
+            return;
+        }
+        nodes     = m_waiters;
+        m_waiters = nullptr;
+    }
+    while (nodes) {
+        //先取next，notify之后节点可能已经被销毁
+        detail::FutureNode *next = nodes->next;
+        nodes->notify(nodes);
+        nodes = next;
+    }
+}
+
+void WaitGroup::wait() {
+    detail::FutureParker parker;
+    {
+        //即使计数已经为0也要加锁，等最后一个done()释放锁
+        MutexType::Lock lock(m_mutex);
+        if (count() == 0) {
+            return;
+        }
+        parker.next = m_waiters;
+        m_waiters   = &parker;
+    }
+    parker.park("waitgroup");
+}
+
+FiberGroup::FiberGroup(Scheduler *scheduler)
+    : m_scheduler(scheduler ? scheduler : Scheduler::GetThis())
+    , m_context(FiberContext::WithCancel(Fiber::GetContext())) {
+    assert(m_scheduler);
+}
+
+FiberGroup::~FiberGroup() {
+    if (m_wg.count() != 0) {
+        cancel();
+    }
+    m_wg.wait();
+}
+
+void FiberGroup::wait() {
+    m_wg.wait();
+    if (m_error) {
+        std::rethrow_exception(m_error);
+    }
+}
+
+bool FiberGroup::enter() {
+    Fiber::GetThis()->setContext(m_context);
+    return !m_context->isDone();
+}
+
+void FiberGroup::fail(std::exception_ptr e) {
+    {
+        Mutex::Lock lock(m_mutex);
+        if (!m_error) {
+            m_error = std::move(e);
+        }
+    }
+    cancel();
+}
+
+} // namespace sylar
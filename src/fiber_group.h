@@ -0,0 +1,170 @@
+/**
+ * @file fiber_group.h
+ * @brief 结构化并发：WaitGroup与FiberGroup
+ * @details FiberGroup中派生的子协程的生命期不超过FiberGroup本身，
+ *          父请求放弃时(FiberGroup析构或者父协程上下文被取消)所有子协程一起被取消，不会留下泄漏的任务
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_FIBER_GROUP_H__
+#define __SYLAR_FIBER_GROUP_H__
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <type_traits>
+#include <utility>
+#include "fiber_context.h"
+#include "future.h"
+#include "mutex.h"
+#include "noncopyable.h"
+#include "scheduler.h"
+
+namespace sylar {
+
+/**
+ * @brief 等待一组任务完成的计数器，类似golang的sync.WaitGroup
+ * @details 计数只是一个原子变量，只有最后一个done()和wait()才加锁
+ */
+class WaitGroup : Noncopyable {
+public:
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 增加计数
+     */
+    void add(int64_t delta = 1) { m_count.fetch_add(delta, std::memory_order_relaxed); }
+
+    /**
+     * @brief 减少一个计数，减到0时唤醒所有等待者
+     */
+    void done();
+
+    /**
+     * @brief 等待计数减到0
+     * @details 在调度器的协程中只挂起协程，其他地方阻塞线程
+     */
+    void wait();
+
+    /**
+     * @brief 获取当前计数
+     */
+    int64_t count() const { return m_count.load(std::memory_order_acquire); }
+
+private:
+    /// 计数
+    std::atomic<int64_t> m_count{0};
+
+    /// 等待者
+    detail::FutureNode *m_waiters = nullptr;
+
+    /// Mutex
+    MutexType m_mutex;
+};
+
+/**
+ * @brief 子协程组(nursery)
+ * @details 通过spawn派生的子协程共享一个协程上下文，该上下文是创建FiberGroup时所在协程上下文的子上下文。
+ *          任意一个子协程抛出异常时记录第一个异常并取消整个上下文，其余子协程挂起中的hook调用立即返回ECANCELED，
+ *          还没开始执行的子协程直接跳过；wait()在所有子协程结束后重新抛出第一个异常。
+ *          析构时取消还没结束的子协程并等待它们结束
+ */
+class FiberGroup : Noncopyable {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] scheduler 运行子协程的调度器，默认为当前线程的调度器
+     */
+    FiberGroup(Scheduler *scheduler = nullptr);
+
+    /**
+     * @brief 析构函数，取消还没结束的子协程并等待它们结束，不抛出异常
+     */
+    ~FiberGroup();
+
+    /**
+     * @brief 派生一个子协程
+     * @details 子协程以回调任务的形式加入调度器，复用调度器的回调协程，不单独创建协程栈。
+     *          可调用对象和组指针一起直接放进调度任务的Callback中，不再套一层Callback，
+     *          可调用对象不超过48字节时派生不分配内存
+     */
+    template <class F>
+    void spawn(F &&f) {
+        m_wg.add(1);
+        m_scheduler->schedule(Child<typename std::decay<F>::type>{this, std::forward<F>(f)});
+    }
+
+    /**
+     * @brief 等待所有子协程结束
+     * @details 在调度器的协程中只挂起协程，不阻塞线程
+     * @exception 有子协程抛出异常时，重新抛出第一个异常
+     */
+    void wait();
+
+    /**
+     * @brief 取消所有子协程
+     */
+    void cancel(int err = ECANCELED) { m_context->cancel(err); }
+
+    /**
+     * @brief 获取子协程共享的上下文，子协程中的计算密集循环可以通过它判断是否已经被取消
+     */
+    const FiberContext::ptr &getContext() const { return m_context; }
+
+    /**
+     * @brief 获取还没结束的子协程数
+     */
+    int64_t count() const { return m_wg.count(); }
+
+private:
+    /**
+     * @brief 子协程入口
+     */
+    template <class F>
+    struct Child {
+        FiberGroup *group;
+        F fn;
+
+        void operator()() {
+            if (group->enter()) {
+                try {
+                    fn();
+                } catch (...) {
+                    group->fail(std::current_exception());
+                }
+            }
+            group->m_wg.done();
+        }
+    };
+
+    /**
+     * @brief 子协程开始执行，设置协程上下文
+     * @return 组已经被取消时返回false，还没开始执行的子协程直接跳过
+     */
+    bool enter();
+
+    /**
+     * @brief 子协程抛出异常，记录第一个异常并取消整个组
+     */
+    void fail(std::exception_ptr e);
+
+private:
+    /// 调度器
+    Scheduler *m_scheduler;
+
+    /// 子协程共享的上下文
+    FiberContext::ptr m_context;
+
+    /// 子协程计数
+    WaitGroup m_wg;
+
+    /// 第一个异常
+    std::exception_ptr m_error;
+
+    /// 保护m_error
+    Mutex m_mutex;
+};
+
+} // namespace sylar
+
+#endif
@@ -0,0 +1,85 @@
+/**
+ * @file fiber_local.h
+ * @brief 协程局部变量
+ * @details 协程可能在不同的调度线程之间迁移，thread_local变量在协程挂起前后可能属于不同的线程，
+ *          需要跟着协程走的状态应该放在协程局部变量里。
+ *          每个FiberLocal对象构造时分配一个全局唯一的key，值存放在每个协程自己的数组中，按key下标访问，O(1)。
+ *          协程结束、重置(回调协程被调度器复用)或析构时销毁该协程的所有值
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_FIBER_LOCAL_H__
+#define __SYLAR_FIBER_LOCAL_H__
+
+#include <utility>
+#include "fiber.h"
+#include "noncopyable.h"
+
+namespace sylar {
+
+/**
+ * @brief 协程局部变量
+ * @details 用法类似thread_local，一般定义成全局或静态对象：
+ *          static FiberLocal<std::string> s_request_id;
+ *          s_request_id.set("abc");  *s_request_id;  s_request_id.get();
+ *          不在协程中(比如线程入口函数)使用时，值存放在线程主协程上，相当于线程局部变量
+ * @attention key不回收，不要在运行期间反复创建FiberLocal对象
+ */
+template <class T>
+class FiberLocal : Noncopyable {
+public:
+    FiberLocal() : m_key(Fiber::AllocLocalKey()) {}
+
+    /**
+     * @brief 获取当前协程的值，没有设置过时返回nullptr
+     */
+    T *get() const { return static_cast<T *>(Fiber::GetLocal(m_key)); }
+
+    /**
+     * @brief 设置当前协程的值
+     */
+    template <class U>
+    void set(U &&v) const {
+        T *p = get();
+        if (p) {
+            *p = std::forward<U>(v);
+        } else {
+            Fiber::SetLocal(m_key, new T(std::forward<U>(v)), &FiberLocal::Destroy);
+        }
+    }
+
+    /**
+     * @brief 删除当前协程的值
+     */
+    void reset() const { Fiber::SetLocal(m_key, nullptr, nullptr); }
+
+    /**
+     * @brief 获取当前协程的值，没有设置过时先默认构造一个
+     */
+    T &operator*() const {
+        T *p = get();
+        if (!p) {
+            p = new T();
+            Fiber::SetLocal(m_key, p, &FiberLocal::Destroy);
+        }
+        return *p;
+    }
+
+    T *operator->() const { return &**this; }
+
+    /**
+     * @brief 获取key
+     */
+    size_t getKey() const { return m_key; }
+
+private:
+    static void Destroy(void *p) { delete static_cast<T *>(p); }
+
+private:
+    /// 协程局部变量数组的下标
+    size_t m_key;
+};
+
+} // namespace sylar
+
+#endif
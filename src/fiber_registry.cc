@@ -0,0 +1,276 @@
+/**
+ * @file fiber_registry.cc
+ * @brief 全局协程登记表实现
+ * @version 0.1
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "fiber_context.h"
+#include "fiber_registry.h"
+#include "iomanager.h"
+#include "mutex.h"
+#include "scheduler.h"
+#include "thread.h"
+#include "util.h"
+
+namespace sylar {
+
+namespace detail {
+std::atomic<bool> g_fiber_registry_enabled{false};
+} // namespace detail
+
+namespace {
+
+/// 分片数，按协程id取模，减少不同线程同时创建销毁协程时的锁竞争
+const size_t kShards = 16;
+
+/// 回溯的最大层数
+const int kMaxFrames = 32;
+
+/**
+ * @brief 一个分片：侵入式双向链表，节点是Fiber自己的m_registryPrev/m_registryNext
+ */
+struct Shard {
+    Spinlock mutex;
+    Fiber *head = nullptr;
+    char padding[64];
+};
+
+Shard s_shards[kShards];
+
+std::atomic<size_t> s_count{0};
+
+Shard &GetShard(uint64_t id) { return s_shards[id % kShards]; }
+
+/// 信号处理函数通知输出线程的管道
+int s_pipe[2] = {-1, -1};
+
+/// 信号触发的输出文件，为空时输出到stderr
+std::string s_dump_path;
+
+void OnSignal(int) {
+    //绕过hook，信号可能打断任意线程上的任意代码。写端非阻塞，输出线程来不及读、管道满时返回EAGAIN，
+    //管道里已经有字节在排队，输出线程总会再输出一次，丢掉这次即可
+    int saved = errno;
+    char c    = 0;
+    long rt   = syscall(SYS_write, s_pipe[1], &c, 1);
+    (void)rt;
+    errno = saved;
+}
+
+void DumpLoop() {
+    while (true) {
+        char c;
+        long rt = syscall(SYS_read, s_pipe[0], &c, 1);
+        if (rt < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rt <= 0) {
+            return;
+        }
+        if (s_dump_path.empty()) {
+            std::stringstream ss;
+            FiberRegistry::Dump(ss);
+            std::cerr << ss.str() << std::flush;
+        } else {
+            FiberRegistry::DumpToFile(s_dump_path);
+        }
+    }
+}
+
+const char *StateName(Fiber::State state) {
+    switch (state) {
+    case Fiber::READY:
+        return "READY";
+    case Fiber::RUNNING:
+        return "RUNNING";
+    case Fiber::TERM:
+        return "TERM";
+    }
+    return "UNKNOWN";
+}
+
+} // namespace
+
+void FiberRegistry::SetEnabled(bool v) {
+    detail::g_fiber_registry_enabled.store(v, std::memory_order_relaxed);
+}
+
+size_t FiberRegistry::Count() {
+    return s_count.load(std::memory_order_relaxed);
+}
+
+void FiberRegistry::Add(Fiber *fiber) {
+    fiber->m_startMS = GetElapsedMS();
+    Shard &shard     = GetShard(fiber->m_id);
+    Spinlock::Lock lock(shard.mutex);
+    fiber->m_registryPrev = nullptr;
+    fiber->m_registryNext = shard.head;
+    if (shard.head) {
+        shard.head->m_registryPrev = fiber;
+    }
+    shard.head          = fiber;
+    fiber->m_registered = true;
+    ++s_count;
+}
+
+void FiberRegistry::Remove(Fiber *fiber) {
+    Shard &shard = GetShard(fiber->m_id);
+    Spinlock::Lock lock(shard.mutex);
+    if (fiber->m_registryPrev) {
+        fiber->m_registryPrev->m_registryNext = fiber->m_registryNext;
+    } else {
+        shard.head = fiber->m_registryNext;
+    }
+    if (fiber->m_registryNext) {
+        fiber->m_registryNext->m_registryPrev = fiber->m_registryPrev;
+    }
+    fiber->m_registryPrev = fiber->m_registryNext = nullptr;
+    fiber->m_registered   = false;
+    --s_count;
+}
+
+void FiberRegistry::ForgetScheduler(Scheduler *scheduler) {
+    for (auto &shard : s_shards) {
+        Spinlock::Lock lock(shard.mutex);
+        for (Fiber *f = shard.head; f; f = f->m_registryNext) {
+            if (f->m_scheduler == scheduler) {
+                f->m_scheduler = nullptr;
+            }
+        }
+    }
+}
+
+void FiberRegistry::Collect(std::vector<FiberInfo> &fibers, bool backtrace) {
+    fibers.clear();
+    //分片锁内只拷贝字段和返回地址，解析函数名放到锁外
+    std::vector<std::vector<void *>> frames;
+    uint64_t now = GetElapsedMS();
+    for (auto &shard : s_shards) {
+        Spinlock::Lock lock(shard.mutex);
+        for (Fiber *f = shard.head; f; f = f->m_registryNext) {
+            FiberInfo info;
+            info.id      = f->m_id;
+            info.tag     = f->m_tag ? f->m_tag : "";
+            info.state   = f->m_state;
+            info.started = f->m_started;
+            info.age_ms  = now > f->m_startMS ? now - f->m_startMS : 0;
+            if (f->m_scheduler) {
+                info.scheduler = f->m_scheduler->getName();
+            }
+            {
+                //等待者在挂起协程的栈上，协程被唤醒后先在这个锁内删除登记，再返回
+                Mutex::Lock lock2(f->m_waitMutex);
+                if (f->m_waiter) {
+                    std::stringstream ss;
+                    if (f->m_waiter->fd >= 0) {
+                        ss << "io fd=" << f->m_waiter->fd
+                           << (f->m_waiter->event == IOManager::READ ? " read" : " write");
+                    } else {
+                        ss << "timer";
+                    }
+                    info.wait = ss.str();
+                }
+            }
+            const char *reason = f->m_waitReason.load(std::memory_order_relaxed);
+            if (info.wait.empty() && reason) {
+                info.wait = reason;
+            }
+
+            frames.emplace_back();
+#if defined(__x86_64__)
+            //切出时swapcontext把返回地址和rbp保存在m_ctx中，沿rbp链回溯，只读本协程栈以内的内存
+            if (backtrace && info.started && info.state == Fiber::READY) {
+                std::vector<void *> &addrs = frames.back();
+                const greg_t *regs         = f->m_ctx.uc_mcontext.gregs;
+                uintptr_t lo               = (uintptr_t)f->m_stack;
+                uintptr_t hi               = lo + f->m_stacksize;
+                addrs.push_back((void *)regs[REG_RIP]);
+                uintptr_t fp = regs[REG_RBP];
+                while ((int)addrs.size() < kMaxFrames && fp >= lo && fp + 2 * sizeof(uintptr_t) <= hi &&
+                       fp % sizeof(uintptr_t) == 0) {
+                    uintptr_t *frame = (uintptr_t *)fp;
+                    if (!frame[1]) {
+                        break;
+                    }
+                    addrs.push_back((void *)frame[1]);
+                    if (frame[0] <= fp) {
+                        break;
+                    }
+                    fp = frame[0];
+                }
+            }
+#endif
+            fibers.push_back(std::move(info));
+        }
+    }
+    for (size_t i = 0; i < fibers.size(); ++i) {
+        if (!frames[i].empty()) {
+            BacktraceSymbols(frames[i].data(), frames[i].size(), fibers[i].backtrace);
+        }
+    }
+    std::sort(fibers.begin(), fibers.end(), [](const FiberInfo &a, const FiberInfo &b) { return a.id < b.id; });
+}
+
+void FiberRegistry::Dump(std::ostream &os, bool backtrace) {
+    std::vector<FiberInfo> fibers;
+    Collect(fibers, backtrace);
+    os << "fibers: " << fibers.size() << " (total " << Fiber::TotalFibers() << ")" << std::endl;
+    for (auto &i : fibers) {
+        os << "fiber " << i.id;
+        if (!i.tag.empty()) {
+            os << " [" << i.tag << "]";
+        }
+        os << " state=" << (i.started ? StateName(i.state) : "NEW");
+        if (!i.scheduler.empty()) {
+            os << " scheduler=" << i.scheduler;
+        }
+        if (!i.wait.empty()) {
+            os << " wait=" << i.wait;
+        }
+        os << " age=" << i.age_ms << "ms" << std::endl;
+        for (auto &frame : i.backtrace) {
+            os << "    " << frame << std::endl;
+        }
+    }
+}
+
+bool FiberRegistry::DumpToFile(const std::string &path, bool backtrace) {
+    std::ofstream ofs(path, std::ios::app);
+    if (!ofs) {
+        return false;
+    }
+    Dump(ofs, backtrace);
+    return (bool)ofs;
+}
+
+bool FiberRegistry::InstallSignalHandler(int signo, const std::string &path) {
+    if (s_pipe[0] >= 0 || pipe2(s_pipe, O_CLOEXEC) != 0) {
+        return false;
+    }
+    //只有写端非阻塞，信号处理函数不会阻塞在满的管道上，输出线程仍然阻塞读
+    long rt = syscall(SYS_fcntl, s_pipe[1], F_SETFL, O_NONBLOCK);
+    assert(rt == 0);
+    (void)rt;
+    s_dump_path = path;
+    //输出线程一直运行到进程退出，Thread析构时会detach
+    Thread thread(&DumpLoop, "fiber_dump");
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &OnSignal;
+    sa.sa_flags   = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    return sigaction(signo, &sa, nullptr) == 0;
+}
+
+} // namespace sylar
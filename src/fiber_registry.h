@@ -0,0 +1,122 @@
+/**
+ * @file fiber_registry.h
+ * @brief 全局协程登记表，列出所有协程的状态、等待原因和调用栈
+ * @details 打开后，新创建的协程(有独立栈的协程，不包括线程主协程)登记到按协程id分片的侵入式链表中，析构时删除；
+ *          关闭只影响之后创建的协程，已经登记的协程仍然保留到析构。Dump逐个分片加锁抓取快照，不暂停任何线程：
+ *          id、tag、状态、最近一次运行它的调度器、等待原因(fd和事件、定时器、join、future、WaitGroup)、
+ *          创建(或重置)至今的时间，以及挂起的协程在切出时保存的上下文中沿帧指针回溯出的调用栈。
+ *          需要-fno-omit-frame-pointer编译才有完整的调用栈，否则通常只有切出点一帧；加上-rdynamic才能解析出函数名。
+ *          服务卡住时可以用信号触发：
+ *          sylar::FiberRegistry::SetEnabled(true);
+ *          sylar::FiberRegistry::InstallSignalHandler(SIGUSR2, "/tmp/fibers.txt");
+ *          kill -USR2 <pid>
+ *          快照是尽力而为的：读取其他线程上协程的状态不加协程自己的锁，协程可能在抓取过程中被切换，
+ *          回溯只读协程栈范围以内的内存，不会访问越界，但正在运行的协程的调用栈可能不准确
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_FIBER_REGISTRY_H__
+#define __SYLAR_FIBER_REGISTRY_H__
+
+#include <signal.h>
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "fiber.h"
+#include "macro.h"
+
+namespace sylar {
+
+namespace detail {
+/// 登记开关，放在头文件中让协程构造函数内联判断
+extern std::atomic<bool> g_fiber_registry_enabled;
+} // namespace detail
+
+class Scheduler;
+
+/**
+ * @brief 全局协程登记表
+ */
+class FiberRegistry {
+public:
+    /**
+     * @brief 一个协程的快照
+     */
+    struct FiberInfo {
+        uint64_t id = 0;
+        std::string tag;
+        Fiber::State state = Fiber::READY;
+        /// 协程还没有运行过
+        bool started = false;
+        /// 最近一次运行该协程的调度器名称，没有时为空
+        std::string scheduler;
+        /// 等待原因，比如"io fd=5 read"、"timer"、"join"，没有在等待时为空
+        std::string wait;
+        /// 创建(或重置)至今的毫秒数
+        uint64_t age_ms = 0;
+        /// 挂起的协程的调用栈，从切出点开始
+        std::vector<std::string> backtrace;
+    };
+
+    /**
+     * @brief 打开或关闭登记，默认关闭
+     */
+    static void SetEnabled(bool v);
+
+    /**
+     * @brief 是否打开了登记
+     */
+    static bool IsEnabled() { return detail::g_fiber_registry_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 当前登记的协程数
+     */
+    static size_t Count();
+
+    /**
+     * @brief 抓取所有登记的协程的快照，按id排序
+     * @param[in] backtrace 是否回溯挂起协程的调用栈
+     */
+    static void Collect(std::vector<FiberInfo> &fibers, bool backtrace = true);
+
+    /**
+     * @brief 以文本格式输出所有登记的协程
+     */
+    static void Dump(std::ostream &os, bool backtrace = true);
+
+    /**
+     * @brief 输出到文件，追加写入
+     */
+    static bool DumpToFile(const std::string &path, bool backtrace = true);
+
+    /**
+     * @brief 安装信号处理函数，收到信号时输出所有登记的协程
+     * @details 信号处理函数只向管道写一个字节，由一个专门的线程完成抓取和输出，不在信号上下文中加锁或分配内存。
+     *          只能安装一次
+     * @param[in] signo 信号，默认SIGUSR2
+     * @param[in] path 输出文件，追加写入，为空时输出到stderr
+     * @return 已经安装过或者创建管道失败时返回false
+     */
+    static bool InstallSignalHandler(int signo = SIGUSR2, const std::string &path = "");
+
+    /**
+     * @brief 登记协程，由协程构造函数调用
+     */
+    static void Add(Fiber *fiber);
+
+    /**
+     * @brief 删除登记，由协程析构函数调用，返回之后不会再有Dump访问该协程
+     */
+    static void Remove(Fiber *fiber);
+
+    /**
+     * @brief 调度器析构时清除登记的协程上指向它的指针
+     */
+    static void ForgetScheduler(Scheduler *scheduler);
+};
+
+} // namespace sylar
+
+#endif
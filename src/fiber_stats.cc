@@ -0,0 +1,167 @@
+/**
+ * @file fiber_stats.cc
+ * @brief 协程CPU时间与挂起时间统计实现
+ * @version 0.1
+ */
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+#include "fiber_stats.h"
+#include "thread_stats.h"
+
+namespace sylar {
+
+namespace detail {
+std::atomic<bool> g_fiber_stats_enabled{false};
+} // namespace detail
+
+namespace {
+
+/**
+ * @brief 一个类别在一个线程内的累加值，时间单位为tsc周期
+ */
+struct Acc {
+    std::atomic<uint64_t> fibers{0};
+    std::atomic<uint64_t> resumes{0};
+    std::atomic<uint64_t> cpu_ticks{0};
+    std::atomic<uint64_t> io_ticks{0};
+    std::atomic<uint64_t> timer_ticks{0};
+};
+
+typedef detail::TagStatsMap<Acc> ThreadStats;
+
+detail::ThreadStatsRegistry<ThreadStats> &Stats() {
+    static detail::ThreadStatsRegistry<ThreadStats> s_stats;
+    return s_stats;
+}
+
+/// 每纳秒的tsc周期数，0表示还没有校准
+std::atomic<double> s_ticks_per_ns{0};
+
+uint64_t MonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief 忙等5ms，对照CLOCK_MONOTONIC得出tsc的频率，只在第一次打开统计时做一次
+ */
+void Calibrate() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (s_ticks_per_ns.load() != 0) {
+        return;
+    }
+    uint64_t ns0  = MonotonicNs();
+    uint64_t tsc0 = FiberStats::Ticks();
+    uint64_t ns1  = ns0;
+    while (ns1 - ns0 < 5 * 1000 * 1000) {
+        ns1 = MonotonicNs();
+    }
+    uint64_t tsc1 = FiberStats::Ticks();
+    s_ticks_per_ns = (double)(tsc1 - tsc0) / (ns1 - ns0);
+#else
+    s_ticks_per_ns = 1;
+#endif
+}
+
+} // namespace
+
+void FiberStats::SetEnabled(bool v) {
+    if (v) {
+        Calibrate();
+    }
+    detail::g_fiber_stats_enabled.store(v, std::memory_order_relaxed);
+}
+
+uint64_t FiberStats::TicksToNs(uint64_t ticks) {
+    double ratio = s_ticks_per_ns.load(std::memory_order_relaxed);
+    return ratio > 0 ? (uint64_t)(ticks / ratio) : 0;
+}
+
+void FiberStats::RecordRun(const char *tag, uint64_t ticks) {
+    Acc *acc = detail::GetTagAcc(Stats(), tag);
+    if (acc) {
+        detail::AddRelaxed(acc->resumes);
+        detail::AddRelaxed(acc->cpu_ticks, ticks);
+    }
+}
+
+void FiberStats::RecordWait(const char *tag, WaitType type, uint64_t ticks) {
+    Acc *acc = detail::GetTagAcc(Stats(), tag);
+    if (acc) {
+        detail::AddRelaxed(type == WAIT_IO ? acc->io_ticks : acc->timer_ticks, ticks);
+    }
+}
+
+void FiberStats::RecordCreate(const char *tag) {
+    Acc *acc = detail::GetTagAcc(Stats(), tag);
+    if (acc) {
+        detail::AddRelaxed(acc->fibers);
+    }
+}
+
+void FiberStats::Collect(std::vector<TagStats> &out) {
+    std::map<std::string, TagStats> merged;
+    Stats().forEach([&merged](ThreadStats &stats) {
+        Spinlock::Lock lock(stats.mutex);
+        for (auto &i : stats.tags) {
+            TagStats &m = merged[detail::TagName(i.first)];
+            m.fibers += i.second.fibers.load(std::memory_order_relaxed);
+            m.resumes += i.second.resumes.load(std::memory_order_relaxed);
+            m.cpu_ns += i.second.cpu_ticks.load(std::memory_order_relaxed);
+            m.io_wait_ns += i.second.io_ticks.load(std::memory_order_relaxed);
+            m.timer_wait_ns += i.second.timer_ticks.load(std::memory_order_relaxed);
+        }
+    });
+    //累加时还是tsc周期，这里换算成纳秒
+    out.clear();
+    for (auto &i : merged) {
+        TagStats stats      = i.second;
+        stats.tag           = i.first;
+        stats.cpu_ns        = TicksToNs(stats.cpu_ns);
+        stats.io_wait_ns    = TicksToNs(stats.io_wait_ns);
+        stats.timer_wait_ns = TicksToNs(stats.timer_wait_ns);
+        out.push_back(stats);
+    }
+    std::stable_sort(out.begin(), out.end(),
+                     [](const TagStats &a, const TagStats &b) { return a.cpu_ns > b.cpu_ns; });
+}
+
+void FiberStats::Dump(std::ostream &os, size_t top_n) {
+    std::vector<TagStats> stats;
+    Collect(stats);
+    uint64_t total = 0;
+    for (auto &i : stats) {
+        total += i.cpu_ns;
+    }
+    os << std::left << std::setw(24) << "tag" << std::right << std::setw(10) << "fibers" << std::setw(12)
+       << "resumes" << std::setw(12) << "cpu(ms)" << std::setw(8) << "cpu%" << std::setw(14) << "us/resume"
+       << std::setw(14) << "io wait(ms)" << std::setw(16) << "timer wait(ms)" << std::endl;
+    os << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < stats.size() && i < top_n; ++i) {
+        const TagStats &s = stats[i];
+        os << std::left << std::setw(24) << s.tag << std::right << std::setw(10) << s.fibers << std::setw(12)
+           << s.resumes << std::setw(12) << s.cpu_ns / 1e6 << std::setw(8) << std::setprecision(1)
+           << (total ? s.cpu_ns * 100.0 / total : 0) << std::setprecision(3) << std::setw(14)
+           << (s.resumes ? s.cpu_ns / 1e3 / s.resumes : 0) << std::setw(14) << s.io_wait_ns / 1e6
+           << std::setw(16) << s.timer_wait_ns / 1e6 << std::endl;
+    }
+    os << std::defaultfloat;
+}
+
+void FiberStats::Reset() {
+    Stats().forEach([](ThreadStats &stats) {
+        Spinlock::Lock lock(stats.mutex);
+        for (auto &i : stats.tags) {
+            i.second.fibers      = 0;
+            i.second.resumes     = 0;
+            i.second.cpu_ticks   = 0;
+            i.second.io_ticks    = 0;
+            i.second.timer_ticks = 0;
+        }
+    });
+}
+
+} // namespace sylar
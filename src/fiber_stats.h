@@ -0,0 +1,130 @@
+/**
+ * @file fiber_stats.h
+ * @brief 协程CPU时间与挂起时间统计
+ * @details 打开后，每个协程记录自己被resume的次数、在CPU上运行的总时间(从resume/call/switchTo到yield)，
+ *          以及在hook的IO调用中等待fd就绪、在sleep系列调用中等待定时器的挂起时间。
+ *          同样的数据按协程的类别(创建协程时传入的tag)在每个线程内累加，汇总后给出最耗CPU的若干类协程。
+ *          计时用rdtsc(非x86平台用CLOCK_MONOTONIC)，每次切换只多两次读时间戳和几次本线程独占的累加，不加锁；
+ *          tsc与纳秒的换算比例在打开统计时和汇总时各取一次样本得出。
+ *          运行时间是挂钟时间：线程被内核抢占、或者协程调用了没有被hook的阻塞函数时，这段时间也算在协程头上
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_FIBER_STATS_H__
+#define __SYLAR_FIBER_STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+#include <time.h>
+#include "macro.h"
+
+namespace sylar {
+
+namespace detail {
+/// 统计开关，放在头文件中让切换路径内联判断
+extern std::atomic<bool> g_fiber_stats_enabled;
+} // namespace detail
+
+/**
+ * @brief 协程CPU时间与挂起时间统计
+ */
+class FiberStats {
+public:
+    /**
+     * @brief 挂起的原因
+     */
+    enum WaitType {
+        /// hook的IO调用等待fd就绪
+        WAIT_IO,
+        /// sleep系列调用等待定时器
+        WAIT_TIMER
+    };
+
+    /**
+     * @brief 一个类别的汇总，时间单位纳秒
+     */
+    struct TagStats {
+        std::string tag;
+        /// 创建的协程数，复用的协程每次重置再计一次
+        uint64_t fibers = 0;
+        /// resume次数
+        uint64_t resumes = 0;
+        uint64_t cpu_ns = 0;
+        uint64_t io_wait_ns = 0;
+        uint64_t timer_wait_ns = 0;
+    };
+
+    /**
+     * @brief 打开或关闭统计，默认关闭
+     */
+    static void SetEnabled(bool v);
+
+    /**
+     * @brief 是否打开了统计
+     */
+    static bool IsEnabled() { return detail::g_fiber_stats_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 当前时间戳，单位是tsc周期(非x86平台为纳秒)
+     */
+    static uint64_t Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+        return __builtin_ia32_rdtsc();
+#else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+    }
+
+    /**
+     * @brief 打开了统计时返回当前时间戳，否则返回0
+     */
+    static uint64_t Begin() { return SYLAR_UNLIKELY(IsEnabled()) ? Ticks() : 0; }
+
+    /**
+     * @brief 时间戳差值换算成纳秒
+     */
+    static uint64_t TicksToNs(uint64_t ticks);
+
+    /**
+     * @brief 记录协程的一次运行
+     * @param[in] tag 协程类别
+     * @param[in] ticks 运行的时间戳差值
+     */
+    static void RecordRun(const char *tag, uint64_t ticks);
+
+    /**
+     * @brief 记录协程的一次挂起
+     */
+    static void RecordWait(const char *tag, WaitType type, uint64_t ticks);
+
+    /**
+     * @brief 记录创建(或重置复用)了一个协程
+     */
+    static void RecordCreate(const char *tag);
+
+    /**
+     * @brief 汇总所有线程的统计，按CPU时间从大到小排序
+     */
+    static void Collect(std::vector<TagStats> &stats);
+
+    /**
+     * @brief 输出CPU时间最多的top_n个类别
+     */
+    static void Dump(std::ostream &os, size_t top_n = 10);
+
+    /**
+     * @brief 清空所有统计
+     * @details 与正在进行的记录并发时，个别累加值可能没有被清零
+     */
+    static void Reset();
+};
+
+} // namespace sylar
+
+#endif
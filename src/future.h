@@ -0,0 +1,504 @@
+/**
+ * @file future.h
+ * @brief Future/Promise以及when_all/when_any组合等待
+ * @details 在调度器的协程中等待结果时只挂起协程，结果就绪时再把协程重新加入调度，不阻塞线程；
+ *          在其他地方(比如线程主协程)等待时才退化为用信号量阻塞线程。
+ *          Promise与Future共享同一个状态对象，通过make_shared一次分配，等待者节点由等待方在自己的栈上提供，不额外分配内存。
+ *          最后一个Promise销毁时还没有设置结果，结果为std::future_error(std::future_errc::broken_promise)异常
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_FUTURE_H__
+#define __SYLAR_FUTURE_H__
+
+#include <atomic>
+#include <cassert>
+#include <exception>
+#include <future>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+#include "fiber.h"
+#include "mutex.h"
+#include "scheduler.h"
+
+namespace sylar {
+
+template <class T>
+class Future;
+
+template <class T>
+class Promise;
+
+namespace detail {
+
+/**
+ * @brief 等待结果的节点，挂在共享状态的侵入式链表上
+ */
+struct FutureNode {
+    /// 链表中的下一个节点
+    FutureNode *next = nullptr;
+
+    /// 结果就绪时的通知函数，调用之后节点可能已经被等待方销毁
+    void (*notify)(FutureNode *node) = nullptr;
+};
+
+/**
+ * @brief 挂起等待的协程或线程
+ */
+struct FutureParker : public FutureNode {
+    Scheduler *scheduler = nullptr;
+    Fiber::ptr fiber;
+    Semaphore sem;
+
+    FutureParker() {
+        notify = &FutureParker::Notify;
+        if (Fiber::InScheduler()) {
+            scheduler = Scheduler::GetThis();
+            fiber     = Fiber::GetThis();
+        }
+    }
+
+    /**
+     * @brief 挂起，直到Notify被调用
+     * @param[in] reason 挂起原因，见Fiber::setWaitReason
+     */
+    void park(const char *reason = "future") {
+        if (fiber) {
+            fiber->setWaitReason(reason);
+            fiber->yield();
+            fiber->setWaitReason(nullptr);
+        } else {
+            sem.wait();
+        }
+    }
+
+    static void Notify(FutureNode *node) {
+        FutureParker *parker = static_cast<FutureParker *>(node);
+        if (parker->fiber) {
+            //先拷贝出来再调度，协程被调度之后随时可能返回并销毁parker
+            Scheduler *scheduler = parker->scheduler;
+            Fiber::ptr fiber     = parker->fiber;
+            scheduler->schedule(fiber);
+        } else {
+            parker->sem.notify();
+        }
+    }
+};
+
+/**
+ * @brief 共享状态中与结果类型无关的部分
+ */
+class FutureStateBase : Noncopyable {
+public:
+    typedef Mutex MutexType;
+
+    /**
+     * @brief 结果(值或异常)是否已经就绪
+     */
+    bool isReady() const { return m_ready.load(std::memory_order_acquire); }
+
+    /**
+     * @brief 登记等待者节点
+     * @return 结果已经就绪时返回false，此时不登记
+     */
+    bool addNode(FutureNode *node) {
+        MutexType::Lock lock(m_mutex);
+        if (m_ready) {
+            return false;
+        }
+        node->next = m_nodes;
+        m_nodes    = node;
+        return true;
+    }
+
+    /**
+     * @brief 删除还没有被通知的等待者节点
+     * @return 节点已经被摘下(即将或已经被通知)时返回false
+     */
+    bool delNode(FutureNode *node) {
+        MutexType::Lock lock(m_mutex);
+        for (FutureNode **it = &m_nodes; *it; it = &(*it)->next) {
+            if (*it == node) {
+                *it = node->next;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief 挂起当前协程(或线程)直到结果就绪
+     */
+    void wait() {
+        if (isReady()) {
+            return;
+        }
+        FutureParker parker;
+        if (addNode(&parker)) {
+            parker.park();
+        }
+    }
+
+    /**
+     * @brief 增加一个写入端(Promise)
+     */
+    void addPromise() { m_promises.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief 减少一个写入端
+     * @return 是否是最后一个写入端
+     */
+    bool releasePromise() { return m_promises.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+    /// 异常结果
+    std::exception_ptr exception;
+
+protected:
+    /**
+     * @brief 标记结果就绪并摘下所有等待者节点，调用者持有锁且已经写好了结果
+     */
+    FutureNode *readyNoLock() {
+        assert(!m_ready);
+        m_ready.store(true, std::memory_order_release);
+        FutureNode *nodes = m_nodes;
+        m_nodes           = nullptr;
+        return nodes;
+    }
+
+    /**
+     * @brief 在锁外通知所有等待者
+     */
+    static void NotifyAll(FutureNode *nodes) {
+        while (nodes) {
+            //先取next，notify之后节点可能已经被销毁
+            FutureNode *next = nodes->next;
+            nodes->notify(nodes);
+            nodes = next;
+        }
+    }
+
+protected:
+    MutexType m_mutex;
+    std::atomic<bool> m_ready{false};
+    FutureNode *m_nodes = nullptr;
+    /// 写入端个数
+    std::atomic<size_t> m_promises{0};
+};
+
+/**
+ * @brief 结果存储，值直接放在共享状态里，不单独分配
+ */
+template <class T>
+struct FutureStorage {
+    typedef const T &result_type;
+
+    FutureStorage() {}
+    ~FutureStorage() {
+        if (has_value) {
+            value.~T();
+        }
+    }
+
+    template <class U>
+    void set(U &&v) {
+        new (&value) T(std::forward<U>(v));
+        has_value = true;
+    }
+
+    result_type get() const { return value; }
+
+    union {
+        T value;
+    };
+    bool has_value = false;
+};
+
+template <>
+struct FutureStorage<void> {
+    typedef void result_type;
+
+    void set() {}
+    void get() const {}
+};
+
+/**
+ * @brief Promise与Future的共享状态
+ */
+template <class T>
+class FutureState : public FutureStateBase, public FutureStorage<T> {
+public:
+    template <class... Args>
+    void setValue(Args &&...args) {
+        FutureNode *nodes = nullptr;
+        {
+            MutexType::Lock lock(m_mutex);
+            this->set(std::forward<Args>(args)...);
+            nodes = readyNoLock();
+        }
+        NotifyAll(nodes);
+    }
+
+    void setException(std::exception_ptr e) {
+        FutureNode *nodes = nullptr;
+        {
+            MutexType::Lock lock(m_mutex);
+            exception = e;
+            nodes     = readyNoLock();
+        }
+        NotifyAll(nodes);
+    }
+
+    /**
+     * @brief 最后一个写入端销毁时调用，还没有结果时设置broken_promise异常
+     */
+    void setBroken() {
+        FutureNode *nodes = nullptr;
+        {
+            MutexType::Lock lock(m_mutex);
+            if (m_ready) {
+                return;
+            }
+            exception = std::make_exception_ptr(std::future_error(std::future_errc::broken_promise));
+            nodes     = readyNoLock();
+        }
+        NotifyAll(nodes);
+    }
+};
+
+/**
+ * @brief when_all/when_any挂在每个Future上的节点，共享同一个MultiParker
+ */
+struct MultiParker;
+
+struct MultiNode : public FutureNode {
+    MultiParker *owner = nullptr;
+    size_t index       = 0;
+};
+
+struct MultiParker {
+    FutureParker parker;
+
+    /// when_all: 还没有就绪的个数；when_any: 还会访问MultiParker的节点数加上等待方自己。减到0的负责唤醒
+    std::atomic<size_t> remaining{0};
+
+    /// when_any: 已经被通知的节点个数，第一个节点负责唤醒
+    std::atomic<size_t> fired{0};
+
+    /// when_any: 第一个就绪的下标
+    size_t index = 0;
+
+    static void NotifyAll(FutureNode *node) {
+        MultiParker *owner = static_cast<MultiNode *>(node)->owner;
+        if (--owner->remaining == 0) {
+            FutureParker::Notify(&owner->parker);
+        }
+    }
+
+    static void NotifyAny(FutureNode *node) {
+        MultiNode *n       = static_cast<MultiNode *>(node);
+        MultiParker *owner = n->owner;
+        //第一个节点唤醒等待方；remaining减到0之前等待方不会返回，owner一直有效
+        if (owner->fired++ == 0) {
+            owner->index = n->index;
+            FutureParker::Notify(&owner->parker);
+        }
+        //最后一个引用owner的节点再唤醒一次等待方，之后不能再访问owner
+        if (--owner->remaining == 0) {
+            FutureParker::Notify(&owner->parker);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief 异步结果的读取端
+ * @details 可以拷贝，拷贝之间共享同一个结果，get()可以重复调用
+ */
+template <class T>
+class Future {
+public:
+    typedef detail::FutureState<T> State;
+    typedef typename detail::FutureStorage<T>::result_type result_type;
+
+    Future() {}
+
+    /**
+     * @brief 是否关联了共享状态
+     */
+    bool valid() const { return (bool)m_state; }
+
+    /**
+     * @brief 结果是否已经就绪
+     */
+    bool isReady() const { return m_state->isReady(); }
+
+    /**
+     * @brief 等待结果就绪，调度器协程中只挂起协程
+     */
+    void wait() const { m_state->wait(); }
+
+    /**
+     * @brief 等待并获取结果，结果为异常时重新抛出该异常
+     */
+    result_type get() const {
+        m_state->wait();
+        if (m_state->exception) {
+            std::rethrow_exception(m_state->exception);
+        }
+        return m_state->get();
+    }
+
+    /**
+     * @brief 获取共享状态，供when_all/when_any使用
+     */
+    State *state() const { return m_state.get(); }
+
+private:
+    friend class Promise<T>;
+
+    explicit Future(const std::shared_ptr<State> &state)
+        : m_state(state) {}
+
+private:
+    std::shared_ptr<State> m_state;
+};
+
+/**
+ * @brief 异步结果的写入端
+ * @details 只是共享状态的句柄，可以拷贝，方便按值捕获进回调；结果只能设置一次。
+ *          共享状态记录写入端个数，最后一个Promise销毁时还没有设置结果，就设置broken_promise异常，等待者不会永远挂起
+ */
+template <class T>
+class Promise {
+public:
+    typedef detail::FutureState<T> State;
+
+    /**
+     * @brief 构造函数，共享状态在这里一次分配
+     */
+    Promise()
+        : m_state(std::make_shared<State>()) {
+        m_state->addPromise();
+    }
+
+    Promise(const Promise &rhs)
+        : m_state(rhs.m_state) {
+        if (m_state) {
+            m_state->addPromise();
+        }
+    }
+
+    Promise(Promise &&rhs)
+        : m_state(std::move(rhs.m_state)) {}
+
+    Promise &operator=(Promise rhs) {
+        std::swap(m_state, rhs.m_state);
+        return *this;
+    }
+
+    ~Promise() {
+        if (m_state && m_state->releasePromise()) {
+            m_state->setBroken();
+        }
+    }
+
+    /**
+     * @brief 获取对应的Future
+     */
+    Future<T> getFuture() const { return Future<T>(m_state); }
+
+    /**
+     * @brief 设置结果并唤醒所有等待者，Promise<void>不带参数
+     */
+    template <class... Args>
+    void setValue(Args &&...args) const {
+        m_state->setValue(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief 设置异常结果并唤醒所有等待者
+     */
+    void setException(std::exception_ptr e) const {
+        m_state->setException(e);
+    }
+
+private:
+    std::shared_ptr<State> m_state;
+};
+
+/**
+ * @brief 等待所有Future就绪
+ * @details 所有Future共用一个等待者，只在最后一个结果就绪时唤醒一次；结果通过各个Future的get()读取
+ */
+template <class T>
+void when_all(const std::vector<Future<T> > &futures) {
+    detail::MultiParker waiter;
+    std::vector<detail::MultiNode> nodes(futures.size());
+    //多算一个，保证登记完所有节点之前不会被唤醒
+    waiter.remaining = futures.size() + 1;
+    for (size_t i = 0; i < futures.size(); ++i) {
+        nodes[i].notify = &detail::MultiParker::NotifyAll;
+        nodes[i].owner  = &waiter;
+        if (!futures[i].state()->addNode(&nodes[i])) {
+            --waiter.remaining;
+        }
+    }
+    if (--waiter.remaining != 0) {
+        waiter.parker.park();
+    }
+}
+
+/**
+ * @brief 等待任意一个Future就绪
+ * @return 第一个就绪的Future的下标
+ * @attention futures不能为空
+ */
+template <class T>
+size_t when_any(const std::vector<Future<T> > &futures) {
+    assert(!futures.empty());
+    detail::MultiParker waiter;
+    std::vector<detail::MultiNode> nodes(futures.size());
+    //每个节点一个引用，再加上等待方自己的一个，保证登记完之前不会被第二次唤醒
+    waiter.remaining = futures.size() + 1;
+
+    size_t added = 0;
+    for (; added < futures.size(); ++added) {
+        nodes[added].notify = &detail::MultiParker::NotifyAny;
+        nodes[added].owner  = &waiter;
+        nodes[added].index  = added;
+        if (!futures[added].state()->addNode(&nodes[added])) {
+            break;
+        }
+    }
+
+    if (added < futures.size()) {
+        //登记过程中发现已经有就绪的，和已登记节点的通知抢第一个，抢输了说明已经被唤醒过，要挂起一次把这次唤醒消耗掉
+        if (waiter.fired++ == 0) {
+            waiter.index = added;
+        } else {
+            waiter.parker.park();
+        }
+    } else {
+        waiter.parker.park();
+    }
+
+    //删除还没有被通知的节点，连同没有登记的节点和自己的引用一起减掉；
+    //已经被摘下的节点正在或即将被通知，由最后一个通知完的节点唤醒，之后节点才能销毁
+    size_t released = futures.size() - added + 1;
+    for (size_t i = 0; i < added; ++i) {
+        if (futures[i].state()->delNode(&nodes[i])) {
+            ++released;
+        }
+    }
+    if (waiter.remaining.fetch_sub(released) != released) {
+        waiter.parker.park();
+    }
+    return waiter.index;
+}
+
+} // namespace sylar
+
+#endif
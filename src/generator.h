@@ -0,0 +1,274 @@
+/**
+ * @file generator.h
+ * @brief 基于协程的生成器
+ * @details 流式解析、分页扫描这类逻辑可以写成一个顺序执行的函数，每产生一个元素调用一次yield_value，
+ *          调用方用range-for逐个取元素，不用拆成回调：
+ *          sylar::Generator<Row> scan([](sylar::Generator<Row>::Yielder &co) {
+ *              for (...) { Row row = ...; co.yield_value(row); }
+ *          });
+ *          for (auto &row : scan) { ... }
+ *          生成器运行在一个不参与调度器调度的协程中，由调用方通过Fiber::call()驱动，每个元素的开销是一来一回两次上下文切换。
+ *          yield_value只传递元素的地址，不拷贝元素；协程和协程栈在线程内缓存复用，创建大量生成器时不反复分配栈
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_GENERATOR_H__
+#define __SYLAR_GENERATOR_H__
+
+#include <cassert>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "fiber.h"
+#include "hook.h"
+
+namespace sylar {
+
+namespace detail {
+
+/**
+ * @brief 生成器协程池，每个线程缓存若干个已结束的默认栈大小的协程，新的生成器reset复用
+ */
+class GeneratorFiberPool {
+public:
+    /// 每个线程最多缓存的协程数
+    static const size_t kMaxSize = 16;
+
+    static Fiber::ptr Acquire(Callback cb) {
+        std::vector<Fiber::ptr> &pool = Pool();
+        if (pool.empty()) {
+            return Fiber::ptr(new Fiber(std::move(cb), 0, false, "generator"));
+        }
+        Fiber::ptr fiber = std::move(pool.back());
+        pool.pop_back();
+        fiber->reset(std::move(cb));
+        return fiber;
+    }
+
+    /**
+     * @brief 归还协程，只有已结束或者从没执行过、且没有其他引用的协程才会被缓存
+     */
+    static void Release(Fiber::ptr &fiber) {
+        std::vector<Fiber::ptr> &pool = Pool();
+        if (fiber.use_count() == 1 && fiber->getState() != Fiber::RUNNING && pool.size() < kMaxSize) {
+            pool.push_back(std::move(fiber));
+        }
+        fiber.reset();
+    }
+
+private:
+    static std::vector<Fiber::ptr> &Pool() {
+        static thread_local std::vector<Fiber::ptr> s_pool;
+        return s_pool;
+    }
+};
+
+/**
+ * @brief 销毁未结束的生成器时，从yield_value抛出该异常，展开生成器协程的栈
+ */
+struct GeneratorStop {};
+
+} // namespace detail
+
+/**
+ * @brief 生成器
+ * @tparam T 元素类型，只读的元素用Generator<const T>
+ * @details 只能移动，不能拷贝。第一次调用begin()时才开始执行生成函数。
+ *          生成函数抛出的异常在调用方取下一个元素(begin()/++)时重新抛出。
+ *          生成器没有迭代完就被销毁时，从生成函数挂起的yield_value处抛出一个内部异常展开协程栈，栈上的对象都会被正确析构，
+ *          所以生成函数里不要用catch(...)吞掉异常
+ * @attention 生成函数中不能挂起协程：hook的阻塞调用在生成器协程中不会挂起协程，而是直接阻塞线程
+ */
+template <class T>
+class Generator {
+public:
+    typedef typename std::remove_const<T>::type ValueType;
+
+    /**
+     * @brief 生成函数用来产出元素的句柄
+     */
+    class Yielder {
+    public:
+        /**
+         * @brief 产出一个元素并挂起，直到调用方取下一个元素
+         * @details 只传递地址，调用方拿到的引用就是这里的v，挂起期间v一直有效
+         */
+        void yield_value(T &v) { suspend(&v); }
+
+        /**
+         * @brief 产出一个临时对象，临时对象在挂起期间一直有效，同样不拷贝
+         */
+        void yield_value(ValueType &&v) { suspend(&v); }
+
+    private:
+        friend class Generator;
+
+        void suspend(T *v) {
+            m_value = v;
+            m_fiber->yield();
+            if (m_stopping) {
+                throw detail::GeneratorStop();
+            }
+        }
+
+        template <class F>
+        void run(F &body) {
+            //生成器协程由调用方驱动，不能被hook挂起
+            set_fiber_hook_enable(false);
+            try {
+                body(*this);
+            } catch (detail::GeneratorStop &) {
+            } catch (...) {
+                m_error = std::current_exception();
+            }
+            m_value = nullptr;
+            m_done  = true;
+        }
+
+        /**
+         * @brief 驱动生成函数执行到下一个yield_value或结束
+         */
+        void next() {
+            assert(!m_done);
+            m_value   = nullptr;
+            m_started = true;
+            m_fiber->call();
+            if (m_error) {
+                std::exception_ptr error = m_error;
+                m_error                  = nullptr;
+                std::rethrow_exception(error);
+            }
+        }
+
+    private:
+        /// 运行生成函数的协程
+        Fiber::ptr m_fiber;
+        /// 当前元素
+        T *m_value = nullptr;
+        /// 是否已经开始执行
+        bool m_started = false;
+        /// 生成函数是否已经结束
+        bool m_done = false;
+        /// 生成器正在被销毁
+        bool m_stopping = false;
+        /// 生成函数抛出的异常
+        std::exception_ptr m_error;
+    };
+
+    /**
+     * @brief 输入迭代器
+     */
+    class iterator {
+    public:
+        typedef std::input_iterator_tag iterator_category;
+        typedef ValueType value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef T *pointer;
+        typedef T &reference;
+
+        iterator(Yielder *y = nullptr) : m_yielder(y) {}
+
+        T &operator*() const { return *m_yielder->m_value; }
+        T *operator->() const { return m_yielder->m_value; }
+
+        iterator &operator++() {
+            m_yielder->next();
+            return *this;
+        }
+
+        void operator++(int) { ++*this; }
+
+        bool operator==(const iterator &rhs) const { return done() == rhs.done(); }
+        bool operator!=(const iterator &rhs) const { return !(*this == rhs); }
+
+    private:
+        bool done() const { return !m_yielder || m_yielder->m_done; }
+
+    private:
+        Yielder *m_yielder;
+    };
+
+    /**
+     * @brief 构造生成器
+     * @param[in] body 生成函数，签名为void(Yielder &)
+     * @param[in] stacksize 协程栈大小，0表示默认大小，只有默认大小的协程栈会被缓存复用
+     */
+    template <class F>
+    explicit Generator(F &&body, size_t stacksize = 0)
+        : m_yielder(new Yielder) {
+        Entry<typename std::decay<F>::type> entry(m_yielder.get(), std::forward<F>(body));
+        if (stacksize == 0) {
+            m_yielder->m_fiber = detail::GeneratorFiberPool::Acquire(std::move(entry));
+        } else {
+            m_yielder->m_fiber.reset(new Fiber(std::move(entry), stacksize, false));
+        }
+    }
+
+    Generator(Generator &&other) = default;
+
+    Generator &operator=(Generator &&other) {
+        if (this != &other) {
+            destroy();
+            m_yielder = std::move(other.m_yielder);
+        }
+        return *this;
+    }
+
+    Generator(const Generator &) = delete;
+    Generator &operator=(const Generator &) = delete;
+
+    ~Generator() { destroy(); }
+
+    /**
+     * @brief 开始执行生成函数，返回指向第一个元素的迭代器
+     * @attention 只能调用一次
+     */
+    iterator begin() {
+        assert(!m_yielder->m_started);
+        m_yielder->next();
+        return iterator(m_yielder.get());
+    }
+
+    iterator end() { return iterator(); }
+
+private:
+    /**
+     * @brief 协程入口，保存生成函数
+     */
+    template <class F>
+    struct Entry {
+        Yielder *yielder;
+        F body;
+
+        template <class U>
+        Entry(Yielder *y, U &&f) : yielder(y), body(std::forward<U>(f)) {}
+
+        void operator()() { yielder->run(body); }
+    };
+
+    /**
+     * @brief 生成函数还挂起在yield_value中时，让它抛出异常展开栈，然后归还协程
+     */
+    void destroy() {
+        if (!m_yielder) {
+            return;
+        }
+        if (m_yielder->m_started && !m_yielder->m_done) {
+            m_yielder->m_stopping = true;
+            m_yielder->m_fiber->call();
+            assert(m_yielder->m_done);
+        }
+        detail::GeneratorFiberPool::Release(m_yielder->m_fiber);
+        m_yielder.reset();
+    }
+
+private:
+    std::unique_ptr<Yielder> m_yielder;
+};
+
+} // namespace sylar
+
+#endif
@@ -6,7 +6,12 @@
 #include "fiber.h"
 #include "iomanager.h"
 #include "fd_manager.h"
+#include "fiber_context.h"
+#include "fiber_local.h"
+#include "hook_stats.h"
 #include "macro.h"          //使用一些分支预测宏
+#include "sdt.h"
+#include "trace.h"
 
 // sylar::Logger::ptr g_logger = SYLAR_LOG_NAME("system");
 namespace sylar {
@@ -19,6 +24,9 @@ const int g_tcp_connect_timeout = 5000;
 //使用线程局部变量表示hook模块是线程粒度的，各个线程可单独启用或关闭hook。
 static thread_local bool t_hook_enable = false;
 
+//协程自己的hook状态，设置了就覆盖所在线程的hook状态。放在协程局部变量里，协程迁移到其他线程后仍然有效
+static FiberLocal<bool> s_fiber_hook_enable;
+
 //然后是获取各个被hook的接口的原始地址， 这里要借助dlsym来获取。sylar使用了一套宏来简化编码
 #define HOOK_FUN(XX) \
     XX(sleep) \
@@ -87,9 +95,10 @@ struct _HookIniter {
 //全局的静态对象
 static _HookIniter s_hook_initer;
 
-//本线程是否hook
+//当前协程是否hook，协程自己设置过就以协程为准，否则看所在线程
 bool is_hook_enable() {
-    return t_hook_enable;
+    bool *flag = s_fiber_hook_enable.get();
+    return flag ? *flag : t_hook_enable;
 }
 
 void set_hook_enable(bool flag) {
@@ -97,6 +106,10 @@ void set_hook_enable(bool flag) {
     t_hook_enable = flag;
 }
 
+void set_fiber_hook_enable(bool flag) {
+    s_fiber_hook_enable.set(flag);
+}
+
 }
 
 //定时器信息 标定该定时器是否被删除 并且存错误原因比如 ETIMEDOUT	110	/* Connection timed out */
@@ -105,17 +118,196 @@ struct timer_info {
 };
 
 
+/**
+ * @brief 读取errno
+ * @details 协程挂起之后可能在另一个线程中恢复，而errno是线程局部变量，编译器会把挂起之前取到的errno地址缓存下来继续使用，
+ *          所以在可能发生协程切换的函数里，切换之后统一通过这两个不内联的函数读写errno
+ */
+static int __attribute__((noinline)) get_errno() {
+    return errno;
+}
+
+/**
+ * @brief 设置errno，见get_errno()
+ */
+static void __attribute__((noinline)) set_errno(int err) {
+    errno = err;
+}
+
+/**
+ * @brief 打开了HookStats时记录一次调用，在确定hook生效之后调用
+ */
+static inline void stats_call(sylar::HookStats::Function f) {
+    if(SYLAR_UNLIKELY(sylar::HookStats::IsEnabled())) {
+        sylar::HookStats::AddCall(f);
+    }
+}
+
+/**
+ * @brief 打开了HookStats时记录一次EAGAIN
+ */
+static inline void stats_eagain(sylar::HookStats::Function f) {
+    if(SYLAR_UNLIKELY(sylar::HookStats::IsEnabled())) {
+        sylar::HookStats::AddEagain(f);
+    }
+}
+
+/**
+ * @brief 打开了HookStats时记录调用失败的原因(超时、取消)
+ * @return err
+ */
+static inline int stats_error(sylar::HookStats::Function f, int err) {
+    if(SYLAR_UNLIKELY(sylar::HookStats::IsEnabled())) {
+        sylar::HookStats::AddError(f, err);
+    }
+    return err;
+}
+
+/**
+ * @brief 用当前协程的截止时间修正等待时间
+ * @param[in, out] timeout_ms 等待时间(毫秒)，(uint64_t)-1表示无限等待，返回时取其与截止时间剩余时间的较小值
+ * @return 截止时间已过返回false
+ */
+static bool deadline_wait(uint64_t& timeout_ms) {
+    uint64_t deadline = sylar::Fiber::GetDeadline();
+    if(deadline == ~0ull) {
+        return true;
+    }
+    //截止时间来自协程上下文时，由上下文唯一的截止定时器负责唤醒，不需要再为每次调用单独加定时器
+    sylar::FiberContext::ptr fctx = sylar::Fiber::GetContext();
+    if(fctx && fctx->getDeadline() <= deadline) {
+        return true;
+    }
+    uint64_t now = sylar::GetElapsedMS();
+    if(now >= deadline) {
+        return false;
+    }
+    if(timeout_ms == (uint64_t)-1 || deadline - now < timeout_ms) {
+        timeout_ms = deadline - now;
+    }
+    return true;
+}
+
+/**
+ * @brief 向协程和协程上下文登记等待者
+ * @details 协程被取消(Fiber::cancel())或者协程上下文结束时，通过等待者提前唤醒本协程
+ * @return 协程已经被取消时返回ECANCELED，协程上下文已经结束时返回其结束原因，此时不登记
+ */
+static int add_waiter(sylar::FiberWaiter& waiter, const sylar::FiberContext::ptr& fctx) {
+    if(!waiter.fiber->setWaiter(&waiter)) {
+        return ECANCELED;
+    }
+    if(fctx && !fctx->addWaiter(&waiter)) {
+        waiter.fiber->setWaiter(nullptr);
+        return fctx->getError();
+    }
+    return 0;
+}
+
+/**
+ * @brief 协程被唤醒之后删除登记的等待者
+ * @return 协程被取消时返回ECANCELED，协程上下文已经结束时返回其结束原因，否则返回0
+ */
+static int del_waiter(sylar::FiberWaiter& waiter, const sylar::FiberContext::ptr& fctx) {
+    waiter.fiber->setWaiter(nullptr);
+    if(fctx) {
+        fctx->delWaiter(&waiter);
+    }
+    if(waiter.fiber->isCancelled()) {
+        return ECANCELED;
+    }
+    return fctx ? fctx->getError() : 0;
+}
+
+/**
+ * @brief 注册好IO事件之后挂起当前协程
+ * @details 挂起期间向协程和协程上下文登记，协程被取消或者上下文超时/被取消时会通过触发该事件提前唤醒本协程
+ * @return 协程被取消时返回ECANCELED，协程上下文已经结束时返回其结束原因(ETIMEDOUT/ECANCELED)，否则返回0
+ */
+static int wait_event(sylar::IOManager* iom, int fd, sylar::IOManager::Event event,
+                      sylar::HookStats::Function stats_fn) {
+    sylar::FiberWaiter waiter;
+    waiter.fiber = sylar::Fiber::GetThis();
+    waiter.iom   = iom;
+    waiter.fd    = fd;
+    waiter.event = event;
+    sylar::FiberContext::ptr fctx = waiter.fiber->getContext();
+
+    int err = add_waiter(waiter, fctx);
+    if(err) {
+        //撤销刚注册的事件。如果事件已经触发，本协程已经被加入调度，需要yield一次把这次调度消耗掉
+        if(!iom->delEvent(fd, event)) {
+            waiter.fiber->yield();
+        }
+        return err;
+    }
+    uint64_t wait_begin = sylar::FiberStats::Begin();
+    uint64_t stats_begin = sylar::HookStats::Begin();
+    SYLAR_PROBE3(hook__suspend, waiter.fiber->getId(), fd, (int)event);
+    waiter.fiber->yield();
+    SYLAR_PROBE3(hook__resume, waiter.fiber->getId(), fd, (int)event);
+    sylar::HookStats::RecordSuspend(stats_fn, stats_begin);
+    waiter.fiber->recordWait(sylar::FiberStats::WAIT_IO, wait_begin);
+    return del_waiter(waiter, fctx);
+}
+
+/**
+ * @brief hook的sleep系列函数的公共实现，通过定时器挂起当前协程
+ * @param[in] ms 睡眠时间(毫秒)
+ * @param[in] stats_fn 调用的函数，用于HookStats
+ * @return 协程被取消或者协程上下文超时/被取消时提前返回原因，正常睡眠结束返回0
+ */
+static int do_sleep(uint64_t ms, sylar::HookStats::Function stats_fn) {
+    sylar::TraceSyscall trace("sleep", -1);
+    sylar::FiberWaiter waiter;
+    waiter.fiber = sylar::Fiber::GetThis();
+    waiter.iom   = sylar::IOManager::GetThis();
+    sylar::FiberContext::ptr fctx = waiter.fiber->getContext();
+    if(waiter.fiber->isCancelled()) {
+        return ECANCELED;
+    }
+    if(fctx && fctx->isDone()) {
+        return fctx->getError();
+    }
+
+    //定时器到期时把当前协程重新加入iom的调度 schedule是完美转发的模板函数，不能再取成员函数指针bind，这里用lambda
+    sylar::IOManager* iom = waiter.iom;
+    sylar::Fiber::ptr fiber = waiter.fiber;
+    waiter.timer = iom->addTimer(ms, [iom, fiber]() {
+        iom->schedule(fiber);
+    });
+    int err = add_waiter(waiter, fctx);
+    if(err) {
+        //定时器已经触发的话本协程已经被加入调度，yield一次把这次调度消耗掉
+        if(!waiter.timer->cancel()) {
+            waiter.fiber->yield();
+        }
+        return err;
+    }
+
+    //再yield 这里是异步的关键 也是同步，阻塞的系统调用体现出异步的关键
+    uint64_t wait_begin = sylar::FiberStats::Begin();
+    uint64_t stats_begin = sylar::HookStats::Begin();
+    SYLAR_PROBE3(hook__suspend, waiter.fiber->getId(), -1, 0);
+    waiter.fiber->yield();
+    SYLAR_PROBE3(hook__resume, waiter.fiber->getId(), -1, 0);
+    sylar::HookStats::RecordSuspend(stats_fn, stats_begin);
+    waiter.fiber->recordWait(sylar::FiberStats::WAIT_TIMER, wait_begin);
+    return del_waiter(waiter, fctx);
+}
+
 //下面read write send一堆函数的共用底层函数 
-//OriginFun为原始调用的函数指针 hook_fun_name为系统调用名称
+//OriginFun为原始调用的函数指针 hook_fun_name为系统调用名称 stats_fn为HookStats中对应的函数
 //event表示iomanager支持的监视的事件名称 无非就是读事件或者写事件
 //timeout_so用来标定是 接收时间(SO_RCVTIMEO) 还是发送时间(SO_SENDTIMEO)
 //args是原始参数 这里使用了万能引用
 template<typename OriginFun, typename... Args>
-static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
+static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name, sylar::HookStats::Function stats_fn,
         uint32_t event, int timeout_so, Args&&... args) {
-    if(!sylar::t_hook_enable) {
+    if(!sylar::is_hook_enable()) {
         return fun(fd, std::forward<Args>(args)...);
     }
+    stats_call(stats_fn);
 
     sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
     if(!ctx) {
@@ -132,6 +324,9 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
         return fun(fd, std::forward<Args>(args)...);
     }
 
+    //只追踪走协程挂起逻辑的调用
+    sylar::TraceSyscall trace(hook_fun_name, fd);
+
     //拿到fdctx中设置的读写超时时间
     uint64_t timeout = ctx->getTimeout(timeout_so);
     
@@ -141,17 +336,25 @@ static ssize_t do_io(int fd, OriginFun fun, const char* hook_fun_name,
 retry:
     ssize_t n = fun(fd, std::forward<Args>(args)...);
     //Interrupted system call
-    while(n == -1 && errno == EINTR) {      //如果失败，并且错误类型为中断错误，无限重试 直到成功 或者 错误为EAGAIN
+    while(n == -1 && get_errno() == EINTR) {      //如果失败，并且错误类型为中断错误，无限重试 直到成功 或者 错误为EAGAIN
         n = fun(fd, std::forward<Args>(args)...);
     }
 
-    if(n == -1 && errno == EAGAIN) {        //try again 资源暂时不可用 这通常发生在非阻塞操作中，当系统资源（如文件描述符、缓冲区、消息队列等）暂时无法满足请求时，
+    if(n == -1 && get_errno() == EAGAIN) {        //try again 资源暂时不可用 这通常发生在非阻塞操作中，当系统资源（如文件描述符、缓冲区、消息队列等）暂时无法满足请求时，
+        stats_eagain(stats_fn);
         sylar::IOManager* iom = sylar::IOManager::GetThis();
         sylar::Timer::ptr timer;
         std::weak_ptr<timer_info> winfo(tinfo);
 
-        if(timeout != (uint64_t)-1) {
-            timer = iom->addConditionTimer(timeout, [winfo, fd, iom, event]() {
+        //协程带有截止时间时，等待时间不能超过截止时间，已经过了截止时间就不再挂起
+        uint64_t wait_ms = timeout;
+        if(!deadline_wait(wait_ms)) {
+            set_errno(stats_error(stats_fn, ETIMEDOUT));
+            return -1;
+        }
+
+        if(wait_ms != (uint64_t)-1) {
+            timer = iom->addConditionTimer(wait_ms, [winfo, fd, iom, event]() {
                 std::cout<<"已经超时，系统调用还没调用成功"<<std::endl;
                 auto t = winfo.lock();
                 if(!t || t->cancelled) {
@@ -176,14 +379,18 @@ retry:
         } 
         else {
             //这里是异步的关键 即比如send调用，如果写缓冲区并未准备好，会阻塞，这里先让其yield，
-            //当fdctx设置的sendtimeout定时器到期后，或者监视事件发生，再重新resume
-            sylar::Fiber::GetThis()->yield();
+            //当fdctx设置的sendtimeout定时器到期后，或者监视事件发生，或者协程被取消，或者协程上下文超时/取消，再重新resume
+            int err = wait_event(iom, fd, (sylar::IOManager::Event)(event), stats_fn);
             
             if(timer) {     //删除定时器 无论其是否触发
                 timer->cancel();
             }
             if(tinfo->cancelled) {      //超时定时器中设置的错误原因
-                errno = tinfo->cancelled;
+                set_errno(stats_error(stats_fn, tinfo->cancelled));
+                return -1;
+            }
+            if(err) {                   //协程被取消，或者协程上下文超时/被取消
+                set_errno(stats_error(stats_fn, err));
                 return -1;
             }
             std::cout<<"本轮没成功，再来一轮"<<std::endl;
@@ -208,68 +415,60 @@ unsigned int sleep(unsigned int seconds) {
     std::cout<<"hook:sleep func() begin"<<std::endl;
 
     //如果本线程不hook，那就直接调原始调用
-    if(!sylar::t_hook_enable) {
+    if(!sylar::is_hook_enable()) {
         std::cout<<"hook:sleep func() end1"<<std::endl;
         return sleep_f(seconds);
     }
 
-    //拿到当前线程正在执行的协程
-    sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
-    
-    //拿到当前的iomanager
-    sylar::IOManager* iom = sylar::IOManager::GetThis();
-    
-    //先添加定时器
-    //将 sylar::IOManager::schedule 成员函数的指针类型转换为 sylar::Scheduler 的成员函数指针类型
-    //sylar::IOManager::schedule的返回值为void 参数为FiberOrCb与int，现在将这个函数指针拿到，并将其强转为(void(sylar::Scheduler::*)(sylar::Fiber::ptr, int thread))这个类型
-    //现在指针强转完成，开始绑定参数，iom作为this参数，fiber为第二个参数，-1表示不指定线程
-    iom->addTimer(seconds * 1000, std::bind( (void(sylar::Scheduler::*)(sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule
-            ,iom, fiber, -1));
-    
-    //再yield 这里是异步的关键 也是同步，阻塞的系统调用体现出异步的关键
+    //先添加定时器 再yield，协程上下文超时或被取消时提前返回，返回值为没睡够的秒数(这里直接返回seconds)
     std::cout<<"hook:sleep fiber yield"<<std::endl;
-
-    sylar::Fiber::GetThis()->yield();
+    stats_call(sylar::HookStats::SLEEP);
+    int err = do_sleep(seconds * 1000, sylar::HookStats::SLEEP);
+    if(err) {
+        set_errno(stats_error(sylar::HookStats::SLEEP, err));
+        return seconds;
+    }
     
     std::cout<<"hook:sleep func() end2"<<std::endl;
     return 0;
 }
 
 int usleep(useconds_t usec) {
-    if(!sylar::t_hook_enable) {
+    if(!sylar::is_hook_enable()) {
         return usleep_f(usec);
     }
-    sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
-    sylar::IOManager* iom = sylar::IOManager::GetThis();
-
-    iom->addTimer(usec / 1000, std::bind((void(sylar::Scheduler::*)(sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule
-            ,iom, fiber, -1));
-    sylar::Fiber::GetThis()->yield();
+    stats_call(sylar::HookStats::USLEEP);
+    int err = do_sleep(usec / 1000, sylar::HookStats::USLEEP);
+    if(err) {
+        set_errno(stats_error(sylar::HookStats::USLEEP, err));
+        return -1;
+    }
     return 0;
 }
 
 int nanosleep(const struct timespec *req, struct timespec *rem) {
-    if(!sylar::t_hook_enable) {
+    if(!sylar::is_hook_enable()) {
         return nanosleep_f(req, rem);
     }
 
     int timeout_ms = req->tv_sec * 1000 + req->tv_nsec / 1000 /1000;
-    sylar::Fiber::ptr fiber = sylar::Fiber::GetThis();
-    sylar::IOManager* iom = sylar::IOManager::GetThis();
-    iom->addTimer(timeout_ms, std::bind((void(sylar::Scheduler::*)
-            (sylar::Fiber::ptr, int thread))&sylar::IOManager::schedule
-            ,iom, fiber, -1));
-    sylar::Fiber::GetThis()->yield();
+    stats_call(sylar::HookStats::NANOSLEEP);
+    int err = do_sleep(timeout_ms, sylar::HookStats::NANOSLEEP);
+    if(err) {
+        set_errno(stats_error(sylar::HookStats::NANOSLEEP, err));
+        return -1;
+    }
     return 0;
 }
 
 //并没有做什么 只是在原有socket基础上创建了一个fdctx，便于后续accept bind connect等一系列行为的管理
 int socket(int domain, int type, int protocol) {        
     std::cout<<"socket func() tag1"<<std::endl;
-    if(!sylar::t_hook_enable) {
+    if(!sylar::is_hook_enable()) {
         std::cout<<"socket func() tag2"<<std::endl;
         return socket_f(domain, type, protocol);
     }
+    stats_call(sylar::HookStats::SOCKET);
     int fd = socket_f(domain, type, protocol);
     if(fd == -1) {
         return fd;
@@ -283,7 +482,7 @@ int socket(int domain, int type, int protocol) {
 }
 
 int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen, uint64_t timeout_ms) {
-    if(!sylar::t_hook_enable) {
+    if(!sylar::is_hook_enable()) {
         std::cout<<"connect_with_time_out func() tag1"<<std::endl;
         return connect_f(fd, addr, addrlen);
     }
@@ -313,6 +512,9 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
 
     //在fdctx的init中已经设置了hook非阻塞，也就是系统非阻塞
 
+    sylar::TraceSyscall trace("connect", fd);
+    stats_call(sylar::HookStats::CONNECT);
+
     //调用系统的connect函数，由于套接字是非阻塞的，这里会直接返回EINPROGRESS错误
     //返回值要么是0 要么是-1 并且errno为EINPROGRESS
     int n = connect_f(fd, addr, addrlen);
@@ -326,6 +528,13 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         //理论上这个分支不会进去
         return n;
     }
+    stats_eagain(sylar::HookStats::CONNECT);
+
+    //协程带有截止时间时，connect的超时时间也不能超过截止时间
+    if(!deadline_wait(timeout_ms)) {
+        errno = stats_error(sylar::HookStats::CONNECT, ETIMEDOUT);
+        return -1;
+    }
 
     //如果超时参数有效，则添加一个条件定时器，在定时时间到后通过t->cancelled设置超时标志并触发一次WRITE事件。
     sylar::IOManager* iom = sylar::IOManager::GetThis();
@@ -369,9 +578,9 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     if(rt == 0) {
         std::cout<<"connect_with_time_out func() tag7"<<std::endl;
         //yield         这里是异步的关键
-        sylar::Fiber::GetThis()->yield();
+        int err = wait_event(iom, fd, sylar::IOManager::WRITE, sylar::HookStats::CONNECT);
         
-        //又恢复执行    两种情况：1.表明client成功连接到server，fiber恢复执行 或者发生错误，clientfd也会可写  2.超时，最后cancleevent又触发了一次事件，fiber恢复执行
+        //又恢复执行    三种情况：1.表明client成功连接到server，fiber恢复执行 或者发生错误，clientfd也会可写  2.超时，最后cancleevent又触发了一次事件，fiber恢复执行 3.协程被取消，或者协程上下文超时/被取消
         if(timer) {//情况1情况2
             std::cout<<"connect_with_time_out func() tag8"<<std::endl;
             //删除定时器 因为已经不需要超时时间了
@@ -379,7 +588,11 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
         }
         if(tinfo->cancelled) {      //情况2：errno设置为超市定时器cb中设置的原因，并返回-1表示失败
             std::cout<<"connect_with_time_out func() tag9"<<std::endl;
-            errno = tinfo->cancelled;
+            set_errno(stats_error(sylar::HookStats::CONNECT, tinfo->cancelled));
+            return -1;
+        }
+        if(err) {                   //情况3：协程被取消，或者协程上下文超时/被取消
+            set_errno(stats_error(sylar::HookStats::CONNECT, err));
             return -1;
         }
     } 
@@ -410,7 +623,7 @@ int connect_with_timeout(int fd, const struct sockaddr* addr, socklen_t addrlen,
     else {
         std::cout<<"connect_with_time_out func() tag13"<<std::endl;
         //errno是一个全局错误标志
-        errno = error;
+        set_errno(error);
         return -1;
     }
 }
@@ -421,7 +634,7 @@ int connect(int sockfd, const struct sockaddr *addr, socklen_t addrlen) {
 }
 
 int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
-    int clientfd = do_io(s, accept_f, "accept", sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
+    int clientfd = do_io(s, accept_f, "accept", sylar::HookStats::ACCEPT, sylar::IOManager::READ, SO_RCVTIMEO, addr, addrlen);
 
     if(clientfd >= 0) {
         //把客户的fdctx搞出来
@@ -431,51 +644,52 @@ int accept(int s, struct sockaddr *addr, socklen_t *addrlen) {
 }
 
 ssize_t read(int fd, void *buf, size_t count) {
-    return do_io(fd, read_f, "read", sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
+    return do_io(fd, read_f, "read", sylar::HookStats::READ, sylar::IOManager::READ, SO_RCVTIMEO, buf, count);
 }
 
 ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, readv_f, "readv", sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
+    return do_io(fd, readv_f, "readv", sylar::HookStats::READV, sylar::IOManager::READ, SO_RCVTIMEO, iov, iovcnt);
 }
 
 ssize_t recv(int sockfd, void *buf, size_t len, int flags) {
-    return do_io(sockfd, recv_f, "recv", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
+    return do_io(sockfd, recv_f, "recv", sylar::HookStats::RECV, sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags);
 }
 
 ssize_t recvfrom(int sockfd, void *buf, size_t len, int flags, struct sockaddr *src_addr, socklen_t *addrlen) {
-    return do_io(sockfd, recvfrom_f, "recvfrom", sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
+    return do_io(sockfd, recvfrom_f, "recvfrom", sylar::HookStats::RECVFROM, sylar::IOManager::READ, SO_RCVTIMEO, buf, len, flags, src_addr, addrlen);
 }
 
 ssize_t recvmsg(int sockfd, struct msghdr *msg, int flags) {
-    return do_io(sockfd, recvmsg_f, "recvmsg", sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);
+    return do_io(sockfd, recvmsg_f, "recvmsg", sylar::HookStats::RECVMSG, sylar::IOManager::READ, SO_RCVTIMEO, msg, flags);
 }
 
 ssize_t write(int fd, const void *buf, size_t count) {
-    return do_io(fd, write_f, "write", sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
+    return do_io(fd, write_f, "write", sylar::HookStats::WRITE, sylar::IOManager::WRITE, SO_SNDTIMEO, buf, count);
 }
 
 ssize_t writev(int fd, const struct iovec *iov, int iovcnt) {
-    return do_io(fd, writev_f, "writev", sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
+    return do_io(fd, writev_f, "writev", sylar::HookStats::WRITEV, sylar::IOManager::WRITE, SO_SNDTIMEO, iov, iovcnt);
 }
 
 ssize_t send(int s, const void *msg, size_t len, int flags) {//send = write
     std::cout<<"send func()"<<std::endl;
-    return do_io(s, send_f, "send", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
+    return do_io(s, send_f, "send", sylar::HookStats::SEND, sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags);
 }
 
 ssize_t sendto(int s, const void *msg, size_t len, int flags, const struct sockaddr *to, socklen_t tolen) {
-    return do_io(s, sendto_f, "sendto", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
+    return do_io(s, sendto_f, "sendto", sylar::HookStats::SENDTO, sylar::IOManager::WRITE, SO_SNDTIMEO, msg, len, flags, to, tolen);
 }
 
 ssize_t sendmsg(int s, const struct msghdr *msg, int flags) {
-    return do_io(s, sendmsg_f, "sendmsg", sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
+    return do_io(s, sendmsg_f, "sendmsg", sylar::HookStats::SENDMSG, sylar::IOManager::WRITE, SO_SNDTIMEO, msg, flags);
 }
 
 //关闭某fd
 int close(int fd) {
-    if(!sylar::t_hook_enable) {
+    if(!sylar::is_hook_enable()) {
         return close_f(fd);
     }
+    stats_call(sylar::HookStats::CLOSE);
 
     sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(fd);
     if(ctx) {
@@ -493,6 +707,9 @@ int close(int fd) {
 //eg:rt = fcntl(m_tickleFds[0], F_SETFL, O_NONBLOCK)
 int fcntl(int fd, int cmd, ... /* arg */ ) {
     std::cout<<"fcntl func() begin "<<std::endl;
+    if(SYLAR_UNLIKELY(sylar::HookStats::IsEnabled()) && sylar::is_hook_enable()) {
+        sylar::HookStats::AddCall(sylar::HookStats::FCNTL);
+    }
     va_list va;
     va_start(va, cmd);
     switch(cmd) {
@@ -603,6 +820,9 @@ int ioctl(int d, unsigned long int request, ...) {
     va_start(va, request);
     void* arg = va_arg(va, void*);
     va_end(va);
+    if(SYLAR_UNLIKELY(sylar::HookStats::IsEnabled()) && sylar::is_hook_enable()) {
+        sylar::HookStats::AddCall(sylar::HookStats::IOCTL);
+    }
 
     if(FIONBIO == request) {
         bool user_nonblock = !!*(int*)arg;
@@ -616,13 +836,17 @@ int ioctl(int d, unsigned long int request, ...) {
 }
 
 int getsockopt(int sockfd, int level, int optname, void *optval, socklen_t *optlen) {       //cnm 脱裤子放屁
+    if(SYLAR_UNLIKELY(sylar::HookStats::IsEnabled()) && sylar::is_hook_enable()) {
+        sylar::HookStats::AddCall(sylar::HookStats::GETSOCKOPT);
+    }
     return getsockopt_f(sockfd, level, optname, optval, optlen);
 }
 
 int setsockopt(int sockfd, int level, int optname, const void *optval, socklen_t optlen) {
-    if(!sylar::t_hook_enable) {
+    if(!sylar::is_hook_enable()) {
         return setsockopt_f(sockfd, level, optname, optval, optlen);
     }
+    stats_call(sylar::HookStats::SETSOCKOPT);
     if(level == SOL_SOCKET) {       //如果level设置的是socket相关
         if(optname == SO_RCVTIMEO || optname == SO_SNDTIMEO) {      //如果要设置的是发送时间或者接收时间
             sylar::FdCtx::ptr ctx = sylar::FdMgr::GetInstance()->get(sockfd);
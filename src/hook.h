@@ -12,12 +12,19 @@
 namespace sylar {
     /**
      * @brief 当前线程是否hook，我们在hook.cc定义了一个线程局部变量标定该线程是否hook，如果启用hook我们就可以在系统调用上附加自己的操作
+     * @details 当前协程通过set_fiber_hook_enable设置过自己的hook状态时，以协程的为准
      */
     bool is_hook_enable();
     /**
      * @brief 设置当前线程的hook状态
      */
     void set_hook_enable(bool flag);
+    /**
+     * @brief 设置当前协程的hook状态，只影响当前协程，覆盖所在线程的hook状态
+     * @details 保存在协程局部变量中，协程迁移到其他线程后仍然有效，协程结束或者被调度器复用时自动清除。
+     *          比如在调度器的协程中临时关闭hook，直接执行阻塞的系统调用
+     */
+    void set_fiber_hook_enable(bool flag);
 }
 
 extern "C" {
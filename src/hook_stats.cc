@@ -0,0 +1,164 @@
+/**
+ * @file hook_stats.cc
+ * @brief hook函数的调用统计实现
+ * @version 0.1
+ */
+
+#include <errno.h>
+#include <iomanip>
+#include "hook_stats.h"
+#include "thread_stats.h"
+
+namespace sylar {
+
+namespace detail {
+std::atomic<bool> g_hook_stats_enabled{false};
+} // namespace detail
+
+namespace {
+
+const char *s_names[HookStats::FUNCTION_NUM] = {
+    "sleep", "usleep", "nanosleep", "socket", "connect", "accept", "read", "readv", "recv", "recvfrom", "recvmsg",
+    "write", "writev", "send", "sendto", "sendmsg", "close", "fcntl", "ioctl", "getsockopt", "setsockopt"};
+
+/**
+ * @brief 一个函数在一个线程内的计数
+ */
+struct Counters {
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> eagain{0};
+    std::atomic<uint64_t> timeouts{0};
+    std::atomic<uint64_t> cancels{0};
+    /// 第一次挂起时分配，之后不再释放
+    std::atomic<Histogram *> suspend{nullptr};
+};
+
+struct ThreadStats {
+    Counters funcs[HookStats::FUNCTION_NUM];
+};
+
+detail::ThreadStatsRegistry<ThreadStats> &Stats() {
+    static detail::ThreadStatsRegistry<ThreadStats> s_stats;
+    return s_stats;
+}
+
+/**
+ * @brief 本线程中该函数的计数，线程正在退出时返回nullptr
+ */
+Counters *GetCounters(HookStats::Function f) {
+    ThreadStats *stats = Stats().local();
+    return SYLAR_LIKELY(stats) ? &stats->funcs[f] : nullptr;
+}
+
+void Add(HookStats::Function f, std::atomic<uint64_t> Counters::*field) {
+    Counters *c = GetCounters(f);
+    if (c) {
+        detail::AddRelaxed(c->*field);
+    }
+}
+
+} // namespace
+
+void HookStats::SetEnabled(bool v) {
+    detail::g_hook_stats_enabled.store(v, std::memory_order_relaxed);
+}
+
+const char *HookStats::GetName(Function f) {
+    return f < FUNCTION_NUM ? s_names[f] : "unknown";
+}
+
+void HookStats::AddCall(Function f) {
+    Add(f, &Counters::calls);
+}
+
+void HookStats::AddEagain(Function f) {
+    Add(f, &Counters::eagain);
+}
+
+void HookStats::AddError(Function f, int err) {
+    if (err == ETIMEDOUT) {
+        Add(f, &Counters::timeouts);
+    } else if (err == ECANCELED) {
+        Add(f, &Counters::cancels);
+    }
+}
+
+void HookStats::RecordSuspend(Function f, uint64_t begin) {
+    if (!begin) {
+        return;
+    }
+    uint64_t now = Metrics::Now();
+    Counters *c  = GetCounters(f);
+    if (!c) {
+        return;
+    }
+    Histogram *h = c->suspend.load(std::memory_order_relaxed);
+    if (SYLAR_UNLIKELY(!h)) {
+        h = new Histogram;
+        c->suspend.store(h, std::memory_order_release);
+    }
+    h->record(now > begin ? now - begin : 0);
+}
+
+void HookStats::Collect(std::vector<FunctionStats> &out) {
+    out.clear();
+    out.resize(FUNCTION_NUM);
+    for (size_t i = 0; i < FUNCTION_NUM; ++i) {
+        out[i].name = s_names[i];
+    }
+    Stats().forEach([&out](ThreadStats &stats) {
+        for (size_t i = 0; i < FUNCTION_NUM; ++i) {
+            const Counters &c = stats.funcs[i];
+            FunctionStats &s  = out[i];
+            s.calls += c.calls.load(std::memory_order_relaxed);
+            s.eagain += c.eagain.load(std::memory_order_relaxed);
+            s.timeouts += c.timeouts.load(std::memory_order_relaxed);
+            s.cancels += c.cancels.load(std::memory_order_relaxed);
+            Histogram *h = c.suspend.load(std::memory_order_acquire);
+            if (h) {
+                h->mergeTo(s.suspend_ns);
+            }
+        }
+    });
+}
+
+void HookStats::Dump(std::ostream &os) {
+    std::vector<FunctionStats> stats;
+    Collect(stats);
+    os << std::left << std::setw(12) << "function" << std::right << std::setw(12) << "calls" << std::setw(12)
+       << "eagain" << std::setw(10) << "eagain/c" << std::setw(12) << "suspends" << std::setw(12) << "p50(us)"
+       << std::setw(12) << "p99(us)" << std::setw(12) << "max(us)" << std::setw(10) << "timeouts" << std::setw(10)
+       << "cancels" << std::endl;
+    std::streamsize precision = os.precision(2);
+    os << std::fixed;
+    for (auto &s : stats) {
+        if (!s.calls && !s.suspend_ns.count) {
+            continue;
+        }
+        const HistogramSnapshot &h = s.suspend_ns;
+        os << std::left << std::setw(12) << s.name << std::right << std::setw(12) << s.calls << std::setw(12)
+           << s.eagain << std::setw(10) << s.eagainRate() << std::setw(12) << h.count << std::setw(12)
+           << h.percentile(0.5) / 1e3 << std::setw(12) << h.percentile(0.99) / 1e3 << std::setw(12) << h.max / 1e3
+           << std::setw(10) << s.timeouts << std::setw(10) << s.cancels << std::endl;
+    }
+    os << std::defaultfloat;
+    os.precision(precision);
+}
+
+void HookStats::Reset() {
+    //不释放直方图，所属线程可能正在记录
+    Stats().forEach([](ThreadStats &stats) {
+        for (auto &c : stats.funcs) {
+            c.calls    = 0;
+            c.eagain   = 0;
+            c.timeouts = 0;
+            c.cancels  = 0;
+            Histogram *h = c.suspend.load(std::memory_order_acquire);
+            if (h) {
+                h->reset();
+            }
+        }
+    });
+}
+
+} // namespace sylar
@@ -0,0 +1,148 @@
+/**
+ * @file hook_stats.h
+ * @brief hook函数的调用统计
+ * @details 打开后，hook.cc中每个被hook的函数在hook生效时记录：调用次数、系统调用返回EAGAIN(connect为EINPROGRESS)的次数、
+ *          因此挂起协程的时间(sleep系列为等待定时器的时间)、以ETIMEDOUT和ECANCELED结束的次数。
+ *          挂起时间记在metrics.h的对数线性直方图中，可以求分位数。
+ *          每个线程写自己的一组计数器，不加锁，直方图在第一次挂起时才分配；Collect()时汇总所有线程：
+ *          sylar::HookStats::SetEnabled(true);
+ *          ...
+ *          sylar::HookStats::Dump(std::cout);
+ *          关闭时每次调用只多一次对全局开关的relaxed读
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_HOOK_STATS_H__
+#define __SYLAR_HOOK_STATS_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "macro.h"
+#include "metrics.h"
+
+namespace sylar {
+
+namespace detail {
+/// 统计开关，放在头文件中让hook函数内联判断
+extern std::atomic<bool> g_hook_stats_enabled;
+} // namespace detail
+
+/**
+ * @brief hook函数的调用统计
+ */
+class HookStats {
+public:
+    /**
+     * @brief 被hook的函数，与hook.cc中的HOOK_FUN一一对应
+     */
+    enum Function {
+        SLEEP,
+        USLEEP,
+        NANOSLEEP,
+        SOCKET,
+        CONNECT,
+        ACCEPT,
+        READ,
+        READV,
+        RECV,
+        RECVFROM,
+        RECVMSG,
+        WRITE,
+        WRITEV,
+        SEND,
+        SENDTO,
+        SENDMSG,
+        CLOSE,
+        FCNTL,
+        IOCTL,
+        GETSOCKOPT,
+        SETSOCKOPT,
+        FUNCTION_NUM
+    };
+
+    /**
+     * @brief 一个函数的汇总
+     */
+    struct FunctionStats {
+        /// 函数名
+        std::string name;
+        /// hook生效时的调用次数
+        uint64_t calls = 0;
+        /// 系统调用返回EAGAIN的次数，一次调用可能多次
+        uint64_t eagain = 0;
+        /// 以ETIMEDOUT结束的调用数
+        uint64_t timeouts = 0;
+        /// 以ECANCELED结束的调用数
+        uint64_t cancels = 0;
+        /// 每次挂起的时间，纳秒，count为挂起次数
+        HistogramSnapshot suspend_ns;
+
+        /**
+         * @brief 平均每次调用遇到EAGAIN的次数
+         */
+        double eagainRate() const { return calls ? (double)eagain / calls : 0; }
+    };
+
+    /**
+     * @brief 打开或关闭统计，默认关闭
+     */
+    static void SetEnabled(bool v);
+
+    /**
+     * @brief 是否打开了统计
+     */
+    static bool IsEnabled() { return detail::g_hook_stats_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 打开了统计时返回当前时间(纳秒)，否则返回0，与RecordSuspend()配对
+     */
+    static uint64_t Begin() { return SYLAR_UNLIKELY(IsEnabled()) ? Metrics::Now() : 0; }
+
+    /**
+     * @brief 函数名
+     */
+    static const char *GetName(Function f);
+
+    /**
+     * @brief 记录一次调用
+     */
+    static void AddCall(Function f);
+
+    /**
+     * @brief 记录一次EAGAIN
+     */
+    static void AddEagain(Function f);
+
+    /**
+     * @brief 记录调用的结果，只统计ETIMEDOUT和ECANCELED
+     */
+    static void AddError(Function f, int err);
+
+    /**
+     * @brief 记录一次挂起，begin为挂起前Begin()的返回值，为0时不记录
+     */
+    static void RecordSuspend(Function f, uint64_t begin);
+
+    /**
+     * @brief 汇总所有线程的统计，按Function的顺序每个函数一项
+     */
+    static void Collect(std::vector<FunctionStats> &stats);
+
+    /**
+     * @brief 以表格输出调用过的函数
+     */
+    static void Dump(std::ostream &os);
+
+    /**
+     * @brief 清空所有统计
+     * @details 与正在进行的记录并发时，个别值可能没有被清零
+     */
+    static void Reset();
+};
+
+} // namespace sylar
+
+#endif
@@ -6,6 +6,9 @@
 #include <cassert>
 // #include "log.h"
 #include "macro.h"  //用于分支预测
+#include "fiber_stats.h"
+#include "sdt.h"
+#include "trace.h"
 
 namespace sylar {
 
@@ -97,16 +100,17 @@ void IOManager::FdContext::triggerEvent(IOManager::Event event) {
      * 也就是说，注册的IO事件是一次性的，如果想持续关注某个socket fd的读写事件，那么每次触发事件之后都要重新添加
      */
     events = (Event)(events & ~event);
+    SYLAR_PROBE2(io__trigger__event, fd, (int)event);
 
     // ctx是该读写事件对应的上下文，读事件返回读事件上下文，写事件返回写事件上下文
     EventContext &ctx = getEventContext(event);
     //如果当时addevent指定了event发生时的cb
     if (ctx.cb) {
-        //将任务push进ctx的调度器队列
-        ctx.scheduler->schedule(ctx.cb);
+        //将任务push进ctx的调度器队列 回调只能移动，直接移进任务，随后resetEventContext清空
+        ctx.scheduler->scheduleReady(std::move(ctx.cb));
     } 
     else {  //如果没指定cb，就将当时的协程重新resume
-        ctx.scheduler->schedule(ctx.fiber);
+        ctx.scheduler->scheduleReady(ctx.fiber);
     }
 
     //已经将任务push到调度器队列中，这里重置三元组中的对应事件上下文
@@ -198,7 +202,7 @@ void IOManager::contextResize(size_t size) {
 
 //为m_epfd这个epollfd添加监视事件 并且注册事件cb
 //event表示要监视读事件还是写事件
-int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
+int IOManager::addEvent(int fd, Event event, Callback cb) {
     // 找到fd对应的FdContext，如果不存在，那就分配一个
     //fdcontext是三元组结构体 也可以理解为客户结构体
     FdContext *fd_ctx = nullptr;
@@ -252,6 +256,7 @@ int IOManager::addEvent(int fd, Event event, std::function<void()> cb) {
 
     // 待执行IO事件数加1
     ++m_pendingEventCount;
+    SYLAR_PROBE2(io__add__event, fd, (int)event);
 
     //更新fdctx的注册事件
     fd_ctx->events                     = (Event)(fd_ctx->events | event);
@@ -323,6 +328,10 @@ bool IOManager::delEvent(int fd, Event event) {
 
 //注意：其与delevent的区别在于其会触发一次事件
 bool IOManager::cancelEvent(int fd, Event event) {
+    return cancelEvent(fd, event, nullptr);
+}
+
+bool IOManager::cancelEvent(int fd, Event event, Fiber *fiber) {
     // 找到fd对应的FdContext
     RWMutexType::ReadLock lock(m_mutex);
     if ((int)m_fdContexts.size() <= fd) {
@@ -335,6 +344,10 @@ bool IOManager::cancelEvent(int fd, Event event) {
     if (SYLAR_UNLIKELY(!(fd_ctx->events & event))) {
         return false;
     }
+    //事件已经换成了别的协程注册的，不是调用者要取消的那次等待
+    if (fiber && fd_ctx->getEventContext(event).fiber.get() != fiber) {
+        return false;
+    }
 
     // 删除事件
     Event new_events = (Event)(fd_ctx->events & ~event);
@@ -416,6 +429,88 @@ IOManager *IOManager::GetThis() {
  * Scheduler::run()每次从idle协程中退出之后，都会重新把任务队列里的所有任务执行完了再重新进入idle
  * 如果没有调度线程处理于idle状态，那也就没必要发通知了
  */
+void IOManager::getMetrics(SchedulerMetrics::Snapshot &snap) {
+    Scheduler::getMetrics(snap);
+    snap.pending_events = m_pendingEventCount;
+    snap.timers         = getTimerCount();
+}
+
+void IOManager::startLagMonitor(uint64_t interval_ms, uint64_t threshold_ms, LagCallback cb) {
+    SYLAR_ASSERT(interval_ms > 0);
+    //三种延迟都记在指标直方图中
+    Metrics::SetEnabled(true);
+    Mutex::Lock lock(m_lagMutex);
+    if(m_lagTimer) {
+        m_lagTimer->cancel();
+    }
+    ++m_lagGeneration;
+    m_lagInterval = interval_ms;
+    m_lagCb       = std::move(cb);
+    m_lagThreshold.store(m_lagCb ? threshold_ms * 1000000 : 0, std::memory_order_relaxed);
+    armLagProbe();
+}
+
+void IOManager::stopLagMonitor() {
+    Mutex::Lock lock(m_lagMutex);
+    if(m_lagTimer) {
+        m_lagTimer->cancel();
+        m_lagTimer.reset();
+    }
+    ++m_lagGeneration;
+    m_lagInterval = 0;
+    m_lagThreshold.store(0, std::memory_order_relaxed);
+    m_lagCb = nullptr;
+}
+
+void IOManager::armLagProbe() {
+    //每次到期后重新添加一次性定时器，不用循环定时器：调用stop()之后不再续期，不会让调度器一直停不下来
+    uint64_t deadline   = Metrics::Now() + m_lagInterval * 1000000;
+    uint64_t generation = m_lagGeneration;
+    m_lagTimer = addTimer(m_lagInterval, [this, deadline, generation]() {
+        onLagProbe(deadline, generation);
+    });
+}
+
+void IOManager::onLagProbe(uint64_t deadline, uint64_t generation) {
+    //每个调度线程一个探测任务，记在各自的指标槽位上，被长任务占住的线程的探测任务会晚很多
+    for(int id : getThreadIds()) {
+        schedule([this, deadline]() {
+            uint64_t now = Metrics::Now();
+            uint64_t lag = now > deadline ? now - deadline : 0;
+            recordMetric(SchedulerMetrics::PROBE_LAG, lag);
+            reportLag(LAG_PROBE, lag);
+        }, id);
+    }
+    Mutex::Lock lock(m_lagMutex);
+    if(generation != m_lagGeneration) {
+        return;
+    }
+    if(isStopping()) {
+        m_lagTimer.reset();
+        return;
+    }
+    armLagProbe();
+}
+
+void IOManager::onEventLag(uint64_t lag_ns) {
+    reportLag(LAG_EVENT, lag_ns);
+}
+
+void IOManager::reportLag(LagType type, uint64_t lag_ns) {
+    uint64_t threshold = m_lagThreshold.load(std::memory_order_relaxed);
+    if(SYLAR_LIKELY(!threshold || lag_ns < threshold)) {
+        return;
+    }
+    LagCallback cb;
+    {
+        Mutex::Lock lock(m_lagMutex);
+        cb = m_lagCb;
+    }
+    if(cb) {
+        cb(type, lag_ns);
+    }
+}
+
 void IOManager::tickle() {
     // SYLAR_LOG_DEBUG(g_logger) << "tickle";
     std::cout<<"tickle:我要做通知了"<<std::endl;
@@ -427,8 +522,10 @@ void IOManager::tickle() {
     }
     std::cout<<"write"<<std::endl;
     //向写端写一个"T" 这就是做通知的具体行为
+    SYLAR_PROBE1(sched__tickle, this);
     int rt = write(m_tickleFds[1], "T", 1);
     SYLAR_ASSERT(rt == 1);
+    addMetric(SchedulerMetrics::TICKLES_SENT);
 }
 
 bool IOManager::stopping() {
@@ -499,7 +596,17 @@ void IOManager::idle() {
 
             //返回值大于0 表示有多少个监视事件发生 并将这些事件存到events数组
             std::cout<<"tag3"<<std::endl;
+            uint64_t trace_begin = Trace::Begin();
+            uint64_t stats_begin = FiberStats::Begin();
+            SYLAR_PROBE2(epoll__wait__enter, m_epfd, (int)next_timeout);
             rt = epoll_wait(m_epfd, events, MAX_EVNETS, (int)next_timeout);
+            SYLAR_PROBE2(epoll__wait__exit, m_epfd, rt);
+            Trace::Record(Trace::EPOLL_WAIT, "epoll_wait", GetFiberId(), rt, trace_begin);
+            Fiber::GetThis()->recordBlocked(FiberStats::WAIT_IO, stats_begin);
+            if (rt >= 0) {
+                addMetric(SchedulerMetrics::EPOLL_WAKEUPS);
+                recordMetric(SchedulerMetrics::EPOLL_EVENTS, rt);
+            }
 
             std::cout<<"rt = "<<rt<<std::endl;
             
@@ -515,14 +622,20 @@ void IOManager::idle() {
         //此时是epoll_wait超时，但是不知道是否有定时器到期，所以需要我们主动检查
 
         // 收集所有已超时的定时器的回调函数，一个个执行回调函数
-        std::vector<std::function<void()>> cbs;
-        listExpiredCb(cbs);
+        std::vector<Callback> cbs;
+        uint64_t timer_late_ms = 0;
+        listExpiredCb(cbs, &timer_late_ms);
         
         std::cout<<"检测出来到期定时器共有: "<<cbs.size()<<std::endl;
         if(!cbs.empty()) {
-            for(const auto &cb : cbs) {
+            Trace::Record(Trace::TIMER_FIRE, "timer.fire", GetFiberId(), cbs.size());
+            if(SYLAR_UNLIKELY(Metrics::IsEnabled())) {
+                recordMetric(SchedulerMetrics::TIMER_LAG, timer_late_ms * 1000000);
+                reportLag(LAG_TIMER, timer_late_ms * 1000000);
+            }
+            for(auto &cb : cbs) {
                 //一个一个将定时器的执行函数push进调度器任务队列
-                schedule(cb);
+                schedule(std::move(cb));
             }
             cbs.clear();
         }
@@ -539,9 +652,11 @@ void IOManager::idle() {
                 std::cout<<"读管道事件"<<std::endl;
                 // ticklefd[0]用于通知协程调度，这时只需要把管道里的内容读完即可
                 uint8_t dummy[256];
-                //因为管道读端是边缘触发 所以要用while读完
-                while (read(m_tickleFds[0], dummy, sizeof(dummy)) > 0)
-                    ;
+                //因为管道读端是边缘触发 所以要用while读完，每个tickle写一个字节
+                ssize_t n;
+                while ((n = read(m_tickleFds[0], dummy, sizeof(dummy))) > 0) {
+                    addMetric(SchedulerMetrics::TICKLES_RECEIVED, n);
+                }
                 continue;
             }
 
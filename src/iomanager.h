@@ -1,6 +1,7 @@
 #ifndef __SYLAR_IOMANAGER_H__
 #define __SYLAR_IOMANAGER_H__
 
+#include <functional>
 #include "scheduler.h"
 #include "timer.h"
 
@@ -26,6 +27,23 @@ public:
         WRITE = 0x4,
     };
 
+    /**
+     * @brief 事件循环延迟的来源，见startLagMonitor()
+     */
+    enum LagType {
+        /// 一批到期的定时器中最晚的一个比到期时间晚了多久
+        LAG_TIMER,
+        /// IO事件就绪到对应任务开始执行的时间
+        LAG_EVENT,
+        /// 延迟探测任务比预定时间晚了多久
+        LAG_PROBE
+    };
+
+    /**
+     * @brief 延迟超过阈值时的回调，在发生延迟的调度线程中调用，lag_ns单位纳秒
+     */
+    typedef std::function<void(LagType type, uint64_t lag_ns)> LagCallback;
+
 private:
     /**
      * @brief socket fd上下文类(三元组)     相当于客户信息，server端每接收一个新client连接都会创建一个三元组
@@ -47,7 +65,7 @@ private:
             Fiber::ptr fiber;
 
             /// 事件回调函数
-            std::function<void()> cb;
+            Callback cb;
         };
 
         /**
@@ -108,7 +126,7 @@ public:
      * @param[in] cb 事件回调函数，如果为空，则默认把当前协程作为回调执行体
      * @return 添加成功返回0,失败返回-1
      */
-    int addEvent(int fd, Event event, std::function<void()> cb = nullptr);
+    int addEvent(int fd, Event event, Callback cb = nullptr);
 
     /**
      * @brief 从epollfd中删除一个监视事件
@@ -129,6 +147,17 @@ public:
      */
     bool cancelEvent(int fd, Event event);
 
+    /**
+     * @brief 取消指定协程注册的事件
+     * @details 在FdContext的锁内确认事件是fiber注册的才取消并触发，
+     *          事件已经触发过、或者已经被其他协程重新注册时什么也不做
+     * @param[in] fd socket句柄
+     * @param[in] event 事件类型
+     * @param[in] fiber 注册事件的协程，为空时同cancelEvent(fd, event)
+     * @return 是否删除成功
+     */
+    bool cancelEvent(int fd, Event event, Fiber *fiber);
+
     /**
      * @brief 取消fd注册的所有事件 也就是取消fd注册的所有读事件或者写事件 只要注册过统统删除
      * @details 所有被注册的回调事件在cancel之前都会被执行一次
@@ -142,6 +171,29 @@ public:
      */
     static IOManager *GetThis();
 
+    /**
+     * @brief 在调度器指标之外加上等待中的IO事件数和定时器数
+     */
+    void getMetrics(SchedulerMetrics::Snapshot &snap) override;
+
+    /**
+     * @brief 开始监控事件循环延迟
+     * @details 每隔interval_ms毫秒向每个调度线程各投递一个探测任务，任务开始执行的时间比预定时间晚了多久记入PROBE_LAG直方图，
+     *          这段时间包括定时器晚到期、任务排队和线程被长任务占住的时间，某个线程被阻塞时它的探测任务会明显变晚。
+     *          此外定时器晚到期(TIMER_LAG)和IO事件就绪后排队(EVENT_LAG)在打开指标记录时一直都会记录，本函数会打开指标记录。
+     *          三种延迟中任意一种达到threshold_ms时调用cb，回调应尽快返回。
+     *          重复调用会替换之前的设置；调用stop()之后探测定时器不再续期
+     * @param[in] interval_ms 探测间隔(毫秒)，大于0
+     * @param[in] threshold_ms 回调的阈值(毫秒)，为0或cb为空时不回调
+     * @param[in] cb 延迟超过阈值时的回调
+     */
+    void startLagMonitor(uint64_t interval_ms, uint64_t threshold_ms = 0, LagCallback cb = nullptr);
+
+    /**
+     * @brief 停止探测，不再回调
+     */
+    void stopLagMonitor();
+
 protected:
     /**
      * @brief 通知调度器有任务要调度
@@ -180,6 +232,29 @@ protected:
      */
     void contextResize(size_t size);
 
+    /**
+     * @brief 检查IO事件就绪后的排队时间是否超过阈值
+     */
+    void onEventLag(uint64_t lag_ns) override;
+
+private:
+    /**
+     * @brief 添加下一次探测的定时器，调用时持有m_lagMutex
+     */
+    void armLagProbe();
+
+    /**
+     * @brief 探测定时器到期，向每个调度线程投递探测任务
+     * @param[in] deadline 预定时间(纳秒，Metrics::Now())
+     * @param[in] generation 添加定时器时的m_lagGeneration，不一致说明监控已经停止或重新开始，不再续期
+     */
+    void onLagProbe(uint64_t deadline, uint64_t generation);
+
+    /**
+     * @brief 延迟达到阈值时调用回调
+     */
+    void reportLag(LagType type, uint64_t lag_ns);
+
 private:
 
     /// epoll 文件句柄 也就是epollfd
@@ -197,6 +272,19 @@ private:
 
     /// socket事件上下文(三元组)的容器 注意元素类型是任务类的原始指针而不是智能指针，所以要手动释放
     std::vector<FdContext *> m_fdContexts;
+
+    /// 保护延迟监控的设置
+    Mutex m_lagMutex;
+    /// 探测间隔(毫秒)，0表示没有在探测
+    uint64_t m_lagInterval = 0;
+    /// 每次开始或停止监控加一
+    uint64_t m_lagGeneration = 0;
+    /// 下一次探测的定时器
+    Timer::ptr m_lagTimer;
+    /// 延迟超过阈值时的回调
+    LagCallback m_lagCb;
+    /// 回调的阈值(纳秒)，0表示不回调，记录延迟的地方不加锁读
+    std::atomic<uint64_t> m_lagThreshold{0};
 };
 
 } // end namespace sylar
@@ -0,0 +1,217 @@
+/**
+ * @file metrics.cc
+ * @brief 调度器与IO调度器的运行时指标实现
+ * @version 0.1
+ */
+
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include "metrics.h"
+
+namespace sylar {
+
+namespace detail {
+std::atomic<bool> g_metrics_enabled{false};
+} // namespace detail
+
+namespace {
+
+std::string EscapeLabel(const std::string &s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '\\' || c == '"') {
+            out.push_back('\\');
+            out.push_back(c);
+        } else if (c == '\n') {
+            out += "\\n";
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+void WriteHeader(std::ostream &os, const char *name, const char *type, const char *help) {
+    os << "# HELP " << name << " " << help << "\n";
+    os << "# TYPE " << name << " " << type << "\n";
+}
+
+void WriteValue(std::ostream &os, const char *name, const char *type, const char *help,
+                const std::string &label, uint64_t v) {
+    WriteHeader(os, name, type, help);
+    os << name << "{scheduler=\"" << label << "\"} " << v << "\n";
+}
+
+/**
+ * @brief 直方图按summary输出，scale把记录的单位换算成输出的单位
+ */
+void WriteSummary(std::ostream &os, const char *name, const char *help, const std::string &label,
+                  const HistogramSnapshot &h, double scale) {
+    static const double kQuantiles[] = {0.5, 0.9, 0.99, 0.999};
+    WriteHeader(os, name, "summary", help);
+    for (double q : kQuantiles) {
+        os << name << "{scheduler=\"" << label << "\",quantile=\"" << q << "\"} " << h.percentile(q) * scale
+           << "\n";
+    }
+    os << name << "_sum{scheduler=\"" << label << "\"} " << h.sum * scale << "\n";
+    os << name << "_count{scheduler=\"" << label << "\"} " << h.count << "\n";
+}
+
+} // namespace
+
+uint64_t HistogramSnapshot::percentile(double p) const {
+    if (!count) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)ceil(p * count);
+    target          = std::max<uint64_t>(1, std::min(target, count));
+    uint64_t seen   = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= target) {
+            return std::min(Histogram::BucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+Histogram::Histogram()
+    : m_count(0)
+    , m_sum(0)
+    , m_max(0) {
+    for (auto &i : m_buckets) {
+        i.store(0, std::memory_order_relaxed);
+    }
+}
+
+size_t Histogram::BucketIndex(uint64_t v) {
+    if (v < kSubBuckets) {
+        return v;
+    }
+    size_t e = 63 - __builtin_clzll(v);
+    size_t m = (v >> (e - kSubBits)) & (kSubBuckets - 1);
+    return (e - kSubBits + 1) * kSubBuckets + m;
+}
+
+uint64_t Histogram::BucketLowerBound(size_t idx) {
+    if (idx < kSubBuckets) {
+        return idx;
+    }
+    size_t e = idx / kSubBuckets + kSubBits - 1;
+    size_t m = idx % kSubBuckets;
+    return (uint64_t)(kSubBuckets + m) << (e - kSubBits);
+}
+
+uint64_t Histogram::BucketUpperBound(size_t idx) {
+    if (idx < kSubBuckets) {
+        return idx;
+    }
+    size_t e = idx / kSubBuckets + kSubBits - 1;
+    return BucketLowerBound(idx) + ((uint64_t)1 << (e - kSubBits)) - 1;
+}
+
+void Histogram::record(uint64_t v) {
+    m_buckets[BucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(v, std::memory_order_relaxed);
+    uint64_t max = m_max.load(std::memory_order_relaxed);
+    while (v > max && !m_max.compare_exchange_weak(max, v, std::memory_order_relaxed)) {
+    }
+}
+
+void Histogram::mergeTo(HistogramSnapshot &snap) const {
+    if (snap.buckets.size() != kBuckets) {
+        snap.buckets.resize(kBuckets, 0);
+    }
+    for (size_t i = 0; i < kBuckets; ++i) {
+        snap.buckets[i] += m_buckets[i].load(std::memory_order_relaxed);
+    }
+    snap.count += m_count.load(std::memory_order_relaxed);
+    snap.sum += m_sum.load(std::memory_order_relaxed);
+    snap.max = std::max(snap.max, m_max.load(std::memory_order_relaxed));
+}
+
+void Histogram::reset() {
+    for (auto &i : m_buckets) {
+        i.store(0, std::memory_order_relaxed);
+    }
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+void Metrics::SetEnabled(bool v) {
+    detail::g_metrics_enabled.store(v, std::memory_order_relaxed);
+}
+
+uint64_t Metrics::Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+SchedulerMetrics::Slot::Slot() {
+    for (auto &i : counters) {
+        i.store(0, std::memory_order_relaxed);
+    }
+}
+
+SchedulerMetrics::SchedulerMetrics(size_t slots) {
+    for (size_t i = 0; i < slots; ++i) {
+        m_slots.emplace_back(new Slot);
+    }
+}
+
+void SchedulerMetrics::collect(Snapshot &snap) const {
+    for (auto &slot : m_slots) {
+        for (size_t i = 0; i < COUNTER_NUM; ++i) {
+            snap.counters[i] += slot->counters[i].load(std::memory_order_relaxed);
+        }
+        for (size_t i = 0; i < HISTOGRAM_NUM; ++i) {
+            slot->histograms[i].mergeTo(snap.histograms[i]);
+        }
+    }
+}
+
+void SchedulerMetrics::WritePrometheus(std::ostream &os, const Snapshot &snap) {
+    std::string label = EscapeLabel(snap.name);
+    WriteValue(os, "sylar_scheduler_tasks_total", "counter", "Tasks resumed by the scheduler.", label,
+               snap.counters[TASKS]);
+    WriteValue(os, "sylar_scheduler_tickles_sent_total", "counter", "Tickles sent to wake idle workers.", label,
+               snap.counters[TICKLES_SENT]);
+    WriteValue(os, "sylar_scheduler_tickles_received_total", "counter", "Tickles consumed by idle workers.",
+               label, snap.counters[TICKLES_RECEIVED]);
+    WriteValue(os, "sylar_scheduler_epoll_wakeups_total", "counter", "Returns from epoll_wait.", label,
+               snap.counters[EPOLL_WAKEUPS]);
+    WriteHeader(os, "sylar_scheduler_idle_seconds_total", "counter", "Time workers spent in the idle fiber.");
+    os << "sylar_scheduler_idle_seconds_total{scheduler=\"" << label << "\"} " << snap.counters[IDLE_NS] / 1e9
+       << "\n";
+
+    WriteValue(os, "sylar_scheduler_queue_depth", "gauge", "Tasks waiting in the run queue.", label,
+               snap.queue_depth);
+    WriteValue(os, "sylar_scheduler_active_threads", "gauge", "Workers running a task.", label,
+               snap.active_threads);
+    WriteValue(os, "sylar_scheduler_idle_threads", "gauge", "Workers in the idle fiber.", label,
+               snap.idle_threads);
+    WriteValue(os, "sylar_scheduler_pending_events", "gauge", "IO events waiting to trigger.", label,
+               snap.pending_events);
+    WriteValue(os, "sylar_scheduler_timers", "gauge", "Timers not yet fired.", label, snap.timers);
+
+    WriteSummary(os, "sylar_scheduler_queue_wait_seconds", "Time from schedule() to dequeue.", label,
+                 snap.histograms[QUEUE_WAIT], 1e-9);
+    WriteSummary(os, "sylar_scheduler_resume_seconds", "Time from resume to yield back to the scheduler.", label,
+                 snap.histograms[RESUME], 1e-9);
+    WriteSummary(os, "sylar_scheduler_idle_duration_seconds", "Time of one stay in the idle fiber.", label,
+                 snap.histograms[IDLE], 1e-9);
+    WriteSummary(os, "sylar_scheduler_epoll_events", "Ready events returned by one epoll_wait.", label,
+                 snap.histograms[EPOLL_EVENTS], 1);
+    WriteSummary(os, "sylar_scheduler_timer_lag_seconds", "Lateness of the latest timer in each expired batch.",
+                 label, snap.histograms[TIMER_LAG], 1e-9);
+    WriteSummary(os, "sylar_scheduler_event_lag_seconds", "Time from an IO event becoming ready to its task running.",
+                 label, snap.histograms[EVENT_LAG], 1e-9);
+    WriteSummary(os, "sylar_scheduler_probe_lag_seconds", "Lateness of the per-worker lag probe.", label,
+                 snap.histograms[PROBE_LAG], 1e-9);
+}
+
+} // namespace sylar
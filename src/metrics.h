@@ -0,0 +1,232 @@
+/**
+ * @file metrics.h
+ * @brief 调度器与IO调度器的运行时指标
+ * @details 每个调度线程写自己的一组计数器和直方图(整组按缓存行隔开，线程之间没有伪共享)，读取时再汇总所有线程。
+ *          直方图是HDR风格的对数线性分桶：按2的幂分段，每段再等分16个子桶，相对误差不超过1/16，
+ *          覆盖整个uint64_t范围，记录只是几次relaxed原子加。
+ *          通过Scheduler::getMetrics()取快照，WritePrometheus()输出Prometheus文本格式：
+ *          计数器为counter，直方图按summary输出分位数、_sum和_count，时间单位为秒。
+ *          默认关闭，Metrics::SetEnabled(true)或IOManager::startLagMonitor()打开；关闭时不读时钟也不记录
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_METRICS_H__
+#define __SYLAR_METRICS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "macro.h"
+
+namespace sylar {
+
+namespace detail {
+/// 指标开关，放在头文件中让记录点内联判断
+extern std::atomic<bool> g_metrics_enabled;
+} // namespace detail
+
+/**
+ * @brief 直方图快照，普通数组，可以合并、求分位数
+ */
+struct HistogramSnapshot {
+    std::vector<uint64_t> buckets;
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+    uint64_t max   = 0;
+
+    /**
+     * @brief 分位数，返回所在桶的上界(不超过最大值)，没有样本时返回0
+     * @param[in] p (0, 1]
+     */
+    uint64_t percentile(double p) const;
+
+    /**
+     * @brief 平均值
+     */
+    double mean() const { return count ? (double)sum / count : 0; }
+};
+
+/**
+ * @brief 对数线性分桶的直方图，可以多线程同时记录，通常每个线程记录自己的一份
+ */
+class Histogram {
+public:
+    /// 每段的子桶数为2^kSubBits
+    static const size_t kSubBits = 4;
+    static const size_t kSubBuckets = 1 << kSubBits;
+    /// 小于kSubBuckets的值每个值一个桶，之后每个2的幂一段
+    static const size_t kBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+    Histogram();
+
+    /**
+     * @brief 记录一个值
+     */
+    void record(uint64_t v);
+
+    /**
+     * @brief 累加到快照中
+     */
+    void mergeTo(HistogramSnapshot &snap) const;
+
+    /**
+     * @brief 清空，与record()并发时个别值可能没有被清零
+     */
+    void reset();
+
+    /**
+     * @brief 值所在的桶
+     */
+    static size_t BucketIndex(uint64_t v);
+
+    /**
+     * @brief 桶能表示的最小值
+     */
+    static uint64_t BucketLowerBound(size_t idx);
+
+    /**
+     * @brief 桶能表示的最大值
+     */
+    static uint64_t BucketUpperBound(size_t idx);
+
+private:
+    std::atomic<uint64_t> m_buckets[kBuckets];
+    std::atomic<uint64_t> m_count;
+    std::atomic<uint64_t> m_sum;
+    std::atomic<uint64_t> m_max;
+};
+
+/**
+ * @brief 指标开关与时钟
+ */
+class Metrics {
+public:
+    /**
+     * @brief 打开或关闭指标记录，默认关闭
+     */
+    static void SetEnabled(bool v);
+
+    /**
+     * @brief 是否打开了指标记录
+     */
+    static bool IsEnabled() { return detail::g_metrics_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 当前时间，单位纳秒
+     */
+    static uint64_t Now();
+
+    /**
+     * @brief 打开了指标记录时返回当前时间，否则返回0
+     */
+    static uint64_t Begin() { return SYLAR_UNLIKELY(IsEnabled()) ? Now() : 0; }
+};
+
+/**
+ * @brief 调度器的指标，每个调度线程一个槽位，非调度线程共用最后一个槽位
+ */
+class SchedulerMetrics {
+public:
+    /**
+     * @brief 计数器
+     */
+    enum CounterType {
+        /// 执行的任务数(一次resume计一次)
+        TASKS,
+        /// 发出的tickle数
+        TICKLES_SENT,
+        /// idle中收到的tickle数
+        TICKLES_RECEIVED,
+        /// epoll_wait返回次数
+        EPOLL_WAKEUPS,
+        /// 待在idle协程中的总时间，纳秒
+        IDLE_NS,
+        COUNTER_NUM
+    };
+
+    /**
+     * @brief 直方图
+     */
+    enum HistogramType {
+        /// 任务从加入队列到被取出的等待时间，纳秒
+        QUEUE_WAIT,
+        /// 一次resume到yield回调度协程的时间，纳秒
+        RESUME,
+        /// 一次进入idle协程到回到调度协程的时间，纳秒
+        IDLE,
+        /// 每次epoll_wait返回的就绪事件数
+        EPOLL_EVENTS,
+        /// 每批到期的定时器中最晚的一个比到期时间晚了多久，纳秒(定时器精度为毫秒)，只有IOManager有
+        TIMER_LAG,
+        /// IO事件就绪到对应任务开始执行的时间，纳秒
+        EVENT_LAG,
+        /// 延迟探测任务比预定时间晚了多久，纳秒，见IOManager::startLagMonitor()
+        PROBE_LAG,
+        HISTOGRAM_NUM
+    };
+
+    /**
+     * @brief 汇总后的快照
+     */
+    struct Snapshot {
+        /// 调度器名称
+        std::string name;
+        uint64_t counters[COUNTER_NUM] = {0};
+        HistogramSnapshot histograms[HISTOGRAM_NUM];
+        /// 任务队列长度
+        uint64_t queue_depth = 0;
+        /// 正在执行任务的线程数
+        uint64_t active_threads = 0;
+        /// 在idle中的线程数
+        uint64_t idle_threads = 0;
+        /// 等待中的IO事件数，只有IOManager有
+        uint64_t pending_events = 0;
+        /// 还没触发的定时器数，只有IOManager有
+        uint64_t timers = 0;
+    };
+
+    /**
+     * @param[in] slots 槽位数，调度线程数+1
+     */
+    explicit SchedulerMetrics(size_t slots);
+
+    size_t getSlotCount() const { return m_slots.size(); }
+
+    void add(size_t slot, CounterType type, uint64_t v = 1) {
+        m_slots[slot]->counters[type].fetch_add(v, std::memory_order_relaxed);
+    }
+
+    void record(size_t slot, HistogramType type, uint64_t v) { m_slots[slot]->histograms[type].record(v); }
+
+    /**
+     * @brief 汇总所有槽位的计数器和直方图到快照中
+     */
+    void collect(Snapshot &snap) const;
+
+    /**
+     * @brief 输出Prometheus文本格式，指标名以sylar_scheduler_开头，带scheduler标签
+     */
+    static void WritePrometheus(std::ostream &os, const Snapshot &snap);
+
+private:
+    /**
+     * @brief 一个线程的指标，单独分配，前面留一个缓存行隔开相邻的分配
+     */
+    struct Slot {
+        char pad[64];
+        std::atomic<uint64_t> counters[COUNTER_NUM];
+        Histogram histograms[HISTOGRAM_NUM];
+
+        Slot();
+    };
+
+    std::vector<std::unique_ptr<Slot>> m_slots;
+};
+
+} // namespace sylar
+
+#endif
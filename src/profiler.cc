@@ -0,0 +1,424 @@
+/**
+ * @file profiler.cc
+ * @brief 按协程归类的采样profiler实现
+ * @version 0.1
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <vector>
+#include "fiber.h"
+#include "mutex.h"
+#include "profiler.h"
+#include "thread.h"
+#include "util.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace sylar {
+
+namespace {
+
+/// 回溯的最大层数
+const int kMaxDepth = 32;
+
+/// 每个线程环形缓冲区的样本数，必须是2的幂；后台线程每50ms汇总一次，99Hz下只需要几个槽位
+const uint64_t kRingSize = 256;
+
+/**
+ * @brief 一个样本，pcs[0]是被打断处
+ */
+struct Sample {
+    uint64_t fiber_id;
+    const char *tag;
+    uint32_t depth;
+    void *pcs[kMaxDepth];
+};
+
+/**
+ * @brief 单生产者单消费者环形缓冲区，生产者是本线程的信号处理函数，消费者是汇总线程
+ */
+struct Ring {
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    Sample samples[kRingSize];
+};
+
+/**
+ * @brief 登记的线程
+ */
+struct ThreadState {
+    pid_t tid;
+    pthread_t thread;
+    /// 线程栈的范围，不在协程中时用它限制回溯
+    uintptr_t stack_lo = 0;
+    uintptr_t stack_hi = 0;
+    /// 第一次采样时分配，线程取消登记并且汇总完之后释放
+    std::atomic<Ring *> ring{nullptr};
+    /// 以下成员受RegistryMutex保护
+    timer_t timer;
+    bool has_timer = false;
+    bool alive     = true;
+
+    ~ThreadState() { delete ring.load(); }
+};
+
+Mutex &RegistryMutex() {
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+std::vector<std::shared_ptr<ThreadState>> &Registry() {
+    static std::vector<std::shared_ptr<ThreadState>> s_registry;
+    return s_registry;
+}
+
+/// 本线程的登记，信号处理函数只读它
+thread_local ThreadState *t_state = nullptr;
+
+/// RegisterThread的嵌套层数
+thread_local int t_depth = 0;
+
+bool s_running    = false;
+uint32_t s_hz     = 99;
+bool s_by_fiber   = false;
+bool s_installed  = false;
+std::unique_ptr<Thread> s_drainer;
+std::atomic<bool> s_stop_drainer{false};
+std::atomic<uint64_t> s_dropped{0};
+
+/**
+ * @brief 汇总的键：协程tag、协程id和调用栈
+ * @details 只有Start时要求按协程区分才记协程id，否则为kNoFiberId，汇总结果的大小不随采到的协程数增长
+ */
+struct Key {
+    const char *tag;
+    uint64_t fiber_id;
+    std::vector<void *> pcs;
+
+    bool operator<(const Key &rhs) const {
+        if (tag != rhs.tag) {
+            return tag < rhs.tag;
+        }
+        if (fiber_id != rhs.fiber_id) {
+            return fiber_id < rhs.fiber_id;
+        }
+        return pcs < rhs.pcs;
+    }
+};
+
+const uint64_t kNoFiberId = ~0ull;
+
+Mutex &AggMutex() {
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+std::map<Key, uint64_t> &Aggregate() {
+    static std::map<Key, uint64_t> s_agg;
+    return s_agg;
+}
+
+uint64_t s_samples = 0;
+
+void OnProf(int, siginfo_t *, void *uctx) {
+    ThreadState *st = t_state;
+    if (!st) {
+        return;
+    }
+    Ring *ring = st->ring.load(std::memory_order_relaxed);
+    if (!ring) {
+        return;
+    }
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if (head - ring->tail.load(std::memory_order_acquire) >= kRingSize) {
+        s_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Sample &s   = ring->samples[head & (kRingSize - 1)];
+    Fiber *f    = Fiber::GetCurrent();
+    s.fiber_id  = f ? f->getId() : 0;
+    s.tag       = f ? f->getTag() : nullptr;
+    s.depth     = 0;
+    uintptr_t lo = st->stack_lo, hi = st->stack_hi;
+    if (f && f->getStack()) {
+        lo = (uintptr_t)f->getStack();
+        hi = lo + f->getStackSize();
+    }
+#if defined(__x86_64__)
+    const greg_t *regs = ((ucontext_t *)uctx)->uc_mcontext.gregs;
+    s.pcs[s.depth++]   = (void *)regs[REG_RIP];
+    uintptr_t fp       = regs[REG_RBP];
+    //只读当前栈以内的内存，rbp不是帧指针时很快就会越界停止
+    while (s.depth < (uint32_t)kMaxDepth && fp >= lo && fp + 2 * sizeof(uintptr_t) <= hi &&
+           fp % sizeof(uintptr_t) == 0) {
+        uintptr_t *frame = (uintptr_t *)fp;
+        if (!frame[1]) {
+            break;
+        }
+        s.pcs[s.depth++] = (void *)frame[1];
+        if (frame[0] <= fp) {
+            break;
+        }
+        fp = frame[0];
+    }
+#endif
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+void InstallHandler() {
+    if (s_installed) {
+        return;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = &OnProf;
+    sa.sa_flags     = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGPROF, &sa, nullptr);
+    s_installed = true;
+}
+
+/**
+ * @brief 给线程创建按其CPU时间计时的定时器，需要持有RegistryMutex
+ */
+void StartTimer(ThreadState *st) {
+    if (st->has_timer || !st->alive) {
+        return;
+    }
+    if (!st->ring.load()) {
+        st->ring.store(new Ring);
+    }
+    clockid_t clock;
+    if (pthread_getcpuclockid(st->thread, &clock)) {
+        return;
+    }
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify           = SIGEV_THREAD_ID;
+    sev.sigev_signo            = SIGPROF;
+    sev.sigev_notify_thread_id = st->tid;
+    if (timer_create(clock, &sev, &st->timer)) {
+        return;
+    }
+    struct itimerspec its;
+    uint64_t interval       = 1000000000ull / s_hz;
+    its.it_interval.tv_sec  = interval / 1000000000ull;
+    its.it_interval.tv_nsec = interval % 1000000000ull;
+    its.it_value            = its.it_interval;
+    timer_settime(st->timer, 0, &its, nullptr);
+    st->has_timer = true;
+}
+
+void StopTimer(ThreadState *st) {
+    if (st->has_timer) {
+        timer_delete(st->timer);
+        st->has_timer = false;
+    }
+}
+
+/**
+ * @brief 把所有线程缓冲区中的样本并入汇总结果，释放已经取消登记的线程
+ */
+void Drain() {
+    Mutex::Lock lock(RegistryMutex());
+    Mutex::Lock lock2(AggMutex());
+    auto &registry = Registry();
+    for (auto &st : registry) {
+        Ring *ring = st->ring.load();
+        if (!ring) {
+            continue;
+        }
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        for (; tail != head; ++tail) {
+            const Sample &s = ring->samples[tail & (kRingSize - 1)];
+            Key key;
+            key.tag      = s.tag;
+            key.fiber_id = s_by_fiber ? s.fiber_id : kNoFiberId;
+            key.pcs.assign(s.pcs, s.pcs + s.depth);
+            ++Aggregate()[key];
+            ++s_samples;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+    }
+    registry.erase(std::remove_if(registry.begin(), registry.end(),
+                                  [](const std::shared_ptr<ThreadState> &st) { return !st->alive; }),
+                   registry.end());
+}
+
+void DrainLoop() {
+    while (!s_stop_drainer.load()) {
+        usleep(50 * 1000);
+        Drain();
+    }
+}
+
+/**
+ * @brief 地址解析成函数名，folded格式用分号分隔帧，名字中的分号换成冒号
+ */
+const std::string &Symbolize(void *pc, std::map<void *, std::string> &cache) {
+    auto it = cache.find(pc);
+    if (it != cache.end()) {
+        return it->second;
+    }
+    std::vector<std::string> names;
+    BacktraceSymbols(&pc, 1, names);
+    std::string name = names.empty() ? "??" : names[0];
+    //没有解析成C++函数名的是"模块(符号+偏移)"，只保留符号，同一函数的不同位置合并成一帧
+    size_t left = name.find('('), plus = name.find('+', left);
+    if (left != std::string::npos && plus != std::string::npos && plus > left + 1 &&
+        name.compare(plus, 3, "+0x") == 0 && name.back() == ')') {
+        name = name.substr(left + 1, plus - left - 1);
+    }
+    std::replace(name.begin(), name.end(), ';', ':');
+    return cache[pc] = name;
+}
+
+} // namespace
+
+bool Profiler::Start(uint32_t hz, bool by_fiber) {
+    Mutex::Lock lock(RegistryMutex());
+    if (s_running) {
+        return false;
+    }
+    InstallHandler();
+    s_running  = true;
+    s_hz       = hz ? hz : 99;
+    s_by_fiber = by_fiber;
+    for (auto &st : Registry()) {
+        StartTimer(st.get());
+    }
+    s_stop_drainer = false;
+    s_drainer.reset(new Thread(&DrainLoop, "profiler"));
+    return true;
+}
+
+void Profiler::Stop() {
+    {
+        Mutex::Lock lock(RegistryMutex());
+        if (!s_running) {
+            return;
+        }
+        s_running = false;
+        for (auto &st : Registry()) {
+            StopTimer(st.get());
+        }
+    }
+    s_stop_drainer = true;
+    s_drainer->join();
+    s_drainer.reset();
+    Drain();
+}
+
+bool Profiler::IsRunning() {
+    Mutex::Lock lock(RegistryMutex());
+    return s_running;
+}
+
+void Profiler::RegisterThread() {
+    if (t_depth++) {
+        return;
+    }
+    std::shared_ptr<ThreadState> st(new ThreadState);
+    st->tid    = GetThreadId();
+    st->thread = pthread_self();
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void *addr  = nullptr;
+        size_t size = 0;
+        if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+            st->stack_lo = (uintptr_t)addr;
+            st->stack_hi = (uintptr_t)addr + size;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    Mutex::Lock lock(RegistryMutex());
+    Registry().push_back(st);
+    t_state = st.get();
+    if (s_running) {
+        StartTimer(st.get());
+    }
+}
+
+void Profiler::UnregisterThread() {
+    if (!t_depth || --t_depth) {
+        return;
+    }
+    ThreadState *st = t_state;
+    //先让信号处理函数看不到登记，之后才到达的信号什么也不做
+    t_state = nullptr;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    Mutex::Lock lock(RegistryMutex());
+    StopTimer(st);
+    st->alive = false;
+}
+
+uint64_t Profiler::GetSampleCount() {
+    Drain();
+    Mutex::Lock lock(AggMutex());
+    return s_samples;
+}
+
+uint64_t Profiler::GetDroppedCount() {
+    return s_dropped.load(std::memory_order_relaxed);
+}
+
+void Profiler::WriteFolded(std::ostream &os, const std::string &tag, bool by_fiber) {
+    Drain();
+    std::map<std::string, uint64_t> folded;
+    std::map<void *, std::string> cache;
+    {
+        Mutex::Lock lock(AggMutex());
+        for (auto &i : Aggregate()) {
+            std::string name = i.first.tag ? i.first.tag : "untagged";
+            if (!tag.empty() && name != tag) {
+                continue;
+            }
+            if (by_fiber && i.first.fiber_id != kNoFiberId) {
+                name += ";fiber_" + std::to_string(i.first.fiber_id);
+            }
+            //最外层帧在前，返回地址减一落在call指令上，避免解析到下一个函数
+            const std::vector<void *> &pcs = i.first.pcs;
+            for (size_t j = pcs.size(); j > 0; --j) {
+                void *pc = j == 1 ? pcs[0] : (void *)((uintptr_t)pcs[j - 1] - 1);
+                name += ";" + Symbolize(pc, cache);
+            }
+            folded[name] += i.second;
+        }
+    }
+    for (auto &i : folded) {
+        os << i.first << " " << i.second << "\n";
+    }
+    os.flush();
+}
+
+bool Profiler::DumpToFile(const std::string &path, const std::string &tag, bool by_fiber) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        return false;
+    }
+    WriteFolded(ofs, tag, by_fiber);
+    return (bool)ofs;
+}
+
+void Profiler::Reset() {
+    Drain();
+    Mutex::Lock lock(AggMutex());
+    Aggregate().clear();
+    s_samples = 0;
+    s_dropped = 0;
+}
+
+} // namespace sylar
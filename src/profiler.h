@@ -0,0 +1,92 @@
+/**
+ * @file profiler.h
+ * @brief 按协程归类的采样profiler
+ * @details perf的火焰图里所有协程都叠在Fiber::MainFunc下面，分不出是哪类请求。
+ *          这里每个登记的线程一个按线程CPU时间计时的定时器(timer_create + SIGEV_THREAD_ID)，到期时给该线程发SIGPROF，
+ *          信号处理函数记下当前协程的id和tag，从信号打断处的rbp沿帧指针回溯(只读当前协程栈或线程栈以内的内存)，
+ *          写入本线程的无锁环形缓冲区；后台线程定期把缓冲区汇总起来。输出folded stack格式，第一帧是协程的tag，
+ *          可以直接交给flamegraph.pl，或者只输出某个tag得到一类请求的火焰图：
+ *          sylar::Profiler::Start(99);
+ *          ...
+ *          sylar::Profiler::Stop();
+ *          sylar::Profiler::DumpToFile("prof.folded");   // flamegraph.pl prof.folded > prof.svg
+ *          调度器的工作线程在Scheduler::run中自动登记，可以在运行中随时Start/Stop，不需要重启进程。
+ *          需要-fno-omit-frame-pointer编译才有完整的调用栈，否则只有被打断处一帧；加上-rdynamic才能解析出函数名
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_PROFILER_H__
+#define __SYLAR_PROFILER_H__
+
+#include <stdint.h>
+#include <ostream>
+#include <string>
+
+namespace sylar {
+
+/**
+ * @brief 采样profiler
+ */
+class Profiler {
+public:
+    /**
+     * @brief 开始采样，给所有登记的线程创建定时器
+     * @param[in] hz 每个线程每秒CPU时间的采样次数，实际精度受内核时钟节拍限制
+     * @param[in] by_fiber 是否按协程id分别汇总，WriteFolded的by_fiber需要它；
+     *            协程多而短命时汇总结果随采到的协程数增长，默认只按tag和调用栈汇总
+     * @return 已经在采样时返回false
+     */
+    static bool Start(uint32_t hz = 99, bool by_fiber = false);
+
+    /**
+     * @brief 停止采样，删除所有定时器并汇总缓冲区中剩下的样本，汇总结果保留到Reset
+     */
+    static void Stop();
+
+    /**
+     * @brief 是否正在采样
+     */
+    static bool IsRunning();
+
+    /**
+     * @brief 登记当前线程，之后(或正在)采样时为其创建定时器
+     * @details 可以嵌套调用，和UnregisterThread配对
+     */
+    static void RegisterThread();
+
+    /**
+     * @brief 取消登记当前线程，线程退出前调用
+     */
+    static void UnregisterThread();
+
+    /**
+     * @brief 汇总的样本数
+     */
+    static uint64_t GetSampleCount();
+
+    /**
+     * @brief 缓冲区满而丢掉的样本数
+     */
+    static uint64_t GetDroppedCount();
+
+    /**
+     * @brief 输出folded stack：每行"tag;最外层帧;...;最内层帧 样本数"
+     * @param[in] tag 只输出该tag的样本，为空时输出全部
+     * @param[in] by_fiber 是否在tag之后再按协程id分一层，只对Start(hz, true)期间的样本有效
+     */
+    static void WriteFolded(std::ostream &os, const std::string &tag = "", bool by_fiber = false);
+
+    /**
+     * @brief 输出到文件
+     */
+    static bool DumpToFile(const std::string &path, const std::string &tag = "", bool by_fiber = false);
+
+    /**
+     * @brief 清空汇总的样本
+     */
+    static void Reset();
+};
+
+} // namespace sylar
+
+#endif
@@ -1,6 +1,9 @@
 #include "scheduler.h"
 // #include "macro.h"
 #include "hook.h"       //因为run中的set_hook_enable
+#include "fiber_registry.h"
+#include "profiler.h"
+#include <algorithm>
 #include <cassert>
 #include "util.h"
 namespace sylar {
@@ -13,12 +16,18 @@ static thread_local Scheduler *thread_scheduler = nullptr;
 /// 当前线程的调度协程，每个线程都独有一份
 static thread_local Fiber *thread_scheduler_fiber = nullptr;
 
+/// 当前线程在哪个调度器中分到了指标槽位，以及槽位下标
+static thread_local Scheduler *thread_metrics_owner = nullptr;
+static thread_local size_t thread_metrics_slot     = 0;
+
 Scheduler::Scheduler(size_t threads, bool use_caller, const std::string &name) {
     assert(threads > 0);
     //SYLAR_ASSERT(threads > 0);
 
     m_useCaller = use_caller;
     m_name      = name;
+    //每个调度线程(含caller线程)一个槽位，再加一个给非调度线程共用
+    m_metrics.reset(new SchedulerMetrics(threads + 1));
 
     if (use_caller) {
         --threads;
@@ -70,6 +79,34 @@ void Scheduler::setThis() {
     thread_scheduler = this;
 }
 
+size_t Scheduler::metricsSlot() const {
+    return thread_metrics_owner == this ? thread_metrics_slot : m_metrics->getSlotCount() - 1;
+}
+
+void Scheduler::getMetrics(SchedulerMetrics::Snapshot &snap) {
+    snap.name = m_name;
+    m_metrics->collect(snap);
+    {
+        MutexType::Lock lock(m_mutex);
+        snap.queue_depth = m_tasks.size() + m_deadlineTasks.size();
+    }
+    snap.active_threads = m_activeThreadCount;
+    snap.idle_threads   = m_idleThreadCount;
+}
+
+void Scheduler::recordResume(uint64_t begin) {
+    addMetric(SchedulerMetrics::TASKS);
+    if (begin) {
+        recordMetric(SchedulerMetrics::RESUME, Metrics::Now() - begin);
+    }
+}
+
+void Scheduler::dumpMetrics(std::ostream &os) {
+    SchedulerMetrics::Snapshot snap;
+    getMetrics(snap);
+    SchedulerMetrics::WritePrometheus(os, snap);
+}
+
 Scheduler::~Scheduler() {
     //SYLAR_LOG_DEBUG(g_logger) << "Scheduler::~Scheduler()";
     assert(m_stopping);
@@ -78,6 +115,9 @@ Scheduler::~Scheduler() {
     if (GetThis() == this) {
         thread_scheduler = nullptr;
     }
+    if (FiberRegistry::Count()) {
+        FiberRegistry::ForgetScheduler(this);
+    }
 }
 
 //启动调度器
@@ -108,7 +148,7 @@ bool Scheduler::stopping() {
     MutexType::Lock lock(m_mutex);
 
     //停止位为true 任务队列为空 当前正在工作的工作线程数位0
-    return m_stopping && m_tasks.empty() && m_activeThreadCount == 0;
+    return m_stopping && m_tasks.empty() && m_deadlineTasks.empty() && m_activeThreadCount == 0;
 }
 
 void Scheduler::tickle() { 
@@ -199,6 +239,13 @@ void Scheduler::run() {
     //设置当前线程的调度器 是所有线程共享一个调度器scheduler
     setThis();
 
+    //分配本线程的指标槽位
+    thread_metrics_owner = this;
+    thread_metrics_slot  = std::min(m_nextMetricsSlot++, m_metrics->getSlotCount() - 1);
+
+    //登记到采样profiler，采样时按本线程的CPU时间发SIGPROF
+    Profiler::RegisterThread();
+
     //若当前线程不是caller线程，而是工作线程
     if (sylar::GetThreadId() != m_rootThread) {
 
@@ -207,11 +254,15 @@ void Scheduler::run() {
     }
 
     //new出一个空闲协程 该空闲协程也是子协程 默认接收调度器调度
-    Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this)));
+    Fiber::ptr idle_fiber(new Fiber(std::bind(&Scheduler::idle, this), 0, true, "scheduler.idle"));
     
     //当任务是函数时，将其包装成协程
     Fiber::ptr cb_fiber;
 
+    //本线程已经结束的回调协程池，下一个回调任务直接reset复用其中的协程，省掉协程对象和协程栈的分配
+    //只在本线程的调度协程中访问，不需要加锁
+    std::vector<Fiber::ptr> fiber_pool;
+
     ScheduleTask task;
 
     //每一个循环体是一轮调度 这里是无限循环 这就是每个线程的调度协程一直在做的事情
@@ -223,80 +274,145 @@ void Scheduler::run() {
         {
             //搞了把线程锁 这里是一把局部锁 当离开本作用域 自动解锁并且销毁
             MutexType::Lock lock(m_mutex);
-            auto it = m_tasks.begin();
-
-            // 遍历所有调度任务
-            while (it != m_tasks.end()) {
-                if (it->thread != -1 && it->thread != sylar::GetThreadId()) {
-                    // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
-                    ++it;
-                    tickle_me = true;
-                    continue;
-                }
 
-                // 找到一个未指定线程，或是指定了当前线程的任务
-                //该任务不是fiber类型就是cb类型
-                //SYLAR_ASSERT(it->fiber || it->cb);
-                assert(it->fiber || it->cb);
-                // if (it->fiber) {
-                //     // 任务队列时的协程一定是READY状态，谁会把RUNNING或TERM状态的协程加入调度呢？
-                //     SYLAR_ASSERT(it->fiber->getState() == Fiber::READY);
-                // }
-
-                // [BUG FIX]: hook IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
-                // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
-                // 这里简单地跳过这种情况，以损失一点性能为代价，否则整个协程框架都要大改
-                if(it->fiber && it->fiber->getState() == Fiber::RUNNING) {
-                    ++it;
-                    continue;
+            // EDF模式下已过截止时间的协程降低优先级，这里记下第一个可调度的过期任务，没有未过期任务时再调度它
+            const bool edf = (m_policy == EDF);
+            uint64_t now   = edf ? sylar::GetElapsedMS() : 0;
+            bool found     = false;
+            std::list<ScheduleTask> *expired_queue = nullptr;
+            std::list<ScheduleTask>::iterator expired;
+
+            // 先找截止时间队列，其中的任务都比先进先出队列中没有截止时间的任务早
+            std::list<ScheduleTask> *queues[] = {&m_deadlineTasks, &m_tasks};
+            for (auto queue : queues) {
+                auto it = queue->begin();
+                // 遍历所有调度任务
+                while (it != queue->end()) {
+                    if (it->thread != -1 && it->thread != sylar::GetThreadId()) {
+                        // 指定了调度线程，但不是在当前线程上调度，标记一下需要通知其他线程进行调度，然后跳过这个任务，继续下一个
+                        ++it;
+                        tickle_me = true;
+                        continue;
+                    }
+
+                    // 找到一个未指定线程，或是指定了当前线程的任务
+                    //该任务不是fiber类型就是cb类型
+                    //SYLAR_ASSERT(it->fiber || it->cb);
+                    assert(it->fiber || it->cb);
+                    // if (it->fiber) {
+                    //     // 任务队列时的协程一定是READY状态，谁会把RUNNING或TERM状态的协程加入调度呢？
+                    //     SYLAR_ASSERT(it->fiber->getState() == Fiber::READY);
+                    // }
+
+                    // [BUG FIX]: hook IO相关的系统调用时，在检测到IO未就绪的情况下，会先添加对应的读写事件，再yield当前协程，等IO就绪后再resume当前协程
+                    // 多线程高并发情境下，有可能发生刚添加事件就被触发的情况，如果此时当前协程还未来得及yield，则这里就有可能出现协程状态仍为RUNNING的情况
+                    // 这里简单地跳过这种情况，以损失一点性能为代价，否则整个协程框架都要大改
+                    if(it->fiber && it->fiber->getState() == Fiber::RUNNING) {
+                        ++it;
+                        continue;
+                    }
+
+                    if (edf && it->deadline < now) {
+                        // 还没开始执行的回调任务已经过期，直接丢弃，相当于过载时的降载
+                        if (it->cb && m_shedExpired) {
+                            queue->erase(it++);
+                            ++m_shedCount;
+                            continue;
+                        }
+                        if (!expired_queue) {
+                            expired_queue = queue;
+                            expired       = it;
+                        }
+                        ++it;
+                        continue;
+                    }
+
+                    //fiber的状态为running
+                    // 当前调度线程找到一个任务，准备开始调度，将其从任务队列中剔除，活动线程数加1
+                    task = std::move(*it);
+                    queue->erase(it++);
+
+                    //工作线程数++
+                    ++m_activeThreadCount;
+                    found = true;
+                    break;
+                }   //end while
+
+                if (found) {
+                    // 当前线程拿完一个任务后，发现后面还有剩余任务，那么tickle一下其他线程
+                    tickle_me |= (it != queue->end()) || (queue == &m_deadlineTasks && !m_tasks.empty());
+                    break;
                 }
+            }
 
-                //fiber的状态为running
-                // 当前调度线程找到一个任务，准备开始调度，将其从任务队列中剔除，活动线程数加1
-                task = *it;
-                m_tasks.erase(it++);
-
-                //工作线程数++
+            // 没有未过期的任务，只能调度过期的协程
+            if (!found && expired_queue) {
+                task = std::move(*expired);
+                expired_queue->erase(expired);
                 ++m_activeThreadCount;
-                break;
-            }   //end while
-            // 当前线程拿完一个任务后，发现任务队列还有剩余，那么tickle一下其他线程
-            tickle_me |= (it != m_tasks.end());
+                tickle_me |= !m_deadlineTasks.empty() || !m_tasks.empty();
+            }
         }   //局域锁失效
 
         if (tickle_me) {
             //当前线程通知其他线程
-            std::cout<<"run:tickle"<<std::endl;
+            //std::cout<<"run:tickle"<<std::endl;
             tickle();
         }
 
+        //任务的排队时间，resume的开始时间也取这个时间
+        uint64_t begin = 0;
+        if ((task.fiber || task.cb) && SYLAR_UNLIKELY(Metrics::IsEnabled())) {
+            begin = Metrics::Now();
+            if (task.enqueue) {
+                recordMetric(SchedulerMetrics::QUEUE_WAIT, begin - task.enqueue);
+                if (task.ready) {
+                    recordMetric(SchedulerMetrics::EVENT_LAG, begin - task.enqueue);
+                    onEventLag(begin - task.enqueue);
+                }
+            }
+        }
+
         //接下来判断该调度协程为本工作线程选中的任务类型
         if (task.fiber) {
-            std::cout<<"拿到一个fiber"<<std::endl;
+            //std::cout<<"拿到一个fiber"<<std::endl;
             // resume协程，resume返回时，协程要么执行完了，要么半路yield了，总之这个任务就算完成了，活跃(工作)线程数减一
             task.fiber->resume();
             --m_activeThreadCount;
+            recordResume(begin);
 
             //重置任务
             task.reset();
         } 
         else if (task.cb) {
-            std::cout<<"拿到一个cb"<<std::endl;
-            if (cb_fiber) {
-                cb_fiber->reset(task.cb);
+            //std::cout<<"拿到一个cb"<<std::endl;
+            if (!fiber_pool.empty()) {
+                cb_fiber = std::move(fiber_pool.back());
+                fiber_pool.pop_back();
+                cb_fiber->reset(std::move(task.cb));
             } 
             else {
                 //这里的任务fiber默认接受调度器调度
-                cb_fiber.reset(new Fiber(task.cb));
+                cb_fiber.reset(new Fiber(std::move(task.cb), 0, true, "scheduler.task"));
             }
+            // 回调任务包装成的协程继承任务的截止时间和上下文
+            cb_fiber->setDeadline(task.deadline);
+            cb_fiber->setContext(task.context);
             //重置任务
             task.reset();
             cb_fiber->resume();
             --m_activeThreadCount;
+            recordResume(begin);
+            // 协程已经结束，并且没有其他地方引用它(比如yield前把自己交给了定时器或事件、或者有人持有它准备join)，才能放回池中复用
+            // 半路yield的协程由持有它的一方重新加入调度，这里只释放引用
+            if (cb_fiber->getState() == Fiber::TERM && cb_fiber.use_count() == 1 &&
+                fiber_pool.size() < m_fiberPoolSize) {
+                fiber_pool.push_back(std::move(cb_fiber));
+            }
             cb_fiber.reset();
         } 
         else {
-            std::cout<<"任务队列为空"<<std::endl;
+            //std::cout<<"任务队列为空"<<std::endl;
             // 进到这个分支情况一定是任务队列空了，调度idle协程即可
             if (idle_fiber->getState() == Fiber::TERM) {
                 // 如果调度器没有调度任务，那么idle协程会不停地resume/yield，不会结束，如果idle协程结束了，那一定是调度器停止了
@@ -305,14 +421,21 @@ void Scheduler::run() {
             }
             //调度idle协程，空闲线程数++ 即本线程空闲了
             ++m_idleThreadCount;
+            uint64_t idle_begin = Metrics::Begin();
             idle_fiber->resume();
 
             //从idle协程退出回到调度协程，不管其是正常结束 还是 中途yield
             --m_idleThreadCount;
+            if (idle_begin) {
+                uint64_t cost = Metrics::Now() - idle_begin;
+                addMetric(SchedulerMetrics::IDLE_NS, cost);
+                recordMetric(SchedulerMetrics::IDLE, cost);
+            }
         }
     }  //无限循环结束
 
     //SYLAR_LOG_DEBUG(g_logger) << "Scheduler::run() exit";
+    Profiler::UnregisterThread();
     std::cout<<"run exit"<<std::endl;
 }
 
@@ -6,6 +6,8 @@
 #include <memory>
 #include <string>
 #include "fiber.h"
+#include "metrics.h"
+#include "sdt.h"
 // #include "log.h"
 #include "thread.h"
 #include <vector>
@@ -30,6 +32,16 @@ public:
     typedef std::shared_ptr<Scheduler> ptr;
     typedef Mutex MutexType;
 
+    /**
+     * @brief 调度策略
+     */
+    enum Policy {
+        /// 先进先出，默认策略
+        FIFO,
+        /// 最早截止时间优先(Earliest Deadline First)，按任务的截止时间从早到晚调度
+        EDF
+    };
+
     /**
      * @brief 创建调度器
      * @param[in] threads 线程数
@@ -48,6 +60,44 @@ public:
      */
     const std::string &getName() const { return m_name; }
 
+    /**
+     * @brief 设置调度策略
+     * @details 建议在添加任务之前设置，切换到EDF时已在队列中的任务不会重新排序，
+     *          切回FIFO时已在截止时间队列中的任务仍然先于其他任务调度
+     */
+    void setPolicy(Policy policy) {
+        MutexType::Lock lock(m_mutex);
+        m_policy = policy;
+    }
+
+    /**
+     * @brief 获取调度策略
+     */
+    Policy getPolicy() const { return m_policy; }
+
+    /**
+     * @brief EDF模式下是否丢弃已过截止时间且还未开始执行的回调任务(过载时的自动降载)
+     * @details 已经开始执行的协程不能丢弃，只会降低其优先级，等没有未过期任务时再调度
+     */
+    void setShedExpired(bool v) { m_shedExpired = v; }
+
+    /**
+     * @brief 获取因过截止时间而被丢弃的任务数
+     */
+    uint64_t getShedCount() const { return m_shedCount; }
+
+    /**
+     * @brief 设置每个调度线程缓存的已结束回调协程的最大个数
+     * @details 回调任务执行完之后，其协程放回本线程的协程池，下一个回调任务reset复用该协程，不再分配协程对象和协程栈。
+     *          每个缓存的协程占用一个协程栈(默认128k)，设为0则每个回调任务都新建协程。建议在start()之前设置
+     */
+    void setFiberPoolSize(size_t size) { m_fiberPoolSize = size; }
+
+    /**
+     * @brief 获取每个调度线程缓存的回调协程的最大个数
+     */
+    size_t getFiberPoolSize() const { return m_fiberPoolSize; }
+
     /**
      * @brief 获取当前线程调度器指针
      */
@@ -61,26 +111,38 @@ public:
 
     /**
      * @brief 添加调度任务 添加调度任务的行为由客户完成，或者是caller线程的主协程，其完成客户添加调度任务的角色
-     * @tparam FiberOrCb 调度任务类型，可以是协程对象或函数指针
-     * @param[] fc 协程对象或指针
+     * @tparam FiberOrCb 调度任务类型，可以是协程对象或任意可调用对象
+     * @param[] fc 协程对象或可调用对象，完美转发，右值的可调用对象直接移动进任务，不拷贝
      * @param[] thread 指定运行该任务的线程号，-1表示任意线程
      */
     template <class FiberOrCb>
-    void schedule(FiberOrCb fc, int thread = -1) {
-        bool need_tickle = false;           //一个标志位 是否需要通知工作线程有活了 如果原来任务队列为空会起作用
-        {
-            //局域锁 是一把线程锁 也就是协程一旦lock 整个线程都会阻塞
-            MutexType::Lock lock(m_mutex);
-            //如果原本队列为空，need_tickle为true
-            need_tickle = scheduleNoLock(fc, thread);
-        }
+    void schedule(FiberOrCb &&fc, int thread = -1) {
+        //在加锁之前构造好任务，回调的构造(可能有堆分配)不占用调度器的锁
+        ScheduleTask task(std::forward<FiberOrCb>(fc), thread);
+        push(std::move(task));
+    }
 
-        if (need_tickle) {
-            std::cout<<"schedule :tickle"<<std::endl;
-            tickle(); // 通知scheduler有任务了
-        }
+    /**
+     * @brief 添加IO事件就绪后要执行的任务，由IOManager::FdContext::triggerEvent调用
+     * @details 与schedule()相同，另外把从事件就绪到任务开始执行的时间记入EVENT_LAG直方图
+     */
+    template <class FiberOrCb>
+    void scheduleReady(FiberOrCb &&fc) {
+        ScheduleTask task(std::forward<FiberOrCb>(fc), -1);
+        task.ready = true;
+        push(std::move(task));
     }
 
+    /**
+     * @brief 汇总所有调度线程的指标，加上任务队列长度、活跃/空闲线程数
+     */
+    virtual void getMetrics(SchedulerMetrics::Snapshot &snap);
+
+    /**
+     * @brief 以Prometheus文本格式输出指标
+     */
+    void dumpMetrics(std::ostream &os);
+
     /**
      * @brief 启动调度器
      */
@@ -123,22 +185,101 @@ protected:
      */
     bool hasIdleThreads() { return m_idleThreadCount > 0; }
 
+    /**
+     * @brief 累加当前线程的计数器，没有打开指标记录时什么也不做
+     */
+    void addMetric(SchedulerMetrics::CounterType type, uint64_t v = 1) {
+        if (SYLAR_UNLIKELY(Metrics::IsEnabled())) {
+            m_metrics->add(metricsSlot(), type, v);
+        }
+    }
+
+    /**
+     * @brief 记录到当前线程的直方图，没有打开指标记录时什么也不做
+     */
+    void recordMetric(SchedulerMetrics::HistogramType type, uint64_t v) {
+        if (SYLAR_UNLIKELY(Metrics::IsEnabled())) {
+            m_metrics->record(metricsSlot(), type, v);
+        }
+    }
+
+    /**
+     * @brief 当前线程的指标槽位，不是本调度器的调度线程时用共享的最后一个槽位
+     */
+    size_t metricsSlot() const;
+
+    /**
+     * @brief IO事件就绪后加入的任务开始执行，lag_ns为从就绪到开始执行的时间，只在打开指标记录时调用
+     */
+    virtual void onEventLag(uint64_t /*lag_ns*/) {}
+
+    /**
+     * @brief 是否已经调用了stop()
+     */
+    bool isStopping() const { return m_stopping; }
+
+    /**
+     * @brief 所有调度线程的id，start()之后才完整
+     */
+    const std::vector<int> &getThreadIds() const { return m_threadIds; }
+
 private:
+    /**
+     * @brief 一次resume结束，计数并记录resume耗时
+     * @param[in] begin resume开始的时间，没有打开指标记录时为0
+     */
+    void recordResume(uint64_t begin);
+
+private:
+    struct ScheduleTask;
+
+    /**
+     * @brief 把构造好的任务加入队列，需要时通知调度线程
+     */
+    void push(ScheduleTask &&task) {
+        task.enqueue = Metrics::Begin();
+        SYLAR_PROBE3(sched__schedule, this, task.fiber ? task.fiber->getId() : 0, task.thread);
+        bool need_tickle = false;           //一个标志位 是否需要通知工作线程有活了 如果原来任务队列为空会起作用
+        {
+            //局域锁 是一把线程锁 也就是协程一旦lock 整个线程都会阻塞
+            MutexType::Lock lock(m_mutex);
+            //如果原本队列为空，need_tickle为true
+            need_tickle = scheduleNoLock(std::move(task));
+        }
+
+        if (need_tickle) {
+            //std::cout<<"schedule :tickle"<<std::endl;
+            tickle(); // 通知scheduler有任务了
+        }
+    }
+
     /**
      * @brief 添加调度任务，无锁(因为该函数的上一层调用时已经加锁了，所以进该函数一定是独立的，无竞态问题)
-     * @tparam FiberOrCb 调度任务类型，可以是协程对象或函数指针
-     * @param[] fc 协程对象或指针
-     * @param[] thread 指定运行该任务的线程号，-1表示任意线程
+     * @param[] task 构造好的调度任务
      */
-    template <class FiberOrCb>
-    bool scheduleNoLock(FiberOrCb fc, int thread) {
+    bool scheduleNoLock(ScheduleTask &&task) {
         //如果原本队列为空，需要tickle
-        bool need_tickle = m_tasks.empty();
-        ScheduleTask task(fc, thread);
+        bool need_tickle = m_tasks.empty() && m_deadlineTasks.empty();
         
         //对task进行任务判断
         if (task.fiber || task.cb) {
-            m_tasks.push_back(task);
+            if (m_policy == EDF && task.deadline != ~0ull) {
+                // 放进截止时间队列，按截止时间有序插入，从队尾往前找，截止时间相同的任务保持先来后到
+                // 没有截止时间的任务在另一个队列里，不用跨过它们；截止时间随到达时间递增时一步就能找到插入位置
+                auto it = m_deadlineTasks.end();
+                while (it != m_deadlineTasks.begin()) {
+                    auto prev = it;
+                    --prev;
+                    if (prev->deadline <= task.deadline) {
+                        break;
+                    }
+                    it = prev;
+                }
+                m_deadlineTasks.insert(it, std::move(task));
+            } 
+            else {
+                m_tasks.push_back(std::move(task));
+            }
         }
         return need_tickle;
     }
@@ -149,30 +290,46 @@ private:
      */
     struct ScheduleTask {
         Fiber::ptr fiber;
-        std::function<void()> cb;
+        Callback cb;
         int thread;
+        /// 截止时间，协程任务取协程自身的截止时间，函数任务继承添加任务时所在协程的截止时间
+        uint64_t deadline;
+        /// 函数任务继承添加任务时所在协程的上下文
+        std::shared_ptr<FiberContext> context;
+        /// 加入队列的时间(纳秒)，没有打开指标记录时为0
+        uint64_t enqueue = 0;
+        /// 是否是IO事件就绪后加入的任务
+        bool ready = false;
 
         ScheduleTask(Fiber::ptr f, int thr) {
-            fiber  = f;
-            thread = thr;
+            fiber    = f;
+            thread   = thr;
+            deadline = f ? f->getDeadline() : ~0ull;
         }
 
         ScheduleTask(Fiber::ptr *f, int thr) {
             fiber.swap(*f);
-            thread = thr;
+            thread   = thr;
+            deadline = fiber ? fiber->getDeadline() : ~0ull;
         }
 
-        ScheduleTask(std::function<void()> f, int thr) {
-            cb     = f;
-            thread = thr;
+        ScheduleTask(Callback f, int thr) {
+            cb       = std::move(f);
+            thread   = thr;
+            deadline = Fiber::GetDeadline();
+            context  = Fiber::GetContext();
         }
 
-        ScheduleTask() { thread = -1; }
+        ScheduleTask() { thread = -1; deadline = ~0ull; }
 
         void reset() {
-            fiber  = nullptr;
-            cb     = nullptr;
-            thread = -1;
+            fiber    = nullptr;
+            cb       = nullptr;
+            thread   = -1;
+            deadline = ~0ull;
+            enqueue  = 0;
+            ready    = false;
+            context.reset();
         }
     };
 
@@ -186,8 +343,11 @@ private:
     /// 线程池
     std::vector<Thread::ptr> m_threads;
     
-    /// 任务队列
+    /// 任务队列，先进先出
     std::list<ScheduleTask> m_tasks;
+
+    /// EDF模式下有截止时间的任务，按截止时间从早到晚排列，调度时先于m_tasks
+    std::list<ScheduleTask> m_deadlineTasks;
     
     /// 线程池的线程ID数组
     std::vector<int> m_threadIds;
@@ -212,6 +372,22 @@ private:
 
     /// 是否正在停止
     bool m_stopping = false;
+
+    /// 调度策略
+    Policy m_policy = FIFO;
+
+    /// EDF模式下是否丢弃已过期的回调任务
+    bool m_shedExpired = false;
+
+    /// 被丢弃的过期任务数
+    std::atomic<uint64_t> m_shedCount = {0};
+
+    /// 每个调度线程缓存的已结束回调协程的最大个数
+    size_t m_fiberPoolSize = 16;
+    /// 运行时指标，每个调度线程一个槽位
+    std::unique_ptr<SchedulerMetrics> m_metrics;
+    /// 下一个进入run()的线程分到的指标槽位
+    std::atomic<size_t> m_nextMetricsSlot = {0};
 };
 
 } // end namespace sylar
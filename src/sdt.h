@@ -0,0 +1,55 @@
+/**
+ * @file sdt.h
+ * @brief USDT静态探测点
+ * @details 系统中有sys/sdt.h(systemtap-sdt-dev / systemtap-sdt-devel)时，SYLAR_PROBEn在代码中留下一条nop，
+ *          并在ELF的.note.stapsdt节中记录探测点的位置和参数的取法；没有被追踪时只执行这条nop，
+ *          bpftrace/perf挂上去时把nop换成断点。不需要重新编译就可以追踪线上的程序：
+ *          bpftrace -l 'usdt:./server:sylar:*'
+ *          bpftrace tools/usdt/fiber_latency.bt ./server
+ *          没有sys/sdt.h或者定义了SYLAR_NO_USDT时探测点为空。
+ *          所有探测点的provider都是sylar，参数只能是整数或指针(字符串传指针，bpftrace中用str()读取)：
+ *          fiber__create(id, tag)           创建协程
+ *          fiber__resume(id, tag)           协程开始运行(resume/call/switchTo)
+ *          fiber__yield(id, state)          协程让出，state为yield之后的状态(Fiber::State)
+ *          fiber__exit(id)                  协程函数执行结束
+ *          sched__schedule(sched, id, thread) 任务加入调度器，id为协程id，函数任务为0
+ *          sched__tickle(sched)             通知空闲的调度线程
+ *          epoll__wait__enter(epfd, timeout_ms)
+ *          epoll__wait__exit(epfd, nevents)
+ *          io__add__event(fd, event)        注册IO事件
+ *          io__trigger__event(fd, event)    IO事件就绪或被取消
+ *          timer__add(ms, next_ms)          添加定时器
+ *          timer__fire(count, now_ms)       一批定时器到期
+ *          hook__suspend(id, fd, event)     hook的调用挂起协程，sleep系列fd为-1、event为0
+ *          hook__resume(id, fd, event)      挂起的协程恢复
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_SDT_H__
+#define __SYLAR_SDT_H__
+
+#if !defined(SYLAR_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define SYLAR_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef SYLAR_HAVE_USDT
+
+#include <sys/sdt.h>
+
+#define SYLAR_PROBE0(name) DTRACE_PROBE(sylar, name)
+#define SYLAR_PROBE1(name, a) DTRACE_PROBE1(sylar, name, a)
+#define SYLAR_PROBE2(name, a, b) DTRACE_PROBE2(sylar, name, a, b)
+#define SYLAR_PROBE3(name, a, b, c) DTRACE_PROBE3(sylar, name, a, b, c)
+
+#else
+
+#define SYLAR_PROBE0(name) do {} while (0)
+#define SYLAR_PROBE1(name, a) do {} while (0)
+#define SYLAR_PROBE2(name, a, b) do {} while (0)
+#define SYLAR_PROBE3(name, a, b, c) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,356 @@
+/**
+ * @file stack_allocator.cc
+ * @brief 协程栈分配器与栈溢出检测实现
+ * @version 0.1
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "fiber.h"
+#include "mutex.h"
+#include "stack_allocator.h"
+#include "util.h"
+
+namespace sylar {
+
+namespace {
+
+std::atomic<int> s_mode{StackAllocator::MALLOC};
+
+std::atomic<bool> s_handler_installed{false};
+
+/// 原来的信号处理方式，不是栈溢出的段错误交还给它们
+struct sigaction s_old_segv;
+struct sigaction s_old_bus;
+
+/// 信号处理专用栈的大小
+const size_t kAltStackSize = 64 * 1024;
+
+size_t PageSize() {
+    static size_t s_page = sysconf(_SC_PAGESIZE);
+    return s_page;
+}
+
+size_t RoundUp(size_t size) {
+    size_t page = PageSize();
+    return (size + page - 1) / page * page;
+}
+
+/**
+ * @brief 每个线程的信号处理专用栈，线程退出时释放
+ */
+struct AltStack {
+    void *mem = nullptr;
+
+    ~AltStack() {
+        if (mem) {
+            stack_t ss;
+            memset(&ss, 0, sizeof(ss));
+            ss.ss_flags = SS_DISABLE;
+            sigaltstack(&ss, nullptr);
+            free(mem);
+        }
+    }
+};
+
+thread_local AltStack t_alt_stack;
+
+/**
+ * @brief 信号处理函数中只用write输出
+ */
+void WriteStderr(const char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(STDERR_FILENO, buf, len);
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+/// 大页大小
+const size_t kHugePageSize = 2 * 1024 * 1024;
+
+/// arena每次向系统映射的大小
+const size_t kArenaChunkSize = 32 * 1024 * 1024;
+
+/// 释放栈时检查隔离区最高地址的多少字节，栈溢出总是先改写这一段
+const size_t kCanaryCheckSize = 512;
+
+const uint64_t kCanary = 0xfdfdfdfdfdfdfdfdULL;
+
+/**
+ * @brief 大页arena，按栈槽大小维护空闲链表，栈槽只复用不归还系统
+ * @details 栈槽的布局为[隔离区(一页)][栈]，隔离区填充哨兵值
+ */
+class StackArena {
+public:
+    void *alloc(size_t size) {
+        size_t slot = RoundUp(size) + PageSize();
+        char *base  = nullptr;
+        {
+            Spinlock::Lock lock(m_mutex);
+            std::vector<void *> &list = m_free[slot];
+            if (!list.empty()) {
+                void *vp = list.back();
+                list.pop_back();
+                return vp;
+            }
+            if (m_cur + slot > m_end) {
+                newChunk(slot);
+            }
+            base = m_cur;
+            m_cur += slot;
+        }
+        uint64_t *canary = (uint64_t *)base;
+        std::fill(canary, canary + PageSize() / sizeof(uint64_t), kCanary);
+        return base + PageSize();
+    }
+
+    void dealloc(void *vp, size_t size) {
+        check(vp, size);
+        size_t slot = RoundUp(size) + PageSize();
+        Spinlock::Lock lock(m_mutex);
+        m_free[slot].push_back(vp);
+    }
+
+    /**
+     * @brief 检查栈底隔离区的哨兵值，被改写时输出后abort
+     */
+    void check(void *vp, size_t size) {
+        const uint64_t *end   = (const uint64_t *)vp;
+        const uint64_t *begin = end - kCanaryCheckSize / sizeof(uint64_t);
+        for (const uint64_t *i = begin; i != end; ++i) {
+            if (*i != kCanary) {
+                char buf[256];
+                int len = snprintf(buf, sizeof(buf),
+                                   "fiber stack overflow: canary below stack %p (stacksize=%zu) was overwritten at %p\n",
+                                   vp, size, (const void *)i);
+                if (len > 0) {
+                    WriteStderr(buf, len < (int)sizeof(buf) ? len : sizeof(buf) - 1);
+                }
+                abort();
+            }
+        }
+    }
+
+    StackAllocator::ArenaBacking backing() const { return m_backing; }
+
+    size_t bytes() const { return m_bytes; }
+
+private:
+    /**
+     * @brief 映射一块新的arena，依次尝试显式大页、透明大页、普通页
+     */
+    void newChunk(size_t slot) {
+        size_t len = std::max(kArenaChunkSize, (slot + kHugePageSize - 1) / kHugePageSize * kHugePageSize);
+        //MAP_HUGETLB不能加MAP_NORESERVE，否则大页不够时访问才报SIGBUS；不加的话mmap直接失败，可以退化
+        void *vp = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (vp != MAP_FAILED) {
+            m_backing = StackAllocator::ARENA_HUGETLB;
+        } else {
+            //多映射一个大页，裁掉首尾得到2MiB对齐的区间，透明大页只能以对齐的2MiB为单位
+            size_t map_len = len + kHugePageSize;
+            char *raw      = (char *)mmap(nullptr, map_len, PROT_READ | PROT_WRITE,
+                                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            assert(raw != MAP_FAILED);
+            char *aligned = (char *)(((uintptr_t)raw + kHugePageSize - 1) / kHugePageSize * kHugePageSize);
+            if (aligned != raw) {
+                munmap(raw, aligned - raw);
+            }
+            size_t tail = (raw + map_len) - (aligned + len);
+            if (tail) {
+                munmap(aligned + len, tail);
+            }
+            vp        = aligned;
+            m_backing = madvise(vp, len, MADV_HUGEPAGE) == 0 ? StackAllocator::ARENA_THP
+                                                             : StackAllocator::ARENA_NORMAL;
+        }
+        m_cur = (char *)vp;
+        m_end = m_cur + len;
+        m_bytes += len;
+    }
+
+private:
+    Spinlock m_mutex;
+    /// 栈槽大小 -> 空闲栈
+    std::unordered_map<size_t, std::vector<void *>> m_free;
+    /// 当前arena中还没切出去的部分
+    char *m_cur = nullptr;
+    char *m_end = nullptr;
+    std::atomic<size_t> m_bytes{0};
+    std::atomic<StackAllocator::ArenaBacking> m_backing{StackAllocator::ARENA_NONE};
+};
+
+StackArena &Arena() {
+    static StackArena s_arena;
+    return s_arena;
+}
+
+/**
+ * @brief 交还给原来的信号处理方式
+ */
+void Chain(int sig, siginfo_t *info, void *uctx) {
+    const struct sigaction &old = (sig == SIGBUS) ? s_old_bus : s_old_segv;
+    if (old.sa_flags & SA_SIGINFO) {
+        if (old.sa_sigaction) {
+            old.sa_sigaction(sig, info, uctx);
+            return;
+        }
+    } else if (old.sa_handler != SIG_DFL && old.sa_handler != SIG_IGN) {
+        old.sa_handler(sig);
+        return;
+    }
+    //恢复默认处理，返回后出错指令重新执行，进程按默认方式终止(产生core)
+    signal(sig, SIG_DFL);
+}
+
+void OnFault(int sig, siginfo_t *info, void *uctx) {
+    Fiber *fiber = Fiber::GetCurrent();
+    char *addr   = (char *)info->si_addr;
+    if (!fiber || !fiber->isStackGuarded()) {
+        Chain(sig, info, uctx);
+        return;
+    }
+    char *stack = (char *)fiber->getStack();
+    char *guard = stack - StackAllocator::GuardSize();
+    if (addr < guard || addr >= stack) {
+        Chain(sig, info, uctx);
+        return;
+    }
+
+    char buf[512];
+    int len = snprintf(buf, sizeof(buf),
+                       "fiber stack overflow: fiber id=%llu tag=%s stacksize=%u fault addr=%p guard page=[%p, %p)\n",
+                       (unsigned long long)fiber->getId(), fiber->getTag() ? fiber->getTag() : "untagged",
+                       (unsigned)fiber->getStackSize(), addr, guard, stack);
+    if (len > 0) {
+        WriteStderr(buf, len < (int)sizeof(buf) ? len : sizeof(buf) - 1);
+    }
+
+    //此时已经要终止进程，不再要求异步信号安全，尽量输出调用栈
+    std::vector<std::string> bt;
+    Backtrace(bt, 32, 1);
+    for (auto &i : bt) {
+        WriteStderr("    ", 4);
+        WriteStderr(i.c_str(), i.size());
+        WriteStderr("\n", 1);
+    }
+    abort();
+}
+
+} // namespace
+
+void StackAllocator::SetMode(Mode mode) {
+    s_mode = mode;
+}
+
+StackAllocator::Mode StackAllocator::GetMode() {
+    return (Mode)s_mode.load();
+}
+
+size_t StackAllocator::GuardSize() {
+    return PageSize();
+}
+
+void *StackAllocator::Alloc(size_t size, Mode &mode) {
+    mode = (Mode)s_mode.load();
+    if (mode == MALLOC) {
+        return malloc(size);
+    }
+    if (mode == HUGE_ARENA) {
+        return Arena().alloc(size);
+    }
+    size_t len = RoundUp(size) + GuardSize();
+    void *base = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    assert(base != MAP_FAILED);
+    //栈从高地址往低地址增长，保护页放在最低地址
+    int rt = mprotect(base, GuardSize(), PROT_NONE);
+    assert(rt == 0);
+    (void)rt;
+    return (char *)base + GuardSize();
+}
+
+void StackAllocator::Dealloc(void *vp, size_t size, Mode mode) {
+    if (mode == MALLOC) {
+        free(vp);
+        return;
+    }
+    if (mode == HUGE_ARENA) {
+        Arena().dealloc(vp, size);
+        return;
+    }
+    munmap((char *)vp - GuardSize(), RoundUp(size) + GuardSize());
+}
+
+void StackAllocator::CheckOverflow(void *vp, size_t size, Mode mode) {
+    if (mode == HUGE_ARENA) {
+        Arena().check(vp, size);
+    }
+}
+
+StackAllocator::ArenaBacking StackAllocator::GetArenaBacking() {
+    return Arena().backing();
+}
+
+const char *StackAllocator::ArenaBackingName(ArenaBacking backing) {
+    switch (backing) {
+    case ARENA_HUGETLB:
+        return "hugetlb";
+    case ARENA_THP:
+        return "thp";
+    case ARENA_NORMAL:
+        return "normal";
+    default:
+        return "none";
+    }
+}
+
+size_t StackAllocator::ArenaBytes() {
+    return Arena().bytes();
+}
+
+void StackAllocator::InstallOverflowHandler() {
+    bool expected = false;
+    if (!s_handler_installed.compare_exchange_strong(expected, true)) {
+        SetupAltStack();
+        return;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = &OnFault;
+    sa.sa_flags     = SA_SIGINFO | SA_ONSTACK;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, &s_old_segv);
+    sigaction(SIGBUS, &sa, &s_old_bus);
+    SetupAltStack();
+}
+
+void StackAllocator::SetupAltStack() {
+    if (!s_handler_installed || t_alt_stack.mem) {
+        return;
+    }
+    t_alt_stack.mem = malloc(kAltStackSize);
+    stack_t ss;
+    memset(&ss, 0, sizeof(ss));
+    ss.ss_sp    = t_alt_stack.mem;
+    ss.ss_size  = kAltStackSize;
+    ss.ss_flags = 0;
+    int rt = sigaltstack(&ss, nullptr);
+    assert(rt == 0);
+    (void)rt;
+}
+
+} // namespace sylar
@@ -0,0 +1,120 @@
+/**
+ * @file stack_allocator.h
+ * @brief 协程栈分配器与栈溢出检测
+ * @details 默认用malloc分配协程栈，栈溢出时会悄悄改写相邻的堆内存。
+ *          切换到MMAP_GUARD模式后，每个协程栈用mmap单独映射，并在栈底(最低地址)放一个不可访问的保护页，
+ *          栈溢出时立即触发SIGSEGV。InstallOverflowHandler()安装的信号处理函数运行在每个线程自己的sigaltstack上
+ *          (溢出的协程栈已经不能再用)，判断出错地址落在当前协程的保护页上时，输出协程id、类别、栈大小和调用栈，然后abort；
+ *          其他段错误交还给原来的信号处理方式。
+ *          HUGE_ARENA模式从2MiB大页背书的大块内存(arena)中切出固定大小的栈槽，几万个协程栈挤在少量大页里，
+ *          协程切换时的TLB缺失大大减少。优先用MAP_HUGETLB(需要预留/proc/sys/vm/nr_hugepages)，
+ *          失败时按2MiB对齐映射后madvise(MADV_HUGEPAGE)使用透明大页，再不行就退化成普通页，都不影响正确性。
+ *          大页内不能用mprotect设置4KiB的保护页(会拆散大页)，所以每个栈槽底部放一段填充哨兵值的隔离区，
+ *          释放栈以及协程重置复用栈时检查哨兵值，被改写说明发生过栈溢出，输出后abort。
+ *          代价是大页一旦被访问就整页常驻，协程栈不再按需提交物理内存，而且arena的内存只复用不归还系统
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_STACK_ALLOCATOR_H__
+#define __SYLAR_STACK_ALLOCATOR_H__
+
+#include <stddef.h>
+
+namespace sylar {
+
+/**
+ * @brief 协程栈分配器
+ */
+class StackAllocator {
+public:
+    /**
+     * @brief 分配方式
+     */
+    enum Mode {
+        /// malloc分配，没有溢出检测，默认方式
+        MALLOC,
+        /// mmap分配，栈底带一个保护页
+        MMAP_GUARD,
+        /// 从大页arena中分配，栈底带哨兵隔离区
+        HUGE_ARENA
+    };
+
+    /**
+     * @brief arena实际使用的内存类型
+     */
+    enum ArenaBacking {
+        /// 还没有分配过arena
+        ARENA_NONE,
+        /// MAP_HUGETLB显式大页
+        ARENA_HUGETLB,
+        /// 透明大页(MADV_HUGEPAGE)
+        ARENA_THP,
+        /// 普通页
+        ARENA_NORMAL
+    };
+
+    /**
+     * @brief 设置分配方式，只影响之后分配的协程栈
+     */
+    static void SetMode(Mode mode);
+
+    /**
+     * @brief 获取分配方式
+     */
+    static Mode GetMode();
+
+    /**
+     * @brief 分配协程栈
+     * @param[in] size 栈大小
+     * @param[out] mode 实际使用的分配方式，释放时原样传回
+     * @return 栈的最低可用地址
+     */
+    static void *Alloc(size_t size, Mode &mode);
+
+    /**
+     * @brief 释放协程栈
+     */
+    static void Dealloc(void *vp, size_t size, Mode mode);
+
+    /**
+     * @brief 检查仍在使用的协程栈是否溢出过，HUGE_ARENA模式检查栈底的哨兵值，被改写时输出后abort
+     * @details 复用的协程栈(调度器的协程池、生成器)很少释放，在协程重置时检查，不用等到释放。
+     *          其他模式溢出时立即报告，什么也不做
+     */
+    static void CheckOverflow(void *vp, size_t size, Mode mode);
+
+    /**
+     * @brief 保护页大小
+     */
+    static size_t GuardSize();
+
+    /**
+     * @brief 最近一次分配arena时实际使用的内存类型
+     */
+    static ArenaBacking GetArenaBacking();
+
+    /**
+     * @brief 内存类型的名字，hugetlb/thp/normal/none
+     */
+    static const char *ArenaBackingName(ArenaBacking backing);
+
+    /**
+     * @brief arena已经向系统映射的总字节数
+     */
+    static size_t ArenaBytes();
+
+    /**
+     * @brief 安装栈溢出的SIGSEGV/SIGBUS处理函数，并给当前线程设置sigaltstack
+     * @details 之后由sylar::Thread创建的线程在启动时自动设置sigaltstack；其他方式创建的线程需要自己调用SetupAltStack()
+     */
+    static void InstallOverflowHandler();
+
+    /**
+     * @brief 给当前线程设置信号处理专用的栈，没有安装溢出处理函数时什么也不做，重复调用无副作用
+     */
+    static void SetupAltStack();
+};
+
+} // namespace sylar
+
+#endif
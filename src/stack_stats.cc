@@ -0,0 +1,197 @@
+/**
+ * @file stack_stats.cc
+ * @brief 协程栈使用量统计实现
+ * @version 0.1
+ */
+
+#include <atomic>
+#include <iomanip>
+#include <map>
+#include <string>
+#include "mutex.h"
+#include "stack_stats.h"
+
+namespace sylar {
+
+namespace {
+
+/// 哨兵值，按8字节填充
+const uint64_t kPattern = 0xcdcdcdcdfeedf00dull;
+
+/// 页大小，建议的栈大小按页取整
+const size_t kPageSize = 4096;
+
+/// 建议栈大小的上限
+const size_t kMaxSuggest = 8 * 1024 * 1024;
+
+/**
+ * @brief 一个类别的统计
+ */
+struct TagStats {
+    uint64_t samples = 0;
+    size_t max       = 0;
+    /// 最近一次记录时的栈大小
+    size_t stacksize = 0;
+    uint64_t buckets[StackStats::kBuckets] = {0};
+};
+
+/**
+ * @brief 全局状态，用函数内静态变量避免静态初始化顺序问题
+ */
+struct State {
+    Mutex mutex;
+    std::map<std::string, TagStats> tags;
+    double percentile    = 0.99;
+    size_t margin        = 16 * 1024;
+    uint64_t min_samples = 100;
+};
+
+State &GetState() {
+    static State s_state;
+    return s_state;
+}
+
+std::atomic<bool> s_painting{false};
+std::atomic<bool> s_adaptive{false};
+
+const char *TagName(const char *tag) { return tag ? tag : "untagged"; }
+
+size_t PercentileNoLock(const TagStats &stats, double percentile) {
+    if (stats.samples == 0) {
+        return 0;
+    }
+    uint64_t target = (uint64_t)(percentile * stats.samples + 0.999999);
+    if (target == 0) {
+        target = 1;
+    }
+    uint64_t count = 0;
+    for (size_t i = 0; i < StackStats::kBuckets; ++i) {
+        count += stats.buckets[i];
+        if (count >= target) {
+            //取桶的上界，但不超过观测到的最大值
+            size_t upper = (i + 1) * StackStats::kBucketSize;
+            return upper < stats.max ? upper : stats.max;
+        }
+    }
+    return stats.max;
+}
+
+size_t SuggestNoLock(const State &state, const TagStats &stats) {
+    if (stats.samples < state.min_samples) {
+        return 0;
+    }
+    size_t size = PercentileNoLock(stats, state.percentile) + state.margin;
+    size        = (size + kPageSize - 1) / kPageSize * kPageSize;
+    return size < kMaxSuggest ? size : kMaxSuggest;
+}
+
+} // namespace
+
+void StackStats::SetPainting(bool v) {
+    s_painting = v;
+}
+
+bool StackStats::IsPainting() {
+    return s_painting;
+}
+
+void StackStats::SetAdaptive(bool v, double percentile, size_t margin, uint64_t min_samples) {
+    State &state = GetState();
+    Mutex::Lock lock(state.mutex);
+    state.percentile  = percentile;
+    state.margin      = margin;
+    state.min_samples = min_samples;
+    s_adaptive        = v;
+}
+
+bool StackStats::IsAdaptive() {
+    return s_adaptive;
+}
+
+void StackStats::Paint(void *stack, size_t stacksize, size_t size) {
+    if (size == 0 || size > stacksize) {
+        size = stacksize;
+    }
+    //栈从高地址往低地址增长，从栈顶往下涂
+    uint64_t *top   = (uint64_t *)stack + stacksize / sizeof(uint64_t);
+    uint64_t *begin = top - (size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+    for (uint64_t *p = begin; p < top; ++p) {
+        *p = kPattern;
+    }
+}
+
+size_t StackStats::HighWater(const void *stack, size_t stacksize) {
+    const uint64_t *p = (const uint64_t *)stack;
+    size_t words      = stacksize / sizeof(uint64_t);
+    size_t i          = 0;
+    while (i < words && p[i] == kPattern) {
+        ++i;
+    }
+    return stacksize - i * sizeof(uint64_t);
+}
+
+void StackStats::Record(const char *tag, size_t used, size_t stacksize) {
+    size_t bucket = used / kBucketSize;
+    if (bucket >= kBuckets) {
+        bucket = kBuckets - 1;
+    }
+    State &state = GetState();
+    Mutex::Lock lock(state.mutex);
+    TagStats &stats = state.tags[TagName(tag)];
+    ++stats.samples;
+    ++stats.buckets[bucket];
+    if (used > stats.max) {
+        stats.max = used;
+    }
+    stats.stacksize = stacksize;
+}
+
+size_t StackStats::SuggestSize(const char *tag) {
+    if (!s_adaptive) {
+        return 0;
+    }
+    State &state = GetState();
+    Mutex::Lock lock(state.mutex);
+    auto it = state.tags.find(TagName(tag));
+    if (it == state.tags.end()) {
+        return 0;
+    }
+    return SuggestNoLock(state, it->second);
+}
+
+size_t StackStats::Percentile(const char *tag, double percentile) {
+    State &state = GetState();
+    Mutex::Lock lock(state.mutex);
+    auto it = state.tags.find(TagName(tag));
+    return it == state.tags.end() ? 0 : PercentileNoLock(it->second, percentile);
+}
+
+uint64_t StackStats::Samples(const char *tag) {
+    State &state = GetState();
+    Mutex::Lock lock(state.mutex);
+    auto it = state.tags.find(TagName(tag));
+    return it == state.tags.end() ? 0 : it->second.samples;
+}
+
+void StackStats::Dump(std::ostream &os) {
+    State &state = GetState();
+    Mutex::Lock lock(state.mutex);
+    os << std::left << std::setw(24) << "tag" << std::right << std::setw(10) << "samples"
+       << std::setw(10) << "p50" << std::setw(10) << "p99" << std::setw(10) << "max"
+       << std::setw(12) << "stacksize" << std::setw(10) << "suggest" << std::endl;
+    for (auto &i : state.tags) {
+        const TagStats &stats = i.second;
+        os << std::left << std::setw(24) << i.first << std::right << std::setw(10) << stats.samples
+           << std::setw(10) << PercentileNoLock(stats, 0.5) << std::setw(10) << PercentileNoLock(stats, 0.99)
+           << std::setw(10) << stats.max << std::setw(12) << stats.stacksize
+           << std::setw(10) << SuggestNoLock(state, stats) << std::endl;
+    }
+}
+
+void StackStats::Reset() {
+    State &state = GetState();
+    Mutex::Lock lock(state.mutex);
+    state.tags.clear();
+}
+
+} // namespace sylar
@@ -0,0 +1,104 @@
+/**
+ * @file stack_stats.h
+ * @brief 协程栈使用量统计与自适应栈大小
+ * @details 打开栈涂色后，协程栈在分配时整块填充哨兵值，协程结束(重置或析构)时从栈底往上找第一个被改写的位置，
+ *          得到本次运行的栈使用最高水位。最高水位按协程的类别(创建协程时传入的tag，一般是调用点的字符串常量)汇总成直方图。
+ *          打开自适应后，带tag且没有指定栈大小的协程按该类别最高水位的百分位数加上余量来决定栈大小，
+ *          样本数不够时仍使用默认栈大小。
+ *          涂色需要把整个栈写一遍，所有栈页都会变成常驻内存，所以只在压测或者灰度时打开，得出合适的栈大小
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_STACK_STATS_H__
+#define __SYLAR_STACK_STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <ostream>
+
+namespace sylar {
+
+/**
+ * @brief 协程栈使用量统计
+ */
+class StackStats {
+public:
+    /// 直方图的粒度
+    static const size_t kBucketSize = 1024;
+
+    /// 直方图的桶数，超过kBucketSize * kBuckets的计入最后一个桶
+    static const size_t kBuckets = 1024;
+
+    /**
+     * @brief 打开或关闭栈涂色，只影响之后创建的协程
+     */
+    static void SetPainting(bool v);
+
+    /**
+     * @brief 是否打开了栈涂色
+     */
+    static bool IsPainting();
+
+    /**
+     * @brief 打开或关闭自适应栈大小
+     * @param[in] percentile 按最高水位的哪个百分位数决定栈大小，(0, 1]
+     * @param[in] margin 在百分位数之上额外留出的字节数
+     * @param[in] min_samples 类别的样本数达到多少之后才调整栈大小
+     */
+    static void SetAdaptive(bool v, double percentile = 0.99, size_t margin = 16 * 1024,
+                            uint64_t min_samples = 100);
+
+    /**
+     * @brief 是否打开了自适应栈大小
+     */
+    static bool IsAdaptive();
+
+    /**
+     * @brief 给协程栈涂色
+     * @param[in] stack 栈的最低地址
+     * @param[in] stacksize 栈大小
+     * @param[in] size 从栈顶往下需要涂色的字节数，0表示整个栈。复用协程时只需要重新涂上次用过的部分
+     */
+    static void Paint(void *stack, size_t stacksize, size_t size = 0);
+
+    /**
+     * @brief 测量栈的最高水位，即栈顶到最低一个被改写位置的字节数
+     */
+    static size_t HighWater(const void *stack, size_t stacksize);
+
+    /**
+     * @brief 记录某个类别的一次最高水位
+     * @param[in] tag 协程类别，nullptr记为"untagged"
+     */
+    static void Record(const char *tag, size_t used, size_t stacksize);
+
+    /**
+     * @brief 获取某个类别建议的栈大小
+     * @return 没有打开自适应、或者样本数不够时返回0，表示使用默认大小
+     */
+    static size_t SuggestSize(const char *tag);
+
+    /**
+     * @brief 获取某个类别最高水位的百分位数，没有样本时返回0
+     */
+    static size_t Percentile(const char *tag, double percentile);
+
+    /**
+     * @brief 获取某个类别的样本数
+     */
+    static uint64_t Samples(const char *tag);
+
+    /**
+     * @brief 输出所有类别的统计：样本数、p50、p99、最大值、栈大小、建议栈大小
+     */
+    static void Dump(std::ostream &os);
+
+    /**
+     * @brief 清空所有统计
+     */
+    static void Reset();
+};
+
+} // namespace sylar
+
+#endif
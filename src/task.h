@@ -0,0 +1,318 @@
+/**
+ * @file task.h
+ * @brief C++20无栈协程(co_await)接口
+ * @details 有栈协程每个都要占一个协程栈(默认128k)，而很多请求/响应处理只是一个很短的状态机。
+ *          Task<T>是C++20的无栈协程，挂起时只保留编译器分配的协程帧(通常几百字节)。
+ *          Task在调度器的线程上和Fiber一起运行：挂起时把恢复操作作为回调注册到IOManager的事件/定时器上，
+ *          或者作为回调任务加入Scheduler，恢复时由调度线程的回调协程执行，执行完回调协程即被复用，不会为每个Task占一个栈。
+ *          sylar::Task<int> handle(int fd) {
+ *              co_await sylar::readable(fd);
+ *              ...
+ *              co_await sylar::sleep_for(100);
+ *              co_return n;
+ *          }
+ *          sylar::co_spawn(handle(fd));
+ *          只在支持C++20协程的编译器上可用(-std=c++20)
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_TASK_H__
+#define __SYLAR_TASK_H__
+
+#if defined(__cpp_impl_coroutine)
+
+#include <cassert>
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "iomanager.h"
+#include "scheduler.h"
+
+namespace sylar {
+
+template <class T = void>
+class Task;
+
+namespace detail {
+
+/**
+ * @brief Task的promise公共部分
+ */
+struct TaskPromiseBase {
+    /**
+     * @brief 协程结束时，有等待者就直接切换到等待者(对称转移)，被co_spawn分离的协程则销毁自己
+     */
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <class Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+            TaskPromiseBase &p = h.promise();
+            if (p.continuation) {
+                return p.continuation;
+            }
+            if (p.detached) {
+                //分离的协程没有人接收异常，和std::thread一样直接终止
+                if (p.error) {
+                    std::terminate();
+                }
+                h.destroy();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    /// 创建时不执行，等被co_await或者co_spawn时再执行
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    FinalAwaiter final_suspend() noexcept { return {}; }
+
+    void unhandled_exception() { error = std::current_exception(); }
+
+    /// 等待本协程结束的协程
+    std::coroutine_handle<> continuation;
+
+    /// 协程抛出的异常
+    std::exception_ptr error;
+
+    /// 是否已经被co_spawn分离
+    bool detached = false;
+};
+
+template <class T>
+struct TaskPromise : TaskPromiseBase {
+    Task<T> get_return_object();
+
+    template <class U>
+    void return_value(U &&v) {
+        value.emplace(std::forward<U>(v));
+    }
+
+    T result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+
+    std::optional<T> value;
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void result() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+} // namespace detail
+
+/**
+ * @brief 无栈协程任务
+ * @tparam T 返回值类型
+ * @details 惰性执行，只能移动。可以在另一个Task中co_await它，取得返回值或者重新抛出其异常；
+ *          最外层的Task通过co_spawn交给调度器执行
+ */
+template <class T>
+class [[nodiscard]] Task {
+public:
+    typedef detail::TaskPromise<T> promise_type;
+    typedef std::coroutine_handle<promise_type> handle_type;
+
+    explicit Task(handle_type h) : m_handle(h) {}
+
+    Task(Task &&other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (m_handle) {
+                m_handle.destroy();
+            }
+            m_handle = std::exchange(other.m_handle, nullptr);
+        }
+        return *this;
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+    ~Task() {
+        if (m_handle) {
+            m_handle.destroy();
+        }
+    }
+
+    /**
+     * @brief 在当前协程中执行本任务，本任务结束后恢复当前协程
+     */
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            handle_type handle;
+
+            bool await_ready() noexcept { return !handle || handle.done(); }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) noexcept {
+                handle.promise().continuation = caller;
+                return handle;
+            }
+
+            T await_resume() { return handle.promise().result(); }
+        };
+        return Awaiter{m_handle};
+    }
+
+    /**
+     * @brief 交出协程句柄，之后由调用者负责销毁
+     */
+    handle_type release() { return std::exchange(m_handle, nullptr); }
+
+private:
+    handle_type m_handle;
+};
+
+namespace detail {
+
+template <class T>
+inline Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T> >::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void> >::from_promise(*this));
+}
+
+/**
+ * @brief 把协程的恢复操作作为回调任务加入调度器
+ */
+inline void ResumeOn(Scheduler *scheduler, std::coroutine_handle<> h) {
+    scheduler->schedule([h] { h.resume(); });
+}
+
+} // namespace detail
+
+/**
+ * @brief 分离执行一个Task
+ * @details 把Task的第一次执行作为回调任务加入调度器，之后Task在哪个线程恢复取决于它等待的事件；
+ *          Task结束后自动销毁协程帧，返回值被丢弃，未捕获的异常导致std::terminate
+ * @param[in] scheduler 调度器，默认为当前线程的调度器
+ */
+template <class T>
+void co_spawn(Task<T> task, Scheduler *scheduler = nullptr) {
+    if (!scheduler) {
+        scheduler = Scheduler::GetThis();
+    }
+    assert(scheduler);
+    auto h                = task.release();
+    h.promise().detached = true;
+    detail::ResumeOn(scheduler, h);
+}
+
+/**
+ * @brief 等待fd上的IO事件
+ */
+class IoAwaiter {
+public:
+    IoAwaiter(int fd, IOManager::Event event) : m_fd(fd), m_event(event) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    /**
+     * @brief 在当前IOManager上注册事件，事件触发时把协程恢复加入调度
+     * @details 注册成功后事件可能立即在其他线程触发并恢复协程，所以注册之后不能再访问本对象
+     */
+    bool await_suspend(std::coroutine_handle<> h) {
+        IOManager *iom = IOManager::GetThis();
+        assert(iom);
+        if (iom->addEvent(m_fd, m_event, [h] { h.resume(); }) != 0) {
+            m_ok = false;
+            return false;
+        }
+        return true;
+    }
+
+    /**
+     * @return 事件触发(或者被cancelEvent取消)时返回true，注册事件失败时返回false
+     */
+    bool await_resume() const noexcept { return m_ok; }
+
+private:
+    int m_fd;
+    IOManager::Event m_event;
+    /// 是否注册成功，只在注册失败(不挂起)时修改
+    bool m_ok = true;
+};
+
+/**
+ * @brief co_await readable(fd)，等待fd可读
+ * @attention 恢复后应该用非阻塞方式读，fd被hook管理时hook的read在数据未就绪时会挂起承载本Task的回调协程
+ */
+inline IoAwaiter readable(int fd) { return IoAwaiter(fd, IOManager::READ); }
+
+/**
+ * @brief co_await writable(fd)，等待fd可写
+ */
+inline IoAwaiter writable(int fd) { return IoAwaiter(fd, IOManager::WRITE); }
+
+/**
+ * @brief 挂起一段时间
+ */
+class SleepAwaiter {
+public:
+    explicit SleepAwaiter(uint64_t ms) : m_ms(ms) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) {
+        IOManager *iom = IOManager::GetThis();
+        assert(iom);
+        iom->addTimer(m_ms, [h] { h.resume(); });
+    }
+
+    void await_resume() const noexcept {}
+
+private:
+    uint64_t m_ms;
+};
+
+/**
+ * @brief co_await sleep_for(ms)，挂起ms毫秒，不占用线程
+ */
+inline SleepAwaiter sleep_for(uint64_t ms) { return SleepAwaiter(ms); }
+
+/**
+ * @brief 切换到指定调度器上继续执行
+ */
+class ScheduleAwaiter {
+public:
+    explicit ScheduleAwaiter(Scheduler *scheduler) : m_scheduler(scheduler) {}
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> h) { detail::ResumeOn(m_scheduler, h); }
+
+    void await_resume() const noexcept {}
+
+private:
+    Scheduler *m_scheduler;
+};
+
+/**
+ * @brief co_await schedule_on(scheduler)，把本Task的后续部分交给另一个调度器执行；
+ *        传当前调度器则相当于让出执行权，排到任务队列末尾
+ */
+inline ScheduleAwaiter schedule_on(Scheduler *scheduler) { return ScheduleAwaiter(scheduler); }
+
+} // namespace sylar
+
+#endif // __cpp_impl_coroutine
+
+#endif
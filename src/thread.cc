@@ -1,5 +1,6 @@
 #include "thread.h"
 // #include "log.h"
+#include "stack_allocator.h"
 #include "util.h"
 
 namespace sylar {
@@ -81,6 +82,9 @@ void *Thread::run(void *arg) {
     //设置线程名称
     pthread_setname_np(pthread_self(), thread->m_name.substr(0, 15).c_str());
 
+    //安装了协程栈溢出处理函数时，给本线程设置信号处理专用栈
+    StackAllocator::SetupAltStack();
+
     std::function<void()> cb;
     cb.swap(thread->m_cb);
 
@@ -0,0 +1,180 @@
+/**
+ * @file thread_stats.h
+ * @brief 按线程记录、汇总时合并的统计
+ * @details fiber_stats、alloc_profiler、hook_stats、block_detector共用。
+ *          记录只写本线程的统计对象，不加锁：只有所属线程写，计数用relaxed的读加写(AddRelaxed)代替原子加，
+ *          汇总和清零时持锁遍历所有线程的统计对象并relaxed读。
+ *          每个统计对象前面留一个缓存行，与相邻分配的对象隔开。
+ *          线程退出时把统计对象交还登记表，之后新建的线程接着使用，累计值不丢，对象个数不超过同时存在过的线程数
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_THREAD_STATS_H__
+#define __SYLAR_THREAD_STATS_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "macro.h"
+#include "mutex.h"
+#include "noncopyable.h"
+
+namespace sylar {
+
+namespace detail {
+
+/**
+ * @brief 只有一个线程写的计数器加n
+ */
+inline void AddRelaxed(std::atomic<uint64_t> &v, uint64_t n = 1) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 每个线程一个T类型的统计对象
+ * @details 每种T只能有一个登记表，一般放在函数内的静态变量里
+ */
+template <class T>
+class ThreadStatsRegistry : Noncopyable {
+public:
+    /**
+     * @brief 本线程的统计对象，第一次调用时分配，或者接手已退出线程交还的对象
+     * @return 线程正在退出(本线程的统计对象已经交还)时返回nullptr
+     */
+    T *local() {
+        T *stats = t_local;
+        if (SYLAR_LIKELY(stats)) {
+            return stats;
+        }
+        return attach();
+    }
+
+    /**
+     * @brief 持锁遍历所有统计对象，包括已退出线程交还的
+     */
+    template <class F>
+    void forEach(F f) {
+        Mutex::Lock lock(m_mutex);
+        for (auto &i : m_slots) {
+            f(i->stats);
+        }
+    }
+
+private:
+    struct Slot {
+        char pad[64];
+        T stats;
+        bool used = false;
+    };
+
+    /**
+     * @brief 线程退出时交还统计对象
+     */
+    struct Owner {
+        ThreadStatsRegistry *registry = nullptr;
+        Slot *slot                    = nullptr;
+
+        ~Owner() {
+            t_local  = nullptr;
+            t_exited = true;
+            if (registry) {
+                Mutex::Lock lock(registry->m_mutex);
+                slot->used = false;
+            }
+        }
+    };
+
+    T *attach() {
+        if (t_exited) {
+            return nullptr;
+        }
+        Slot *slot = nullptr;
+        {
+            Mutex::Lock lock(m_mutex);
+            for (auto &i : m_slots) {
+                if (!i->used) {
+                    slot = i.get();
+                    break;
+                }
+            }
+            if (!slot) {
+                m_slots.emplace_back(new Slot);
+                slot = m_slots.back().get();
+            }
+            slot->used = true;
+        }
+        t_owner.registry = this;
+        t_owner.slot     = slot;
+        t_local          = &slot->stats;
+        return t_local;
+    }
+
+private:
+    Mutex m_mutex;
+    std::vector<std::unique_ptr<Slot>> m_slots;
+
+    static thread_local T *t_local;
+    static thread_local bool t_exited;
+    static thread_local Owner t_owner;
+};
+
+template <class T>
+thread_local T *ThreadStatsRegistry<T>::t_local = nullptr;
+
+template <class T>
+thread_local bool ThreadStatsRegistry<T>::t_exited = false;
+
+template <class T>
+thread_local typename ThreadStatsRegistry<T>::Owner ThreadStatsRegistry<T>::t_owner;
+
+/**
+ * @brief 一个线程内按协程类别(tag)累加的统计，Acc是一个类别的计数
+ * @details 以tag指针为键，汇总时再按字符串内容合并(TagName)。只有所属线程插入新类别，插入和汇总时的遍历加锁，
+ *          所属线程查找不加锁；大部分记录和上一次是同一个类别，直接用缓存的指针。
+ *          类别插入后不删除，所属线程可能正拿着缓存的指针
+ */
+template <class Acc>
+struct TagStatsMap {
+    Spinlock mutex;
+    std::unordered_map<const char *, Acc> tags;
+    const char *last_tag = nullptr;
+    Acc *last            = nullptr;
+
+    Acc &get(const char *tag) {
+        if (SYLAR_LIKELY(last && last_tag == tag)) {
+            return *last;
+        }
+        auto it = tags.find(tag);
+        if (it == tags.end()) {
+            Spinlock::Lock lock(mutex);
+            it = tags.emplace(std::piecewise_construct, std::forward_as_tuple(tag), std::forward_as_tuple()).first;
+        }
+        last_tag = tag;
+        last     = &it->second;
+        return it->second;
+    }
+};
+
+/**
+ * @brief 本线程中该类别的累加值，线程正在退出时返回nullptr
+ */
+template <class Acc>
+Acc *GetTagAcc(ThreadStatsRegistry<TagStatsMap<Acc>> &registry, const char *tag) {
+    TagStatsMap<Acc> *stats = registry.local();
+    return SYLAR_LIKELY(stats) ? &stats->get(tag) : nullptr;
+}
+
+/**
+ * @brief 汇总时显示的类别名，没有设置类别的协程和线程自己记为untagged
+ */
+inline const char *TagName(const char *tag) { return tag ? tag : "untagged"; }
+
+} // namespace detail
+
+} // namespace sylar
+
+#endif
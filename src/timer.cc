@@ -1,6 +1,7 @@
 #include "timer.h"
 #include "util.h"
 #include "macro.h"
+#include "sdt.h"
 
 namespace sylar {
 
@@ -26,11 +27,11 @@ bool Timer::Comparator::operator()(const Timer::ptr& lhs
 }
 
 
-Timer::Timer(uint64_t ms, std::function<void()> cb,
+Timer::Timer(uint64_t ms, Callback cb,
              bool recurring, TimerManager* manager)
     :m_recurring(recurring)
     ,m_ms(ms)
-    ,m_cb(cb)
+    ,m_cb(std::move(cb))
     ,m_manager(manager) {
     
     //GetElapsedMS拿到当前时间
@@ -48,6 +49,7 @@ bool Timer::cancel() {
     if(m_cb) {
         //将回调函数清零
         m_cb = nullptr;
+        m_sharedCb.reset();
         auto it = m_manager->m_timers.find(shared_from_this());
         m_manager->m_timers.erase(it);
         return true;
@@ -129,6 +131,7 @@ void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
     
     //it是一个迭代器类型 其会根据自定义的排序规则选择合适位置进行插入
     auto it = m_timers.insert(val).first;
+    SYLAR_PROBE2(timer__add, val->m_ms, val->m_next);
     
     //如果插入的是定时器容器头部 并且原来没有触发过定时器tickle
     bool at_front = (it == m_timers.begin()) && !m_tickled;
@@ -145,31 +148,49 @@ void TimerManager::addTimer(Timer::ptr val, RWMutexType::WriteLock& lock) {
     }
 }
 
-Timer::ptr TimerManager::addTimer(uint64_t ms, std::function<void()> cb
+Timer::ptr TimerManager::addTimer(uint64_t ms, Callback cb
                                   ,bool recurring) {
-    Timer::ptr timer(new Timer(ms, cb, recurring, this));
+    Timer::ptr timer(new Timer(ms, std::move(cb), recurring, this));
     RWMutexType::WriteLock lock(m_mutex);
     addTimer(timer, lock);
     return timer;
 }
 
+namespace {
+
 //条件判定函数
-//本函数就是考虑条件情况下，对用户cb的封装
-static void OnTimer(std::weak_ptr<void> weak_cond, std::function<void()> cb) {
-    /*weak_ptr的lock函数是C++标准库中weak_ptr类的一个成员函数，它的主要作用是尝试获取一个指向weak_ptr所管理的对象的shared_ptr。*/
-    std::shared_ptr<void> tmp = weak_cond.lock();
-    
-    //如果条件满足
-    if(tmp) {
-        cb();
+//本函数对象就是考虑条件情况下，对用户cb的封装 Callback只能移动，std::bind调用时只能以左值传参，所以这里用函数对象
+struct OnTimer {
+    std::weak_ptr<void> weak_cond;
+    Callback cb;
+
+    void operator()() const {
+        /*weak_ptr的lock函数是C++标准库中weak_ptr类的一个成员函数，它的主要作用是尝试获取一个指向weak_ptr所管理的对象的shared_ptr。*/
+        std::shared_ptr<void> tmp = weak_cond.lock();
+
+        //如果条件满足
+        if(tmp) {
+            cb();
+        }
     }
-}
+};
+
+//循环定时器每次到期交出去的回调，共享同一个Callback
+struct SharedCallback {
+    std::shared_ptr<Callback> cb;
+
+    void operator()() const {
+        (*cb)();
+    }
+};
 
-Timer::ptr TimerManager::addConditionTimer(uint64_t ms, std::function<void()> cb
+} // namespace
+
+Timer::ptr TimerManager::addConditionTimer(uint64_t ms, Callback cb
                                     ,std::weak_ptr<void> weak_cond
                                     ,bool recurring) {
                                         //将上面的条件判定函数和条件绑定，以及和原始cb绑定，搞成一个新的cb
-    return addTimer(ms, std::bind(&OnTimer, weak_cond, cb), recurring);
+    return addTimer(ms, OnTimer{weak_cond, std::move(cb)}, recurring);
 }
 
 uint64_t TimerManager::get_the_most_recent_Timer_time() {
@@ -193,9 +214,12 @@ uint64_t TimerManager::get_the_most_recent_Timer_time() {
     }
 }
 
-void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
+void TimerManager::listExpiredCb(std::vector<Callback>& cbs, uint64_t* max_late_ms) {
     //拿到当前时间
     uint64_t now_ms = sylar::GetElapsedMS();
+    if(max_late_ms) {
+        *max_late_ms = 0;
+    }
     
     //超时定时器数组
     std::vector<Timer::ptr> expired;
@@ -241,17 +265,28 @@ void TimerManager::listExpiredCb(std::vector<std::function<void()> >& cbs) {
 
     expired.insert(expired.begin(), m_timers.begin(), it);
     m_timers.erase(m_timers.begin(), it);
+    SYLAR_PROBE2(timer__fire, expired.size(), now_ms);
     cbs.reserve(expired.size());
 
     for(auto& timer : expired) {
-        cbs.push_back(timer->m_cb);
-        
+        //时间跳变时到期时间没有意义，不计算
+        if(max_late_ms && !rollover && now_ms - timer->m_next > *max_late_ms) {
+            *max_late_ms = now_ms - timer->m_next;
+        }
         //该定时器要循环使用 那么更新器m_next，再重新插入
         if(timer->m_recurring) {
+            //回调只能移动，循环定时器自己还要留一份 第一次到期时转成共享的，m_cb中也换成共享的，保证cancel()仍能判断定时器是否有效
+            if(!timer->m_sharedCb) {
+                timer->m_sharedCb = std::make_shared<Callback>(std::move(timer->m_cb));
+                timer->m_cb = SharedCallback{timer->m_sharedCb};
+            }
+            cbs.push_back(SharedCallback{timer->m_sharedCb});
             timer->m_next = now_ms + timer->m_ms;
             m_timers.insert(timer);
         } 
         else {
+            //一次性定时器直接把回调移出来，m_cb变为空
+            cbs.push_back(std::move(timer->m_cb));
             timer->m_cb = nullptr;
         }
     }
@@ -283,4 +318,9 @@ bool TimerManager::hasTimer() {
     return !m_timers.empty();
 }
 
+size_t TimerManager::getTimerCount() {
+    RWMutexType::ReadLock lock(m_mutex);
+    return m_timers.size();
+}
+
 }
@@ -4,6 +4,7 @@
 #include <memory>
 #include <vector>
 #include <set>
+#include "callback.h"
 #include "mutex.h"
 
 namespace sylar {
@@ -42,7 +43,7 @@ private:
      * @param[in] recurring 是否循环
      * @param[in] manager 定时器管理器
      */
-    Timer(uint64_t ms, std::function<void()> cb,
+    Timer(uint64_t ms, Callback cb,
           bool recurring, TimerManager* manager);
     /**
      * @brief 构造函数
@@ -65,7 +66,10 @@ private:
     uint64_t m_next = 0;
 
     /// 回调函数
-    std::function<void()> m_cb;
+    Callback m_cb;
+
+    /// 循环定时器第一次到期时把回调转成共享的，之后每次到期只拷贝这个shared_ptr，不再拷贝回调本身
+    std::shared_ptr<Callback> m_sharedCb;
 
     /// 定时器管理器
     TimerManager* m_manager = nullptr;
@@ -105,11 +109,15 @@ public:
 
     /**
      * @brief 添加定时器
+     * @details 循环定时器每次到期执行的是同一个回调对象，不再像std::function那样每次拷贝一份：
+     *          回调中可变的状态(比如mutable lambda按值捕获的变量)在多次到期之间保留；
+     *          上一次到期的回调还没执行完时下一次又到期，同一个对象可能在两个调度线程上并发执行，
+     *          这种情况下回调需要自己保证线程安全
      * @param[in] ms 定时器执行间隔时间 周期
      * @param[in] cb 定时器回调函数
      * @param[in] recurring 是否循环定时器
      */
-    Timer::ptr addTimer(uint64_t ms, std::function<void()> cb
+    Timer::ptr addTimer(uint64_t ms, Callback cb
                         ,bool recurring = false);
 
     /**
@@ -117,9 +125,9 @@ public:
      * @param[in] ms 定时器执行间隔时间
      * @param[in] cb 定时器回调函数
      * @param[in] weak_cond 条件(即定时器到时后还要判断一下条件)
-     * @param[in] recurring 是否循环
+     * @param[in] recurring 是否循环，循环时回调对象在多次到期之间共享，同addTimer()
      */
-    Timer::ptr addConditionTimer(uint64_t ms, std::function<void()> cb
+    Timer::ptr addConditionTimer(uint64_t ms, Callback cb
                         ,std::weak_ptr<void> weak_cond
                         ,bool recurring = false);
 
@@ -133,14 +141,20 @@ public:
     /**
      * @brief 获取需要执行的定时器的回调函数列表
      * @param[out] cbs 回调函数数组 这是一个传出参数
+     * @param[out] max_late_ms 不为空时返回到期的定时器中最晚的一个比到期时间晚了多少毫秒，没有到期的定时器时为0
      */
-    void listExpiredCb(std::vector<std::function<void()> >& cbs);
+    void listExpiredCb(std::vector<Callback>& cbs, uint64_t* max_late_ms = nullptr);
 
     /**
      * @brief 是否有定时器,即定时器数组是否为空
      */
     bool hasTimer();
 
+    /**
+     * @brief 还没触发的定时器个数
+     */
+    size_t getTimerCount();
+
 protected:
 
     /**
@@ -0,0 +1,297 @@
+/**
+ * @file trace.cc
+ * @brief 协程事件追踪实现
+ * @version 0.1
+ */
+
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <vector>
+#include "mutex.h"
+#include "thread.h"
+#include "trace.h"
+#include "util.h"
+
+namespace sylar {
+
+namespace detail {
+std::atomic<bool> g_trace_enabled{false};
+} // namespace detail
+
+namespace {
+
+struct TraceEvent {
+    uint64_t ts;
+    uint64_t dur;
+    uint64_t fiber;
+    int64_t arg;
+    const char *name;
+    Trace::Type type;
+};
+
+/**
+ * @brief 线程的事件缓冲区，只有所属线程写，导出时其他线程读
+ * @details 缓冲区由全局列表持有，线程退出后事件仍然可以导出，导出或者Clear()之后释放
+ */
+struct TraceBuffer {
+    pid_t tid;
+    std::string thread_name;
+    std::vector<TraceEvent> events;
+    /// 已经写入的事件总数，写完事件后release递增
+    std::atomic<uint64_t> pos{0};
+    /// Clear()时的pos，之前的事件不再导出
+    std::atomic<uint64_t> cleared{0};
+    /// 所属线程已经退出，不会再写入
+    std::atomic<bool> dead{false};
+};
+
+std::atomic<size_t> s_buffer_size{65536};
+
+Mutex &BuffersMutex() {
+    static Mutex s_mutex;
+    return s_mutex;
+}
+
+std::vector<std::shared_ptr<TraceBuffer>> &Buffers() {
+    static std::vector<std::shared_ptr<TraceBuffer>> s_buffers;
+    return s_buffers;
+}
+
+thread_local TraceBuffer *t_buffer = nullptr;
+
+/// 线程局部对象已经析构，之后(其他线程局部对象析构时)的事件不再记录
+thread_local bool t_exited = false;
+
+/**
+ * @brief 线程退出时把缓冲区标记为不再写入
+ */
+struct BufferOwner {
+    ~BufferOwner() {
+        t_exited = true;
+        if (t_buffer) {
+            t_buffer->dead.store(true, std::memory_order_release);
+            t_buffer = nullptr;
+        }
+    }
+};
+
+thread_local BufferOwner t_owner;
+
+/**
+ * @brief 释放已退出线程的缓冲区，调用者持有BuffersMutex()
+ * @param[in] exported 只释放其中的缓冲区，为空时释放所有已退出线程的缓冲区
+ */
+void PruneDead(const std::vector<std::shared_ptr<TraceBuffer>> *exported) {
+    std::vector<std::shared_ptr<TraceBuffer>> &buffers = Buffers();
+    buffers.erase(std::remove_if(buffers.begin(), buffers.end(),
+                                 [exported](const std::shared_ptr<TraceBuffer> &buf) {
+                                     return buf->dead.load(std::memory_order_acquire) &&
+                                            (!exported || std::find(exported->begin(), exported->end(), buf) !=
+                                                              exported->end());
+                                 }),
+                  buffers.end());
+}
+
+TraceBuffer *GetBuffer() {
+    if (SYLAR_UNLIKELY(!t_buffer)) {
+        //访问一次，让线程退出时析构
+        (void)&t_owner;
+        std::shared_ptr<TraceBuffer> buf(new TraceBuffer);
+        buf->tid         = GetThreadId();
+        buf->thread_name = Thread::GetName();
+        buf->events.resize(std::max<size_t>(s_buffer_size, 1));
+        Mutex::Lock lock(BuffersMutex());
+        Buffers().push_back(buf);
+        t_buffer = buf.get();
+    }
+    return t_buffer;
+}
+
+/**
+ * @brief 输出JSON字符串，名字都是程序中的常量，只处理引号、反斜杠和控制字符
+ */
+void WriteString(std::ostream &os, const char *s) {
+    os << '"';
+    for (; s && *s; ++s) {
+        if (*s == '"' || *s == '\\') {
+            os << '\\' << *s;
+        } else if ((unsigned char)*s < 0x20) {
+            os << ' ';
+        } else {
+            os << *s;
+        }
+    }
+    os << '"';
+}
+
+/**
+ * @brief trace-event的时间单位是微秒，保留纳秒精度
+ */
+void WriteUS(std::ostream &os, const char *key, uint64_t ns) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), ",\"%s\":%llu.%03llu", key, (unsigned long long)(ns / 1000),
+             (unsigned long long)(ns % 1000));
+    os << buf;
+}
+
+void WriteEvent(std::ostream &os, const TraceEvent &e, pid_t pid, pid_t tid) {
+    const char *name = e.name;
+    const char *cat  = "fiber";
+    const char *ph   = "i";
+    switch (e.type) {
+    case Trace::FIBER_CREATE:
+        name = "fiber.create";
+        break;
+    case Trace::FIBER_RUN:
+        name = e.name ? e.name : "fiber";
+        ph   = "X";
+        break;
+    case Trace::FIBER_TERM:
+        name = "fiber.term";
+        break;
+    case Trace::SYSCALL_BEGIN:
+        cat = "syscall";
+        ph  = "b";
+        break;
+    case Trace::SYSCALL_END:
+        cat = "syscall";
+        ph  = "e";
+        break;
+    case Trace::EPOLL_WAIT:
+        cat = "iomanager";
+        ph  = "X";
+        break;
+    case Trace::TIMER_FIRE:
+        cat = "timer";
+        break;
+    }
+
+    os << "{\"name\":";
+    WriteString(os, name);
+    os << ",\"cat\":\"" << cat << "\",\"ph\":\"" << ph << "\"";
+    WriteUS(os, "ts", e.ts);
+    if (*ph == 'X') {
+        WriteUS(os, "dur", e.dur);
+    } else if (*ph == 'i') {
+        os << ",\"s\":\"t\"";
+    } else {
+        os << ",\"id\":" << e.fiber;
+    }
+    os << ",\"pid\":" << pid << ",\"tid\":" << tid << ",\"args\":{\"fiber\":" << e.fiber;
+    switch (e.type) {
+    case Trace::FIBER_CREATE:
+        os << ",\"tag\":";
+        WriteString(os, e.name ? e.name : "untagged");
+        break;
+    case Trace::SYSCALL_BEGIN:
+        os << ",\"fd\":" << e.arg;
+        break;
+    case Trace::EPOLL_WAIT:
+        os << ",\"events\":" << e.arg;
+        break;
+    case Trace::TIMER_FIRE:
+        os << ",\"count\":" << e.arg;
+        break;
+    default:
+        break;
+    }
+    os << "}}";
+}
+
+} // namespace
+
+void Trace::SetEnabled(bool v) {
+    detail::g_trace_enabled.store(v, std::memory_order_relaxed);
+}
+
+void Trace::SetBufferSize(size_t events) {
+    s_buffer_size = events;
+}
+
+uint64_t Trace::Now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void Trace::DoRecord(Type type, const char *name, uint64_t fiber, int64_t arg, uint64_t begin) {
+    if ((type == FIBER_RUN || type == EPOLL_WAIT) && !begin) {
+        //开始时还没有打开追踪
+        return;
+    }
+    if (SYLAR_UNLIKELY(t_exited)) {
+        return;
+    }
+    TraceBuffer *buf = GetBuffer();
+    uint64_t now     = Now();
+    uint64_t pos     = buf->pos.load(std::memory_order_relaxed);
+    TraceEvent &e    = buf->events[pos % buf->events.size()];
+    e.ts             = begin ? begin : now;
+    e.dur            = begin ? now - begin : 0;
+    e.fiber          = fiber;
+    e.arg            = arg;
+    e.name           = name;
+    e.type           = type;
+    buf->pos.store(pos + 1, std::memory_order_release);
+}
+
+void Trace::Dump(std::ostream &os) {
+    std::vector<std::shared_ptr<TraceBuffer>> buffers, dead;
+    {
+        Mutex::Lock lock(BuffersMutex());
+        buffers = Buffers();
+    }
+    //先记下已经退出的线程，它们的事件这次全部导出，之后释放
+    for (auto &buf : buffers) {
+        if (buf->dead.load(std::memory_order_acquire)) {
+            dead.push_back(buf);
+        }
+    }
+    pid_t pid  = getpid();
+    bool first = true;
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (auto &buf : buffers) {
+        os << (first ? "\n" : ",\n");
+        first = false;
+        os << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buf->tid
+           << ",\"args\":{\"name\":";
+        WriteString(os, buf->thread_name.empty() ? "unnamed" : buf->thread_name.c_str());
+        os << "}}";
+
+        uint64_t end   = buf->pos.load(std::memory_order_acquire);
+        uint64_t size  = buf->events.size();
+        uint64_t begin = std::max(buf->cleared.load(std::memory_order_relaxed), end > size ? end - size : 0);
+        for (uint64_t i = begin; i < end; ++i) {
+            os << ",\n";
+            WriteEvent(os, buf->events[i % size], pid, buf->tid);
+        }
+    }
+    os << "\n]}\n";
+    if (!dead.empty()) {
+        Mutex::Lock lock(BuffersMutex());
+        PruneDead(&dead);
+    }
+}
+
+bool Trace::DumpToFile(const std::string &path) {
+    std::ofstream ofs(path);
+    if (!ofs) {
+        return false;
+    }
+    Dump(ofs);
+    return (bool)ofs;
+}
+
+void Trace::Clear() {
+    Mutex::Lock lock(BuffersMutex());
+    PruneDead(nullptr);
+    for (auto &buf : Buffers()) {
+        buf->cleared.store(buf->pos.load(std::memory_order_acquire), std::memory_order_relaxed);
+    }
+}
+
+} // namespace sylar
@@ -0,0 +1,147 @@
+/**
+ * @file trace.h
+ * @brief 协程事件追踪，导出为Chrome trace-event JSON
+ * @details 记录协程创建/运行/结束、hook系统调用的进入和退出、epoll_wait的耗时、定时器触发，
+ *          导出的JSON可以直接拖进Perfetto(ui.perfetto.dev)或chrome://tracing查看。
+ *          每个线程第一次记录事件时分配自己的环形缓冲区，写事件不加锁，缓冲区写满后覆盖最早的事件，只保留最近的一段。
+ *          线程退出后缓冲区保留到下一次Dump()或Clear()，线程反复创建退出时内存不会一直增长。
+ *          关闭时每个追踪点只多一次对全局开关的relaxed读：
+ *          sylar::Trace::SetEnabled(true);
+ *          ...
+ *          sylar::Trace::SetEnabled(false);
+ *          sylar::Trace::DumpToFile("trace.json");
+ *          协程的运行区间画在线程轨道上，名字是协程的tag；hook系统调用会跨越协程的挂起，画成以协程id区分的异步区间
+ * @version 0.1
+ */
+
+#ifndef __SYLAR_TRACE_H__
+#define __SYLAR_TRACE_H__
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <string>
+#include "macro.h"
+
+namespace sylar {
+
+namespace detail {
+/// 追踪开关，放在头文件中让追踪点内联判断
+extern std::atomic<bool> g_trace_enabled;
+} // namespace detail
+
+/**
+ * @brief 事件追踪
+ */
+class Trace {
+public:
+    /**
+     * @brief 事件类型
+     */
+    enum Type {
+        /// 创建协程，瞬时事件
+        FIBER_CREATE,
+        /// 协程的一次运行，从resume到yield
+        FIBER_RUN,
+        /// 协程函数执行结束，瞬时事件
+        FIBER_TERM,
+        /// 进入hook的系统调用
+        SYSCALL_BEGIN,
+        /// 退出hook的系统调用
+        SYSCALL_END,
+        /// 一次epoll_wait
+        EPOLL_WAIT,
+        /// 一批定时器到期，瞬时事件
+        TIMER_FIRE
+    };
+
+    /**
+     * @brief 打开或关闭追踪
+     */
+    static void SetEnabled(bool v);
+
+    /**
+     * @brief 是否打开了追踪
+     */
+    static bool IsEnabled() { return detail::g_trace_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief 设置每个线程缓冲区能保存的事件数，只影响之后才开始记录事件的线程，默认65536
+     */
+    static void SetBufferSize(size_t events);
+
+    /**
+     * @brief 当前时间，单位纳秒
+     */
+    static uint64_t Now();
+
+    /**
+     * @brief 区间事件的开始时间，没有打开追踪时返回0
+     */
+    static uint64_t Begin() { return SYLAR_UNLIKELY(IsEnabled()) ? Now() : 0; }
+
+    /**
+     * @brief 记录一个事件
+     * @param[in] type 事件类型
+     * @param[in] name 事件名，必须是静态字符串(字符串常量)，导出时才读取
+     * @param[in] fiber 协程id
+     * @param[in] arg 附加参数：FIBER_CREATE无，SYSCALL_BEGIN为fd，EPOLL_WAIT为就绪事件数，TIMER_FIRE为到期定时器数
+     * @param[in] begin 区间事件(FIBER_RUN/EPOLL_WAIT)由Begin()得到的开始时间，为0时不记录
+     */
+    static void Record(Type type, const char *name, uint64_t fiber, int64_t arg = 0, uint64_t begin = 0) {
+        if (SYLAR_UNLIKELY(IsEnabled())) {
+            DoRecord(type, name, fiber, arg, begin);
+        }
+    }
+
+    /**
+     * @brief 导出所有线程缓冲区中的事件，最好在关闭追踪之后导出，否则正在写的事件可能不完整
+     * @details 已退出线程的缓冲区导出之后释放，下一次导出不再包含这些线程
+     */
+    static void Dump(std::ostream &os);
+
+    /**
+     * @brief 导出到文件
+     * @return 文件打开失败返回false
+     */
+    static bool DumpToFile(const std::string &path);
+
+    /**
+     * @brief 丢弃已经记录的事件，同时释放已退出线程的缓冲区
+     */
+    static void Clear();
+
+private:
+    static void DoRecord(Type type, const char *name, uint64_t fiber, int64_t arg, uint64_t begin);
+};
+
+/**
+ * @brief 在作用域内记录一次hook系统调用的进入和退出
+ */
+class TraceSyscall {
+public:
+    TraceSyscall(const char *name, int fd)
+        : m_name(name)
+        , m_enabled(Trace::IsEnabled()) {
+        if (SYLAR_UNLIKELY(m_enabled)) {
+            m_fiber = GetFiberId();
+            Trace::Record(Trace::SYSCALL_BEGIN, m_name, m_fiber, fd);
+        }
+    }
+
+    ~TraceSyscall() {
+        //协程挂起期间可能迁移到别的线程，按进入时的协程id配对
+        if (SYLAR_UNLIKELY(m_enabled)) {
+            Trace::Record(Trace::SYSCALL_END, m_name, m_fiber);
+        }
+    }
+
+private:
+    const char *m_name;
+    uint64_t m_fiber = 0;
+    bool m_enabled;
+};
+
+} // namespace sylar
+
+#endif
@@ -62,6 +62,7 @@ static std::string demangle(const char *str) {
         }
     }
     if (1 == sscanf(str, "%255s", &rt[0])) {
+        rt.resize(strlen(rt.c_str()));
         return rt;
     }
     return str;
@@ -69,20 +70,25 @@ static std::string demangle(const char *str) {
 
 void Backtrace(std::vector<std::string> &bt, int size, int skip) {
     void **array = (void **)malloc((sizeof(void *) * size));
-    size_t s     = ::backtrace(array, size);
+    int s        = ::backtrace(array, size);
+    if (s > skip) {
+        BacktraceSymbols(array + skip, s - skip, bt);
+    }
+    free(array);
+}
 
-    char **strings = backtrace_symbols(array, s);
+void BacktraceSymbols(void *const *array, int size, std::vector<std::string> &bt) {
+    char **strings = backtrace_symbols(array, size);
     if (strings == NULL) {
         //SYLAR_LOG_ERROR(g_logger) << "backtrace_synbols error";
         return;
     }
 
-    for (size_t i = skip; i < s; ++i) {
+    for (int i = 0; i < size; ++i) {
         bt.push_back(demangle(strings[i]));
     }
 
     free(strings);
-    free(array);
 }
 
 std::string BacktraceToString(int size, int skip, const std::string &prefix) {
@@ -57,6 +57,14 @@ void SetThreadName(const std::string &name);
  */
 void Backtrace(std::vector<std::string> &bt, int size = 64, int skip = 1);
 
+/**
+ * @brief 把一组返回地址解析成函数名
+ * @param[in] array 地址
+ * @param[in] size 地址个数
+ * @param[out] bt 保存解析结果
+ */
+void BacktraceSymbols(void *const *array, int size, std::vector<std::string> &bt);
+
 /**
  * @brief 获取当前栈信息的字符串
  * @param[in] size 栈的最大层数
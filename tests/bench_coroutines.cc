@@ -0,0 +1,376 @@
+/**
+ * @file bench_coroutines.cc
+ * @brief 三种协程实现的对比测试：sylar::Fiber(ucontext，独立栈)、stack_co::Coroutine(switch_context.S，独立栈)、
+ *        stackless_co::Schedule(ucontext，共享栈，切出时拷贝栈)
+ * @details 三种实现跑同样的协程体：每次被resume时在栈上写256字节，然后yield，都由主协程逐个resume。每种实现测：
+ *          create/destroy   一批1000个没有运行过的协程的创建和销毁，每个的耗时
+ *          resume_yield     一个协程resume+yield来回一次的耗时
+ *          scaling          1千/10万/100万个协程：创建耗时；每个都resume一次停在yield中之后，
+ *                           每个挂起协程的常驻内存(RSS增量)和堆内存(mallinfo2，含mmap的栈)；按创建顺序轮流resume的来回耗时
+ *          有栈协程每个栈128KiB，stack_co创建时清零整个栈，常驻内存远大于另外两种。
+ *          按上一档实测的每协程常驻内存估算下一档，超过内存上限的档位不跑，在结果中记为skipped并给出原因。
+ *          结果以JSON输出到stderr，便于保存后对比：./bench_coroutines 2>result.json
+ *          用法：./bench_coroutines [最大协程数=1000000] [内存上限MiB=可用内存的一半]
+ * @version 0.1
+ */
+
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../src/fiber.h"
+#include "../coroutine/stack_co/coroutine.h"
+#include "../coroutine/stack_co/utils.h"
+#include "../coroutine/stackless_co/schedule.h"
+
+static size_t s_max_coroutines = 1000000;
+static uint64_t s_budget       = 0;
+static const size_t s_levels[] = {1000, 100000, 1000000};
+static const int s_batch       = 1000;
+static const int s_batches     = 10;
+static const int s_round_trips = 1000000;
+
+/// 为true时协程体退出循环
+static bool s_stop = false;
+
+static uint64_t NowNS() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static uint64_t RssBytes() {
+    long pages = 0, rss = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+            rss = 0;
+        }
+        fclose(fp);
+    }
+    return (uint64_t)rss * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief 已分配的堆内存，包括mmap分配的大块(协程栈)
+ */
+static uint64_t HeapBytes() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+/**
+ * @brief /proc/meminfo中的MemAvailable
+ */
+static uint64_t AvailableBytes() {
+    uint64_t kb = 0;
+    FILE *fp    = fopen("/proc/meminfo", "r");
+    if (fp) {
+        char line[256];
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "MemAvailable: %lu kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    return kb * 1024;
+}
+
+/**
+ * @brief 三种实现共用的协程体中每次resume做的事：在栈上写256字节
+ */
+static inline void TouchStack() {
+    volatile char buf[256];
+    for (size_t i = 0; i < sizeof(buf); i += 64) {
+        buf[i] = (char)i;
+    }
+}
+
+/**
+ * @brief sylar::Fiber，不参与调度器调度，resume/yield与线程主协程切换
+ */
+class SylarGroup {
+public:
+    static const char *Name() { return "sylar::Fiber"; }
+    static const char *Kind() { return "stackful, ucontext, 128KiB stack per fiber"; }
+
+    void create(size_t n) {
+        m_fibers.reserve(m_fibers.size() + n);
+        for (size_t i = 0; i < n; ++i) {
+            m_fibers.emplace_back(new sylar::Fiber(&Body, 0, false));
+        }
+    }
+    void resume(size_t i) { m_fibers[i]->resume(); }
+    void destroy() { m_fibers.clear(); }
+
+private:
+    static void Body() {
+        sylar::Fiber *self = sylar::Fiber::GetCurrent();
+        while (!s_stop) {
+            TouchStack();
+            self->yield();
+        }
+    }
+
+private:
+    std::vector<sylar::Fiber::ptr> m_fibers;
+};
+
+/**
+ * @brief stack_co::Coroutine，协程对象内嵌128KiB的栈
+ */
+class StackCoGroup {
+public:
+    static const char *Name() { return "stack_co::Coroutine"; }
+    static const char *Kind() { return "stackful, switch_context.S, 128KiB stack embedded in object"; }
+
+    void create(size_t n) {
+        stack_co::Environment &env = stack_co::open();
+        m_cos.reserve(m_cos.size() + n);
+        for (size_t i = 0; i < n; ++i) {
+            m_cos.push_back(env.create_coroutine(&Body));
+        }
+    }
+    void resume(size_t i) { m_cos[i]->resume(); }
+    void destroy() { m_cos.clear(); }
+
+private:
+    static void Body() {
+        while (!s_stop) {
+            TouchStack();
+            stack_co::this_coroutine::yield();
+        }
+    }
+
+private:
+    std::vector<std::shared_ptr<stack_co::Coroutine>> m_cos;
+};
+
+/**
+ * @brief stackless_co::Schedule，所有协程在调度器的1MiB共享栈上运行，yield时把用到的栈拷贝到协程自己的缓冲区
+ */
+class StacklessGroup {
+public:
+    static const char *Name() { return "stackless_co::Schedule"; }
+    static const char *Kind() { return "shared 1MiB stack, ucontext, stack copied out on yield"; }
+
+    StacklessGroup() : m_sched(stackless_co::Schedule::schedule_new()) {}
+    ~StacklessGroup() { destroy(); }
+
+    void create(size_t n) {
+        m_ids.reserve(m_ids.size() + n);
+        for (size_t i = 0; i < n; ++i) {
+            m_ids.push_back(m_sched->coroutine_new(&Body, nullptr));
+        }
+    }
+    void resume(size_t i) { m_sched->coroutine_resume(m_ids[i]); }
+    void destroy() {
+        if (m_sched) {
+            m_sched->schedule_close();
+            m_sched = nullptr;
+        }
+        m_ids.clear();
+    }
+
+private:
+    static void Body(stackless_co::Schedule *s, void *) {
+        while (!s_stop) {
+            TouchStack();
+            s->coroutine_yield();
+        }
+    }
+
+private:
+    stackless_co::Schedule *m_sched;
+    std::vector<int> m_ids;
+};
+
+/**
+ * @brief 一种实现的结果，直接拼成JSON对象
+ */
+class Result {
+public:
+    void add(const std::string &key, const std::string &json) {
+        m_fields.push_back("\"" + key + "\": " + json);
+    }
+    void add(const std::string &key, const char *str) { add(key, Quote(str)); }
+    void add(const std::string &key, double v) {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1) << v;
+        add(key, ss.str());
+    }
+    void add(const std::string &key, uint64_t v) { add(key, std::to_string(v)); }
+
+    std::string str(const std::string &indent) const {
+        std::string s = "{";
+        for (size_t i = 0; i < m_fields.size(); ++i) {
+            s += (i ? ",\n" : "\n") + indent + "  " + m_fields[i];
+        }
+        return s + "\n" + indent + "}";
+    }
+
+    static std::string Quote(const std::string &s) { return "\"" + s + "\""; }
+
+private:
+    std::vector<std::string> m_fields;
+};
+
+/**
+ * @brief 让一组中的协程都结束：先前resume过的协程停在yield中，再resume一次退出循环
+ */
+template <class Group>
+static void Finish(Group &g, size_t n) {
+    s_stop = true;
+    for (size_t i = 0; i < n; ++i) {
+        g.resume(i);
+    }
+    s_stop = false;
+}
+
+template <class Group>
+static void BenchCreateDestroy(Result &r) {
+    uint64_t create = 0, destroy = 0;
+    for (int b = 0; b < s_batches; ++b) {
+        Group g;
+        uint64_t begin = NowNS();
+        g.create(s_batch);
+        uint64_t mid = NowNS();
+        g.destroy();
+        uint64_t end = NowNS();
+        create += mid - begin;
+        destroy += end - mid;
+    }
+    r.add("create_ns", (double)create / s_batch / s_batches);
+    r.add("destroy_ns", (double)destroy / s_batch / s_batches);
+}
+
+template <class Group>
+static void BenchRoundTrip(Result &r) {
+    Group g;
+    g.create(1);
+    g.resume(0);
+    uint64_t begin = NowNS();
+    for (int i = 0; i < s_round_trips; ++i) {
+        g.resume(0);
+    }
+    uint64_t cost = NowNS() - begin;
+    Finish(g, 1);
+    g.destroy();
+    r.add("resume_yield_ns", (double)cost / s_round_trips);
+}
+
+/**
+ * @brief 一档协程数，返回每个挂起协程的常驻内存，跳过时返回0
+ */
+template <class Group>
+static uint64_t BenchScale(Result &r, size_t n, uint64_t rss_per_co) {
+    r.add("coroutines", (uint64_t)n);
+    if (rss_per_co && rss_per_co * n > s_budget) {
+        std::stringstream ss;
+        ss << "estimated rss " << rss_per_co * n / 1024 / 1024 << "MiB exceeds budget " << s_budget / 1024 / 1024
+           << "MiB";
+        r.add("skipped", ss.str().c_str());
+        return 0;
+    }
+    malloc_trim(0);
+    uint64_t rss_before  = RssBytes();
+    uint64_t heap_before = HeapBytes();
+
+    Group g;
+    uint64_t begin = NowNS();
+    g.create(n);
+    uint64_t create = NowNS() - begin;
+    //每个协程都运行到第一次yield，栈上有了数据
+    for (size_t i = 0; i < n; ++i) {
+        g.resume(i);
+    }
+    uint64_t rss  = RssBytes() - rss_before;
+    uint64_t heap = HeapBytes() - heap_before;
+
+    int rounds = (int)std::min<size_t>(100, std::max<size_t>(1, 1000000 / n));
+    begin      = NowNS();
+    for (int k = 0; k < rounds; ++k) {
+        for (size_t i = 0; i < n; ++i) {
+            g.resume(i);
+        }
+    }
+    uint64_t cost = NowNS() - begin;
+
+    Finish(g, n);
+    g.destroy();
+
+    r.add("create_ns", (double)create / n);
+    r.add("resume_yield_ns", (double)cost / rounds / n);
+    r.add("rss_bytes_per_coroutine", (uint64_t)(rss / n));
+    r.add("heap_bytes_per_coroutine", (uint64_t)(heap / n));
+    return std::max<uint64_t>(rss / n, 1);
+}
+
+template <class Group>
+static std::string Bench() {
+    Result r;
+    r.add("engine", Group::Name());
+    r.add("kind", Group::Kind());
+    BenchCreateDestroy<Group>(r);
+    BenchRoundTrip<Group>(r);
+
+    std::string scaling = "[";
+    uint64_t rss_per_co = 0, suspended = 0;
+    for (size_t n : s_levels) {
+        if (n > s_max_coroutines) {
+            break;
+        }
+        Result level;
+        uint64_t v = BenchScale<Group>(level, n, rss_per_co);
+        if (v) {
+            rss_per_co = suspended = v;
+        }
+        scaling += (scaling.size() > 1 ? ", " : "") + level.str("      ");
+    }
+    scaling += "]";
+    //最大一档实测的值
+    r.add("rss_bytes_per_suspended", suspended);
+    r.add("scaling", scaling);
+    return r.str("    ");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_max_coroutines = strtoul(argv[1], nullptr, 10);
+    }
+    if (argc > 2) {
+        s_budget = strtoull(argv[2], nullptr, 10) * 1024 * 1024;
+    } else {
+        s_budget = AvailableBytes() / 2;
+    }
+    sylar::Fiber::GetThis();
+
+    std::vector<std::string> engines;
+    engines.push_back(Bench<SylarGroup>());
+    engines.push_back(Bench<StackCoGroup>());
+    engines.push_back(Bench<StacklessGroup>());
+
+    std::stringstream ss;
+    ss << "{\n  \"benchmark\": \"coroutines\",\n  \"max_coroutines\": " << s_max_coroutines
+       << ",\n  \"memory_budget_mib\": " << s_budget / 1024 / 1024 << ",\n  \"round_trips\": " << s_round_trips
+       << ",\n  \"create_batch\": " << s_batch << ",\n  \"engines\": [\n";
+    for (size_t i = 0; i < engines.size(); ++i) {
+        ss << "    " << engines[i] << (i + 1 < engines.size() ? ",\n" : "\n");
+    }
+    ss << "  ]\n}\n";
+    std::cerr << ss.str();
+    return 0;
+}
+
+//g++ bench_coroutines.cc ../coroutine/stack_co/context.cc ../coroutine/stack_co/coroutine.cc ../coroutine/stack_co/environment.cc ../coroutine/stack_co/switch_context.S ../coroutine/stackless_co/schedule.cc ../coroutine/stackless_co/coroutine.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o bench_coroutines -O2 -std=c++11 -lpthread -ldl -lrt
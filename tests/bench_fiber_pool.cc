@@ -0,0 +1,58 @@
+/**
+ * @file bench_fiber_pool.cc
+ * @brief 短回调任务吞吐测试：对比调度线程复用已结束的回调协程与每个任务新建协程
+ * @details 先添加好所有任务再启动调度器，统计从start到stop的耗时，得到每秒执行的任务数。
+ *          用法：./bench_fiber_pool [任务数=200000] [线程数=1]，调度器的调试输出在stdout，结果输出到stderr
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include "../src/scheduler.h"
+
+static int s_tasks   = 200000;
+static int s_threads = 1;
+
+static std::atomic<uint64_t> s_done{0};
+
+static uint64_t NowNS() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void bench(const char *name, size_t pool_size) {
+    sylar::Scheduler sc(s_threads, false, name);
+    sc.setFiberPoolSize(pool_size);
+    s_done = 0;
+    for (int i = 0; i < s_tasks; ++i) {
+        sc.schedule([] {
+            s_done.fetch_add(1, std::memory_order_relaxed);
+        });
+    }
+
+    uint64_t begin = NowNS();
+    sc.start();
+    sc.stop();
+    uint64_t cost = NowNS() - begin;
+
+    std::cerr << name << ": tasks=" << s_done << " cost=" << cost / 1000000.0 << "ms"
+              << " throughput=" << (uint64_t)(s_done * 1e9 / cost) << " tasks/s"
+              << " fibers=" << sylar::Fiber::TotalFibers() << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_tasks = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_threads = atoi(argv[2]);
+    }
+    bench("no pool", 0);
+    bench("pool 16", 16);
+    return 0;
+}
+
+//g++ bench_fiber_pool.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o bench_fiber_pool -O2 -std=c++11 -lpthread -ldl -lrt
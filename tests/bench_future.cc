@@ -0,0 +1,113 @@
+/**
+ * @file bench_future.cc
+ * @brief 扇出延迟测试：一个协程扇出N个后端调用，分别用when_all/when_any/join等待结果
+ * @details 用法：./bench_future [轮数=10000] [扇出数=20] [线程数=2]
+ *          调度器的调试输出在stdout，结果输出到stderr，可以 ./bench_future > /dev/null
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+#include "../src/future.h"
+#include "../src/scheduler.h"
+
+static int s_rounds  = 10000;
+static int s_fanout  = 20;
+static int s_threads = 2;
+
+static uint64_t NowNS() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void Report(const char *name, std::vector<uint64_t> &lat) {
+    std::sort(lat.begin(), lat.end());
+    uint64_t sum = 0;
+    for (auto i : lat) {
+        sum += i;
+    }
+    std::cerr << name << ": rounds=" << lat.size()
+              << " avg=" << sum / lat.size() / 1000.0 << "us"
+              << " p50=" << lat[lat.size() / 2] / 1000.0 << "us"
+              << " p99=" << lat[lat.size() * 99 / 100] / 1000.0 << "us"
+              << " max=" << lat.back() / 1000.0 << "us" << std::endl;
+}
+
+/**
+ * @brief 扇出s_fanout个回调任务，每个任务完成一个Promise
+ */
+static std::vector<sylar::Future<int> > FanOut(sylar::Scheduler *sc) {
+    std::vector<sylar::Future<int> > futures;
+    futures.reserve(s_fanout);
+    for (int i = 0; i < s_fanout; ++i) {
+        sylar::Promise<int> promise;
+        futures.push_back(promise.getFuture());
+        sc->schedule([promise, i] {
+            promise.setValue(i);
+        });
+    }
+    return futures;
+}
+
+static void bench(sylar::Scheduler *sc) {
+    std::vector<uint64_t> lat;
+    lat.reserve(s_rounds);
+
+    for (int r = 0; r < s_rounds; ++r) {
+        uint64_t begin = NowNS();
+        std::vector<sylar::Future<int> > futures = FanOut(sc);
+        sylar::when_all(futures);
+        lat.push_back(NowNS() - begin);
+    }
+    Report("when_all", lat);
+
+    lat.clear();
+    for (int r = 0; r < s_rounds; ++r) {
+        uint64_t begin = NowNS();
+        std::vector<sylar::Future<int> > futures = FanOut(sc);
+        sylar::when_any(futures);
+        lat.push_back(NowNS() - begin);
+        //剩下的结果不计时，等它们完成再开始下一轮
+        sylar::when_all(futures);
+    }
+    Report("when_any", lat);
+
+    lat.clear();
+    std::vector<sylar::Fiber::ptr> fibers(s_fanout);
+    for (int r = 0; r < s_rounds; ++r) {
+        uint64_t begin = NowNS();
+        for (int i = 0; i < s_fanout; ++i) {
+            fibers[i].reset(new sylar::Fiber([] {}));
+            sc->schedule(fibers[i]);
+        }
+        for (int i = 0; i < s_fanout; ++i) {
+            fibers[i]->join();
+        }
+        lat.push_back(NowNS() - begin);
+    }
+    Report("join", lat);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_rounds = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_fanout = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        s_threads = atoi(argv[3]);
+    }
+
+    sylar::Scheduler sc(s_threads, false);
+    sc.start();
+    sc.schedule(std::bind(bench, &sc));
+    sc.stop();
+    return 0;
+}
+
+//g++ bench_future.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o bench_future -O2 -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,60 @@
+/**
+ * @file bench_generator.cc
+ * @brief 生成器开销测试：逐个迭代大量小元素的单元素耗时，以及创建并迭代完一个短生成器的耗时
+ * @details 用法：./bench_generator [元素数=1000000] [生成器数=100000]，结果输出到stderr
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <chrono>
+#include <iostream>
+#include "../src/generator.h"
+
+static int s_items      = 1000000;
+static int s_generators = 100000;
+
+static uint64_t NowNS() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static sylar::Generator<int> range(int begin, int end) {
+    return sylar::Generator<int>([begin, end](sylar::Generator<int>::Yielder &co) {
+        for (int i = begin; i < end; ++i) {
+            co.yield_value(i);
+        }
+    });
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_items = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_generators = atoi(argv[2]);
+    }
+
+    uint64_t sum   = 0;
+    uint64_t begin = NowNS();
+    for (int i : range(0, s_items)) {
+        sum += i;
+    }
+    uint64_t cost = NowNS() - begin;
+    std::cerr << "iterate: items=" << s_items << " cost=" << cost / 1000000.0 << "ms"
+              << " per item=" << (double)cost / s_items << "ns" << std::endl;
+
+    begin = NowNS();
+    for (int n = 0; n < s_generators; ++n) {
+        for (int i : range(0, 4)) {
+            sum += i;
+        }
+    }
+    cost = NowNS() - begin;
+    std::cerr << "create+iterate 4 items: generators=" << s_generators << " cost=" << cost / 1000000.0 << "ms"
+              << " per generator=" << (double)cost / s_generators << "ns"
+              << " fibers=" << sylar::Fiber::TotalFibers() << std::endl;
+    return sum == 0;
+}
+
+//g++ bench_generator.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o bench_generator -O2 -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,135 @@
+/**
+ * @file bench_huge_stack.cc
+ * @brief 大量协程轮流切换的吞吐：malloc分配的协程栈 vs 大页arena中的协程栈
+ * @details 创建N个协程，每个协程循环：在栈上写一段数据，然后yield。主协程按打乱后的固定顺序逐个resume，
+ *          每次切换都落在不同的协程栈上，协程数远大于TLB能覆盖的页数时，普通页的每次切换都伴随TLB缺失。
+ *          大页arena中16个128KiB的栈共用一个2MiB大页。
+ *          注意大页一旦被访问就整页常驻：arena模式的常驻内存约为 协程数*(栈大小+4KiB)，
+ *          10万个128KiB的栈需要12.5GiB，内存不够时用更小的栈大小测试。
+ *          用法：./bench_huge_stack [协程数=100000] [栈大小=16384] [轮数=10]，结果输出到stderr
+ * @version 0.1
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+#include "../src/fiber.h"
+#include "../src/stack_allocator.h"
+
+static int s_fibers        = 100000;
+static size_t s_stacksize  = 16384;
+static int s_rounds        = 10;
+static volatile bool s_stop = false;
+
+static uint64_t NowNS() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/**
+ * @brief 当前进程的常驻内存，单位MiB
+ */
+static double RssMB() {
+    long pages = 0, rss = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &pages, &rss) != 2) {
+            rss = 0;
+        }
+        fclose(fp);
+    }
+    return rss * sysconf(_SC_PAGESIZE) / 1024.0 / 1024.0;
+}
+
+/**
+ * @brief 协程体：每次被resume时在栈上写一段数据，模拟真实协程的栈访问
+ */
+static void Body() {
+    sylar::Fiber::ptr self = sylar::Fiber::GetThis();
+    sylar::Fiber *fiber    = self.get();
+    self.reset();
+    while (!s_stop) {
+        volatile char buf[256];
+        for (size_t i = 0; i < sizeof(buf); i += 64) {
+            buf[i] = (char)i;
+        }
+        fiber->yield();
+    }
+}
+
+static void Run(sylar::StackAllocator::Mode mode, const char *name) {
+    sylar::StackAllocator::SetMode(mode);
+    s_stop = false;
+    double rss_before = RssMB();
+
+    uint64_t begin = NowNS();
+    std::vector<sylar::Fiber::ptr> fibers;
+    fibers.reserve(s_fibers);
+    for (int i = 0; i < s_fibers; ++i) {
+        fibers.emplace_back(new sylar::Fiber(&Body, s_stacksize, false));
+    }
+    uint64_t create = NowNS() - begin;
+
+    std::vector<sylar::Fiber *> order;
+    for (auto &i : fibers) {
+        order.push_back(i.get());
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(12345));
+    //第一轮把栈页都访问一遍，不计时
+    for (auto i : order) {
+        i->resume();
+    }
+
+    begin = NowNS();
+    for (int r = 0; r < s_rounds; ++r) {
+        for (auto i : order) {
+            i->resume();
+        }
+    }
+    uint64_t cost     = NowNS() - begin;
+    uint64_t switches = (uint64_t)s_rounds * s_fibers;
+    double rss        = RssMB() - rss_before;
+
+    s_stop = true;
+    for (auto i : order) {
+        i->resume();
+        assert(i->getState() == sylar::Fiber::TERM);
+    }
+    fibers.clear();
+
+    std::cerr << name << ": fibers=" << s_fibers << " stacksize=" << s_stacksize
+              << " create=" << create / 1000000.0 << "ms"
+              << " resume+yield=" << (double)cost / switches << "ns"
+              << " switches/s=" << (uint64_t)(switches * 1e9 / cost)
+              << " rss+=" << rss << "MiB";
+    if (mode == sylar::StackAllocator::HUGE_ARENA) {
+        std::cerr << " backing=" << sylar::StackAllocator::ArenaBackingName(sylar::StackAllocator::GetArenaBacking())
+                  << " arena=" << sylar::StackAllocator::ArenaBytes() / 1024 / 1024 << "MiB";
+    }
+    std::cerr << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_fibers = atoi(argv[1]);
+    }
+    if (argc > 2) {
+        s_stacksize = atoi(argv[2]);
+    }
+    if (argc > 3) {
+        s_rounds = atoi(argv[3]);
+    }
+    sylar::Fiber::GetThis();
+    Run(sylar::StackAllocator::MALLOC, "malloc");
+    Run(sylar::StackAllocator::HUGE_ARENA, "huge arena");
+    return 0;
+}
+
+//g++ bench_huge_stack.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o bench_huge_stack -O2 -std=c++11 -lpthread -ldl -lrt
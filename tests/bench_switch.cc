@@ -0,0 +1,98 @@
+/**
+ * @file bench_switch.cc
+ * @brief 乒乓测试：两个协程来回交出执行权，对比经过调度协程的交接与Fiber::switchTo直接切换
+ * @details 经过调度器：schedule(对方) + yield()，每次交接两次上下文切换加一次调度器加锁；
+ *          switchTo：一次上下文切换，不加锁。
+ *          两种方式各跑两遍，第二遍打开FiberStats，对比协程运行时间统计在切换路径上的开销。
+ *          用法：./bench_switch [来回次数=1000000]，调度器的调试输出在stdout，结果输出到stderr
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include "../src/fiber_stats.h"
+#include "../src/scheduler.h"
+
+static int s_rounds = 1000000;
+
+static uint64_t NowNS() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void Report(const char *name, uint64_t cost) {
+    std::cerr << name << (sylar::FiberStats::IsEnabled() ? " (fiber stats)" : "") << ": rounds=" << s_rounds << " cost=" << cost / 1000000.0 << "ms"
+              << " per handoff=" << (double)cost / s_rounds / 2 << "ns" << std::endl;
+}
+
+/**
+ * @brief 经过调度协程：先把对方加入调度，再yield回调度协程，由调度协程resume对方
+ */
+static void bench_schedule() {
+    sylar::Scheduler sc(1, false, "schedule");
+    sylar::Fiber::ptr ping, pong;
+    uint64_t begin = 0, end = 0;
+    ping.reset(new sylar::Fiber([&] {
+        begin = NowNS();
+        for (int i = 0; i < s_rounds; ++i) {
+            sc.schedule(pong);
+            ping->yield();
+        }
+        end = NowNS();
+    }));
+    pong.reset(new sylar::Fiber([&] {
+        for (int i = 0; i < s_rounds; ++i) {
+            sc.schedule(ping);
+            pong->yield();
+        }
+    }));
+    sc.schedule(ping);
+    sc.start();
+    sc.stop();
+    Report("schedule+yield", end - begin);
+}
+
+/**
+ * @brief switchTo直接切换
+ */
+static void bench_switch() {
+    sylar::Scheduler sc(1, false, "switchTo");
+    sylar::Fiber::ptr ping, pong;
+    uint64_t begin = 0, end = 0;
+    ping.reset(new sylar::Fiber([&] {
+        begin = NowNS();
+        for (int i = 0; i < s_rounds; ++i) {
+            ping->switchTo(*pong);
+        }
+        end = NowNS();
+        //pong停在最后一次switchTo中，交给调度器让它结束
+        sc.schedule(pong);
+    }));
+    pong.reset(new sylar::Fiber([&] {
+        for (int i = 0; i < s_rounds; ++i) {
+            pong->switchTo(*ping);
+        }
+    }));
+    sc.schedule(ping);
+    sc.start();
+    sc.stop();
+    assert(ping->getState() == sylar::Fiber::TERM && pong->getState() == sylar::Fiber::TERM);
+    Report("switchTo", end - begin);
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_rounds = atoi(argv[1]);
+    }
+    for (int i = 0; i < 2; ++i) {
+        sylar::FiberStats::SetEnabled(i == 1);
+        bench_schedule();
+        bench_switch();
+    }
+    return 0;
+}
+
+//g++ bench_switch.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o bench_switch -O2 -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,66 @@
+/**
+ * @file bench_task_alloc.cc
+ * @brief 统计每个调度任务的malloc次数
+ * @details 在本文件中替换malloc(转调glibc的__libc_malloc)来计数，分别统计添加任务(schedule)阶段和执行任务阶段的malloc次数，
+ *          回调任务按捕获大小分为几档，对应常见的lambda。
+ *          用法：./bench_task_alloc [任务数=100000]，调度器的调试输出在stdout，结果输出到stderr
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <atomic>
+#include <iostream>
+#include "../src/scheduler.h"
+
+extern "C" void *__libc_malloc(size_t size);
+
+static std::atomic<uint64_t> s_mallocs{0};
+
+extern "C" void *malloc(size_t size) {
+    s_mallocs.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(size);
+}
+
+static int s_tasks = 100000;
+
+/**
+ * @brief 捕获N个字节的回调
+ */
+template <size_t N>
+struct Payload {
+    char data[N];
+    void operator()() const { (void)data; }
+};
+
+template <size_t N>
+static void bench(const char *name) {
+    sylar::Scheduler sc(1, false, name);
+    Payload<N> payload = {};
+
+    uint64_t begin = s_mallocs;
+    for (int i = 0; i < s_tasks; ++i) {
+        sc.schedule(payload);
+    }
+    uint64_t scheduled = s_mallocs;
+
+    sc.start();
+    sc.stop();
+    uint64_t end = s_mallocs;
+
+    std::cerr << name << ": schedule " << (double)(scheduled - begin) / s_tasks
+              << " mallocs/task, schedule+run " << (double)(end - begin) / s_tasks
+              << " mallocs/task" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_tasks = atoi(argv[1]);
+    }
+    bench<8>("capture 8B");
+    bench<24>("capture 24B");
+    bench<40>("capture 40B");
+    bench<64>("capture 64B");
+    return 0;
+}
+
+//g++ bench_task_alloc.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o bench_task_alloc -O2 -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,131 @@
+/**
+ * @file bench_task_memory.cc
+ * @brief 每个连接的内存占用：每个连接一个Fiber(有栈) vs 每个连接一个Task(C++20无栈协程)，需要-std=c++20
+ * @details 建立N个socketpair，每个连接的处理者都挂起在读事件上，然后统计堆上分配的字节数(mallinfo2，含mmap的块)和RSS的增量，
+ *          再给每个连接写一个字节，处理者回显后结束。
+ *          用法：./bench_task_memory [连接数=2000]，调度器的调试输出在stdout，结果输出到stderr
+ * @version 0.1
+ */
+
+#include <malloc.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <vector>
+#include "../src/fd_manager.h"
+#include "../src/hook.h"
+#include "../src/iomanager.h"
+#include "../src/task.h"
+
+static int s_conns = 2000;
+
+static std::atomic<int> s_parked{0};
+static std::atomic<int> s_finished{0};
+
+/**
+ * @brief 已分配的堆内存，包括mmap分配的大块(协程栈)
+ */
+static uint64_t HeapBytes() {
+    struct mallinfo2 mi = mallinfo2();
+    return mi.uordblks + mi.hblkhd;
+}
+
+static uint64_t RssBytes() {
+    long size = 0, resident = 0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &size, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(fp);
+    }
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * @brief Task版本的处理者：等可读，读一个字节回显
+ */
+static sylar::Task<void> handle(int fd) {
+    ++s_parked;
+    co_await sylar::readable(fd);
+    char c = 0;
+    if (read(fd, &c, 1) == 1) {
+        write(fd, &c, 1);
+    }
+    ++s_finished;
+}
+
+/**
+ * @brief 先让所有处理者挂起，统计内存，再逐个唤醒
+ * @param[in] spawn 启动一个连接的处理者
+ */
+template <class Spawn>
+static void bench(const char *name, Spawn spawn) {
+    std::vector<int> fds(s_conns * 2);
+    for (int i = 0; i < s_conns; ++i) {
+        int sv[2];
+        assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0);
+        fds[i * 2]     = sv[0];
+        fds[i * 2 + 1] = sv[1];
+        //交给hook管理，Fiber版本中的read才会挂起协程而不是阻塞线程
+        sylar::FdMgr::GetInstance()->get(sv[0], true);
+    }
+    s_parked   = 0;
+    s_finished = 0;
+
+    sylar::IOManager iom(1, false, name);
+    uint64_t heap = HeapBytes();
+    uint64_t rss  = RssBytes();
+    for (int i = 0; i < s_conns; ++i) {
+        spawn(iom, fds[i * 2]);
+    }
+    while (s_parked != s_conns) {
+        usleep(10 * 1000);
+    }
+    usleep(100 * 1000);
+    uint64_t heap_used = HeapBytes() - heap;
+    uint64_t rss_used  = RssBytes() - rss;
+
+    for (int i = 0; i < s_conns; ++i) {
+        char c = 'x';
+        write(fds[i * 2 + 1], &c, 1);
+    }
+    while (s_finished != s_conns) {
+        usleep(10 * 1000);
+    }
+    iom.stop();
+    for (int i = 0; i < s_conns; ++i) {
+        sylar::FdMgr::GetInstance()->del(fds[i * 2]);
+        close(fds[i * 2]);
+        close(fds[i * 2 + 1]);
+    }
+
+    std::cerr << name << ": conns=" << s_conns
+              << " heap/conn=" << heap_used / s_conns << "B"
+              << " rss/conn=" << rss_used / s_conns << "B" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1) {
+        s_conns = atoi(argv[1]);
+    }
+    bench("fiber", [](sylar::IOManager &iom, int fd) {
+        iom.schedule([fd] {
+            ++s_parked;
+            char c = 0;
+            if (read(fd, &c, 1) == 1) {
+                write(fd, &c, 1);
+            }
+            ++s_finished;
+        });
+    });
+    bench("task", [](sylar::IOManager &iom, int fd) {
+        sylar::co_spawn(handle(fd), &iom);
+    });
+    return 0;
+}
+
+//g++ bench_task_memory.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/fd_manager.cc -o bench_task_memory -O2 -std=c++20 -lpthread -ldl -lrt
@@ -120,7 +120,7 @@ int main(int argc, char *argv[]) {
 }
 
 //使用mysylar库 并且开启hook
-//g++ test1.cc ../src/iomanager.cc ../src/scheduler.cc ../src/fiber.cc ../src/mutex.cc ../src/thread.cc  ../src/timer.cc ../src/util.cpp ../src/hook.cc  ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl
+//g++ test1.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc  ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc  ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
 //qps:1266.14
 //ab -n 10 -c 2 https://127.0.0.1:9190/
 
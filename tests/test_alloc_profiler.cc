@@ -0,0 +1,138 @@
+/**
+ * @file test_alloc_profiler.cc
+ * @brief 按协程归类的内存分配统计测试
+ * @details 需要链接alloc_hook.cc。逐次记录：分配多的tag排在第一，次数、字节数、释放次数和单个协程的统计，realloc的释放，
+ *          重置复用的协程统计从零开始；
+ *          采样模式：估计的字节数和次数与实际相差不大；关闭后不再记录；最后输出每次malloc+free的耗时
+ * @version 0.1
+ */
+
+#include <stdlib.h>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include "../src/alloc_profiler.h"
+#include "../src/scheduler.h"
+
+static const sylar::AllocProfiler::TagStats *find(const std::vector<sylar::AllocProfiler::TagStats> &stats,
+                                                  const std::string &tag) {
+    for (auto &i : stats) {
+        if (i.tag == tag) {
+            return &i;
+        }
+    }
+    return nullptr;
+}
+
+static void churn(int n, size_t size) {
+    for (int i = 0; i < n; ++i) {
+        void *volatile p = malloc(size);
+        free(p);
+    }
+}
+
+/**
+ * @brief 在调度器中跑一个heavy协程和一个light协程，返回heavy协程
+ */
+static sylar::Fiber::ptr run(int heavy_count) {
+    sylar::Fiber::ptr heavy(new sylar::Fiber([heavy_count] { churn(heavy_count, 1024); }, 0, true, "heavy"));
+    sylar::Scheduler sc(1, false, "alloc");
+    sc.start();
+    sc.schedule(heavy);
+    sc.schedule(sylar::Fiber::ptr(new sylar::Fiber([] { churn(10, 16); }, 0, true, "light")));
+    sc.stop();
+    return heavy;
+}
+
+static double bench() {
+    const int n = 1000000;
+    auto begin = std::chrono::steady_clock::now();
+    churn(n, 64);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / n;
+}
+
+int main(int argc, char *argv[]) {
+    assert(sylar::AllocProfiler::IsHooked());
+
+    //逐次记录
+    sylar::AllocProfiler::SetEnabled(true);
+    sylar::Fiber::ptr heavy = run(1000);
+    std::vector<sylar::AllocProfiler::TagStats> stats;
+    sylar::AllocProfiler::Collect(stats);
+    sylar::AllocProfiler::Dump(std::cout);
+    assert(!stats.empty() && stats[0].tag == "heavy");
+    const sylar::AllocProfiler::TagStats *h = find(stats, "heavy");
+    assert(h->calls >= 1000 && h->bytes >= 1000 * 1024 && h->frees >= 1000);
+    //协程函数里只有churn在分配，不会多出太多
+    assert(h->bytes < 1000 * 1024 + 64 * 1024);
+    const sylar::AllocProfiler::TagStats *l = find(stats, "light");
+    assert(l && l->calls >= 10 && l->bytes < h->bytes);
+    assert(heavy->getAllocCount() == h->calls && heavy->getAllocBytes() == h->bytes);
+    //调度线程自己的分配记在untagged或调度器的协程上
+    assert(find(stats, "untagged"));
+
+    //realloc记一次分配和一次旧块的释放，realloc(p, 0)只记释放
+    sylar::AllocProfiler::Reset();
+    {
+        sylar::Scheduler sc(1, false, "realloc");
+        sc.start();
+        sc.schedule(sylar::Fiber::ptr(new sylar::Fiber(
+            [] {
+                void *volatile p = malloc(16);
+                p                = realloc(p, 1024);
+                p                = realloc(p, 64 * 1024);
+                p                = realloc(p, 0);
+                assert(!p);
+            },
+            0, true, "realloc")));
+        sc.stop();
+    }
+    sylar::AllocProfiler::Collect(stats);
+    const sylar::AllocProfiler::TagStats *r = find(stats, "realloc");
+    assert(r && r->calls == 3 && r->frees == 3 && r->bytes == 16 + 1024 + 64 * 1024);
+
+    //重置复用的协程不再算上之前任务的分配
+    sylar::Fiber::GetThis();
+    sylar::Fiber::ptr reused(new sylar::Fiber([] { churn(10, 32); }, 0, false, "reused"));
+    reused->resume();
+    assert(reused->getAllocCount() == 10 && reused->getAllocBytes() == 10 * 32);
+    reused->reset([] { churn(1, 32); });
+    reused->resume();
+    assert(reused->getAllocCount() == 1 && reused->getAllocBytes() == 32);
+
+    //采样：每64KiB采样一次，估计10MB的分配
+    sylar::AllocProfiler::Reset();
+    sylar::AllocProfiler::SetSampleRate(64 * 1024);
+    run(10000);
+    sylar::AllocProfiler::Collect(stats);
+    sylar::AllocProfiler::Dump(std::cout);
+    h = find(stats, "heavy");
+    std::cout << "sampled heavy: calls=" << h->calls << " bytes=" << h->bytes << std::endl;
+    assert(h->bytes >= 10000 * 1024 * 9 / 10 && h->bytes <= 10000 * 1024 * 11 / 10);
+    assert(h->calls >= 10000 * 9 / 10 && h->calls <= 10000 * 11 / 10);
+    assert(h->frees == 0);
+
+    //关闭后不再记录
+    sylar::AllocProfiler::SetEnabled(false);
+    sylar::AllocProfiler::Reset();
+    churn(100, 128);
+    sylar::AllocProfiler::Collect(stats);
+    for (auto &i : stats) {
+        assert(i.calls == 0 && i.bytes == 0);
+    }
+
+    //每次malloc+free的耗时
+    double off = bench();
+    sylar::AllocProfiler::SetEnabled(true);
+    sylar::AllocProfiler::SetSampleRate(0);
+    double exact = bench();
+    sylar::AllocProfiler::SetSampleRate(512 * 1024);
+    double sampled = bench();
+    sylar::AllocProfiler::SetEnabled(false);
+    std::cout << "malloc+free: off=" << off << "ns exact=" << exact << "ns sampled=" << sampled << "ns" << std::endl;
+
+    std::cout << "test_alloc_profiler end" << std::endl;
+    return 0;
+}
+
+//g++ test_alloc_profiler.cc ../src/alloc_hook.cc ../src/alloc_profiler.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_alloc_profiler -O2 -std=c++11 -lpthread -ldl -lrt
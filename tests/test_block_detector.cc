@@ -0,0 +1,117 @@
+/**
+ * @file test_block_detector.cc
+ * @brief 阻塞调用检测测试
+ * @details 协程中阻塞50ms的poll和等待主线程释放的pthread_mutex_lock超过10ms的阈值，被报告，报告中有协程id、类别和调用栈；
+ *          没有超过阈值的调用只计数；不在协程中的调用不计时；关闭检测后不再记录
+ * @version 0.1
+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cassert>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include "../src/block_detector.h"
+#include "../src/iomanager.h"
+
+static std::mutex s_mutex;
+static std::vector<sylar::BlockDetector::Report> s_reports;
+
+static void on_report(const sylar::BlockDetector::Report &r) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_reports.push_back(r);
+}
+
+static const sylar::BlockDetector::FunctionStats &get(const std::vector<sylar::BlockDetector::FunctionStats> &stats,
+                                                       sylar::BlockDetector::Function f) {
+    assert(stats.size() == sylar::BlockDetector::FUNCTION_NUM);
+    assert(stats[f].name == sylar::BlockDetector::GetName(f));
+    return stats[f];
+}
+
+int main(int argc, char *argv[]) {
+    sylar::BlockDetector::SetThreshold(10 * 1000);
+    sylar::BlockDetector::SetReporter(on_report);
+    sylar::BlockDetector::SetEnabled(true);
+    assert(sylar::BlockDetector::GetThreshold() == 10 * 1000);
+
+    //不在协程中，不计时
+    poll(nullptr, 0, 20);
+
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_mutex_lock(&mutex);
+    uint64_t poll_fiber = 0, lock_fiber = 0;
+    {
+        sylar::IOManager iom(2, false, "block");
+        sylar::Fiber::ptr poller(new sylar::Fiber(
+            [] {
+                poll(nullptr, 0, 0);
+                poll(nullptr, 0, 50);
+            },
+            0, true, "poller"));
+        poll_fiber = poller->getId();
+        iom.schedule(poller);
+        sylar::Fiber::ptr locker(new sylar::Fiber([&mutex] {
+            //主线程30ms后才释放
+            pthread_mutex_lock(&mutex);
+            pthread_mutex_unlock(&mutex);
+        }));
+        lock_fiber = locker->getId();
+        iom.schedule(locker);
+        usleep(30 * 1000);
+        pthread_mutex_unlock(&mutex);
+        iom.stop();
+    }
+
+    std::vector<sylar::BlockDetector::FunctionStats> stats;
+    sylar::BlockDetector::Collect(stats);
+    sylar::BlockDetector::Dump(std::cout);
+
+    const sylar::BlockDetector::FunctionStats &poll_stats = get(stats, sylar::BlockDetector::POLL);
+    assert(poll_stats.calls == 2 && poll_stats.slow == 1);
+    assert(poll_stats.max_ns >= 45 * 1000 * 1000 && poll_stats.total_ns >= poll_stats.max_ns);
+    const sylar::BlockDetector::FunctionStats &lock_stats = get(stats, sylar::BlockDetector::PTHREAD_MUTEX_LOCK);
+    assert(lock_stats.slow == 1 && lock_stats.max_ns >= 15 * 1000 * 1000);
+    assert(get(stats, sylar::BlockDetector::FSYNC).calls == 0);
+
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        assert(s_reports.size() == 2);
+        for (auto &r : s_reports) {
+            std::cout << r.function << " " << r.ns / 1e6 << "ms fiber " << r.fiber_id << " "
+                      << (r.tag ? r.tag : "") << std::endl;
+            for (auto &i : r.backtrace) {
+                std::cout << "    " << i << std::endl;
+            }
+            assert(!r.backtrace.empty());
+            if (strcmp(r.function, "poll") == 0) {
+                assert(r.fiber_id == poll_fiber && r.tag && strcmp(r.tag, "poller") == 0);
+                assert(r.ns >= 45 * 1000 * 1000);
+            } else {
+                assert(strcmp(r.function, "pthread_mutex_lock") == 0);
+                assert(r.fiber_id == lock_fiber && !r.tag);
+            }
+        }
+    }
+
+    //关闭检测后不再记录
+    sylar::BlockDetector::SetEnabled(false);
+    sylar::BlockDetector::Reset();
+    {
+        sylar::IOManager iom(1, false, "block_off");
+        iom.schedule([] { poll(nullptr, 0, 20); });
+        iom.stop();
+    }
+    sylar::BlockDetector::Collect(stats);
+    for (auto &i : stats) {
+        assert(i.calls == 0 && i.slow == 0 && i.total_ns == 0);
+    }
+    assert(s_reports.size() == 2);
+
+    std::cout << "test_block_detector end" << std::endl;
+    return 0;
+}
+
+//g++ test_block_detector.cc ../src/block_detector.cc ../src/block_detector_hook.cc ../src/hook_stats.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_block_detector -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,85 @@
+/**
+ * @file test_edf.cc
+ * @brief EDF(最早截止时间优先)调度测试
+ * @version 0.1
+ */
+
+#include "../src/scheduler.h"
+#include "../src/util.h"
+#include <cassert>
+#include <vector>
+
+static std::vector<int> s_order;
+
+/**
+ * @brief 截止时间越早的协程越先执行，与添加顺序无关
+ */
+void test_edf_order() {
+    sylar::Scheduler sc;
+    sc.setPolicy(sylar::Scheduler::EDF);
+
+    //没有截止时间的任务先添加，也排在所有有截止时间的任务之后，彼此先进先出
+    sc.schedule([] {
+        s_order.push_back(6);
+    });
+
+    uint64_t now = sylar::GetElapsedMS();
+    //倒序添加，截止时间分别为now+500 now+400 ... now+100
+    for (int i = 5; i >= 1; --i) {
+        sylar::Fiber::ptr fiber(new sylar::Fiber([i] {
+            s_order.push_back(i);
+        }));
+        fiber->setDeadline(now + i * 100);
+        sc.schedule(fiber);
+    }
+    sc.schedule([] {
+        s_order.push_back(7);
+    });
+
+    sc.start();
+    sc.stop();
+
+    for (size_t i = 0; i < s_order.size(); ++i) {
+        std::cout << "order[" << i << "] = " << s_order[i] << std::endl;
+    }
+    assert(s_order.size() == 7);
+    for (size_t i = 0; i < s_order.size(); ++i) {
+        assert(s_order[i] == (int)i + 1);
+    }
+}
+
+/**
+ * @brief 已经过期的回调任务在开启降载后直接丢弃
+ */
+void test_edf_shed() {
+    sylar::Scheduler sc;
+    sc.setPolicy(sylar::Scheduler::EDF);
+    sc.setShedExpired(true);
+
+    static int s_executed = 0;
+    sylar::Fiber::ptr fiber(new sylar::Fiber([&sc] {
+        //在带截止时间的协程里添加的回调任务会继承该截止时间，此时已经过期
+        for (int i = 0; i < 10; ++i) {
+            sc.schedule([] {
+                ++s_executed;
+            });
+        }
+    }));
+    fiber->setDeadline(sylar::GetElapsedMS() - 1);
+    sc.schedule(fiber);
+
+    sc.start();
+    sc.stop();
+
+    std::cout << "executed = " << s_executed << " shed = " << sc.getShedCount() << std::endl;
+    assert(s_executed == 0 && sc.getShedCount() == 10);
+}
+
+int main() {
+    test_edf_order();
+    test_edf_shed();
+    std::cout << "test_edf end" << std::endl;
+    return 0;
+}
+
+//g++ test_edf.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,84 @@
+/**
+ * @file test_fiber_cancel.cc
+ * @brief 取消挂起在hook调用中的协程测试
+ * @version 0.1
+ */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <string.h>
+#include <errno.h>
+#include <cassert>
+#include "../src/iomanager.h"
+#include "../src/fd_manager.h"
+#include "../src/hook.h"
+#include "../src/util.h"
+
+static int s_sv[2];
+
+/**
+ * @brief 取消挂起在recv中的协程，同一个fd上的事件被删除，之后其他协程仍然可以在这个fd上等待
+ */
+void test_cancel_recv() {
+    sylar::Fiber::ptr reader(new sylar::Fiber([] {
+        char buf[16];
+        uint64_t begin = sylar::GetElapsedMS();
+        ssize_t n = recv(s_sv[0], buf, sizeof(buf), 0);
+        std::cout << "cancelled recv n=" << n << " errno=" << strerror(errno)
+                  << " cost=" << sylar::GetElapsedMS() - begin << "ms" << std::endl;
+        assert(n == -1 && errno == ECANCELED);
+
+        //已经被取消的协程再进行阻塞调用直接返回
+        n = recv(s_sv[0], buf, sizeof(buf), 0);
+        assert(n == -1 && errno == ECANCELED);
+    }));
+    sylar::IOManager::GetThis()->schedule(reader);
+
+    usleep(100 * 1000);
+    reader->cancel();
+    usleep(10 * 1000);
+
+    //取消时注册的读事件已经删除，新的协程可以重新在该fd上等待读事件
+    sylar::IOManager::GetThis()->schedule([] {
+        char buf[16];
+        ssize_t n = recv(s_sv[0], buf, sizeof(buf), 0);
+        std::cout << "second recv n=" << n << std::endl;
+        assert(n == 5 && !memcmp(buf, "hello", 5));
+        close(s_sv[0]);
+        close(s_sv[1]);
+    });
+    usleep(10 * 1000);
+    send(s_sv[1], "hello", 5, 0);
+}
+
+/**
+ * @brief 取消挂起在sleep中的协程
+ */
+void test_cancel_sleep() {
+    sylar::Fiber::ptr sleeper(new sylar::Fiber([] {
+        uint64_t begin = sylar::GetElapsedMS();
+        int rt = usleep(5 * 1000 * 1000);
+        std::cout << "cancelled usleep rt=" << rt << " errno=" << strerror(errno)
+                  << " cost=" << sylar::GetElapsedMS() - begin << "ms" << std::endl;
+        assert(rt == -1 && errno == ECANCELED);
+    }));
+    sylar::IOManager::GetThis()->schedule(sleeper);
+
+    usleep(100 * 1000);
+    sleeper->cancel();
+}
+
+int main(int argc, char *argv[]) {
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, s_sv);
+    assert(!rt);
+    //socketpair没有被hook，手动为其创建FdCtx，这样recv才会走协程挂起的逻辑
+    sylar::FdMgr::GetInstance()->get(s_sv[0], true);
+
+    sylar::IOManager iom(2);
+    iom.schedule(test_cancel_recv);
+    iom.schedule(test_cancel_sleep);
+    return 0;
+}
+
+//g++ test_fiber_cancel.cc ../src/fiber_context.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,113 @@
+/**
+ * @file test_fiber_context.cc
+ * @brief 协程上下文(请求截止时间/取消)测试
+ * @version 0.1
+ */
+
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <string.h>
+#include <errno.h>
+#include <cassert>
+#include "../src/iomanager.h"
+#include "../src/fiber_context.h"
+#include "../src/fd_manager.h"
+#include "../src/hook.h"
+#include "../src/util.h"
+
+/**
+ * @brief 整个请求300ms超时，accept与子任务中的recv共用同一个截止定时器
+ */
+void test_deadline() {
+    sylar::FiberContext::ptr ctx = sylar::FiberContext::WithTimeout(300);
+    sylar::Fiber::GetThis()->setContext(ctx);
+
+    int sv[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(!rt);
+    //socketpair没有被hook，手动为其创建FdCtx，这样recv才会走协程挂起的逻辑
+    sylar::FdMgr::GetInstance()->get(sv[0], true);
+
+    //在当前协程中添加的回调任务继承当前协程的上下文
+    sylar::IOManager::GetThis()->schedule([sv] {
+        char buf[16];
+        uint64_t begin = sylar::GetElapsedMS();
+        ssize_t n = recv(sv[0], buf, sizeof(buf), 0);
+        std::cout << "child recv n=" << n << " errno=" << strerror(errno)
+                  << " cost=" << sylar::GetElapsedMS() - begin << "ms" << std::endl;
+        assert(n == -1 && errno == ETIMEDOUT);
+        close(sv[0]);
+        close(sv[1]);
+    });
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0;
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr.s_addr);
+    rt = bind(listen_fd, (const sockaddr*)&addr, sizeof(addr));
+    assert(!rt);
+    rt = listen(listen_fd, 16);
+    assert(!rt);
+
+    uint64_t begin = sylar::GetElapsedMS();
+    int fd = accept(listen_fd, nullptr, nullptr);
+    std::cout << "accept rt=" << fd << " errno=" << strerror(errno)
+              << " cost=" << sylar::GetElapsedMS() - begin << "ms" << std::endl;
+    assert(fd == -1 && errno == ETIMEDOUT);
+    close(listen_fd);
+}
+
+/**
+ * @brief 取消上下文会唤醒正在sleep的协程
+ */
+void test_cancel() {
+    sylar::FiberContext::ptr ctx = sylar::FiberContext::WithCancel();
+
+    sylar::IOManager::GetThis()->schedule([ctx] {
+        sylar::Fiber::GetThis()->setContext(ctx);
+        uint64_t begin = sylar::GetElapsedMS();
+        int rt = usleep(5 * 1000 * 1000);
+        std::cout << "usleep rt=" << rt << " errno=" << strerror(errno)
+                  << " cost=" << sylar::GetElapsedMS() - begin << "ms" << std::endl;
+        assert(rt == -1 && errno == ECANCELED);
+    });
+
+    usleep(100 * 1000);
+    ctx->cancel();
+}
+
+/**
+ * @brief 指定协程的cancelEvent只取消该协程注册的事件，等待者唤醒时不会误取消别的协程在同一fd上的注册
+ */
+void test_cancel_event_owner() {
+    int sv[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(!rt);
+    sylar::IOManager *iom = sylar::IOManager::GetThis();
+    sylar::Fiber::ptr self = sylar::Fiber::GetThis();
+    sylar::Fiber::ptr other(new sylar::Fiber([] {}));
+
+    rt = iom->addEvent(sv[0], sylar::IOManager::READ);
+    assert(!rt);
+    assert(!iom->cancelEvent(sv[0], sylar::IOManager::READ, other.get()));
+    assert(iom->cancelEvent(sv[0], sylar::IOManager::READ, self.get()));
+    //事件已经触发，协程已经在调度队列里
+    self->yield();
+    assert(!iom->cancelEvent(sv[0], sylar::IOManager::READ, self.get()));
+    close(sv[0]);
+    close(sv[1]);
+}
+
+int main(int argc, char *argv[]) {
+    sylar::IOManager iom(2);
+    iom.schedule(test_deadline);
+    iom.schedule(test_cancel);
+    iom.schedule(test_cancel_event_owner);
+    return 0;
+}
+
+//g++ test_fiber_context.cc ../src/fiber_context.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
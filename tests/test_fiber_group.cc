@@ -0,0 +1,96 @@
+/**
+ * @file test_fiber_group.cc
+ * @brief 结构化并发测试：FiberGroup/WaitGroup
+ * @version 0.1
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <atomic>
+#include <cassert>
+#include <stdexcept>
+#include "../src/iomanager.h"
+#include "../src/fiber_group.h"
+#include "../src/hook.h"
+#include "../src/util.h"
+
+/**
+ * @brief 派生大量子协程，挂起父协程等待它们全部结束
+ */
+void test_wait_all() {
+    static std::atomic<int> s_sum{0};
+    uint64_t begin = sylar::GetElapsedMS();
+    sylar::FiberGroup group;
+    for (int i = 1; i <= 1000; ++i) {
+        group.spawn([i] {
+            s_sum += i;
+        });
+    }
+    group.wait();
+    std::cout << "sum = " << s_sum << " cost=" << sylar::GetElapsedMS() - begin << "ms" << std::endl;
+    assert(s_sum == 500500 && group.count() == 0);
+}
+
+/**
+ * @brief 一个子协程出错，其余挂起在sleep中的子协程被取消，wait()重新抛出第一个异常
+ */
+void test_first_error() {
+    static std::atomic<int> s_cancelled{0};
+    uint64_t begin = sylar::GetElapsedMS();
+    sylar::FiberGroup group;
+    for (int i = 0; i < 10; ++i) {
+        group.spawn([] {
+            if (usleep(5 * 1000 * 1000) == -1 && errno == ECANCELED) {
+                ++s_cancelled;
+            }
+        });
+    }
+    group.spawn([] {
+        usleep(50 * 1000);
+        throw std::runtime_error("backend failed");
+    });
+
+    bool caught = false;
+    try {
+        group.wait();
+    } catch (std::runtime_error &e) {
+        caught = true;
+        std::cout << "caught: " << e.what() << " cancelled=" << s_cancelled
+                  << " cost=" << sylar::GetElapsedMS() - begin << "ms" << std::endl;
+    }
+    assert(caught && s_cancelled == 10);
+    assert(sylar::GetElapsedMS() - begin < 1000);
+}
+
+/**
+ * @brief 父请求放弃时，离开作用域的FiberGroup取消并回收所有子协程
+ */
+void test_scoped() {
+    static std::atomic<int> s_finished{0};
+    uint64_t begin = sylar::GetElapsedMS();
+    {
+        sylar::FiberGroup group;
+        for (int i = 0; i < 10; ++i) {
+            group.spawn([] {
+                usleep(5 * 1000 * 1000);
+                ++s_finished;
+            });
+        }
+        usleep(20 * 1000);
+    }
+    std::cout << "scoped finished = " << s_finished << " cost=" << sylar::GetElapsedMS() - begin << "ms" << std::endl;
+    assert(s_finished == 10 && sylar::GetElapsedMS() - begin < 1000);
+}
+
+int main(int argc, char *argv[]) {
+    sylar::IOManager iom(2);
+    iom.schedule([] {
+        test_wait_all();
+        test_first_error();
+        test_scoped();
+        std::cout << "test_fiber_group end" << std::endl;
+    });
+    return 0;
+}
+
+//g++ test_fiber_group.cc ../src/fiber_group.cc ../src/fiber_context.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,102 @@
+/**
+ * @file test_fiber_local.cc
+ * @brief 协程局部变量测试
+ * @version 0.1
+ */
+
+#include <unistd.h>
+#include <atomic>
+#include <cassert>
+#include <string>
+#include "../src/iomanager.h"
+#include "../src/fiber_group.h"
+#include "../src/fiber_local.h"
+#include "../src/hook.h"
+#include "../src/util.h"
+
+static sylar::FiberLocal<std::string> s_request_id;
+
+static std::atomic<int> s_alive{0};
+
+/**
+ * @brief 统计存活个数，用来检查协程结束时值被销毁
+ */
+struct Counted {
+    Counted() { ++s_alive; }
+    ~Counted() { --s_alive; }
+    int value = 0;
+};
+
+static sylar::FiberLocal<Counted> s_counted;
+
+/**
+ * @brief 多个协程交替挂起，并可能在不同线程上恢复，每个协程看到的都是自己的值
+ */
+void test_isolation() {
+    static std::atomic<int> s_ok{0};
+    sylar::FiberGroup group;
+    for (int i = 0; i < 100; ++i) {
+        group.spawn([i] {
+            assert(s_request_id.get() == nullptr);
+            s_request_id.set("req-" + std::to_string(i));
+            s_counted->value = i;
+            for (int j = 0; j < 3; ++j) {
+                usleep(1000);
+                assert(*s_request_id == "req-" + std::to_string(i));
+                assert(s_counted->value == i);
+            }
+            ++s_ok;
+        });
+    }
+    group.wait();
+    std::cout << "isolation ok=" << s_ok << " alive=" << s_alive << std::endl;
+    assert(s_ok == 100);
+    //协程结束时销毁了自己的值，被复用的回调协程也看不到上一个任务的值
+    assert(s_alive == 0);
+}
+
+/**
+ * @brief 协程内关闭hook只影响该协程，协程结束后不会遗留给复用它的下一个任务
+ */
+void test_hook_enable() {
+    assert(sylar::is_hook_enable());
+    sylar::FiberGroup group;
+    group.spawn([] {
+        sylar::set_fiber_hook_enable(false);
+        assert(!sylar::is_hook_enable());
+        uint64_t begin = sylar::GetElapsedMS();
+        usleep(10 * 1000);  //真正的阻塞sleep
+        assert(!sylar::is_hook_enable());
+        assert(sylar::GetElapsedMS() - begin >= 9);
+    });
+    group.wait();
+    assert(sylar::is_hook_enable());
+
+    sylar::FiberGroup group2;
+    for (int i = 0; i < 10; ++i) {
+        group2.spawn([] {
+            assert(sylar::is_hook_enable());
+        });
+    }
+    group2.wait();
+    std::cout << "hook enable ok" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    //不在协程中使用时，值在线程主协程上，相当于线程局部变量
+    s_request_id.set("main");
+    assert(*s_request_id == "main");
+    {
+        sylar::IOManager iom(2);
+        iom.schedule([] {
+            assert(s_request_id.get() == nullptr);
+            test_isolation();
+            test_hook_enable();
+            std::cout << "test_fiber_local end" << std::endl;
+        });
+    }
+    assert(*s_request_id == "main");
+    return 0;
+}
+
+//g++ test_fiber_local.cc ../src/fiber_group.cc ../src/fiber_context.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
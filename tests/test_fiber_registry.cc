@@ -0,0 +1,145 @@
+/**
+ * @file test_fiber_registry.cc
+ * @brief 全局协程登记表测试
+ * @details 挂起在recv、sleep、join、future、WaitGroup上的协程各自的等待原因、所属调度器和调用栈；
+ *          没有运行过的协程；调度器析构后清除调度器；析构后删除登记；关闭后新协程不登记；SIGUSR2触发输出到文件。
+ *          用-fno-omit-frame-pointer -rdynamic编译可以看到完整的调用栈和函数名
+ * @version 0.1
+ */
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include "../src/fd_manager.h"
+#include "../src/fiber_group.h"
+#include "../src/fiber_registry.h"
+#include "../src/future.h"
+#include "../src/iomanager.h"
+
+static const sylar::FiberRegistry::FiberInfo *find(const std::vector<sylar::FiberRegistry::FiberInfo> &fibers,
+                                                   const std::string &tag) {
+    for (auto &i : fibers) {
+        if (i.tag == tag) {
+            return &i;
+        }
+    }
+    return nullptr;
+}
+
+static void check_parked(const std::vector<sylar::FiberRegistry::FiberInfo> &fibers, const std::string &tag,
+                         const std::string &wait) {
+    const sylar::FiberRegistry::FiberInfo *info = find(fibers, tag);
+    assert(info);
+    assert(info->started && info->state == sylar::Fiber::READY);
+    assert(info->scheduler == "registry");
+    assert(info->wait == wait);
+    assert(info->age_ms >= 50);
+    assert(!info->backtrace.empty());
+}
+
+int main(int argc, char *argv[]) {
+    sylar::FiberRegistry::SetEnabled(true);
+    std::string path = "/tmp/test_fiber_registry.txt";
+    unlink(path.c_str());
+    assert(sylar::FiberRegistry::InstallSignalHandler(SIGUSR2, path));
+    assert(!sylar::FiberRegistry::InstallSignalHandler(SIGUSR2, path));
+
+    int sv[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(rt == 0);
+    //socketpair没有被hook，手动为其创建FdCtx，这样recv才会走协程挂起的逻辑
+    sylar::FdMgr::GetInstance()->get(sv[0], true);
+
+    sylar::Fiber::GetThis();
+    size_t base = sylar::FiberRegistry::Count();
+    sylar::Fiber::ptr idle_fiber(new sylar::Fiber([] {}, 0, true, "never_run"));
+    sylar::Fiber::ptr reader;
+    sylar::Promise<int> promise;
+    sylar::WaitGroup wg;
+    wg.add(1);
+    {
+        sylar::IOManager iom(1, false, "registry");
+        reader.reset(new sylar::Fiber([sv] {
+            char buf[16];
+            ssize_t n = recv(sv[0], buf, sizeof(buf), 0);
+            assert(n == 5);
+        }, 0, true, "reader"));
+        iom.schedule(reader);
+        iom.schedule(sylar::Fiber::ptr(new sylar::Fiber([] { usleep(200 * 1000); }, 0, true, "sleeper")));
+        iom.schedule(sylar::Fiber::ptr(new sylar::Fiber([promise] {
+            assert(promise.getFuture().get() == 1);
+        }, 0, true, "future")));
+        iom.schedule(sylar::Fiber::ptr(new sylar::Fiber([&wg] { wg.wait(); }, 0, true, "waitgroup")));
+        iom.schedule(sylar::Fiber::ptr(new sylar::Fiber([reader] { reader->join(); }, 0, true, "joiner")));
+        usleep(100 * 1000);
+
+        std::vector<sylar::FiberRegistry::FiberInfo> fibers;
+        sylar::FiberRegistry::Collect(fibers);
+        std::stringstream ss;
+        sylar::FiberRegistry::Dump(ss);
+        std::cout << ss.str();
+
+        check_parked(fibers, "reader", "io fd=" + std::to_string(sv[0]) + " read");
+        check_parked(fibers, "sleeper", "timer");
+        check_parked(fibers, "future", "future");
+        check_parked(fibers, "waitgroup", "waitgroup");
+        check_parked(fibers, "joiner", "join");
+
+        const sylar::FiberRegistry::FiberInfo *info = find(fibers, "never_run");
+        assert(info && !info->started && info->scheduler.empty() && info->backtrace.empty());
+        assert(ss.str().find("[never_run] state=NEW age=") != std::string::npos);
+        //调度器自己的idle协程也在登记表中
+        assert(find(fibers, "scheduler.idle"));
+        for (size_t i = 1; i < fibers.size(); ++i) {
+            assert(fibers[i - 1].id < fibers[i].id);
+        }
+
+        //信号触发输出，由输出线程写到文件
+        raise(SIGUSR2);
+        std::string text;
+        for (int i = 0; i < 100 && text.find("[joiner]") == std::string::npos; ++i) {
+            usleep(10 * 1000);
+            std::ifstream ifs(path);
+            std::stringstream content;
+            content << ifs.rdbuf();
+            text = content.str();
+        }
+        assert(text.find("fiber ") != std::string::npos);
+        assert(text.find("[reader] state=READY scheduler=registry wait=io fd=") != std::string::npos);
+
+        rt = write(sv[1], "hello", 5);
+        assert(rt == 5);
+        promise.setValue(1);
+        wg.done();
+        iom.stop();
+    }
+
+    //调度器析构之后，还活着的协程不再指向它；结束的协程析构后删除登记
+    std::vector<sylar::FiberRegistry::FiberInfo> fibers;
+    sylar::FiberRegistry::Collect(fibers);
+    const sylar::FiberRegistry::FiberInfo *info = find(fibers, "reader");
+    assert(info && info->state == sylar::Fiber::TERM && info->scheduler.empty() && info->wait.empty());
+    assert(!find(fibers, "sleeper") && !find(fibers, "scheduler.idle"));
+    reader.reset();
+    assert(sylar::FiberRegistry::Count() == base + 1);
+
+    //关闭后新创建的协程不登记，已经登记的保留到析构
+    sylar::FiberRegistry::SetEnabled(false);
+    sylar::Fiber::ptr fiber(new sylar::Fiber([] {}, 0, false, "off"));
+    assert(sylar::FiberRegistry::Count() == base + 1);
+    idle_fiber.reset();
+    assert(sylar::FiberRegistry::Count() == base);
+
+    sylar::FdMgr::GetInstance()->del(sv[0]);
+    close(sv[0]);
+    close(sv[1]);
+    unlink(path.c_str());
+    std::cout << "test_fiber_registry end" << std::endl;
+    return 0;
+}
+
+//g++ test_fiber_registry.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_group.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_fiber_registry -std=c++11 -fno-omit-frame-pointer -rdynamic -lpthread -ldl -lrt
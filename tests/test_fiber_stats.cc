@@ -0,0 +1,131 @@
+/**
+ * @file test_fiber_stats.cc
+ * @brief 协程CPU时间与挂起时间统计测试
+ * @details 忙等的协程CPU时间最多，排在报告第一；sleep的协程记在定时器等待上，等待socket可读的协程记在IO等待上；
+ *          单个协程的resume次数和CPU时间；关闭统计后不再记录
+ * @version 0.1
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include "../src/fd_manager.h"
+#include "../src/fiber_stats.h"
+#include "../src/iomanager.h"
+
+static void spin(int ms) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+static const sylar::FiberStats::TagStats *find(const std::vector<sylar::FiberStats::TagStats> &stats,
+                                               const std::string &tag) {
+    for (auto &i : stats) {
+        if (i.tag == tag) {
+            return &i;
+        }
+    }
+    return nullptr;
+}
+
+int main(int argc, char *argv[]) {
+    sylar::FiberStats::SetEnabled(true);
+
+    int sv[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(rt == 0);
+    //socketpair没有被hook，手动为其创建FdCtx，这样recv才会走协程挂起的逻辑
+    sylar::FdMgr::GetInstance()->get(sv[0], true);
+
+    sylar::Fiber::ptr busy_fiber;
+    {
+        sylar::IOManager iom(1, false, "stats");
+        for (int i = 0; i < 5; ++i) {
+            sylar::Fiber::ptr fiber(new sylar::Fiber([] { spin(4); }, 0, true, "busy"));
+            if (i == 0) {
+                busy_fiber = fiber;
+            }
+            iom.schedule(fiber);
+        }
+        for (int i = 0; i < 50; ++i) {
+            iom.schedule(sylar::Fiber::ptr(new sylar::Fiber([] {}, 0, true, "light")));
+        }
+        iom.schedule(sylar::Fiber::ptr(new sylar::Fiber([] { usleep(30 * 1000); }, 0, true, "sleeper")));
+        iom.schedule(sylar::Fiber::ptr(new sylar::Fiber([sv] {
+            char buf[16];
+            ssize_t n = recv(sv[0], buf, sizeof(buf), 0);
+            assert(n == 5);
+        }, 0, true, "reader")));
+        iom.schedule([sv] {
+            usleep(40 * 1000);
+            ssize_t n = write(sv[1], "hello", 5);
+            assert(n == 5);
+        });
+        iom.stop();
+    }
+
+    std::vector<sylar::FiberStats::TagStats> stats;
+    sylar::FiberStats::Collect(stats);
+    sylar::FiberStats::Dump(std::cout);
+    assert(!stats.empty() && stats[0].tag == "busy");
+    //idle协程阻塞在epoll_wait上的时间不算运行时间，记在IO等待上
+    const sylar::FiberStats::TagStats *idle = find(stats, "scheduler.idle");
+    assert(idle && idle->io_wait_ns > 0);
+
+    const sylar::FiberStats::TagStats *busy = find(stats, "busy");
+    assert(busy && busy->fibers == 5 && busy->resumes == 5);
+    assert(busy->cpu_ns >= 20 * 1000 * 1000);
+    assert(busy->io_wait_ns == 0 && busy->timer_wait_ns == 0);
+
+    const sylar::FiberStats::TagStats *light = find(stats, "light");
+    assert(light && light->fibers == 50 && light->resumes == 50);
+    assert(light->cpu_ns < busy->cpu_ns);
+
+    const sylar::FiberStats::TagStats *sleeper = find(stats, "sleeper");
+    assert(sleeper && sleeper->resumes == 2);
+    assert(sleeper->timer_wait_ns >= 25 * 1000 * 1000 && sleeper->io_wait_ns == 0);
+
+    const sylar::FiberStats::TagStats *reader = find(stats, "reader");
+    assert(reader && reader->resumes == 2);
+    assert(reader->io_wait_ns >= 30 * 1000 * 1000 && reader->timer_wait_ns == 0);
+
+    //单个协程的统计
+    assert(busy_fiber->getResumeCount() == 1);
+    assert(busy_fiber->getCpuTime() >= 4 * 1000 * 1000);
+    assert(busy_fiber->getWaitTime(sylar::FiberStats::WAIT_IO) == 0);
+
+    //重置复用的协程统计从零开始，按任务计数
+    sylar::Fiber::GetThis();
+    sylar::Fiber::ptr reused(new sylar::Fiber([] {}, 0, false, "reused"));
+    for (int i = 0; i < 3; ++i) {
+        if (i) {
+            reused->reset([] {});
+        }
+        reused->resume();
+        assert(reused->getResumeCount() == 1);
+    }
+    sylar::FiberStats::Collect(stats);
+    assert(find(stats, "reused")->fibers == 3 && find(stats, "reused")->resumes == 3);
+
+    //关闭统计后不再记录
+    sylar::FiberStats::SetEnabled(false);
+    sylar::FiberStats::Reset();
+    sylar::Fiber::GetThis();
+    sylar::Fiber::ptr fiber(new sylar::Fiber([] {}, 0, false, "off"));
+    fiber->resume();
+    assert(fiber->getResumeCount() == 0);
+    sylar::FiberStats::Collect(stats);
+    assert(!find(stats, "off"));
+    assert(find(stats, "busy")->cpu_ns == 0);
+
+    sylar::FdMgr::GetInstance()->del(sv[0]);
+    close(sv[0]);
+    close(sv[1]);
+    std::cout << "test_fiber_stats end" << std::endl;
+    return 0;
+}
+
+//g++ test_fiber_stats.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_fiber_stats -std=c++11 -lpthread -ldl -lrt
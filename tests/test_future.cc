@@ -0,0 +1,166 @@
+/**
+ * @file test_future.cc
+ * @brief Future/Promise、when_all/when_any以及Fiber::join测试
+ * @version 0.1
+ */
+
+#include <cassert>
+#include <future>
+#include <stdexcept>
+#include <vector>
+#include "../src/future.h"
+#include "../src/scheduler.h"
+
+/**
+ * @brief 扇出20个任务，when_all等所有结果，when_any等第一个结果，全部在调度器协程中挂起等待
+ */
+void test_when_all_any(sylar::Scheduler *sc) {
+    std::vector<sylar::Promise<int> > promises(20);
+    std::vector<sylar::Future<int> > futures;
+    for (size_t i = 0; i < promises.size(); ++i) {
+        futures.push_back(promises[i].getFuture());
+    }
+
+    //只完成第7个，when_any必然返回7
+    sc->schedule([promises] {
+        promises[7].setValue(7);
+    });
+    size_t first = sylar::when_any(futures);
+    std::cout << "when_any first = " << first << std::endl;
+    assert(first == 7 && futures[7].get() == 7);
+
+    for (size_t i = 0; i < promises.size(); ++i) {
+        if (i == 7) {
+            continue;
+        }
+        sylar::Promise<int> promise = promises[i];
+        sc->schedule([promise, i] {
+            promise.setValue((int)i);
+        });
+    }
+    sylar::when_all(futures);
+
+    int sum = 0;
+    for (auto &f : futures) {
+        assert(f.isReady());
+        sum += f.get();
+    }
+    std::cout << "when_all sum = " << sum << std::endl;
+    assert(sum == 190);
+}
+
+/**
+ * @brief 异常结果在get()时重新抛出
+ */
+void test_exception(sylar::Scheduler *sc) {
+    sylar::Promise<void> promise;
+    sylar::Future<void> future = promise.getFuture();
+    sc->schedule([promise] {
+        promise.setException(std::make_exception_ptr(std::runtime_error("backend error")));
+    });
+    bool caught = false;
+    try {
+        future.get();
+    } catch (std::runtime_error &e) {
+        std::cout << "caught: " << e.what() << std::endl;
+        caught = true;
+    }
+    assert(caught);
+}
+
+/**
+ * @brief 所有Promise都销毁了还没有设置结果，等待者得到broken_promise异常而不是永远挂起
+ */
+void test_broken_promise(sylar::Scheduler *sc) {
+    sylar::Future<int> future;
+    {
+        sylar::Promise<int> promise;
+        future = promise.getFuture();
+        //最后一个拷贝随任务一起销毁
+        sc->schedule([promise] {});
+    }
+    bool caught = false;
+    try {
+        future.get();
+    } catch (std::future_error &e) {
+        std::cout << "caught: " << e.what() << std::endl;
+        caught = e.code() == std::future_errc::broken_promise;
+    }
+    assert(caught);
+
+    //设置过结果之后销毁不影响结果
+    sylar::Future<int> done;
+    {
+        sylar::Promise<int> promise;
+        done = promise.getFuture();
+        promise.setValue(1);
+    }
+    assert(done.get() == 1);
+}
+
+/**
+ * @brief 多个Future同时就绪，when_any返回时其他节点的通知都已经结束，节点可以安全销毁
+ */
+void test_when_any_race(sylar::Scheduler *sc) {
+    for (int round = 0; round < 1000; ++round) {
+        std::vector<sylar::Promise<int> > promises(4);
+        std::vector<sylar::Future<int> > futures;
+        for (size_t i = 0; i < promises.size(); ++i) {
+            futures.push_back(promises[i].getFuture());
+            sylar::Promise<int> promise = promises[i];
+            sc->schedule([promise, i] {
+                promise.setValue((int)i);
+            });
+        }
+        size_t first = sylar::when_any(futures);
+        assert(first < futures.size() && futures[first].isReady());
+        assert(futures[first].get() == (int)first);
+    }
+    std::cout << "when_any race end" << std::endl;
+}
+
+/**
+ * @brief join挂起调用者协程，直到被等待的协程结束
+ */
+void test_join(sylar::Scheduler *sc) {
+    static int s_steps = 0;
+    sylar::Fiber::ptr worker(new sylar::Fiber([sc] {
+        for (int i = 0; i < 3; ++i) {
+            ++s_steps;
+            sc->schedule(sylar::Fiber::GetThis());
+            sylar::Fiber::GetThis()->yield();
+        }
+    }));
+    sc->schedule(worker);
+    worker->join();
+    std::cout << "join steps = " << s_steps << std::endl;
+    assert(s_steps == 3 && worker->getState() == sylar::Fiber::TERM);
+}
+
+int main(int argc, char *argv[]) {
+    {
+        sylar::Scheduler sc(2, false);
+        sc.start();
+        sc.schedule(std::bind(test_when_all_any, &sc));
+        sc.schedule(std::bind(test_exception, &sc));
+        sc.schedule(std::bind(test_broken_promise, &sc));
+        sc.schedule(std::bind(test_when_any_race, &sc));
+        sc.schedule(std::bind(test_join, &sc));
+
+        //不在调度器的协程中，Future和join退化为阻塞线程等待
+        sylar::Promise<int> promise;
+        sc.schedule([promise] {
+            promise.setValue(42);
+        });
+        assert(promise.getFuture().get() == 42);
+
+        sylar::Fiber::ptr fiber(new sylar::Fiber([] {}));
+        sc.schedule(fiber);
+        fiber->join();
+        sc.stop();
+    }
+    std::cout << "test_future end" << std::endl;
+    return 0;
+}
+
+//g++ test_future.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,177 @@
+/**
+ * @file test_generator.cc
+ * @brief 生成器测试
+ * @version 0.1
+ */
+
+#include <unistd.h>
+#include <atomic>
+#include <cassert>
+#include <stdexcept>
+#include <string>
+#include "../src/generator.h"
+#include "../src/iomanager.h"
+
+/**
+ * @brief 统计存活个数，用来检查提前销毁的生成器展开了协程栈
+ */
+static int s_alive = 0;
+struct Guard {
+    Guard() { ++s_alive; }
+    ~Guard() { --s_alive; }
+};
+
+sylar::Generator<int> range(int begin, int end) {
+    return sylar::Generator<int>([begin, end](sylar::Generator<int>::Yielder &co) {
+        for (int i = begin; i < end; ++i) {
+            co.yield_value(i);
+        }
+    });
+}
+
+void test_range() {
+    int sum = 0;
+    for (int i : range(0, 100)) {
+        sum += i;
+    }
+    assert(sum == 4950);
+
+    //空生成器
+    for (int i : range(0, 0)) {
+        (void)i;
+        assert(false);
+    }
+    std::cout << "range ok" << std::endl;
+}
+
+/**
+ * @brief yield_value传递的是地址，调用方拿到的引用就是生成函数里的对象
+ */
+void test_zero_copy() {
+    static const std::string *s_addr = nullptr;
+    sylar::Generator<std::string> gen([](sylar::Generator<std::string>::Yielder &co) {
+        std::string line(100, 'x');
+        s_addr = &line;
+        co.yield_value(line);
+        //临时对象在挂起期间一直有效
+        co.yield_value(std::string("tmp"));
+    });
+    auto it = gen.begin();
+    assert(&*it == s_addr && it->size() == 100);
+    ++it;
+    assert(*it == "tmp");
+    ++it;
+    assert(it == gen.end());
+    std::cout << "zero copy ok" << std::endl;
+}
+
+/**
+ * @brief 没有迭代完就销毁，生成函数栈上的对象被析构
+ */
+void test_early_destroy() {
+    {
+        sylar::Generator<int> gen([](sylar::Generator<int>::Yielder &co) {
+            Guard guard;
+            for (int i = 0;; ++i) {
+                co.yield_value(i);
+            }
+        });
+        for (int i : gen) {
+            assert(s_alive == 1);
+            if (i == 10) {
+                break;
+            }
+        }
+    }
+    assert(s_alive == 0);
+
+    //从没开始执行的生成器
+    { sylar::Generator<int> gen = range(0, 10); }
+    std::cout << "early destroy ok" << std::endl;
+}
+
+/**
+ * @brief 生成函数抛出的异常在调用方重新抛出
+ */
+void test_exception() {
+    sylar::Generator<int> gen([](sylar::Generator<int>::Yielder &co) {
+        co.yield_value(1);
+        throw std::runtime_error("parse error");
+    });
+    bool caught = false;
+    int n       = 0;
+    try {
+        for (int i : gen) {
+            n += i;
+        }
+    } catch (std::runtime_error &e) {
+        caught = true;
+    }
+    assert(caught && n == 1);
+    std::cout << "exception ok" << std::endl;
+}
+
+/**
+ * @brief 生成器嵌套：一个生成器消费另一个生成器
+ */
+void test_nested() {
+    sylar::Generator<int> evens([](sylar::Generator<int>::Yielder &co) {
+        for (int i : range(0, 20)) {
+            if (i % 2 == 0) {
+                co.yield_value(i);
+            }
+        }
+    });
+    int count = 0;
+    for (int i : evens) {
+        assert(i % 2 == 0);
+        ++count;
+    }
+    assert(count == 10);
+    std::cout << "nested ok" << std::endl;
+}
+
+/**
+ * @brief 协程栈复用：大量生成器不会累积协程
+ */
+void test_reuse() {
+    uint64_t before = sylar::Fiber::TotalFibers();
+    for (int i = 0; i < 10000; ++i) {
+        int sum = 0;
+        for (int v : range(0, 3)) {
+            sum += v;
+        }
+        assert(sum == 3);
+    }
+    assert(sylar::Fiber::TotalFibers() <= before + 16);
+    std::cout << "reuse ok fibers=" << sylar::Fiber::TotalFibers() << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    //在线程主协程中使用
+    test_range();
+    test_zero_copy();
+    test_early_destroy();
+    test_exception();
+    test_nested();
+    test_reuse();
+
+    //在调度器的协程中使用，调用方在两次取元素之间挂起并可能迁移到其他线程
+    static std::atomic<int> s_sum{0};
+    {
+        sylar::IOManager iom(2);
+        for (int k = 0; k < 4; ++k) {
+            iom.schedule([] {
+                for (int i : range(0, 10)) {
+                    usleep(1000);
+                    s_sum += i;
+                }
+            });
+        }
+    }
+    assert(s_sum == 4 * 45);
+    std::cout << "test_generator end" << std::endl;
+    return 0;
+}
+
+//g++ test_generator.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
@@ -95,4 +95,4 @@ int main(int argc, char *argv[]) {
 }
 
 
-//g++ test_hook.cc ../src/iomanager.cc ../src/scheduler.cc ../src/fiber.cc ../src/mutex.cc ../src/thread.cc  ../src/timer.cc ../src/util.cpp ../src/hook.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl
\ No newline at end of file
+//g++ test_hook.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc  ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
\ No newline at end of file
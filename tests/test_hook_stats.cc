@@ -0,0 +1,119 @@
+/**
+ * @file test_hook_stats.cc
+ * @brief hook函数调用统计测试
+ * @details 等待socket可读的recv记一次EAGAIN和一次挂起，挂起时间与对端写入的延迟相当；
+ *          设置了SO_RCVTIMEO的recv超时；被取消的usleep；关闭统计后不再记录
+ * @version 0.1
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cassert>
+#include <iostream>
+#include "../src/fd_manager.h"
+#include "../src/hook_stats.h"
+#include "../src/iomanager.h"
+
+static const sylar::HookStats::FunctionStats &get(const std::vector<sylar::HookStats::FunctionStats> &stats,
+                                                  sylar::HookStats::Function f) {
+    assert(stats.size() == sylar::HookStats::FUNCTION_NUM);
+    assert(stats[f].name == sylar::HookStats::GetName(f));
+    return stats[f];
+}
+
+int main(int argc, char *argv[]) {
+    sylar::HookStats::SetEnabled(true);
+
+    int sv[2], tv[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(rt == 0);
+    rt = socketpair(AF_UNIX, SOCK_STREAM, 0, tv);
+    assert(rt == 0);
+    //socketpair没有被hook，手动为其创建FdCtx，这样recv才会走协程挂起的逻辑
+    sylar::FdMgr::GetInstance()->get(sv[0], true);
+    sylar::FdMgr::GetInstance()->get(tv[0], true);
+
+    {
+        sylar::IOManager iom(1, false, "hook_stats");
+        //对端40ms后才写，挂起一次
+        iom.schedule([sv] {
+            char buf[16];
+            ssize_t n = recv(sv[0], buf, sizeof(buf), 0);
+            assert(n == 5);
+        });
+        iom.schedule([sv] {
+            usleep(40 * 1000);
+            ssize_t n = write(sv[1], "hello", 5);
+            assert(n == 5);
+        });
+        //20ms超时
+        iom.schedule([tv] {
+            struct timeval t = {0, 20 * 1000};
+            int rt = setsockopt(tv[0], SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t));
+            assert(rt == 0);
+            char buf[16];
+            ssize_t n = recv(tv[0], buf, sizeof(buf), 0);
+            assert(n == -1 && errno == ETIMEDOUT);
+        });
+        //睡眠中被取消
+        sylar::Fiber::ptr sleeper(new sylar::Fiber([] {
+            int rt = usleep(1000 * 1000);
+            assert(rt == -1 && errno == ECANCELED);
+        }));
+        iom.schedule(sleeper);
+        iom.schedule([sleeper] {
+            usleep(10 * 1000);
+            sleeper->cancel();
+        });
+        iom.stop();
+    }
+
+    std::vector<sylar::HookStats::FunctionStats> stats;
+    sylar::HookStats::Collect(stats);
+    sylar::HookStats::Dump(std::cout);
+
+    const sylar::HookStats::FunctionStats &recv_stats = get(stats, sylar::HookStats::RECV);
+    assert(recv_stats.calls == 2 && recv_stats.eagain == 2);
+    assert(recv_stats.suspend_ns.count == 2);
+    assert(recv_stats.timeouts == 1 && recv_stats.cancels == 0);
+    assert(recv_stats.eagainRate() == 1);
+    //一次约20ms(超时)，一次约40ms(等对端写)
+    assert(recv_stats.suspend_ns.max >= 35 * 1000 * 1000);
+    assert(recv_stats.suspend_ns.percentile(0.5) >= 15 * 1000 * 1000);
+
+    //调度器tickle用的pipe也会调用write，这里只看没有挂起
+    const sylar::HookStats::FunctionStats &write_stats = get(stats, sylar::HookStats::WRITE);
+    assert(write_stats.calls >= 1 && write_stats.eagain == 0 && write_stats.suspend_ns.count == 0);
+
+    const sylar::HookStats::FunctionStats &usleep_stats = get(stats, sylar::HookStats::USLEEP);
+    assert(usleep_stats.calls == 3 && usleep_stats.suspend_ns.count == 3);
+    assert(usleep_stats.cancels == 1 && usleep_stats.timeouts == 0);
+    assert(usleep_stats.suspend_ns.sum >= 45 * 1000 * 1000);
+
+    assert(get(stats, sylar::HookStats::SETSOCKOPT).calls == 1);
+    assert(get(stats, sylar::HookStats::CONNECT).calls == 0);
+
+    //关闭统计后不再记录
+    sylar::HookStats::SetEnabled(false);
+    sylar::HookStats::Reset();
+    {
+        sylar::IOManager iom(1, false, "hook_stats_off");
+        iom.schedule([] { usleep(1000); });
+        iom.stop();
+    }
+    sylar::HookStats::Collect(stats);
+    for (auto &i : stats) {
+        assert(i.calls == 0 && i.eagain == 0 && i.suspend_ns.count == 0);
+    }
+
+    sylar::FdMgr::GetInstance()->del(sv[0]);
+    sylar::FdMgr::GetInstance()->del(tv[0]);
+    close(sv[0]);
+    close(sv[1]);
+    close(tv[0]);
+    close(tv[1]);
+    std::cout << "test_hook_stats end" << std::endl;
+    return 0;
+}
+
+//g++ test_hook_stats.cc ../src/hook_stats.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_hook_stats -std=c++11 -lpthread -ldl -lrt
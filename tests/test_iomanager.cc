@@ -136,4 +136,4 @@ int main(int argc, char *argv[]) {
     return 0;
 }
 
-//g++ test_iomanager.cc ../src/fiber.cc ../src/scheduler.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/iomanager.cc ../src/timer.cc -o test -std=c++11 -lpthread
\ No newline at end of file
+//g++ test_iomanager.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/iomanager.cc ../src/timer.cc -o test -std=c++11 -lpthread -lrt
\ No newline at end of file
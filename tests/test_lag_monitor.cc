@@ -0,0 +1,103 @@
+/**
+ * @file test_lag_monitor.cc
+ * @brief 事件循环延迟监控测试
+ * @details 唯一的调度线程被一个长任务占住100ms：探测任务和定时器都晚到期，记入直方图并触发回调；
+ *          IO事件就绪后排在长任务后面，就绪到执行的时间记入EVENT_LAG；停止监控后不再探测；Prometheus输出中有三个直方图
+ * @version 0.1
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include "../src/iomanager.h"
+
+static void spin(int ms) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+static std::atomic<int> s_reports[3];
+static std::atomic<uint64_t> s_max_lag[3];
+
+static void on_lag(sylar::IOManager::LagType type, uint64_t lag_ns) {
+    ++s_reports[type];
+    if (lag_ns > s_max_lag[type]) {
+        s_max_lag[type] = lag_ns;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    int sv[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(rt == 0);
+
+    sylar::IOManager iom(1, false, "lag");
+    iom.startLagMonitor(10, 20, on_lag);
+    //探测定时器10ms后到期，线程被占住到100ms
+    iom.schedule([] { spin(100); });
+    usleep(150 * 1000);
+
+    sylar::SchedulerMetrics::Snapshot snap;
+    iom.getMetrics(snap);
+    const sylar::HistogramSnapshot &probe = snap.histograms[sylar::SchedulerMetrics::PROBE_LAG];
+    const sylar::HistogramSnapshot &timer = snap.histograms[sylar::SchedulerMetrics::TIMER_LAG];
+    std::cout << "probe lag: count=" << probe.count << " max=" << probe.max / 1e6 << "ms" << std::endl;
+    std::cout << "timer lag: count=" << timer.count << " max=" << timer.max / 1e6 << "ms" << std::endl;
+    assert(probe.count >= 2 && probe.max >= 60 * 1000 * 1000);
+    assert(timer.count >= 2 && timer.max >= 60 * 1000 * 1000);
+    //线程空闲之后探测任务基本准时
+    assert(probe.percentile(0.5) < 20 * 1000 * 1000);
+    assert(s_reports[sylar::IOManager::LAG_PROBE] >= 1 && s_max_lag[sylar::IOManager::LAG_PROBE] >= 60 * 1000 * 1000);
+    assert(s_reports[sylar::IOManager::LAG_TIMER] >= 1);
+
+    //IO事件在长任务执行中就绪(cancelEvent立即触发)，回调排在长任务后面
+    //addEvent要在调度线程中调用，事件回调交给当前调度器
+    std::atomic<bool> fired{false};
+    iom.schedule([&iom, &fired, sv] {
+        int rt = iom.addEvent(sv[0], sylar::IOManager::READ, [&fired] { fired = true; });
+        assert(rt == 0);
+        iom.cancelEvent(sv[0], sylar::IOManager::READ);
+        spin(50);
+    });
+    while (!fired) {
+        usleep(1000);
+    }
+    snap = sylar::SchedulerMetrics::Snapshot();
+    iom.getMetrics(snap);
+    const sylar::HistogramSnapshot &event = snap.histograms[sylar::SchedulerMetrics::EVENT_LAG];
+    std::cout << "event lag: count=" << event.count << " max=" << event.max / 1e6 << "ms" << std::endl;
+    assert(event.count >= 1 && event.max >= 40 * 1000 * 1000);
+    assert(s_reports[sylar::IOManager::LAG_EVENT] == 1);
+
+    //停止后不再探测
+    iom.stopLagMonitor();
+    usleep(20 * 1000);
+    snap = sylar::SchedulerMetrics::Snapshot();
+    iom.getMetrics(snap);
+    uint64_t probes = snap.histograms[sylar::SchedulerMetrics::PROBE_LAG].count;
+    usleep(50 * 1000);
+    snap = sylar::SchedulerMetrics::Snapshot();
+    iom.getMetrics(snap);
+    assert(snap.histograms[sylar::SchedulerMetrics::PROBE_LAG].count == probes);
+
+    std::stringstream ss;
+    iom.dumpMetrics(ss);
+    assert(ss.str().find("sylar_scheduler_timer_lag_seconds_count{scheduler=\"lag\"}") != std::string::npos);
+    assert(ss.str().find("sylar_scheduler_event_lag_seconds_count{scheduler=\"lag\"}") != std::string::npos);
+    assert(ss.str().find("sylar_scheduler_probe_lag_seconds_count{scheduler=\"lag\"}") != std::string::npos);
+
+    //监控中调用stop()也能正常结束
+    iom.startLagMonitor(10);
+    iom.stop();
+    close(sv[0]);
+    close(sv[1]);
+    std::cout << "test_lag_monitor end" << std::endl;
+    return 0;
+}
+
+//g++ test_lag_monitor.cc ../src/hook_stats.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_lag_monitor -std=c++11 -lpthread -ldl -lrt
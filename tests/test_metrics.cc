@@ -0,0 +1,136 @@
+/**
+ * @file test_metrics.cc
+ * @brief 运行时指标测试
+ * @details 直方图分桶和分位数的误差；IOManager运行中的快照(等待中的IO事件、定时器)；停止后的计数和直方图；
+ *          Prometheus文本输出；关闭指标记录后不再记录
+ * @version 0.1
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include "../src/fd_manager.h"
+#include "../src/iomanager.h"
+#include "../src/metrics.h"
+
+static void test_histogram() {
+    //每个值都落在自己桶的上下界之间，桶号单调
+    size_t last = 0;
+    for (uint64_t v = 0; v < 100000; ++v) {
+        size_t idx = sylar::Histogram::BucketIndex(v);
+        assert(idx >= last && idx < sylar::Histogram::kBuckets);
+        assert(sylar::Histogram::BucketLowerBound(idx) <= v && v <= sylar::Histogram::BucketUpperBound(idx));
+        last = idx;
+    }
+    uint64_t big = ~0ull;
+    assert(sylar::Histogram::BucketIndex(big) == sylar::Histogram::kBuckets - 1);
+    assert(sylar::Histogram::BucketUpperBound(sylar::Histogram::kBuckets - 1) == big);
+
+    //分位数的相对误差不超过1/16
+    sylar::Histogram h;
+    for (uint64_t v = 1; v <= 100000; ++v) {
+        h.record(v);
+    }
+    sylar::HistogramSnapshot snap;
+    h.mergeTo(snap);
+    assert(snap.count == 100000 && snap.max == 100000);
+    assert(snap.sum == 100000ull * 100001 / 2);
+    uint64_t p50 = snap.percentile(0.5), p99 = snap.percentile(0.99);
+    assert(p50 >= 50000 && p50 <= 50000 + 50000 / 16);
+    assert(p99 >= 99000 && p99 <= 100000);
+    assert(snap.percentile(1) == 100000);
+    std::cout << "histogram p50=" << p50 << " p99=" << p99 << std::endl;
+}
+
+static void test_iomanager() {
+    int sv[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(rt == 0);
+    //socketpair没有被hook，手动为其创建FdCtx，这样recv才会走协程挂起的逻辑
+    sylar::FdMgr::GetInstance()->get(sv[0], true);
+
+    sylar::IOManager iom(2, false, "metrics");
+    iom.schedule([sv] {
+        char buf[16];
+        ssize_t n = recv(sv[0], buf, sizeof(buf), 0);
+        assert(n == 5);
+    });
+    sylar::Timer::ptr timer = iom.addTimer(100000, [] {});
+    for (int i = 0; i < 1000; ++i) {
+        iom.schedule([] {});
+    }
+    usleep(100 * 1000);
+
+    //运行中的快照：recv挂起在读事件上，还有一个远期定时器
+    sylar::SchedulerMetrics::Snapshot snap;
+    iom.getMetrics(snap);
+    assert(snap.name == "metrics");
+    assert(snap.pending_events == 1);
+    assert(snap.timers == 1);
+    assert(snap.queue_depth == 0);
+    assert(snap.counters[sylar::SchedulerMetrics::TASKS] >= 1001);
+
+    rt = write(sv[1], "hello", 5);
+    assert(rt == 5);
+    timer->cancel();
+    iom.stop();
+
+    snap = sylar::SchedulerMetrics::Snapshot();
+    iom.getMetrics(snap);
+    //recv的协程被resume了两次
+    assert(snap.counters[sylar::SchedulerMetrics::TASKS] >= 1002);
+    assert(snap.histograms[sylar::SchedulerMetrics::QUEUE_WAIT].count >= 1002);
+    assert(snap.histograms[sylar::SchedulerMetrics::RESUME].count == snap.counters[sylar::SchedulerMetrics::TASKS]);
+    assert(snap.counters[sylar::SchedulerMetrics::EPOLL_WAKEUPS] > 0);
+    assert(snap.histograms[sylar::SchedulerMetrics::EPOLL_EVENTS].count ==
+           snap.counters[sylar::SchedulerMetrics::EPOLL_WAKEUPS]);
+    assert(snap.histograms[sylar::SchedulerMetrics::IDLE].count > 0);
+    assert(snap.counters[sylar::SchedulerMetrics::TICKLES_SENT] > 0);
+    assert(snap.counters[sylar::SchedulerMetrics::TICKLES_RECEIVED] <= snap.counters[sylar::SchedulerMetrics::TICKLES_SENT]);
+    assert(snap.pending_events == 0 && snap.timers == 0);
+
+    std::stringstream ss;
+    sylar::SchedulerMetrics::WritePrometheus(ss, snap);
+    std::string text = ss.str();
+    std::cout << text;
+    assert(text.find("# TYPE sylar_scheduler_tasks_total counter\n") != std::string::npos);
+    assert(text.find("sylar_scheduler_tasks_total{scheduler=\"metrics\"} " +
+                     std::to_string(snap.counters[sylar::SchedulerMetrics::TASKS]) + "\n") != std::string::npos);
+    assert(text.find("sylar_scheduler_queue_wait_seconds{scheduler=\"metrics\",quantile=\"0.99\"} ") != std::string::npos);
+    assert(text.find("sylar_scheduler_epoll_events_count{scheduler=\"metrics\"} ") != std::string::npos);
+    assert(text.find("sylar_scheduler_pending_events{scheduler=\"metrics\"} 0\n") != std::string::npos);
+
+    sylar::FdMgr::GetInstance()->del(sv[0]);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+static void test_disabled() {
+    sylar::Metrics::SetEnabled(false);
+    sylar::Scheduler sc(1, false, "disabled");
+    sc.start();
+    for (int i = 0; i < 100; ++i) {
+        sc.schedule([] {});
+    }
+    sc.stop();
+    sylar::SchedulerMetrics::Snapshot snap;
+    sc.getMetrics(snap);
+    assert(snap.counters[sylar::SchedulerMetrics::TASKS] == 0);
+    assert(snap.histograms[sylar::SchedulerMetrics::QUEUE_WAIT].count == 0);
+    sylar::Metrics::SetEnabled(true);
+}
+
+int main(int argc, char *argv[]) {
+    //指标记录默认关闭
+    assert(!sylar::Metrics::IsEnabled());
+    sylar::Metrics::SetEnabled(true);
+    test_histogram();
+    test_iomanager();
+    test_disabled();
+    std::cout << "test_metrics end" << std::endl;
+    return 0;
+}
+
+//g++ test_metrics.cc ../src/metrics.cc ../src/trace.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_metrics -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,109 @@
+/**
+ * @file test_profiler.cc
+ * @brief 采样profiler测试
+ * @details 调度器中tag为hot的协程忙等的时间是cold的十倍，样本数也应该多得多；只输出某个tag时只有该tag的行；
+ *          folded格式每行以样本数结尾；停止后不再采样；Reset清空。
+ *          用法：./test_profiler [out.folded]，给出文件名时把结果写到文件，可以用flamegraph.pl画图。
+ *          用-fno-omit-frame-pointer -rdynamic编译可以看到完整的调用栈和函数名
+ * @version 0.1
+ */
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../src/profiler.h"
+#include "../src/scheduler.h"
+
+__attribute__((noinline)) static void burn(int ms) {
+    auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+/**
+ * @brief 统计某个tag的样本数
+ */
+static uint64_t count(const std::string &folded, const std::string &tag) {
+    std::stringstream ss(folded);
+    std::string line;
+    uint64_t n = 0;
+    while (std::getline(ss, line)) {
+        if (line.compare(0, tag.size() + 1, tag + ";") == 0) {
+            n += std::stoull(line.substr(line.rfind(' ') + 1));
+        }
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    assert(!sylar::Profiler::IsRunning());
+    assert(sylar::Profiler::Start(250, true));
+    assert(!sylar::Profiler::Start(250));
+    {
+        sylar::Scheduler sc(1, false, "profiler");
+        sc.start();
+        for (int i = 0; i < 10; ++i) {
+            sc.schedule(sylar::Fiber::ptr(new sylar::Fiber([] { burn(50); }, 0, true, "hot")));
+            sc.schedule(sylar::Fiber::ptr(new sylar::Fiber([] { burn(5); }, 0, true, "cold")));
+        }
+        sc.stop();
+    }
+    sylar::Profiler::Stop();
+    assert(!sylar::Profiler::IsRunning());
+
+    std::stringstream ss;
+    sylar::Profiler::WriteFolded(ss);
+    std::string folded = ss.str();
+    std::cout << folded;
+    if (argc > 1) {
+        assert(sylar::Profiler::DumpToFile(argv[1]));
+    }
+    uint64_t samples = sylar::Profiler::GetSampleCount();
+    uint64_t hot = count(folded, "hot"), cold = count(folded, "cold");
+    std::cout << "samples=" << samples << " hot=" << hot << " cold=" << cold
+              << " dropped=" << sylar::Profiler::GetDroppedCount() << std::endl;
+    assert(hot >= 20);
+    assert(hot > cold * 3);
+    assert(samples >= hot + cold);
+
+    //只输出hot
+    ss.str("");
+    sylar::Profiler::WriteFolded(ss, "hot", true);
+    std::string only = ss.str();
+    assert(count(only, "hot") == hot && count(only, "cold") == 0);
+    assert(only.find("hot;fiber_") == 0);
+
+    //停止之后不再采样
+    burn(50);
+    assert(sylar::Profiler::GetSampleCount() == samples);
+
+    sylar::Profiler::Reset();
+    assert(sylar::Profiler::GetSampleCount() == 0);
+    ss.str("");
+    sylar::Profiler::WriteFolded(ss);
+    assert(ss.str().empty());
+
+    //默认不按协程汇总，即使输出时要求按协程分层也没有协程id
+    assert(sylar::Profiler::Start(250));
+    {
+        sylar::Scheduler sc(1, false, "profiler");
+        sc.start();
+        for (int i = 0; i < 10; ++i) {
+            sc.schedule(sylar::Fiber::ptr(new sylar::Fiber([] { burn(20); }, 0, true, "hot")));
+        }
+        sc.stop();
+    }
+    sylar::Profiler::Stop();
+    ss.str("");
+    sylar::Profiler::WriteFolded(ss, "hot", true);
+    only = ss.str();
+    assert(count(only, "hot") > 0 && only.find("fiber_") == std::string::npos);
+    sylar::Profiler::Reset();
+
+    std::cout << "test_profiler end" << std::endl;
+    return 0;
+}
+
+//g++ test_profiler.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_profiler -std=c++11 -fno-omit-frame-pointer -rdynamic -lpthread -ldl -lrt
@@ -125,4 +125,4 @@ int main() {
     return 0;
 }
 
-//g++ test_scheduler.cc ../src/fiber.cc ../src/scheduler.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/iomanager.cc ../src/timer.cc -o test -std=c++11 -lpthread
\ No newline at end of file
+//g++ test_scheduler.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/stack_allocator.cc ../src/mutex.cc ../src/iomanager.cc ../src/timer.cc -o test -std=c++11 -lpthread -lrt
\ No newline at end of file
@@ -0,0 +1,160 @@
+/**
+ * @file test_stack_overflow.cc
+ * @brief 协程栈保护页、大页arena与栈溢出报告测试
+ * @details 在子进程中制造栈溢出，父进程检查子进程被SIGABRT终止，并且stderr中有溢出协程的报告
+ * @version 0.1
+ */
+
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include "../src/fiber.h"
+#include "../src/scheduler.h"
+#include "../src/stack_allocator.h"
+
+int __attribute__((noinline)) recurse(int n) {
+    volatile char buf[1024];
+    buf[0] = (char)n;
+    if (n > 1000000) {
+        return buf[0];
+    }
+    return recurse(n + 1) + buf[0];
+}
+
+/**
+ * @brief 在子进程中执行fn，返回子进程的stderr输出和终止信号
+ */
+template <class F>
+std::string run_child(F fn, int &sig) {
+    int fds[2];
+    assert(pipe(fds) == 0);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        dup2(fds[1], STDERR_FILENO);
+        close(fds[0]);
+        fn();
+        _exit(0);
+    }
+    close(fds[1]);
+    std::string out;
+    char buf[4096];
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) {
+        out.append(buf, n);
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    sig = WIFSIGNALED(status) ? WTERMSIG(status) : 0;
+    return out;
+}
+
+int main(int argc, char *argv[]) {
+    int sig = 0;
+
+    //线程主协程中运行的协程溢出
+    std::string out = run_child([] {
+        sylar::StackAllocator::SetMode(sylar::StackAllocator::MMAP_GUARD);
+        sylar::StackAllocator::InstallOverflowHandler();
+        sylar::Fiber::GetThis();
+        sylar::Fiber::ptr fiber(new sylar::Fiber([] { recurse(0); }, 32 * 1024, false, "recurse"));
+        fiber->resume();
+    }, sig);
+    std::cout << out;
+    assert(sig == SIGABRT);
+    assert(out.find("fiber stack overflow") != std::string::npos);
+    assert(out.find("tag=recurse stacksize=32768") != std::string::npos);
+    assert(out.find("recurse") != std::string::npos);
+
+    //调度器工作线程中的协程溢出，工作线程有自己的sigaltstack
+    out = run_child([] {
+        sylar::StackAllocator::SetMode(sylar::StackAllocator::MMAP_GUARD);
+        sylar::StackAllocator::InstallOverflowHandler();
+        sylar::Scheduler sc(1, false);
+        sc.start();
+        sc.schedule([] { recurse(0); });
+        sc.stop();
+    }, sig);
+    std::cout << out;
+    assert(sig == SIGABRT);
+    assert(out.find("fiber stack overflow") != std::string::npos);
+    assert(out.find("tag=scheduler.task") != std::string::npos);
+
+    //不是栈溢出的段错误交还给默认处理
+    out = run_child([] {
+        sylar::StackAllocator::SetMode(sylar::StackAllocator::MMAP_GUARD);
+        sylar::StackAllocator::InstallOverflowHandler();
+        sylar::Fiber::GetThis();
+        sylar::Fiber::ptr fiber(new sylar::Fiber([] {
+            volatile int *p = nullptr;
+            *p = 1;
+        }, 0, false));
+        fiber->resume();
+    }, sig);
+    assert(sig == SIGSEGV);
+    assert(out.find("fiber stack overflow") == std::string::npos);
+
+    //大页arena中没有保护页，溢出改写了栈底的哨兵值，释放栈时发现
+    out = run_child([] {
+        sylar::StackAllocator::SetMode(sylar::StackAllocator::HUGE_ARENA);
+        sylar::Fiber::GetThis();
+        sylar::Fiber::ptr fiber(new sylar::Fiber([] {
+            volatile char *stack = (char *)sylar::Fiber::GetCurrent()->getStack();
+            stack[-8] = 1;
+        }, 32 * 1024, false));
+        fiber->resume();
+    }, sig);
+    std::cout << out;
+    assert(sig == SIGABRT);
+    assert(out.find("canary below stack") != std::string::npos);
+
+    //协程重置复用栈时也检查哨兵值，不用等到释放
+    out = run_child([] {
+        sylar::StackAllocator::SetMode(sylar::StackAllocator::HUGE_ARENA);
+        sylar::Fiber::GetThis();
+        sylar::Fiber::ptr fiber(new sylar::Fiber([] {
+            volatile char *stack = (char *)sylar::Fiber::GetCurrent()->getStack();
+            stack[-8] = 1;
+        }, 32 * 1024, false));
+        fiber->resume();
+        fiber->reset([] {});
+        std::cerr << "reset passed" << std::endl;
+    }, sig);
+    std::cout << out;
+    assert(sig == SIGABRT);
+    assert(out.find("canary below stack") != std::string::npos && out.find("reset passed") == std::string::npos);
+
+    //arena的栈槽释放后按大小复用
+    sylar::StackAllocator::SetMode(sylar::StackAllocator::HUGE_ARENA);
+    sylar::Fiber::GetThis();
+    void *stack = nullptr;
+    for (int i = 0; i < 1000; ++i) {
+        sylar::Fiber::ptr fiber(new sylar::Fiber([] {}, 64 * 1024, false));
+        assert(!fiber->isStackGuarded());
+        assert(!stack || fiber->getStack() == stack);
+        stack = fiber->getStack();
+        fiber->resume();
+    }
+    assert(sylar::StackAllocator::GetArenaBacking() != sylar::StackAllocator::ARENA_NONE);
+    std::cout << "arena backing: "
+              << sylar::StackAllocator::ArenaBackingName(sylar::StackAllocator::GetArenaBacking()) << std::endl;
+
+    //没有溢出的协程正常运行，保护页随协程栈释放
+    sylar::StackAllocator::SetMode(sylar::StackAllocator::MMAP_GUARD);
+    sylar::Fiber::GetThis();
+    for (int i = 0; i < 1000; ++i) {
+        sylar::Fiber::ptr fiber(new sylar::Fiber([] {}, 0, false));
+        assert(fiber->isStackGuarded());
+        fiber->resume();
+    }
+
+    std::cout << "test_stack_overflow end" << std::endl;
+    return 0;
+}
+
+//g++ test_stack_overflow.cc ../src/stack_allocator.cc ../src/stack_stats.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/mutex.cc ../src/thread.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test -std=c++11 -rdynamic -lpthread -ldl -lrt
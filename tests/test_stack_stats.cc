@@ -0,0 +1,82 @@
+/**
+ * @file test_stack_stats.cc
+ * @brief 协程栈涂色、最高水位统计与自适应栈大小测试
+ * @version 0.1
+ */
+
+#include <string.h>
+#include <cassert>
+#include <iostream>
+#include "../src/fiber.h"
+#include "../src/stack_stats.h"
+
+/**
+ * @brief 在栈上用掉大约n字节
+ */
+template <size_t N>
+void __attribute__((noinline)) use_stack() {
+    volatile char buf[N];
+    memset((char *)buf, 1, N);
+    (void)buf[0];
+}
+
+template <size_t N>
+void run_fibers(const char *tag, int count) {
+    for (int i = 0; i < count; ++i) {
+        sylar::Fiber::ptr fiber(new sylar::Fiber(&use_stack<N>, 0, false, tag));
+        fiber->resume();
+        assert(fiber->getState() == sylar::Fiber::TERM);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    sylar::Fiber::GetThis();
+    sylar::StackStats::SetPainting(true);
+
+    run_fibers<2 * 1024>("small", 100);
+    run_fibers<40 * 1024>("big", 100);
+    sylar::StackStats::Dump(std::cout);
+
+    size_t small = sylar::StackStats::Percentile("small", 0.99);
+    size_t big   = sylar::StackStats::Percentile("big", 0.99);
+    assert(sylar::StackStats::Samples("small") == 100 && sylar::StackStats::Samples("big") == 100);
+    assert(small >= 2 * 1024 && small < 8 * 1024);
+    assert(big >= 40 * 1024 && big < 48 * 1024);
+
+    //复用同一个协程，每次重置都记录一次，并且只重新涂用过的部分
+    sylar::Fiber::ptr fiber(new sylar::Fiber(&use_stack<40 * 1024>, 0, false, "reuse"));
+    fiber->resume();
+    fiber->reset(&use_stack<2 * 1024>);
+    fiber->resume();
+    fiber->reset(&use_stack<2 * 1024>);
+    assert(sylar::StackStats::Samples("reuse") == 2);
+    assert(sylar::StackStats::Percentile("reuse", 0.5) < 8 * 1024);
+
+    //没有打开自适应时使用默认栈大小
+    sylar::Fiber small_fiber(&use_stack<2 * 1024>, 0, false, "small");
+    assert(small_fiber.getStackSize() == 128 * 1024);
+
+    //打开自适应，按p99加16k余量决定栈大小
+    sylar::StackStats::SetAdaptive(true, 0.99, 16 * 1024, 100);
+    sylar::Fiber::ptr a(new sylar::Fiber(&use_stack<2 * 1024>, 0, false, "small"));
+    sylar::Fiber::ptr b(new sylar::Fiber(&use_stack<40 * 1024>, 0, false, "big"));
+    sylar::Fiber::ptr c(new sylar::Fiber(&use_stack<2 * 1024>, 0, false, "reuse"));
+    sylar::Fiber::ptr d(new sylar::Fiber(&use_stack<2 * 1024>, 64 * 1024, false, "small"));
+    std::cout << "small=" << a->getStackSize() << " big=" << b->getStackSize()
+              << " reuse=" << c->getStackSize() << std::endl;
+    assert(a->getStackSize() >= small + 16 * 1024 && a->getStackSize() < 32 * 1024);
+    assert(b->getStackSize() >= big + 16 * 1024 && b->getStackSize() < 72 * 1024);
+    //样本数不够
+    assert(c->getStackSize() == 128 * 1024);
+    //指定了栈大小
+    assert(d->getStackSize() == 64 * 1024);
+    a->resume();
+    b->resume();
+    c->resume();
+    d->resume();
+
+    std::cout << "test_stack_stats end" << std::endl;
+    return 0;
+}
+
+//g++ test_stack_stats.cc ../src/stack_stats.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test -std=c++11 -lpthread -ldl -lrt
@@ -0,0 +1,120 @@
+/**
+ * @file test_task.cc
+ * @brief C++20无栈协程Task测试，需要-std=c++20
+ * @version 0.1
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cassert>
+#include <stdexcept>
+#include "../src/hook.h"
+#include "../src/iomanager.h"
+#include "../src/task.h"
+#include "../src/util.h"
+
+static std::atomic<int> s_done{0};
+
+sylar::Task<int> add(int a, int b) {
+    co_await sylar::sleep_for(10);
+    co_return a + b;
+}
+
+sylar::Task<void> fail() {
+    co_await sylar::sleep_for(1);
+    throw std::runtime_error("fail");
+}
+
+/**
+ * @brief Task之间co_await，取返回值、传递异常
+ */
+sylar::Task<void> test_compose() {
+    int v = co_await add(1, 2);
+    v += co_await add(v, 4);
+    assert(v == 10);
+
+    bool caught = false;
+    try {
+        co_await fail();
+    } catch (std::runtime_error &e) {
+        caught = true;
+    }
+    assert(caught);
+    std::cout << "compose ok" << std::endl;
+    ++s_done;
+}
+
+/**
+ * @brief 多个Task同时sleep，不占用调度线程
+ */
+sylar::Task<void> test_sleep() {
+    static std::atomic<int> s_sleepers{0};
+    uint64_t begin = sylar::GetElapsedMS();
+    for (int i = 0; i < 100; ++i) {
+        sylar::co_spawn([]() -> sylar::Task<void> {
+            co_await sylar::sleep_for(50);
+            ++s_sleepers;
+        }());
+    }
+    while (s_sleepers != 100) {
+        co_await sylar::sleep_for(5);
+    }
+    uint64_t cost = sylar::GetElapsedMS() - begin;
+    std::cout << "sleep ok cost=" << cost << "ms" << std::endl;
+    assert(cost < 500);
+    ++s_done;
+}
+
+/**
+ * @brief 等待fd可读，写端由一个Fiber延迟写入，Task和Fiber在同一个调度器上运行
+ */
+sylar::Task<void> test_readable() {
+    int fds[2];
+    assert(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    sylar::IOManager::GetThis()->schedule([fds] {
+        usleep(20 * 1000);
+        write(fds[1], "ping", 4);
+    });
+    uint64_t begin = sylar::GetElapsedMS();
+    bool ok        = co_await sylar::readable(fds[0]);
+    char buf[8]    = {0};
+    assert(ok && read(fds[0], buf, sizeof(buf)) == 4);
+    assert(std::string(buf) == "ping" && sylar::GetElapsedMS() - begin >= 15);
+
+    ok = co_await sylar::writable(fds[0]);
+    assert(ok);
+    close(fds[0]);
+    close(fds[1]);
+    std::cout << "readable ok" << std::endl;
+    ++s_done;
+}
+
+/**
+ * @brief 在两个调度器之间切换
+ */
+sylar::Task<void> test_hop(sylar::Scheduler *other) {
+    sylar::Scheduler *origin = sylar::Scheduler::GetThis();
+    co_await sylar::schedule_on(other);
+    assert(sylar::Scheduler::GetThis() == other);
+    co_await sylar::schedule_on(origin);
+    assert(sylar::Scheduler::GetThis() == origin);
+    std::cout << "hop ok" << std::endl;
+    ++s_done;
+}
+
+int main(int argc, char *argv[]) {
+    {
+        sylar::IOManager other(1, false, "other");
+        sylar::IOManager iom(2);
+        sylar::co_spawn(test_compose());
+        sylar::co_spawn(test_sleep());
+        sylar::co_spawn(test_readable());
+        sylar::co_spawn(test_hop(&other));
+    }
+    assert(s_done == 4);
+    std::cout << "test_task end" << std::endl;
+    return 0;
+}
+
+//g++ test_task.cc ../src/iomanager.cc ../src/scheduler.cc ../src/metrics.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/trace.cc ../src/stack_stats.cc ../src/fiber_context.cc ../src/mutex.cc ../src/thread.cc ../src/stack_allocator.cc ../src/timer.cc ../src/util.cpp ../src/hook_stats.cc ../src/hook.cc ../src/fd_manager.cc -o test -std=c++20 -lpthread -ldl -lrt
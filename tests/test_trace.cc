@@ -0,0 +1,121 @@
+/**
+ * @file test_trace.cc
+ * @brief 事件追踪测试
+ * @details 关闭时不记录；打开后一个协程挂起在recv上、另一个协程sleep之后写数据，导出的JSON中有协程运行区间、
+ *          recv和sleep的异步区间、epoll_wait和定时器事件；Clear之后不再导出旧事件；缓冲区写满后只保留最近的事件；
+ *          已退出线程的缓冲区导出之后释放。
+ *          用法：./test_trace [trace.json]，给出文件名时把追踪结果写到文件，可以拖进ui.perfetto.dev查看
+ * @version 0.1
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cassert>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "../src/fd_manager.h"
+#include "../src/iomanager.h"
+#include "../src/thread.h"
+#include "../src/trace.h"
+
+static size_t count(const std::string &s, const std::string &sub) {
+    size_t n = 0;
+    for (size_t pos = s.find(sub); pos != std::string::npos; pos = s.find(sub, pos + sub.size())) {
+        ++n;
+    }
+    return n;
+}
+
+static std::string dump() {
+    std::stringstream ss;
+    sylar::Trace::Dump(ss);
+    return ss.str();
+}
+
+static void run_io() {
+    int sv[2];
+    int rt = socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    assert(rt == 0);
+    //socketpair没有被hook，手动为其创建FdCtx，这样recv才会走协程挂起的逻辑
+    sylar::FdMgr::GetInstance()->get(sv[0], true);
+
+    sylar::IOManager iom(1, false, "trace");
+    iom.schedule([sv] {
+        char buf[16];
+        ssize_t n = recv(sv[0], buf, sizeof(buf), 0);
+        assert(n == 5);
+    });
+    iom.schedule([sv] {
+        usleep(10 * 1000);
+        ssize_t n = write(sv[1], "hello", 5);
+        assert(n == 5);
+    });
+    iom.stop();
+    sylar::FdMgr::GetInstance()->del(sv[0]);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+int main(int argc, char *argv[]) {
+    //关闭时不记录事件
+    assert(!sylar::Trace::IsEnabled());
+    run_io();
+    std::string out = dump();
+    assert(count(out, "fiber.create") == 0);
+
+    sylar::Trace::SetEnabled(true);
+    run_io();
+    sylar::Trace::SetEnabled(false);
+    out = dump();
+    if (argc > 1) {
+        assert(sylar::Trace::DumpToFile(argv[1]));
+    }
+
+    assert(out.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 0);
+    assert(out.find("\"name\":\"trace_0\"") != std::string::npos);
+    assert(count(out, "\"name\":\"fiber.create\"") >= 2);
+    assert(count(out, "\"name\":\"fiber.term\"") >= 2);
+    assert(count(out, "\"name\":\"scheduler.task\",\"cat\":\"fiber\",\"ph\":\"X\"") >= 3);
+    assert(count(out, "\"name\":\"scheduler.idle\",\"cat\":\"fiber\",\"ph\":\"X\"") >= 1);
+    assert(count(out, "\"name\":\"recv\",\"cat\":\"syscall\",\"ph\":\"b\"") == 1);
+    assert(count(out, "\"name\":\"recv\",\"cat\":\"syscall\",\"ph\":\"e\"") == 1);
+    assert(count(out, "\"name\":\"sleep\",\"cat\":\"syscall\",\"ph\":\"b\"") == 1);
+    assert(count(out, "\"name\":\"sleep\",\"cat\":\"syscall\",\"ph\":\"e\"") == 1);
+    assert(count(out, "\"name\":\"epoll_wait\"") >= 1);
+    assert(count(out, "\"name\":\"timer.fire\"") >= 1);
+    assert(count(out, "{") == count(out, "}"));
+
+    //Clear之后不再导出旧事件，IOManager的线程已经退出，缓冲区被释放，连线程的元数据也没有了
+    sylar::Trace::Clear();
+    out = dump();
+    assert(count(out, "\"ph\":\"X\"") == 0);
+    assert(count(out, "\"name\":\"fiber.create\"") == 0);
+    assert(count(out, "\"ph\":\"M\"") == 0);
+
+    //缓冲区写满后覆盖最早的事件
+    sylar::Trace::SetBufferSize(16);
+    sylar::Trace::SetEnabled(true);
+    sylar::Thread::ptr thr(new sylar::Thread([] {
+        for (int i = 0; i < 100; ++i) {
+            sylar::Trace::Record(sylar::Trace::FIBER_TERM, nullptr, 1000 + i);
+        }
+    }, "ring"));
+    thr->join();
+    sylar::Trace::SetEnabled(false);
+    out = dump();
+    assert(count(out, "\"name\":\"fiber.term\"") == 16);
+    assert(out.find("\"fiber\":1083}") == std::string::npos);
+    assert(out.find("\"fiber\":1084}") != std::string::npos);
+    assert(out.find("\"fiber\":1099}") != std::string::npos);
+
+    //已退出线程的缓冲区导出一次之后释放
+    assert(count(out, "\"name\":\"ring\"") == 1);
+    out = dump();
+    assert(count(out, "\"name\":\"ring\"") == 0);
+
+    std::cout << "test_trace end" << std::endl;
+    return 0;
+}
+
+//g++ test_trace.cc ../src/trace.cc ../src/profiler.cc ../src/fiber_registry.cc ../src/fiber_stats.cc ../src/fiber.cc ../src/stack_stats.cc ../src/stack_allocator.cc ../src/fiber_context.cc ../src/scheduler.cc ../src/metrics.cc ../src/util.cpp ../src/thread.cc ../src/mutex.cc ../src/hook_stats.cc ../src/hook.cc ../src/iomanager.cc ../src/timer.cc ../src/fd_manager.cc -o test_trace -std=c++11 -lpthread -ldl -lrt